@@ -38,12 +38,25 @@
 #include "buffering.h"
 #include "linked_list.h"
 
+/* Hosted builds map audio files into memory instead of copying them to the
+   buffer; only the handle itself takes buffer space */
+#if defined(APPLICATION) && !defined(WIN32)
+#define BUFFERING_MMAP
+#include <sys/mman.h>
+#endif
+
 /* Define LOGF_ENABLE to enable logf output in this file */
 /* #define LOGF_ENABLE */
 #include "logf.h"
 
 #define BUF_MAX_HANDLES 384
 
+#ifdef BUFFERING_MMAP
+/* Limit the address space taken by mapped files (some hosts are 32-bit);
+   files over the limit are buffered normally */
+#define BUFFERING_MMAP_MAX (512*1024*1024)
+#endif
+
 /* macros to enable logf for queues
    logging on SYS_TIMEOUT can be disabled */
 #ifdef SIMULATOR
@@ -67,14 +80,30 @@
 
 #define GUARD_BUFSIZE   (32*1024)
 
-/* amount of data to read in one read() call */
+/* amount of data to read in one read() call, until the storage
+   throughput has been measured */
 #define BUFFERING_DEFAULT_FILECHUNK      (1024*32)
 
+/* The read size adapts to the throughput so that one read() call takes about
+   BUFFERING_FILECHUNK_TICKS: large reads on fast storage, but still checking
+   the queue often enough on slow storage */
+#define BUFFERING_MIN_FILECHUNK          (1024*8)
+#define BUFFERING_MAX_FILECHUNK          (1024*128)
+#define BUFFERING_FILECHUNK_TICKS        (HZ/20)
+
+/* Time spent reading between two throughput updates; reads taking longer
+   than BUFFERING_RATE_MAX_TICKS likely waited for the storage to wake up
+   and are ignored */
+#define BUFFERING_RATE_WINDOW            (HZ/5)
+#define BUFFERING_RATE_MAX_TICKS         (HZ/2)
+
 enum handle_flags
 {
     H_CANWRAP   = 0x1,   /* Handle data may wrap in buffer */
     H_ALLOCALL  = 0x2,   /* All data must be allocated up front */
     H_FIXEDDATA = 0x4,   /* Data is fixed in position */
+    H_FILLWAIT  = 0x8,   /* Waiting for data since fill_tick */
+    H_MAPPED    = 0x10,  /* Whole file is mapped at map, no data in buffer */
 };
 
 struct memory_handle {
@@ -94,9 +123,19 @@ struct memory_handle {
     off_t   start;          /* Offset at which we started reading the file */
     off_t   pos;            /* Read position in file */
     off_t volatile end;     /* Offset at which we stopped reading the file */
+    long    fill_tick;      /* When the data was requested (H_FILLWAIT) */
+#ifdef BUFFERING_MMAP
+    char   *map;            /* File mapping (H_MAPPED) */
+#endif
     char    path[];         /* Path if data originated in a file */
 };
 
+#ifdef BUFFERING_MMAP
+#define HANDLE_MAPPED(h) ((h)->flags & H_MAPPED)
+#else
+#define HANDLE_MAPPED(h) false
+#endif
+
 /* Minimum allowed handle movement */
 #define MIN_MOVE_DELTA      sizeof(struct memory_handle)
 
@@ -119,6 +158,9 @@ static struct lld_head handle_list; /* buffer-order handle list */
 static struct lld_head mru_cache;   /* MRU-ordered list of handles */
 static int num_handles;             /* number of handles in the lists */
 static int base_handle_id;
+#ifdef BUFFERING_MMAP
+static size_t mapped_size;          /* total size of the mapped files */
+#endif
 
 /* Main lock for adding / removing handles */
 static struct mutex llist_mutex SHAREDBSS_ATTR;
@@ -149,6 +191,16 @@ static struct data_counters
     size_t useful;      /* Amount of data still useful to the user */
 } data_counters;
 
+static struct fill_stats
+{
+    size_t filechunk;   /* Amount of data to read in one read() call */
+    size_t rate;        /* Measured read throughput in bytes per tick */
+    size_t win_bytes;   /* Bytes read in the current measuring window */
+    long   win_ticks;   /* Ticks spent reading in the current window */
+    long   latency[FILL_CLASS_COUNT];     /* Last wait for data by class */
+    long   latency_max[FILL_CLASS_COUNT]; /* Longest wait for data by class */
+} fill_stats = { .filechunk = BUFFERING_DEFAULT_FILECHUNK };
+
 
 /* Messages available to communicate with the buffering thread */
 enum
@@ -360,7 +412,8 @@ add_handle(unsigned int flags, size_t data_size, const char *path,
         struct memory_handle *last = HLIST_LAST;
         ridx = ringbuf_offset(first);
         widx = last->data;
-        cur_total = last->filesize - last->start;
+        if (!HANDLE_MAPPED(last))
+            cur_total = last->filesize - last->start;
     }
 
     if (cur_total > 0) {
@@ -600,8 +653,11 @@ static int update_data_counters(struct data_counters *dc)
         off_t pos = m->pos;
         off_t end = m->end;
 
-        buffered  += end - m->start;
-        remaining += m->filesize - end;
+        /* mapped files take no buffer space but are entirely available */
+        if (!HANDLE_MAPPED(m)) {
+            buffered  += end - m->start;
+            remaining += m->filesize - end;
+        }
 
         if (m->id == base_handle_id)
             is_useful = true;
@@ -619,6 +675,74 @@ static int update_data_counters(struct data_counters *dc)
     return num;
 }
 
+/* Fill priority of a handle: the handle being read comes first, then what
+   is needed to start the next tracks, then their images and finally the rest
+   of the audio */
+static enum fill_class fill_class(const struct memory_handle *h)
+{
+    if (h->id == base_handle_id)
+        return FILL_CLASS_CURRENT;
+
+    switch (h->type)
+    {
+        case TYPE_ID3:
+        case TYPE_CODEC:
+            return FILL_CLASS_META;
+        case TYPE_BITMAP:
+        case TYPE_CUESHEET:
+            return FILL_CLASS_IMAGE;
+        default:
+            return FILL_CLASS_OTHER;
+    }
+}
+
+/* Start timing the wait for data of a handle */
+static inline void fill_request(struct memory_handle *h)
+{
+    h->flags |= H_FILLWAIT;
+    h->fill_tick = current_tick;
+}
+
+/* The first data of a handle arrived since it was requested */
+static void fill_started(struct memory_handle *h)
+{
+    if (!(h->flags & H_FILLWAIT))
+        return;
+
+    enum fill_class fc = fill_class(h);
+    long ticks = current_tick - h->fill_tick;
+
+    h->flags &= ~H_FILLWAIT;
+    fill_stats.latency[fc] = ticks;
+    if (ticks > fill_stats.latency_max[fc])
+        fill_stats.latency_max[fc] = ticks;
+}
+
+/* Account for a read() call and adapt the read size to the throughput */
+static void update_filechunk(size_t bytes, long ticks)
+{
+    if (ticks > BUFFERING_RATE_MAX_TICKS)
+        return;
+
+    fill_stats.win_bytes += bytes;
+    fill_stats.win_ticks += ticks;
+
+    if (fill_stats.win_ticks < BUFFERING_RATE_WINDOW)
+        return;
+
+    size_t rate = fill_stats.win_bytes / fill_stats.win_ticks;
+    fill_stats.rate = fill_stats.rate ? (3*fill_stats.rate + rate) / 4 : rate;
+    fill_stats.win_bytes = 0;
+    fill_stats.win_ticks = 0;
+
+    size_t chunk = fill_stats.rate * BUFFERING_FILECHUNK_TICKS;
+    chunk = MIN(chunk, BUFFERING_MAX_FILECHUNK);
+    chunk = MAX(chunk, BUFFERING_MIN_FILECHUNK);
+
+    /* Keep reads in whole sectors */
+    fill_stats.filechunk = chunk & ~(BUFFERING_MIN_FILECHUNK - 1);
+}
+
 /* Q_BUFFER_HANDLE event and buffer data for the given handle.
    Return whether or not the buffering should continue explicitly.  */
 static bool buffer_handle(int handle_id, size_t to_buffer)
@@ -657,6 +781,7 @@ static bool buffer_handle(int handle_id, size_t to_buffer)
         h->fd = -1; /* with above, behavior same as close_fd */
         h->widx = ringbuf_add(h->data, h->filesize);
         h->end  = h->filesize;
+        fill_started(h);
         send_event(BUFFER_EVENT_FINISHED, &handle_id);
         return true;
     }
@@ -667,7 +792,7 @@ static bool buffer_handle(int handle_id, size_t to_buffer)
         /* max amount to copy */
         size_t widx = h->widx;
         ssize_t copy_n = h->filesize - h->end;
-        copy_n = MIN(copy_n, BUFFERING_DEFAULT_FILECHUNK);
+        copy_n = MIN(copy_n, (off_t)fill_stats.filechunk);
         copy_n = MIN(copy_n, (off_t)(buffer_len - widx));
 
         mutex_lock(&llist_mutex);
@@ -689,6 +814,7 @@ static bool buffer_handle(int handle_id, size_t to_buffer)
             return false; /* no space for read */
 
         /* rc is the actual amount read */
+        long tick = current_tick;
         ssize_t rc = read(h->fd, ringbuf_ptr(widx), copy_n);
 
         if (rc <= 0) {
@@ -704,9 +830,12 @@ static bool buffer_handle(int handle_id, size_t to_buffer)
             break;
         }
 
+        update_filechunk(rc, current_tick - tick);
+
         /* Advance buffer and make data available to users */
         h->widx = ringbuf_add(widx, rc);
         h->end += rc;
+        fill_started(h);
 
         yield();
 
@@ -740,6 +869,12 @@ static bool close_handle(int handle_id)
     /* If the handle is not found, it is closed */
     if (h) {
         close_fd(&h->fd);
+#ifdef BUFFERING_MMAP
+        if (HANDLE_MAPPED(h)) {
+            munmap(h->map, h->filesize);
+            mapped_size -= h->filesize;
+        }
+#endif
         unlink_handle(h);
     }
 
@@ -751,8 +886,8 @@ static bool close_handle(int handle_id)
    part of its data buffer or by moving all the data. */
 static struct memory_handle * shrink_handle(struct memory_handle *h)
 {
-    if (!h)
-        return NULL;
+    if (!h || HANDLE_MAPPED(h))
+        return h;
 
     if (h->type == TYPE_PACKET_AUDIO) {
         /* only move the handle struct */
@@ -818,26 +953,36 @@ static bool fill_buffer(void)
     logf("fill_buffer()");
     mutex_lock(&llist_mutex);
 
-    struct memory_handle *m = shrink_handle(HLIST_FIRST);
+    shrink_handle(HLIST_FIRST);
 
     mutex_unlock(&llist_mutex);
 
-    while (queue_empty(&buffering_queue) && m) {
-        if (m->end < m->filesize && !buffer_handle(m->id, 0)) {
-            m = NULL;
-            break;
+    /* Visit the handles by priority, keeping the buffer order within the
+       same priority. Space up to the end of their files is reserved for all
+       but the last handle, so they can be filled in any order. */
+    for (int prio = 0; prio < FILL_CLASS_COUNT; prio++) {
+        for (struct memory_handle *m = HLIST_FIRST; m; m = HLIST_NEXT(m)) {
+            if (!queue_empty(&buffering_queue))
+                return true;
+
+            if (m->end >= m->filesize || (int)fill_class(m) != prio)
+                continue;
+
+            if (!buffer_handle(m->id, 0)) {
+                /* buffer is full */
+                storage_sleep();
+                return false;
+            }
         }
-        m = HLIST_NEXT(m);
     }
 
-    if (m) {
+    /* only spin the disk down if the filling wasn't interrupted by an
+       event arriving in the queue. */
+    if (!queue_empty(&buffering_queue))
         return true;
-    } else {
-        /* only spin the disk down if the filling wasn't interrupted by an
-           event arriving in the queue. */
-        storage_sleep();
-        return false;
-    }
+
+    storage_sleep();
+    return false;
 }
 
 #ifdef HAVE_ALBUMART
@@ -898,6 +1043,62 @@ management functions for all the actual handle management work.
 */
 
 
+#ifdef BUFFERING_MMAP
+/* Open an audio file as a mapped handle: bufread and bufgetdata access the
+   mapping directly and nothing is left to buffer. Returns the handle id, or
+   ERR_UNSUPPORTED_TYPE if the file should be buffered normally instead. */
+static int open_mapped_handle(int fd, const char *file, off_t offset,
+                              enum data_type type, size_t size)
+{
+    if (size == 0 || size > BUFFERING_MMAP_MAX - mapped_size)
+        return ERR_UNSUPPORTED_TYPE;
+
+    /* private writable mapping: codecs may modify the data they get */
+    char *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+        return ERR_UNSUPPORTED_TYPE;
+
+#ifdef POSIX_MADV_SEQUENTIAL
+    posix_madvise(map, size, POSIX_MADV_SEQUENTIAL);
+#endif
+
+    mutex_lock(&llist_mutex);
+
+    size_t data;
+    struct memory_handle *h = add_handle(0, 0, file, &data);
+    if (!h) {
+        mutex_unlock(&llist_mutex);
+        munmap(map, size);
+        return ERR_BUFFER_FULL;
+    }
+
+    int handle_id = h->id;
+
+    h->type     = type;
+    h->flags   |= H_MAPPED;
+    h->fd       = -1;
+    h->map      = map;
+    h->data     = data;
+    h->ridx     = data;
+    h->widx     = data;
+    h->filesize = size;
+    h->start    = 0;
+    h->pos      = (size_t)offset <= size ? offset : 0;
+    h->end      = size;
+
+    mapped_size += size;
+    link_handle(h);
+
+    mutex_unlock(&llist_mutex);
+
+    /* there is nothing left to buffer */
+    send_event(BUFFER_EVENT_FINISHED, &handle_id);
+
+    logf("bufopen: mapped hdl %d", handle_id);
+    return handle_id;
+}
+#endif /* BUFFERING_MMAP */
+
 /* Reserve space in the buffer for a file.
    filename: name of the file to open
    offset: offset at which to start buffering the file, useful when the first
@@ -936,6 +1137,7 @@ int bufopen(const char *file, off_t offset, enum data_type type,
             h->pos      = 0;
             h->end      = 0;
 
+            fill_request(h);
             link_handle(h);
 
             /* Inform the buffering thread that we added a handle */
@@ -985,6 +1187,16 @@ int bufopen(const char *file, off_t offset, enum data_type type,
     if (size == 0)
         size = filesize(fd);
 
+#ifdef BUFFERING_MMAP
+    if (type == TYPE_PACKET_AUDIO || type == TYPE_ATOMIC_AUDIO) {
+        handle_id = open_mapped_handle(fd, file, offset, type, size);
+        if (handle_id != ERR_UNSUPPORTED_TYPE) {
+            close(fd);
+            return handle_id;
+        }
+    }
+#endif
+
     unsigned int hflags = 0;
     if (type == TYPE_PACKET_AUDIO || type == TYPE_CODEC)
         hflags |= H_CANWRAP;
@@ -1060,6 +1272,7 @@ int bufopen(const char *file, off_t offset, enum data_type type,
         h->widx     = data;
         h->filesize = size;
         h->end      = adjusted_offset;
+        fill_request(h);
         link_handle(h);
     }
 
@@ -1215,6 +1428,7 @@ static void rebuffer_handle(int handle_id, off_t newpos)
     /* Reset the handle to its new position */
     h->ridx = h->widx = h->data = new_index;
     h->start = h->pos = h->end = newpos;
+    fill_request(h);
 
     if (h->fd >= 0)
         lseek(h->fd, newpos, SEEK_SET);
@@ -1248,7 +1462,8 @@ static int seek_handle(struct memory_handle *h, off_t newpos)
                     (intptr_t)&(struct buf_message_data){ h->id, newpos });
     }
     else {
-        h->ridx = ringbuf_add(h->data, newpos - h->start);
+        if (!HANDLE_MAPPED(h))
+            h->ridx = ringbuf_add(h->data, newpos - h->start);
         h->pos  = newpos;
         return 0;
     }
@@ -1329,6 +1544,12 @@ static struct memory_handle *prep_bufdata(int handle_id, size_t *size,
     if (realsize <= 0 || realsize > filerem)
         realsize = filerem; /* clip to eof */
 
+    if (HANDLE_MAPPED(h)) {
+        /* All of the file is linear and available */
+        *size = realsize;
+        return h;
+    }
+
     if (guardbuf_limit && realsize > GUARD_BUFSIZE) {
         logf("data request > guardbuf");
         /* If more than the size of the guardbuf is requested and this is a
@@ -1396,6 +1617,13 @@ ssize_t bufread(int handle_id, size_t size, void *dest)
     if (!h)
         return ERR_HANDLE_NOT_FOUND;
 
+#ifdef BUFFERING_MMAP
+    if (HANDLE_MAPPED(h)) {
+        memcpy(dest, h->map + h->pos, size);
+        return size;
+    }
+#endif
+
     if (h->ridx + size > buffer_len) {
         /* the data wraps around the end of the buffer */
         size_t read = buffer_len - h->ridx;
@@ -1424,6 +1652,14 @@ ssize_t bufgetdata(int handle_id, size_t size, void **data)
     if (!h)
         return ERR_HANDLE_NOT_FOUND;
 
+#ifdef BUFFERING_MMAP
+    if (HANDLE_MAPPED(h)) {
+        if (data)
+            *data = h->map + h->pos;
+        return size;
+    }
+#endif
+
     if (h->ridx + size > buffer_len) {
         /* the data wraps around the end of the buffer :
            use the guard buffer to provide the requested amount of data. */
@@ -1717,6 +1953,9 @@ bool buffering_reset(char *buf, size_t buflen)
     num_handles = 0;
     base_handle_id = -1;
 
+    memset(fill_stats.latency, 0, sizeof(fill_stats.latency));
+    memset(fill_stats.latency_max, 0, sizeof(fill_stats.latency_max));
+
     /* Set the high watermark as 75% full...or 25% empty :)
        This is the greatest fullness that will trigger low-buffer events
        no matter what the setting because high-bitrate files can have
@@ -1738,4 +1977,11 @@ void buffering_get_debugdata(struct buffering_debug *dbgdata)
     dbgdata->buffered_data = dc.buffered;
     dbgdata->useful_data = dc.useful;
     dbgdata->watermark = BUF_WATERMARK;
+    dbgdata->filechunk = fill_stats.filechunk;
+    dbgdata->read_rate = fill_stats.rate * HZ;
+
+    for (int i = 0; i < FILL_CLASS_COUNT; i++) {
+        dbgdata->fill_latency[i] = fill_stats.latency[i];
+        dbgdata->fill_latency_max[i] = fill_stats.latency_max[i];
+    }
 }
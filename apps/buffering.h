@@ -114,12 +114,26 @@ void buf_set_watermark(size_t bytes);
 size_t buf_get_watermark(void);
 
 /* Debugging */
+
+/* Handles are filled by priority class, highest first */
+enum fill_class {
+    FILL_CLASS_CURRENT = 0, /* handle being read (buf_set_base_handle) */
+    FILL_CLASS_META,        /* metadata and codecs of the next tracks */
+    FILL_CLASS_IMAGE,       /* album art and cuesheets */
+    FILL_CLASS_OTHER,       /* audio of the next tracks */
+    FILL_CLASS_COUNT
+};
+
 struct buffering_debug {
     int num_handles;
     size_t buffered_data;
     size_t data_rem;
     size_t useful_data;
     size_t watermark;
+    size_t filechunk;       /* current read() size */
+    size_t read_rate;       /* measured throughput in bytes/s */
+    long fill_latency[FILL_CLASS_COUNT];     /* in ticks, from request to */
+    long fill_latency_max[FILL_CLASS_COUNT]; /* first data of a handle */
 };
 void buffering_get_debugdata(struct buffering_debug *dbgdata);
 
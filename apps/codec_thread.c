@@ -33,6 +33,7 @@
 #include "dsp_core.h"
 #include "metadata.h"
 #include "settings.h"
+#include "seekindex.h"
 
 /* Define LOGF_ENABLE to enable logf output in this file */
 /*#define LOGF_ENABLE*/
@@ -244,8 +245,12 @@ static void codec_pcmbuf_insert_callback(
             cancel_cpu_boost();
 
             /* It may be awhile before space is available but we want
-               "instant" response to any message */
-            queue_wait_w_tmo(&codec_queue, NULL, HZ/20);
+               "instant" response to any message. In low-latency mode
+               under 10ms is queued so refill as soon as a chunk plays. */
+            if (pcmbuf_get_low_latency())
+                pcmbuf_wait_low_latency();
+            else
+                queue_wait_w_tmo(&codec_queue, NULL, HZ/20);
         }
         else
         {
@@ -440,6 +445,13 @@ static bool codec_loop_track_callback(void)
     return global_settings.repeat_mode == REPEAT_ONE;
 }
 
+static bool codec_seek_index_callback(uint64_t sample,
+                                      struct seek_point *before,
+                                      struct seek_point *after)
+{
+    return seek_index_find(ci.id3, sample, before, after);
+}
+
 
 /** --- CODEC THREAD --- **/
 
@@ -647,6 +659,7 @@ void INIT_ATTR codec_thread_init(void)
     ci.configure        = codec_configure_callback;
     ci.get_command      = codec_get_command_callback;
     ci.loop_track       = codec_loop_track_callback;
+    ci.seek_index_find  = codec_seek_index_callback;
 
     /* Init threading */
     queue_init(&codec_queue, false);
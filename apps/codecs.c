@@ -150,6 +150,8 @@ struct codec_api ci = {
     /* new stuff at the end, sort into place next time
        the API gets incompatible */
 
+    NULL, /* seek_index_find */
+
 };
 
 void codec_get_full_path(char *path, const char *codec_root_fn)
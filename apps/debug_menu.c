@@ -61,6 +61,7 @@
 #include "rtc.h"
 #include "storage.h"
 #include "fs_defines.h"
+#include "disk_cache.h"
 #include "eeprom_24cxx.h"
 #if (CONFIG_STORAGE & STORAGE_MMC) || (CONFIG_STORAGE & STORAGE_SD)
 #include "sdmmc.h"
@@ -493,6 +494,19 @@ static bool dbg_buffering_thread(void)
                              pcmbuf_used_descs(), pcmbufdescs);
             screens[i].putsf(0, line++, "watermark: %6d",
                              (int)(d.watermark));
+            screens[i].putsf(0, line++, "chunk: %3ldK %5ldK/s",
+                             (long)(d.filechunk / 1024),
+                             (long)(d.read_rate / 1024));
+            screens[i].putsf(0, line++, "wait ms: %ld/%ld/%ld/%ld",
+                             d.fill_latency[FILL_CLASS_CURRENT] * 1000 / HZ,
+                             d.fill_latency[FILL_CLASS_META] * 1000 / HZ,
+                             d.fill_latency[FILL_CLASS_IMAGE] * 1000 / HZ,
+                             d.fill_latency[FILL_CLASS_OTHER] * 1000 / HZ);
+            screens[i].putsf(0, line++, "max ms: %ld/%ld/%ld/%ld",
+                             d.fill_latency_max[FILL_CLASS_CURRENT] * 1000 / HZ,
+                             d.fill_latency_max[FILL_CLASS_META] * 1000 / HZ,
+                             d.fill_latency_max[FILL_CLASS_IMAGE] * 1000 / HZ,
+                             d.fill_latency_max[FILL_CLASS_OTHER] * 1000 / HZ);
 
             screens[i].update();
         }
@@ -1853,8 +1867,84 @@ static bool dbg_disk_info(void)
     info.scroll_all = true;
     return simplelist_show_list(&info);
 }
+
+static int disk_cache_callback(int btn, struct gui_synclist *lists)
+{
+    (void)lists;
+    struct dc_info info;
+    dc_get_info(&info);
+
+    simplelist_set_line_count(0);
+
+    unsigned long probes = info.hits + info.misses;
+    unsigned int hitrate = probes ? 1000ull*info.hits / probes : 0;
+    simplelist_addline("Hits: %lu (%u.%u%%)", info.hits,
+                       hitrate / 10, hitrate % 10);
+    simplelist_addline("Misses: %lu", info.misses);
+    simplelist_addline("Read ahead: %lu sectors", info.readahead);
+    simplelist_addline("Read ahead hits: %lu", info.readahead_hits);
+    simplelist_addline("Written: %lu sectors", info.writes);
+    simplelist_addline("Write requests: %lu", info.write_ops);
+
+    if (btn == ACTION_NONE)
+        btn = ACTION_REDRAW;
+
+    return btn;
+}
+
+static bool dbg_disk_cache_info(void)
+{
+    struct simplelist_info info;
+    simplelist_info_init(&info, "Disk Cache Info", 6, NULL);
+    info.action_callback = disk_cache_callback;
+    info.scroll_all = true;
+    return simplelist_show_list(&info);
+}
 #endif /* PLATFORM_NATIVE */
 
+static int font_cache_callback(int btn, struct gui_synclist *lists)
+{
+    (void)lists;
+    struct font_cache_info info;
+    bool any = false;
+
+    simplelist_set_line_count(0);
+
+    for (int font_id = FONT_FIRSTUSERFONT; font_id < MAXFONTS; font_id++)
+    {
+        if (!font_get_cache_info(font_id, &info))
+            continue;
+
+        unsigned long probes = info.hits + info.misses;
+        unsigned int hitrate = probes ? 1000ull*info.hits / probes : 0;
+        simplelist_addline("Font %d: %d/%d glyphs", font_id,
+                           info.used, info.capacity);
+        simplelist_addline(" Hits: %lu (%u.%u%%)", info.hits,
+                           hitrate / 10, hitrate % 10);
+        simplelist_addline(" Misses: %lu", info.misses);
+        simplelist_addline(" Prefetched: %lu", info.prefetched);
+        simplelist_addline(" File reads: %lu", info.reads);
+        any = true;
+    }
+
+    if (!any)
+        simplelist_addline("No cached fonts");
+
+    if (btn == ACTION_NONE)
+        btn = ACTION_REDRAW;
+
+    return btn;
+}
+
+static bool dbg_font_cache_info(void)
+{
+    struct simplelist_info info;
+    simplelist_info_init(&info, "Font Cache Info", 1, NULL);
+    info.action_callback = font_cache_callback;
+    info.scroll_all = true;
+    return simplelist_show_list(&info);
+}
+
 #ifdef HAVE_DIRCACHE
 static int dircache_callback(int btn, struct gui_synclist *lists)
 {
@@ -1905,6 +1995,15 @@ static int dircache_callback(int btn, struct gui_synclist *lists)
     simplelist_addline("Scanning took: %ld.%ld s",
                        ticks / HZ, (ticks*10 / HZ) % 10);
     simplelist_addline("Entry count: %u", info.entry_count);
+    unsigned int load = info.hash_slots ?
+                        1000ull*info.hash_used / info.hash_slots : 0;
+    simplelist_addline("Name hash: %u/%u (%u.%u%%)%s", info.hash_used,
+                       info.hash_slots, load / 10, load % 10,
+                       info.hash_full ? " full" : "");
+    unsigned int probes = info.lookups ?
+                          100ull*info.probes / info.lookups : 0;
+    simplelist_addline("Lookups: %lu (%u.%02u probes)", info.lookups,
+                       probes / 100, probes % 100);
 
     if (btn == ACTION_NONE)
         btn = ACTION_REDRAW;
@@ -1916,7 +2015,7 @@ static bool dbg_dircache_info(void)
 {
     struct simplelist_info info;
     int syncbuild = 0;
-    simplelist_info_init(&info, "Dircache Info", 8, &syncbuild);
+    simplelist_info_init(&info, "Dircache Info", 10, &syncbuild);
     info.action_callback = dircache_callback;
     info.scroll_all = true;
     return simplelist_show_list(&info);
@@ -2808,6 +2907,7 @@ static const struct {
 #endif
 #if (CONFIG_PLATFORM & PLATFORM_NATIVE)
         { "View disk info", dbg_disk_info },
+        { "View disk cache info", dbg_disk_cache_info },
 #if (CONFIG_STORAGE & STORAGE_ATA)
         { "Dump ATA identify info", dbg_identify_info},
 #ifdef HAVE_ATA_SMART
@@ -2816,6 +2916,7 @@ static const struct {
 #endif
 #endif
         { "Metadata log", dbg_metadatalog },
+        { "View font cache info", dbg_font_cache_info },
 #ifdef HAVE_DIRCACHE
         { "View dircache info", dbg_dircache_info },
 #endif
@@ -0,0 +1,312 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * Copyright (C) 2026 The Rockbox Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+
+/* Lowers the element tree of a freshly parsed skin into one flat array of
+ * struct skin_op, which is what skin_render.c runs on every refresh.
+ *
+ * Every LINE gets a contiguous run of ops. Element types, tag flags,
+ * whether a tag can draw and which part of get_token_value() has its value
+ * are resolved here once. Each conditional op is
+ * followed by one BRANCH op per option holding the position of that
+ * branch's code, so the renderer indexes the taken branch directly.
+ * Branch lines are placed after the line they belong to.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "skin_buffer.h"
+#include "skin_parser.h"
+#include "tag_table.h"
+#include "screen_access.h"
+#include "wps_internals.h"
+
+static char *skin_buffer;
+static struct skin_op *code; /* NULL on the counting pass */
+static int code_len;
+
+static inline struct skin_element*
+get_child(OFFSETTYPE(struct skin_element**) children, int child)
+{
+    OFFSETTYPE(struct skin_element*) *kids = SKINOFFSETTOPTR(skin_buffer, children);
+    return SKINOFFSETTOPTR(skin_buffer, kids[child]);
+}
+
+/* Tokens handled by do_non_text_tags() in skin_render.c. A token wrongly
+ * listed here only costs a failed lookup, one missing would never draw. */
+static bool is_drawing_token(enum skin_token_type type)
+{
+    switch (type)
+    {
+        case SKIN_TOKEN_VIEWPORT_FGCOLOUR:
+        case SKIN_TOKEN_VIEWPORT_BGCOLOUR:
+        case SKIN_TOKEN_VIEWPORT_TEXTSTYLE:
+        case SKIN_TOKEN_VIEWPORT_GRADIENT_SETUP:
+        case SKIN_TOKEN_VIEWPORT_ENABLE:
+        case SKIN_TOKEN_LIST_ITEM_CFG:
+        case SKIN_TOKEN_UIVIEWPORT_ENABLE:
+        case SKIN_TOKEN_PEAKMETER:
+        case SKIN_TOKEN_DRAWRECTANGLE:
+        case SKIN_TOKEN_PEAKMETER_LEFTBAR:
+        case SKIN_TOKEN_PEAKMETER_RIGHTBAR:
+        case SKIN_TOKEN_VOLUMEBAR:
+        case SKIN_TOKEN_BATTERY_PERCENTBAR:
+        case SKIN_TOKEN_SETTINGBAR:
+        case SKIN_TOKEN_PROGRESSBAR:
+        case SKIN_TOKEN_TUNER_RSSI_BAR:
+        case SKIN_TOKEN_LIST_SCROLLBAR:
+        case SKIN_TOKEN_IMAGE_DISPLAY:
+        case SKIN_TOKEN_IMAGE_DISPLAY_LISTICON:
+        case SKIN_TOKEN_IMAGE_PRELOAD_DISPLAY:
+        case SKIN_TOKEN_IMAGE_DISPLAY_9SEGMENT:
+        case SKIN_TOKEN_ALBUMART_DISPLAY:
+        case SKIN_TOKEN_DRAW_INBUILTBAR:
+        case SKIN_TOKEN_VIEWPORT_CUSTOMLIST:
+        case SKIN_TOKEN_VAR_SET:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool is_align_token(enum skin_token_type type)
+{
+    switch (type)
+    {
+        case SKIN_TOKEN_ALIGN_LEFT:
+        case SKIN_TOKEN_ALIGN_LEFT_RTL:
+        case SKIN_TOKEN_ALIGN_CENTER:
+        case SKIN_TOKEN_ALIGN_RIGHT:
+        case SKIN_TOKEN_ALIGN_RIGHT_RTL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Number of ops the children of a LINE compile to, not counting its
+ * branch lines */
+static int count_line_ops(struct skin_element *line)
+{
+    struct skin_element *child;
+    int count = 0;
+
+    if (line->children_count == 0)
+        return 0;
+
+    for (child = get_child(line->children, 0); child;
+         child = SKINOFFSETTOPTR(skin_buffer, child->next))
+    {
+        switch (child->type)
+        {
+            case CONDITIONAL:
+                if (SKINOFFSETTOPTR(skin_buffer, child->data))
+                    count += 1 + child->children_count;
+                break;
+            case TAG:
+                if (SKINOFFSETTOPTR(skin_buffer, child->data) ||
+                    is_align_token(child->tag->type) ||
+                    (child->tag->flags & NOBREAK) ||
+                    child->tag->type == SKIN_TOKEN_SUBLINE_SCROLL)
+                    count++;
+                break;
+            case TEXT:
+                count++;
+                break;
+            default:
+                break;
+        }
+    }
+    return count;
+}
+
+static void compile_element(struct skin_element *element);
+
+static void emit(int *pos, struct skin_op *op)
+{
+    if (code)
+        code[*pos] = *op;
+    (*pos)++;
+}
+
+static void compile_line(struct skin_element *line)
+{
+    struct line *data = SKINOFFSETTOPTR(skin_buffer, line->data);
+    struct skin_element *child;
+    int count = count_line_ops(line);
+    int pos = code_len;
+
+    code_len += count;
+    if (code && data)
+    {
+        data->code = pos;
+        data->code_len = count;
+    }
+    if (count == 0)
+        return;
+
+    for (child = get_child(line->children, 0); child;
+         child = SKINOFFSETTOPTR(skin_buffer, child->next))
+    {
+        struct skin_op op;
+
+        memset(&op, 0, sizeof(op));
+        op.data = child->data;
+        op.element = PTRTOSKINOFFSET(skin_buffer, child);
+
+        switch (child->type)
+        {
+            case CONDITIONAL:
+                if (!SKINOFFSETTOPTR(skin_buffer, child->data))
+                    break;
+                op.type = SKIN_OP_CONDITIONAL;
+                op.count = child->children_count;
+                emit(&pos, &op);
+
+                for (int i = 0; i < child->children_count; i++)
+                {
+                    struct skin_element *branch = get_child(child->children, i);
+                    struct line *branch_data = SKINOFFSETTOPTR(skin_buffer, branch->data);
+
+                    compile_element(branch);
+
+                    memset(&op, 0, sizeof(op));
+                    op.type = SKIN_OP_BRANCH;
+                    op.element = PTRTOSKINOFFSET(skin_buffer, branch);
+                    if (branch->type == LINE_ALTERNATOR)
+                        op.arg = -1;
+                    else if (branch_data)
+                    {
+                        op.arg = branch_data->code;
+                        op.count = branch_data->code_len;
+                    }
+                    emit(&pos, &op);
+                }
+                break;
+            case TAG:
+            {
+                struct skin_tag_parameter *params =
+                        SKINOFFSETTOPTR(skin_buffer, child->params);
+                enum skin_token_type type = child->tag->type;
+
+                /* the playlist viewer renders a line passed as a parameter */
+                for (int i = 0; i < child->params_count; i++)
+                {
+                    struct skin_element *arg;
+                    if (params[i].type != CODE)
+                        continue;
+                    arg = SKINOFFSETTOPTR(skin_buffer, params[i].data.code);
+                    if (arg && (arg->type == LINE || arg->type == LINE_ALTERNATOR))
+                        compile_element(arg);
+                }
+
+                if (child->tag->flags & NOBREAK)
+                    op.flags |= SKIN_OP_NOBREAK;
+                if (type == SKIN_TOKEN_SUBLINE_SCROLL)
+                    op.flags |= SKIN_OP_SCROLLS;
+                op.refresh = child->tag->flags;
+
+                /* alignment tags have no value of their own */
+                if (is_align_token(type))
+                {
+                    op.type = SKIN_OP_ALIGN;
+                    op.arg = type;
+                }
+                else if (SKINOFFSETTOPTR(skin_buffer, child->data))
+                {
+                    op.type = is_drawing_token(type) ? SKIN_OP_TAG : SKIN_OP_VALUE;
+                    struct wps_token *token = SKINOFFSETTOPTR(skin_buffer, child->data);
+                    op.arg = skin_token_family(token->type);
+                }
+                else if (op.flags)
+                    op.type = SKIN_OP_FLAGS;
+                else
+                    break;
+                emit(&pos, &op);
+                break;
+            }
+            case TEXT:
+                op.type = SKIN_OP_TEXT;
+                emit(&pos, &op);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+static void compile_element(struct skin_element *element)
+{
+    switch (element->type)
+    {
+        case VIEWPORT:
+            if (element->children_count)
+            {
+                struct skin_element *line = get_child(element->children, 0);
+                for (; line; line = SKINOFFSETTOPTR(skin_buffer, line->next))
+                    compile_element(line);
+            }
+            break;
+        case LINE:
+            compile_line(element);
+            break;
+        case LINE_ALTERNATOR:
+            for (int i = 0; i < element->children_count; i++)
+                compile_element(get_child(element->children, i));
+            break;
+        default:
+            break;
+    }
+}
+
+static void compile_tree(struct skin_element *tree)
+{
+    code_len = 0;
+    for (; tree; tree = SKINOFFSETTOPTR(skin_buffer, tree->next))
+        compile_element(tree);
+}
+
+/* Compile the skin whose tree is in buffer, returns the number of ops or
+ * -1 if the skin buffer is too small to hold them */
+int skin_compile(char *buffer, struct wps_data *data)
+{
+    struct skin_element *tree;
+
+    skin_buffer = buffer;
+    tree = SKINOFFSETTOPTR(skin_buffer, data->tree);
+
+    /* count, then allocate and emit */
+    code = NULL;
+    compile_tree(tree);
+    if (code_len == 0)
+    {
+        data->code = PTRTOSKINOFFSET(skin_buffer, NULL);
+        return 0;
+    }
+
+    code = skin_buffer_alloc(code_len * sizeof(struct skin_op));
+    if (!code)
+        return -1;
+    compile_tree(tree);
+    data->code = PTRTOSKINOFFSET(skin_buffer, code);
+    code = NULL;
+    return code_len;
+}
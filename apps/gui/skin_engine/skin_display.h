@@ -40,6 +40,18 @@ void wps_display_images(struct gui_wps *gwps, struct viewport* vp);
 void skin_render_viewport(struct skin_element* viewport, struct gui_wps *gwps,
                         struct skin_viewport* skin_viewport, unsigned long refresh_type);
 
+/* Rendering counters, shown on the skin engine debug screen */
+struct skin_render_stats {
+    int renders_per_sec;         /* skin_render() calls in the last second */
+    int update_percent;          /* average share of the screen sent to the
+                                    LCD per render in the last second */
+    unsigned long lines_drawn;   /* lines written since boot */
+    unsigned long lines_skipped; /* unchanged lines not redrawn since boot */
+    int render_time_us;          /* average time per render, measured in
+                                    ticks over many renders */
+};
+void skin_render_get_stats(struct skin_render_stats *stats);
+
 
 /* Evaluate the conditional that is at *token_index and return whether a skip
    has ocurred. *token_index is updated with the new position.
@@ -39,6 +39,7 @@
 #include "skin_buffer.h"
 #include "statusbar-skinned.h"
 #include "wps_internals.h"
+#include "skin_display.h"
 
 #define FAILSAFENAME "rockbox_failsafe"
 
@@ -334,6 +335,7 @@ void skin_request_full_update(enum skinnable_screens skin)
 bool dbg_skin_engine(void)
 {
     struct simplelist_info info;
+    struct skin_render_stats render;
     int i, total = 0;
 #if defined(HAVE_BACKDROP_IMAGE)
     int ref_count;
@@ -358,6 +360,8 @@ bool dbg_skin_engine(void)
                         stats->tree_size);
                 simplelist_addline("\tImages: %zd bytes",
                         stats->images_size);
+                simplelist_addline("\tCode: %zd ops",
+                        stats->code_ops);
                 simplelist_addline("\tTotal: %zd bytes",
                         stats->tree_size + stats->images_size);
                 total += stats->tree_size + stats->images_size;
@@ -365,6 +369,13 @@ bool dbg_skin_engine(void)
         }
     }
     simplelist_addline("Skin total usage: %d bytes", total);
+    skin_render_get_stats(&render);
+    simplelist_addline("Renders: %d/s, %d%% of screen updated",
+                       render.renders_per_sec, render.update_percent);
+    simplelist_addline("Lines drawn: %lu, unchanged: %lu",
+                       render.lines_drawn, render.lines_skipped);
+    simplelist_addline("Render time: %d us average",
+                       render.render_time_us);
 #if defined(HAVE_BACKDROP_IMAGE)
     simplelist_addline("Backdrop Images:");
     i = 0;
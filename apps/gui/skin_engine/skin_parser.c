@@ -1899,6 +1899,7 @@ static void skin_data_reset(struct wps_data *wps_data)
     skin_data_free_buflib_allocs(wps_data);
     wps_data->images = INVALID_OFFSET;
     wps_data->tree = INVALID_OFFSET;
+    wps_data->code = INVALID_OFFSET;
 #ifdef HAVE_BACKDROP_IMAGE
     if (wps_data->backdrop_id >= 0)
         skin_backdrop_unload(wps_data->backdrop_id);
@@ -2462,6 +2463,10 @@ static int skin_element_callback(struct skin_element* element, void* data)
         {
             curr_line = skin_buffer_alloc(sizeof(*curr_line));
             curr_line->update_mode = SKIN_REFRESH_STATIC;
+            curr_line->last_crc = 0;
+            curr_line->overdrawn = false;
+            curr_line->code = 0;
+            curr_line->code_len = 0;
             element->data = PTRTOSKINOFFSET(skin_buffer, curr_line);
         }
         break;
@@ -2584,6 +2589,19 @@ bool skin_data_load(enum screen_type screen, struct wps_data *wps_data,
         return false;
     }
 
+    /* lower the tree to the code the renderer runs */
+    int code_ops = skin_compile(skin_buffer, wps_data);
+    if (code_ops < 0)
+    {
+#ifdef DEBUG_SKIN_ENGINE
+        if (isfile && debug_wps)
+            DEBUGF("Not enough skin buffer to compile the skin\n");
+#endif
+        skin_data_reset(wps_data);
+        return false;
+    }
+    stats->code_ops = code_ops;
+
     char bmpdir[MAX_PATH];
     if (isfile)
     {
@@ -29,6 +29,7 @@
 #include "config.h"
 #include "core_alloc.h"
 #include "kernel.h"
+#include "crc32.h"
 #include "appevents.h"
 #ifdef HAVE_ALBUMART
 #include "albumart.h"
@@ -93,6 +94,246 @@ get_child(OFFSETTYPE(struct skin_element**) children, int child)
     return SKINOFFSETTOPTR(skin_buffer, kids[child]);
 }
 
+/* Screen areas drawn to by the current skin_render() call. Only these are
+ * sent to the LCD at the end, and a line whose text hasn't changed is left
+ * alone unless something else was drawn over it first. */
+#define MAX_DAMAGE_RECTS 8
+
+/* Lines left alone by the current skin_render() call. An area cleared after
+ * that wipes them, so the skin is then rendered a second time with every
+ * line drawn, and such a line is never left alone again. */
+#define MAX_SKIPPED_LINES 16
+
+/* Renders the render time is averaged over, ticks being too coarse to time
+ * a single one */
+#define RENDER_TIME_RENDERS 64
+
+struct damage_rect {
+    int x1, y1, x2, y2; /* x2 and y2 are exclusive */
+};
+
+static struct {
+    bool full;
+    int count;
+    int width, height;
+    struct damage_rect rect[MAX_DAMAGE_RECTS];
+} damage;
+
+static struct {
+    bool off;   /* second pass, draw every line */
+    bool wiped; /* a line left alone was cleared */
+    int count;
+    struct {
+        struct line *line;
+        struct damage_rect rect;
+    } entry[MAX_SKIPPED_LINES];
+} skipped;
+
+static struct {
+    long window_start;
+    int renders;
+    unsigned long percent_updated; /* sum over the renders in this window */
+    long render_start;
+    int timed_renders;
+    long render_ticks;             /* sum over the timed renders */
+    struct skin_render_stats last;
+} render_stats;
+
+static void damage_reset(struct screen *display, bool full)
+{
+    damage.full = full;
+    damage.count = 0;
+    damage.width = display->lcdwidth;
+    damage.height = display->lcdheight;
+    skipped.off = false;
+    skipped.wiped = false;
+    skipped.count = 0;
+    render_stats.render_start = current_tick;
+}
+
+static inline bool rects_touch(const struct damage_rect *a,
+                               const struct damage_rect *b)
+{
+    return a->x1 <= b->x2 && b->x1 <= a->x2 &&
+           a->y1 <= b->y2 && b->y1 <= a->y2;
+}
+
+static inline void rect_union(struct damage_rect *a,
+                              const struct damage_rect *b)
+{
+    a->x1 = MIN(a->x1, b->x1);
+    a->y1 = MIN(a->y1, b->y1);
+    a->x2 = MAX(a->x2, b->x2);
+    a->y2 = MAX(a->y2, b->y2);
+}
+
+static void add_damage(int x, int y, int width, int height)
+{
+    struct damage_rect r = {
+        MAX(x, 0), MAX(y, 0),
+        MIN(x + width, damage.width), MIN(y + height, damage.height)
+    };
+
+    if (damage.full || r.x1 >= r.x2 || r.y1 >= r.y2)
+        return;
+
+    /* merge with everything it touches, the union may touch more rects */
+    for (int i = 0; i < damage.count; i++)
+    {
+        if (rects_touch(&r, &damage.rect[i]))
+        {
+            rect_union(&r, &damage.rect[i]);
+            damage.rect[i] = damage.rect[--damage.count];
+            i = -1;
+        }
+    }
+
+    /* out of slots, collapse everything into one bounding rect */
+    if (damage.count == MAX_DAMAGE_RECTS)
+    {
+        for (int i = 1; i < damage.count; i++)
+            rect_union(&damage.rect[0], &damage.rect[i]);
+        rect_union(&damage.rect[0], &r);
+        damage.count = 1;
+        return;
+    }
+
+    damage.rect[damage.count++] = r;
+}
+
+static inline void add_viewport_damage(struct viewport *vp)
+{
+    add_damage(vp->x, vp->y, vp->width, vp->height);
+}
+
+/* Like add_damage() for an area cleared to the background, which also wipes
+ * the lines left alone so far */
+static void add_cleared(int x, int y, int width, int height)
+{
+    struct damage_rect r = { x, y, x + width, y + height };
+
+    add_damage(x, y, width, height);
+
+    for (int i = 0; i < skipped.count; i++)
+    {
+        const struct damage_rect *d = &skipped.entry[i].rect;
+        if (r.x1 < d->x2 && d->x1 < r.x2 && r.y1 < d->y2 && d->y1 < r.y2)
+        {
+            skipped.entry[i].line->overdrawn = true;
+            skipped.wiped = true;
+        }
+    }
+}
+
+static inline void add_viewport_cleared(struct viewport *vp)
+{
+    add_cleared(vp->x, vp->y, vp->width, vp->height);
+}
+
+static inline void add_image_cleared(struct viewport *vp, struct gui_img *img)
+{
+    add_cleared(vp->x + img->x, vp->y + img->y,
+                img->bm.width, img->subimage_height);
+}
+
+static bool is_damaged(int x, int y, int width, int height)
+{
+    struct damage_rect r = { x, y, x + width, y + height };
+
+    if (damage.full)
+        return true;
+
+    for (int i = 0; i < damage.count; i++)
+    {
+        const struct damage_rect *d = &damage.rect[i];
+        if (r.x1 < d->x2 && d->x1 < r.x2 && r.y1 < d->y2 && d->y1 < r.y2)
+            return true;
+    }
+    return false;
+}
+
+/* Send the damaged areas to the LCD and account for them in the stats */
+static void damage_update(struct screen *display)
+{
+    unsigned long area = 0;
+
+    if (damage.full)
+    {
+        display->update();
+        area = damage.width * damage.height;
+    }
+    else
+    {
+        for (int i = 0; i < damage.count; i++)
+        {
+            const struct damage_rect *d = &damage.rect[i];
+            display->update_rect(d->x1, d->y1, d->x2 - d->x1, d->y2 - d->y1);
+            area += (d->x2 - d->x1) * (d->y2 - d->y1);
+        }
+    }
+
+    if (TIME_AFTER(current_tick, render_stats.window_start + HZ))
+    {
+        render_stats.last.renders_per_sec = render_stats.renders;
+        render_stats.last.update_percent = render_stats.renders ?
+            render_stats.percent_updated / render_stats.renders : 0;
+        render_stats.window_start = current_tick;
+        render_stats.renders = 0;
+        render_stats.percent_updated = 0;
+    }
+    render_stats.renders++;
+    render_stats.percent_updated += area * 100 / (damage.width * damage.height);
+
+    render_stats.render_ticks += current_tick - render_stats.render_start;
+    if (++render_stats.timed_renders == RENDER_TIME_RENDERS)
+    {
+        render_stats.last.render_time_us = render_stats.render_ticks *
+            (1000000 / HZ) / RENDER_TIME_RENDERS;
+        render_stats.timed_renders = 0;
+        render_stats.render_ticks = 0;
+    }
+}
+
+void skin_render_get_stats(struct skin_render_stats *stats)
+{
+    *stats = render_stats.last;
+}
+
+/* Checksum of everything that decides what write_line() puts on screen */
+static uint32_t line_checksum(struct skin_draw_info *info)
+{
+    struct align_pos *align = &info->align;
+    struct line_desc *linedes = &info->line_desc;
+    struct viewport *vp = &info->skin_vp->vp;
+    const char *text[3] = { align->left, align->center, align->right };
+    uint32_t attr[] = {
+        info->line_number, vp->x, vp->y, vp->width, vp->font,
+        vp->fg_pattern, vp->bg_pattern,
+        linedes->height, linedes->nlines, linedes->line, linedes->style,
+        linedes->text_color, linedes->line_color, linedes->line_end_color,
+        linedes->separator_height,
+    };
+    uint32_t crc = crc_32(attr, sizeof(attr), 0xffffffff);
+
+    for (int i = 0; i < 3; i++)
+    {
+        const char *s = text[i] ? text[i] : "";
+        crc = crc_32(s, strlen(s) + 1, crc);
+    }
+    return crc;
+}
+
+/* The LINE the viewport is showing, the current one for an alternator */
+static struct line *get_line_data(struct skin_element *line)
+{
+    if (line->type == LINE_ALTERNATOR)
+    {
+        struct line_alternator *alternator = SKINOFFSETTOPTR(skin_buffer, line->data);
+        line = get_child(line->children, alternator->current_line);
+    }
+    return SKINOFFSETTOPTR(skin_buffer, line->data);
+}
+
 
 static bool do_non_text_tags(struct gui_wps *gwps, struct skin_draw_info *info,
                              struct skin_element *element)
@@ -194,7 +435,10 @@ static bool do_non_text_tags(struct gui_wps *gwps, struct skin_draw_info *info,
         case SKIN_TOKEN_PEAKMETER:
             data->peak_meter_enabled = true;
             if (do_refresh)
+            {
                 draw_peakmeters(gwps, info->line_number, &skin_vp->vp);
+                add_viewport_damage(&skin_vp->vp);
+            }
             break;
         case SKIN_TOKEN_DRAWRECTANGLE:
             if (do_refresh)
@@ -202,6 +446,7 @@ static bool do_non_text_tags(struct gui_wps *gwps, struct skin_draw_info *info,
                 struct draw_rectangle *rect =
                         SKINOFFSETTOPTR(skin_buffer, token->value.data);
                 if (!rect) break;
+                add_viewport_damage(&skin_vp->vp);
 #ifdef HAVE_LCD_COLOR
                 if (rect->start_colour != rect->end_colour &&
                     gwps->display->screen_type == SCREEN_MAIN)
@@ -237,14 +482,20 @@ static bool do_non_text_tags(struct gui_wps *gwps, struct skin_draw_info *info,
         {
             struct progressbar *bar = (struct progressbar*)SKINOFFSETTOPTR(skin_buffer, token->value.data);
             if (do_refresh)
+            {
                 draw_progressbar(gwps, info->skin_vp, info->line_number, bar);
+                add_viewport_damage(&skin_vp->vp);
+            }
         }
         break;
         case SKIN_TOKEN_IMAGE_DISPLAY:
         {
             struct gui_img *img = SKINOFFSETTOPTR(skin_buffer, token->value.data);
             if (img && img->loaded && do_refresh)
+            {
                 img->display = 0;
+                add_viewport_damage(&skin_vp->vp);
+            }
         }
         break;
         case SKIN_TOKEN_IMAGE_DISPLAY_LISTICON:
@@ -257,6 +508,7 @@ static bool do_non_text_tags(struct gui_wps *gwps, struct skin_draw_info *info,
             struct gui_img *img = skin_find_item(label,SKIN_FIND_IMAGE, data);
             if (img && img->loaded)
             {
+                add_viewport_damage(&skin_vp->vp);
                 if (SKINOFFSETTOPTR(skin_buffer, id->token) == NULL)
                 {
                     img->display = id->subimage;
@@ -280,6 +532,7 @@ static bool do_non_text_tags(struct gui_wps *gwps, struct skin_draw_info *info,
 
                     /* Clear the image, as in conditionals */
                     clear_image_pos(gwps, img);
+                    add_image_cleared(&skin_vp->vp, img);
 
                     /* If the token returned a value which is higher than
                      * the amount of subimages, don't draw it. */
@@ -307,19 +560,24 @@ static bool do_non_text_tags(struct gui_wps *gwps, struct skin_draw_info *info,
                 }
 #endif
                 aa->draw_handle = handle;
+                add_viewport_damage(&skin_vp->vp);
             }
             break;
         }
 #endif
         case SKIN_TOKEN_DRAW_INBUILTBAR:
+            add_viewport_damage(&skin_vp->vp);
             gui_statusbar_draw(&(statusbars.statusbars[gwps->display->screen_type]),
                                info->refresh_type == SKIN_REFRESH_ALL,
                                SKINOFFSETTOPTR(skin_buffer, token->value.data));
             break;
         case SKIN_TOKEN_VIEWPORT_CUSTOMLIST:
             if (do_refresh)
+            {
                 skin_render_playlistviewer(SKINOFFSETTOPTR(skin_buffer, token->value.data), gwps,
                                            info->skin_vp, info->refresh_type);
+                add_viewport_damage(&skin_vp->vp);
+            }
             break;
 #ifdef HAVE_SKIN_VARIABLES
         case SKIN_TOKEN_VAR_SET:
@@ -398,6 +656,7 @@ static void do_tags_in_hidden_conditional(struct skin_element* branch,
                 struct gui_img *img = skin_find_item(SKINOFFSETTOPTR(skin_buffer, id->label),
                                                      SKIN_FIND_IMAGE, data);
                 clear_image_pos(gwps, img);
+                add_image_cleared(&info->skin_vp->vp, img);
             }
             else if (token->type == SKIN_TOKEN_PEAKMETER)
             {
@@ -446,6 +705,7 @@ static void do_tags_in_hidden_conditional(struct skin_element* branch,
                                 gwps->display->clear_viewport();
                                 gwps->display->set_viewport_ex(&info->skin_vp->vp, VP_FLAG_VP_SET_CLEAN);
                             }
+                            add_viewport_cleared(&skin_viewport->vp);
                             skin_viewport->hidden_flags |= VP_DRAW_HIDDEN;
                         }
                     }
@@ -456,6 +716,7 @@ static void do_tags_in_hidden_conditional(struct skin_element* branch,
             {
                 draw_album_art(gwps,
                         playback_current_aa_hid(data->playback_aa_slot), true);
+                add_viewport_cleared(&info->skin_vp->vp);
             }
 #endif
         skip:
@@ -464,12 +725,12 @@ static void do_tags_in_hidden_conditional(struct skin_element* branch,
     }
 }
 
-static void fix_line_alignment(struct skin_draw_info *info, struct skin_element *element)
+static void fix_line_alignment(struct skin_draw_info *info, int type)
 {
     struct align_pos *align = &info->align;
     char *cur_pos = info->cur_align_start + strlen(info->cur_align_start);
     char *next_pos = cur_pos + 1;
-    switch (element->tag->type)
+    switch (type)
     {
         case SKIN_TOKEN_ALIGN_LEFT:
             align->left = next_pos;
@@ -504,117 +765,138 @@ static void fix_line_alignment(struct skin_draw_info *info, struct skin_element
     *next_pos = '\0';
 }
 
-/* Draw a LINE element onto the display */
-static bool skin_render_line(struct skin_element* line, struct skin_draw_info *info)
+static bool skin_render_code(struct skin_op *code, int start, int count,
+                             struct skin_draw_info *info);
+
+/* Run the conditional at op, followed by its BRANCH ops */
+static bool skin_render_conditional(struct skin_op *code, struct skin_op *op,
+                                    struct skin_draw_info *info)
 {
-    bool needs_update = false;
+    struct conditional *conditional = SKINOFFSETTOPTR(skin_buffer, op->data);
+    struct skin_op *branches = op + 1;
+    struct skin_op *branch;
+    int last_value = conditional->last_value;
+    int value = evaluate_conditional(info->gwps, info->offset,
+                                     conditional, op->count);
+    bool needs_update;
 
-    int last_value, value;
+    conditional->last_value = value;
+    if (op->count == 1)
+    {
+        /* special handling so
+         * %?aa<true> and %?<true|false> need special handlng here */
 
-    if (line->children_count == 0)
-        return false; /* empty line, do nothing */
+        if (value == -1) /* tag is false */
+        {
+            /* we are in a false branch of a %?aa<true> conditional */
+            if (last_value == 0)
+                do_tags_in_hidden_conditional(
+                        SKINOFFSETTOPTR(skin_buffer, branches[0].element), info);
+            return false;
+        }
+    }
+    else
+    {
+        if (last_value >= 0 && value != last_value && last_value < op->count)
+            do_tags_in_hidden_conditional(
+                    SKINOFFSETTOPTR(skin_buffer, branches[last_value].element), info);
+    }
 
-    struct skin_element *child = get_child(line->children, 0);
-    struct conditional *conditional;
-    skin_render_func func = skin_render_line;
-    int old_refresh_mode = info->refresh_type;
-    while (child)
+    if (value != last_value)
     {
-        switch (child->type)
-        {
-            case CONDITIONAL:
-                conditional = SKINOFFSETTOPTR(skin_buffer, child->data);
-                if (!conditional) break;
-                last_value = conditional->last_value;
-                value = evaluate_conditional(info->gwps, info->offset,
-                                             conditional, child->children_count);
-                conditional->last_value = value;
-                if (child->children_count == 1)
-                {
-                    /* special handling so
-                     * %?aa<true> and %?<true|false> need special handlng here */
+        info->refresh_type = SKIN_REFRESH_ALL;
+        info->force_redraw = true;
+    }
 
-                    if (value == -1) /* tag is false */
-                    {
-                        /* we are in a false branch of a %?aa<true> conditional */
-                        if (last_value == 0)
-                            do_tags_in_hidden_conditional(get_child(child->children, 0), info);
-                        break;
-                    }
-                }
-                else
-                {
-                    if (last_value >= 0 && value != last_value && last_value < child->children_count)
-                        do_tags_in_hidden_conditional(get_child(child->children, last_value), info);
-                }
-                if (get_child(child->children, value)->type == LINE_ALTERNATOR)
-                {
-                    func = skin_render_alternator;
-                }
-                else if (get_child(child->children, value)->type == LINE)
-                    func = skin_render_line;
+    branch = &branches[value];
+    if (branch->arg < 0)
+        needs_update = skin_render_alternator(
+                SKINOFFSETTOPTR(skin_buffer, branch->element), info);
+    else
+        needs_update = skin_render_code(code, branch->arg, branch->count, info);
 
-                if (value != last_value)
-                {
-                    info->refresh_type = SKIN_REFRESH_ALL;
-                    info->force_redraw = true;
-                }
+    return needs_update || (last_value != value);
+}
 
-                if (func(get_child(child->children, value), info))
-                    needs_update = true;
-                else
-                    needs_update = needs_update || (last_value != value);
+/* Run the compiled code of a line, see skin_compile.c */
+static bool skin_render_code(struct skin_op *code, int start, int count,
+                             struct skin_draw_info *info)
+{
+    bool needs_update = false;
+    int old_refresh_mode = info->refresh_type;
+    struct skin_op *op = &code[start];
+    struct skin_op *end = op + count;
 
+    while (op < end)
+    {
+        if (op->flags & SKIN_OP_NOBREAK)
+            info->no_line_break = true;
+        if (op->flags & SKIN_OP_SCROLLS)
+            info->line_scrolls = true;
+
+        switch (op->type)
+        {
+            case SKIN_OP_CONDITIONAL:
+                if (skin_render_conditional(code, op, info))
+                    needs_update = true;
                 info->refresh_type = old_refresh_mode;
+                op += op->count;
                 break;
-            case TAG:
-
-                if (child->tag->flags & NOBREAK)
-                    info->no_line_break = true;
-                if (child->tag->type == SKIN_TOKEN_SUBLINE_SCROLL)
-                    info->line_scrolls = true;
-
-                fix_line_alignment(info, child);
-
-                if (!SKINOFFSETTOPTR(skin_buffer, child->data))
-                {
+            case SKIN_OP_ALIGN:
+                fix_line_alignment(info, op->arg);
+                break;
+            case SKIN_OP_TAG:
+                if (do_non_text_tags(info->gwps, info,
+                                     SKINOFFSETTOPTR(skin_buffer, op->element)))
                     break;
-                }
-                if (!do_non_text_tags(info->gwps, info, child))
+                /* fall through */
+            case SKIN_OP_VALUE:
+            {
+                static char tempbuf[128];
+                const char *valuestr = get_token_value_family(info->gwps,
+                                                    SKINOFFSETTOPTR(skin_buffer, op->data),
+                                                    op->arg, info->offset, tempbuf,
+                                                    sizeof(tempbuf), NULL);
+                if (valuestr)
                 {
-                    static char tempbuf[128];
-                    const char *valuestr = get_token_value(info->gwps, SKINOFFSETTOPTR(skin_buffer, child->data),
-                                                        info->offset, tempbuf,
-                                                        sizeof(tempbuf), NULL);
-                    if (valuestr)
-                    {
 #if CONFIG_RTC
-                        if (child->tag->flags&SKIN_RTC_REFRESH)
-                            needs_update = needs_update || info->refresh_type&SKIN_REFRESH_DYNAMIC;
+                    if (op->refresh&SKIN_RTC_REFRESH)
+                        needs_update = needs_update || info->refresh_type&SKIN_REFRESH_DYNAMIC;
 #endif
-                        needs_update = needs_update ||
-                                ((child->tag->flags&info->refresh_type)!=0);
-                        strlcat(info->cur_align_start, valuestr,
-                                info->buf_size - (info->cur_align_start-info->buf));
-                    }
+                    needs_update = needs_update ||
+                            ((op->refresh&info->refresh_type)!=0);
+                    strlcat(info->cur_align_start, valuestr,
+                            info->buf_size - (info->cur_align_start-info->buf));
                 }
                 break;
-            case TEXT:
-                strlcat(info->cur_align_start, SKINOFFSETTOPTR(skin_buffer, child->data),
+            }
+            case SKIN_OP_TEXT:
+                strlcat(info->cur_align_start, SKINOFFSETTOPTR(skin_buffer, op->data),
                         info->buf_size - (info->cur_align_start-info->buf));
                 needs_update = needs_update ||
                                 (info->refresh_type&SKIN_REFRESH_STATIC) != 0;
                 break;
-            case COMMENT:
+            case SKIN_OP_FLAGS:
             default:
                 break;
         }
-
-        child = SKINOFFSETTOPTR(skin_buffer, child->next);
+        op++;
     }
     return needs_update;
 }
 
+/* Draw a LINE element onto the display */
+static bool skin_render_line(struct skin_element* line, struct skin_draw_info *info)
+{
+    struct line *data = SKINOFFSETTOPTR(skin_buffer, line->data);
+
+    if (!data || data->code_len == 0)
+        return false; /* empty line, do nothing */
+
+    return skin_render_code(SKINOFFSETTOPTR(skin_buffer, info->gwps->data->code),
+                            data->code, data->code_len, info);
+}
+
 static int get_subline_timeout(struct gui_wps *gwps, struct skin_element* line)
 {
     struct skin_element *element=line;
@@ -791,12 +1073,41 @@ void skin_render_viewport(struct skin_element* viewport, struct gui_wps *gwps,
         /* only update if the line needs to be, and there is something to write */
         if (refresh_type && (needs_update || update_all))
         {
-            if (info.force_redraw)
-                display->scroll_stop_viewport_rect(&skin_viewport->vp,
-                    0, info.line_number*display->getcharheight(),
-                    skin_viewport->vp.width, display->getcharheight());
-            write_line(display, align, info.line_number,
-                    info.line_scrolls, &info.line_desc);
+            struct viewport *vp = &skin_viewport->vp;
+            struct line *line_data = get_line_data(line);
+            int height = display->getcharheight();
+            int y = info.line_number*height;
+            uint32_t crc = line_checksum(&info);
+
+            /* a line showing the same text as last time can be left alone,
+             * unless something else has been drawn over it since */
+            if (line_data && crc == line_data->last_crc &&
+                !line_data->overdrawn && !skipped.off &&
+                (refresh_type&SKIN_REFRESH_ALL) != SKIN_REFRESH_ALL &&
+                !update_all && !info.force_redraw && !info.line_scrolls &&
+                skipped.count < MAX_SKIPPED_LINES &&
+                !is_damaged(vp->x, vp->y + y, vp->width, height))
+            {
+                struct damage_rect *r = &skipped.entry[skipped.count].rect;
+                r->x1 = vp->x;
+                r->y1 = vp->y + y;
+                r->x2 = vp->x + vp->width;
+                r->y2 = vp->y + y + height;
+                skipped.entry[skipped.count++].line = line_data;
+                render_stats.last.lines_skipped++;
+            }
+            else
+            {
+                if (info.force_redraw)
+                    display->scroll_stop_viewport_rect(vp,
+                        0, y, vp->width, height);
+                write_line(display, align, info.line_number,
+                        info.line_scrolls, &info.line_desc);
+                add_damage(vp->x, vp->y + y, vp->width, MIN(height, vp->height - y));
+                render_stats.last.lines_drawn++;
+                if (line_data)
+                    line_data->last_crc = crc;
+            }
         }
         if (!info.no_line_break)
             info.line_number++;
@@ -805,7 +1116,7 @@ void skin_render_viewport(struct skin_element* viewport, struct gui_wps *gwps,
     wps_display_images(gwps, &skin_viewport->vp);
 }
 
-void skin_render(struct gui_wps *gwps, unsigned refresh_mode)
+static void skin_render_pass(struct gui_wps *gwps, unsigned refresh_mode)
 {
     const int vp_is_appearing = (VP_DRAW_WASHIDDEN|VP_DRAW_HIDEABLE);
     struct wps_data *data = gwps->data;
@@ -884,6 +1195,7 @@ void skin_render(struct gui_wps *gwps, unsigned refresh_mode)
         if ((vp_refresh_mode&SKIN_REFRESH_ALL) == SKIN_REFRESH_ALL)
         {
             display->clear_viewport();
+            add_viewport_cleared(&skin_viewport->vp);
         }
         /* render */
         if (viewport->children_count)
@@ -904,7 +1216,27 @@ void skin_render(struct gui_wps *gwps, unsigned refresh_mode)
     }
     /* Restore the default viewport */
     display->set_viewport_ex(NULL, VP_FLAG_VP_SET_CLEAN);
-    display->update();
+}
+
+void skin_render(struct gui_wps *gwps, unsigned refresh_mode)
+{
+    struct screen *display = gwps->display;
+
+    damage_reset(display,
+                 (refresh_mode&SKIN_REFRESH_ALL) == SKIN_REFRESH_ALL);
+
+    skin_render_pass(gwps, refresh_mode);
+
+    /* Something cleared after a line was left alone wiped it, and its text
+     * is long gone by now, so draw it all again */
+    if (skipped.wiped)
+    {
+        skipped.off = true;
+        skipped.count = 0;
+        skin_render_pass(gwps, refresh_mode);
+    }
+
+    damage_update(display);
 }
 
 static __attribute__((noinline))
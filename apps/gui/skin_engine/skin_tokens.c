@@ -698,6 +698,18 @@ const char *get_token_value(struct gui_wps *gwps,
                            struct wps_token *token, int offset,
                            char *buf, int buf_size,
                            int *intval)
+{
+    if (!token)
+        return NULL;
+
+    return get_token_value_family(gwps, token, skin_token_family(token->type),
+                                  offset, buf, buf_size, intval);
+}
+
+const char *get_token_value_family(struct gui_wps *gwps,
+                                   struct wps_token *token,
+                                   enum skin_token_family family, int offset,
+                                   char *buf, int buf_size, int *intval)
 {
     int numeric_ret = -1;
     const char *numeric_buf = "?";
@@ -710,7 +722,7 @@ const char *get_token_value(struct gui_wps *gwps,
 
     struct wps_data *data = gwps->data;
     struct wps_state *state = get_wps_state();
-    struct mp3entry *id3; /* Think very carefully about using this.
+    struct mp3entry *id3 = NULL; /* Think very carefully about using this.
                              maybe get_id3_token() is the better place? */
     const char *out_text = NULL;
     char *filename = NULL;
@@ -718,7 +730,9 @@ const char *get_token_value(struct gui_wps *gwps,
     if (!data || !state)
         return NULL;
 
-    id3 = get_mp3entry_from_offset(token->next? 1: offset, &filename);
+    /* other than its own family only the replaygain token looks at it */
+    if (family == SKIN_TOKEN_FAMILY_ID3 || token->type == SKIN_TOKEN_REPLAYGAIN)
+        id3 = get_mp3entry_from_offset(token->next? 1: offset, &filename);
 
 #if CONFIG_RTC
     struct tm* tm = NULL;
@@ -742,21 +756,26 @@ const char *get_token_value(struct gui_wps *gwps,
         *intval = -1;
     }
 
-    if (id3 && id3 == state->id3 && id3->cuesheet )
+    if (family == SKIN_TOKEN_FAMILY_ID3)
     {
-        out_text = get_cuesheetid3_token(token, id3,
-                                         token->next?1:offset, buf, buf_size);
-        if (out_text)
-            return out_text;
+        if (id3 && id3 == state->id3 && id3->cuesheet )
+        {
+            out_text = get_cuesheetid3_token(token, id3,
+                                             token->next?1:offset, buf, buf_size);
+            if (out_text)
+                return out_text;
+        }
+        return get_id3_token(token, id3, filename, buf, buf_size, limit, intval);
     }
-    out_text = get_id3_token(token, id3, filename, buf, buf_size, limit, intval);
-    if (out_text)
-        return out_text;
+
+    if (family == SKIN_TOKEN_FAMILY_RADIO)
+    {
 #if CONFIG_TUNER
-    out_text = get_radio_token(token, offset, buf, buf_size, limit, intval);
-    if (out_text)
-        return out_text;
+        return get_radio_token(token, offset, buf, buf_size, limit, intval);
+#else
+        return NULL;
 #endif
+    }
 
     switch (token->type)
     {
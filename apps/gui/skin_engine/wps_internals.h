@@ -37,6 +37,7 @@ struct skin_stats {
     size_t buflib_handles;
     size_t tree_size;
     size_t images_size;
+    size_t code_ops;
 };
 
 int skin_get_num_skins(void);
@@ -281,6 +282,56 @@ struct skin_albumart {
 
 struct line {
     unsigned update_mode;
+    uint32_t last_crc; /* checksum of the text and style last drawn */
+    bool overdrawn;    /* was cleared by a later draw while left alone */
+    int code;          /* first op of the line in wps_data.code */
+    int code_len;
+};
+
+/* Skins are compiled to a flat array of these once they are loaded
+ * (skin_compile.c) and skin_render.c runs them on every refresh */
+enum skin_op_type {
+    SKIN_OP_TEXT,        /* append the text in data */
+    SKIN_OP_VALUE,       /* append the value of the token in data, arg is
+                            its skin_token_family */
+    SKIN_OP_TAG,         /* token in data may draw, else append its value,
+                            arg is its skin_token_family */
+    SKIN_OP_ALIGN,       /* change alignment, arg is the token type */
+    SKIN_OP_FLAGS,       /* tag which only sets the op flags */
+    SKIN_OP_CONDITIONAL, /* data is the conditional, count BRANCH ops follow */
+    SKIN_OP_BRANCH,      /* arg is the first op of the LINE, count its length,
+                            arg is -1 for a LINE_ALTERNATOR */
+};
+
+#define SKIN_OP_NOBREAK 0x01 /* the line doesn't advance the line number */
+#define SKIN_OP_SCROLLS 0x02 /* the line scrolls */
+
+/* Which part of get_token_value() has the value of a token */
+enum skin_token_family {
+    SKIN_TOKEN_FAMILY_OTHER,
+    SKIN_TOKEN_FAMILY_ID3,   /* get_id3_token(), also the cuesheet and file */
+    SKIN_TOKEN_FAMILY_RADIO, /* get_radio_token() */
+};
+
+static inline enum skin_token_family skin_token_family(enum skin_token_type type)
+{
+    if ((type >= SKIN_TOKEN_DATABASE_PLAYCOUNT && type <= SKIN_TOKEN_FILE_DIRECTORY) ||
+        (type >= SKIN_TOKEN_METADATA_ARTIST && type <= SKIN_TOKEN_METADATA_COMMENT) ||
+        (type >= SKIN_TOKEN_TRACK_ELAPSED_PERCENT && type <= SKIN_TOKEN_TRACK_ENDING))
+        return SKIN_TOKEN_FAMILY_ID3;
+    if (type >= SKIN_TOKEN_TUNER_TUNED && type <= SKIN_TOKEN_RDS_TEXT)
+        return SKIN_TOKEN_FAMILY_RADIO;
+    return SKIN_TOKEN_FAMILY_OTHER;
+}
+
+struct skin_op {
+    unsigned char type;
+    unsigned char flags;
+    unsigned short count;
+    int arg;
+    unsigned refresh; /* tag flags of TAG and VALUE ops */
+    OFFSETTYPE(void*) data;
+    OFFSETTYPE(struct skin_element*) element;
 };
 
 struct line_alternator {
@@ -356,6 +407,7 @@ struct wps_data
     int buflib_handle;
 
     OFFSETTYPE(struct skin_element *) tree;
+    OFFSETTYPE(struct skin_op *) code;
     OFFSETTYPE(struct skin_token_list *) images;
     OFFSETTYPE(int *) font_ids;
     int font_count;
@@ -418,6 +470,11 @@ const char *get_token_value(struct gui_wps *gwps,
                            struct wps_token *token, int offset,
                            char *buf, int buf_size,
                            int *intval);
+/* get_token_value() for a token whose family is already known */
+const char *get_token_value_family(struct gui_wps *gwps,
+                                   struct wps_token *token,
+                                   enum skin_token_family family, int offset,
+                                   char *buf, int buf_size, int *intval);
 
 /* Get the id3 fields from the cuesheet */
 const char *get_cuesheetid3_token(struct wps_token *token, struct mp3entry *id3,
@@ -443,6 +500,12 @@ enum skin_find_what {
 void *skin_find_item(const char *label, enum skin_find_what what,
                      struct wps_data *data);
 
+/***** skin_compile.c ******/
+
+/* Compile the parsed skin in buffer into data->code. Returns the number
+   of ops, or -1 if they don't fit in the skin buffer */
+int skin_compile(char *buffer, struct wps_data *data);
+
 #if defined(SIMULATOR) || defined(CHECKWPS)
 #define DEBUG_SKIN_ENGINE
 extern bool debug_wps;
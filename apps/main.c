@@ -278,17 +278,23 @@ static int INIT_ATTR init_dircache(bool preinit)
 
     int result = -1;
 
+#ifdef DIRCACHE_PERSIST
 #ifdef HAVE_EEPROM_SETTINGS
     if (firmware_settings.initialized &&
         firmware_settings.disk_clean &&
         preinit)
+#else
+    if (preinit)
+#endif
     {
         result = dircache_load();
+    #ifdef HAVE_EEPROM_SETTINGS
         if (result < 0)
             firmware_settings.disk_clean = false;
+    #endif
     }
     else
-#endif /* HAVE_EEPROM_SETTINGS */
+#endif /* DIRCACHE_PERSIST */
     if (!preinit)
     {
         result = dircache_enable();
@@ -320,10 +320,10 @@ bool settings_parseline(char* line, char** name, char** value)
     return true;
 }
 
-static void system_flush(void)
+static void system_flush(bool shutdown)
 {
     playlist_shutdown();
-    tree_flush();
+    tree_flush(shutdown);
     open_plugin_cache_flush();
     call_storage_idle_notifys(true); /*doesnt work on usb and shutdown from ata thread */
 }
@@ -417,7 +417,10 @@ static bool clean_shutdown(enum shutdown_type sd_type,
             audio_close_recording();
 #endif
 
-            system_flush();
+            system_flush(true);
+#ifdef DIRCACHE_PERSIST
+            tree_save_dircache();
+#endif
 #ifdef HAVE_EEPROM_SETTINGS
             if (firmware_settings.initialized)
             {
@@ -647,7 +650,7 @@ long default_event_handler_ex(long event, void (*callback)(void *), void *parame
             if (callback != NULL)
                 callback(parameter);
             {
-                system_flush();
+                system_flush(false);
 #ifdef BOOTFILE
 #if !defined(USB_NONE) && !defined(USB_HANDLED_BY_OF)
                 check_bootfile(false); /* gets initial size */
@@ -701,7 +704,7 @@ long default_event_handler_ex(long event, void (*callback)(void *), void *parame
                 if (storage_removable(i) && !storage_present(i))
                     return SYS_FS_CHANGED;
             }
-            system_flush();
+            system_flush(false);
             check_bootfile(true); /* state gotten in main.c:init() */
             system_restore();
         }
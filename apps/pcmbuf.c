@@ -64,6 +64,14 @@
    draining between inserts and observe low-latency mode) */
 #define PCMBUF_MAX_BUFFER    (PCMBUF_CHUNK_SIZE * 4)
 
+/* Low-latency mode commits each write as its own chunk of at most
+   LOW_LATENCY_SIZE bytes (a quarter tick) and keeps no more than
+   LOW_LATENCY_CHUNKS of them queued ahead of playback, under 10ms in all.
+   The PCM callback wakes the codec as each chunk is freed so it doesn't
+   have to wait for the next tick to refill */
+#define LOW_LATENCY_SIZE     ALIGN_DOWN(BYTERATE / (HZ*4), PCMBUF_SAMPLE_SIZE)
+#define LOW_LATENCY_CHUNKS   3
+
 /* Forced buffer insert constraint can thus be from 1KB to 32KB using 8KB
    chunks */
 
@@ -110,6 +118,12 @@ static unsigned int pcmbuf_desc_count;
 static unsigned int position_key = 1;
 static unsigned int pcmbuf_sampr = 0;
 
+/* The committed chunks form a single-producer/single-consumer ring: only
+   the PCM callback advances chunk_ridx and only the codec side advances
+   chunk_widx. Each side publishes its index once it is done with the chunk
+   contents and reads the other's before touching them, so the handoff needs
+   no locking. Moving chunk_widx backwards (snipping the tail) still happens
+   under PCM lockout. */
 static size_t chunk_ridx;
 static size_t chunk_widx;
 
@@ -120,6 +134,7 @@ static size_t chunk_transidx;
 static size_t pcmbuf_watermark = 0;
 
 static bool low_latency_mode = false;
+static struct semaphore low_latency_sema;
 
 static bool pcmbuf_sync_position = false;
 
@@ -204,6 +219,34 @@ extern void audio_pcmbuf_sync_position(void);
 
 /**************************************/
 
+#if (CONFIG_PLATFORM & PLATFORM_HOSTED)
+/* The PCM callback runs on its own thread, possibly on another core */
+static FORCE_INLINE size_t ring_index_load(const size_t *indexp)
+{
+    return __atomic_load_n(indexp, __ATOMIC_ACQUIRE);
+}
+
+static FORCE_INLINE void ring_index_store(size_t *indexp, size_t index)
+{
+    __atomic_store_n(indexp, index, __ATOMIC_RELEASE);
+}
+#else
+/* The PCM callback interrupts the writer on the same core so only the
+   compiler can reorder the accesses */
+static FORCE_INLINE size_t ring_index_load(const size_t *indexp)
+{
+    size_t index = *(const volatile size_t *)indexp;
+    asm volatile ("" : : : "memory");
+    return index;
+}
+
+static FORCE_INLINE void ring_index_store(size_t *indexp, size_t index)
+{
+    asm volatile ("" : : : "memory");
+    *(volatile size_t *)indexp = index;
+}
+#endif /* CONFIG_PLATFORM */
+
 /* start PCM if callback says it's alright */
 static void start_audio_playback(void)
 {
@@ -215,8 +258,8 @@ static void start_audio_playback(void)
    a full chunk even if only partially filled) */
 static size_t pcmbuf_unplayed_bytes(void)
 {
-    size_t ridx = chunk_ridx;
-    size_t widx = chunk_widx;
+    size_t ridx = ring_index_load(&chunk_ridx);
+    size_t widx = ring_index_load(&chunk_widx);
 
     if (ridx > widx)
         widx += pcmbuf_size;
@@ -283,8 +326,8 @@ static bool index_committed(size_t index)
     if (index == INVALID_BUF_INDEX)
         return false;
 
-    size_t ridx = chunk_ridx;
-    size_t widx = chunk_widx;
+    size_t ridx = ring_index_load(&chunk_ridx);
+    size_t widx = ring_index_load(&chunk_widx);
 
     if (widx < ridx)
     {
@@ -309,7 +352,7 @@ void snip_buffer_tail(size_t index, int offset)
     if (!index_committed(index) && index != chunk_widx)
         return;
 
-    chunk_widx = index;
+    ring_index_store(&chunk_widx, index);
     pcmbuf_bytes_waiting = 0;
     index_chunkdesc(index)->pos_key = 0;
 
@@ -349,7 +392,8 @@ static void commit_chunks(size_t threshold)
 
         /* Advance the current write chunk and make it available to the
            PCM callback */
-        chunk_widx = index = index_next(index);
+        index = index_next(index);
+        ring_index_store(&chunk_widx, index);
         desc = index_chunkdesc(index);
 
         /* Reset it before using it */
@@ -480,9 +524,11 @@ void * pcmbuf_request_buffer(int *count)
     {
         if (low_latency_mode)
         {
-            /* 1/4s latency. */
-            if (remaining > DATA_LEVEL(1))
+            /* Every chunk holds at most LOW_LATENCY_SIZE */
+            if (remaining >= LOW_LATENCY_CHUNKS*PCMBUF_CHUNK_SIZE)
                 return NULL;
+
+            size = MIN(size, LOW_LATENCY_SIZE);
         }
 
         /* Boost CPU if necessary */
@@ -508,14 +554,14 @@ void * pcmbuf_request_buffer(int *count)
 #ifdef HAVE_CROSSFADE
     if (crossfade_status != CROSSFADE_INACTIVE)
     {
-        crossfade_bufidx = index_chunk_offs(chunk_ridx, -1);
+        crossfade_bufidx = index_chunk_offs(ring_index_load(&chunk_ridx), -1);
         buf = index_buffer(crossfade_bufidx); /* always CROSSFADE_BUFSIZE */
     }
     else
 #endif
     {
         /* Give the maximum amount available if there's more */
-        if (size + PCMBUF_CHUNK_SIZE < freespace)
+        if (size + PCMBUF_CHUNK_SIZE < freespace && !low_latency_mode)
             size = freespace - PCMBUF_CHUNK_SIZE;
 
         buf = get_write_buffer(&size);
@@ -539,7 +585,17 @@ void pcmbuf_write_complete(int count, unsigned long elapsed, off_t offset)
 #endif
     {
         stamp_chunk(index_chunkdesc(chunk_widx), elapsed, offset);
-        commit_write_buffer(size);
+
+        if (low_latency_mode)
+        {
+            /* Hand it to the callback right away */
+            pcmbuf_bytes_waiting += size;
+            commit_if_needed(COMMIT_ALL_DATA);
+        }
+        else
+        {
+            commit_write_buffer(size);
+        }
     }
 
     /* Revert to position updates by PCM */
@@ -614,6 +670,8 @@ size_t pcmbuf_init(void *bufend)
 
     init_buffer_state();
 
+    semaphore_init(&low_latency_sema, 1, 0);
+
     pcmbuf_soft_mode(false);
 
     return bufend - bufstart;
@@ -795,6 +853,7 @@ static void pcmbuf_pcm_callback(const void **start, size_t *size)
 {
     /*- Process the chunk that just finished -*/
     size_t index = chunk_ridx;
+    size_t widx = ring_index_load(&chunk_widx);
     struct chunkdesc *desc = current_desc;
 
     if (desc)
@@ -807,11 +866,16 @@ static void pcmbuf_pcm_callback(const void **start, size_t *size)
         }
 
         /* Free it for reuse */
-        chunk_ridx = index = index_next(index);
+        index = index_next(index);
+        ring_index_store(&chunk_ridx, index);
+
+        /* Let the codec refill it now rather than on the next tick */
+        if (low_latency_mode)
+            semaphore_release(&low_latency_sema);
     }
 
     /*- Process the new one -*/
-    if (index != chunk_widx && !fade_out_complete)
+    if (index != widx && !fade_out_complete)
     {
         current_desc = desc = index_chunkdesc(index);
 
@@ -1429,6 +1493,17 @@ void pcmbuf_set_low_latency(bool state)
     low_latency_mode = state;
 }
 
+bool pcmbuf_get_low_latency(void)
+{
+    return low_latency_mode;
+}
+
+/* Wait for playback to free a chunk, at most one tick */
+void pcmbuf_wait_low_latency(void)
+{
+    semaphore_wait(&low_latency_sema, 1);
+}
+
 void pcmbuf_update_frequency(void)
 {
     pcmbuf_sampr = mixer_get_frequency();
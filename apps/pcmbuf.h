@@ -80,6 +80,8 @@ void pcmbuf_sync_position_update(void);
 /* Misc */
 bool pcmbuf_is_lowdata(void);
 void pcmbuf_set_low_latency(bool state);
+bool pcmbuf_get_low_latency(void);
+void pcmbuf_wait_low_latency(void);
 void pcmbuf_update_frequency(void);
 unsigned int pcmbuf_get_frequency(void);
 
@@ -488,6 +488,16 @@ static bool loop_track(void)
     return false;
 }
 
+/* No seek index; the codecs fall back to their own seeking. */
+static bool seek_index_find(uint64_t sample, struct seek_point *before,
+                            struct seek_point *after)
+{
+    (void)sample;
+    (void)before;
+    (void)after;
+    return false;
+}
+
 static void set_offset(size_t value)
 {
     ci.id3->offset = value;
@@ -547,6 +557,7 @@ static void init_ci(void)
     ci.configure = configure;
     ci.get_command = get_command;
     ci.loop_track = loop_track;
+    ci.seek_index_find = seek_index_find;
 
     /* --- "Core" functions --- */
 
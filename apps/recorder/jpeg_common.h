@@ -31,7 +31,13 @@
 #include "bmp.h"
 
 #define HUFF_LOOKAHEAD 8 /* # of bits of lookahead */
+/* Compressed data is read from the file in chunks of this size. Every read()
+ * goes through the whole file layer, so keep it large where memory allows */
+#if MEMORYSIZE > 2
+#define JPEG_READ_BUF_SIZE 4096
+#else
 #define JPEG_READ_BUF_SIZE 16
+#endif
 struct derived_tbl
 {
     /* Basic tables: (element [0] of each array is unused) */
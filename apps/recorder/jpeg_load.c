@@ -79,6 +79,7 @@ struct jpeg
     int fd;
     int buf_left;
     int buf_index;
+    unsigned char buf[JPEG_READ_BUF_SIZE];
 #endif
     unsigned long len;
     unsigned long int bitbuf;
@@ -127,7 +128,6 @@ struct jpeg
     int subsample_x[3]; /* info per component */
     int subsample_y[3];
     bool resize;
-    unsigned char buf[JPEG_READ_BUF_SIZE];
     struct img_part part;
 };
 
@@ -0,0 +1,452 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * Copyright (C) 2026 The Rockbox Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+
+/* Persistent seek index for formats that have no usable seek table of their
+ * own, i.e. VBR MPEG audio (the Xing TOC only has 100 entries) and FLAC
+ * files without a SEEKTABLE block.
+ *
+ * The frames of a file are scanned once and every frame that starts a new
+ * SEEK_INDEX_INTERVAL block of samples is written to a small file in
+ * SEEK_INDEX_DIR, named after the CRC of the path. The file's size and
+ * modification time are stored with it so that an edited file gets its
+ * index rebuilt. Lookups binary search the index file directly, so no
+ * memory is held between seeks.
+ *
+ * Scanning a whole file takes a while, so indexes are built by a background
+ * thread. Until a file's index is ready, lookups fail and the codecs seek
+ * with their own estimates as they would without an index.
+ */
+
+#include <stdio.h>
+#include "config.h"
+#include "system.h"
+#include "kernel.h"
+#include "thread.h"
+#include "usb.h"
+#include "file.h"
+#include "dir.h"
+#include "pathfuncs.h"
+#include "string-extra.h"
+#include "crc32.h"
+#include "misc.h"
+#include "metadata.h"
+#include "mp3data.h"
+#include "seekindex.h"
+
+/* Define LOGF_ENABLE to enable logf output in this file */
+/*#define LOGF_ENABLE*/
+#include "logf.h"
+
+#define SEEK_INDEX_MAGIC    0x52425831 /* RBX1 */
+
+/* Samples between indexed frames, a power of two; the codec decodes and
+   drops up to this many samples after seeking to a point */
+#define SEEK_INDEX_INTERVAL 16384
+
+/* Points collected before they are written out */
+#define SEEK_INDEX_BATCH    128
+
+struct seek_index_header
+{
+    uint32_t magic;
+    uint32_t filesize;   /* size of the audio file */
+    uint32_t mtime;      /* modification time of the audio file */
+    uint32_t count;      /* number of points following the header */
+    char path[MAX_PATH]; /* audio file, in case two paths share a CRC */
+};
+
+/* A file waiting for its index or having it built */
+struct seek_index_job
+{
+    char path[MAX_PATH];
+    unsigned int codectype;
+    unsigned long first_frame_offset;
+    unsigned long filesize;
+};
+
+enum
+{
+    SEEK_INDEX_BUILD = 1,
+};
+
+static struct event_queue seekindex_queue SHAREDBSS_ATTR;
+static long seekindex_stack[(DEFAULT_STACK_SIZE + 0x800)/sizeof(long)];
+static const char seekindex_thread_name[] = "seekindex";
+static bool seekindex_thread_started = false;
+
+/* The last file an index was requested for. A failed build is not retried
+   until another file asks for one. */
+static struct seek_index_job request;
+
+/* Size and modification time of the last file looked up, so that seeking
+   around in a track doesn't read its directory every time. The audio size
+   and offset from its metadata tell a replaced file apart. */
+static struct
+{
+    struct seek_index_job job;
+    uint32_t filesize;
+    uint32_t mtime;
+} stamp_cache;
+
+static struct
+{
+    int fd;
+    uint64_t next;       /* first sample of the next interval */
+    unsigned int count;
+    unsigned int batched;
+    bool error;
+    struct seek_point batch[SEEK_INDEX_BATCH];
+} build;
+
+/* Big enough for buf_seek() to skip the largest MPEG frame */
+static unsigned char scan_buf[4096];
+
+static bool flush_points(void)
+{
+    size_t size = build.batched * sizeof (struct seek_point);
+
+    if (build.batched && write(build.fd, build.batch, size) != (ssize_t)size)
+        build.error = true;
+
+    build.batched = 0;
+    return !build.error;
+}
+
+static bool add_frame(void *data, uint64_t sample, unsigned long offset)
+{
+    (void)data;
+
+    if (sample < build.next)
+        return true;
+
+    /* Give up if there's a new request or USB wants the disk */
+    if (!queue_empty(&seekindex_queue))
+    {
+        build.error = true;
+        return false;
+    }
+
+    build.batch[build.batched].sample = sample;
+    build.batch[build.batched].offset = offset;
+    build.count++;
+    build.next = (sample & ~(uint64_t)(SEEK_INDEX_INTERVAL - 1)) +
+                 SEEK_INDEX_INTERVAL;
+
+    if (++build.batched >= SEEK_INDEX_BATCH)
+    {
+        yield();
+        return flush_points();
+    }
+
+    return true;
+}
+
+/* Get the size and modification time of a file from its directory entry */
+static bool get_file_stamp(const struct seek_index_job *job,
+                           struct seek_index_header *hdr)
+{
+    const char *path = job->path;
+    char dirpath[MAX_PATH];
+    const char *name;
+    size_t len = path_dirname(path, &name);
+    bool found = false;
+
+    if (stamp_cache.job.filesize == job->filesize &&
+        stamp_cache.job.first_frame_offset == job->first_frame_offset &&
+        !strcmp(stamp_cache.job.path, path))
+    {
+        hdr->filesize = stamp_cache.filesize;
+        hdr->mtime = stamp_cache.mtime;
+        return true;
+    }
+
+    if (len == 0 || len >= sizeof (dirpath))
+        return false;
+
+    strmemccpy(dirpath, name, len + 1);
+    path_basename(path, &name);
+
+    DIR *dir = opendir(dirpath);
+    if (!dir)
+        return false;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)))
+    {
+        if (!strcmp(entry->d_name, name))
+        {
+            struct dirinfo info = dir_get_info(dir, entry);
+            hdr->filesize = info.size;
+            hdr->mtime = info.mtime;
+            found = true;
+            break;
+        }
+    }
+
+    closedir(dir);
+
+    if (found)
+    {
+        stamp_cache.job = *job;
+        stamp_cache.filesize = hdr->filesize;
+        stamp_cache.mtime = hdr->mtime;
+    }
+
+    return found;
+}
+
+/* Scan the audio file and write a fresh index to fd */
+static bool build_index(int fd, const struct seek_index_job *job,
+                        struct seek_index_header *hdr)
+{
+    int audio_fd = open(job->path, O_RDONLY);
+    int frames = -1;
+
+    if (audio_fd < 0)
+        return false;
+
+    logf("building seek index for %s", job->path);
+
+    build.fd = fd;
+    build.next = 0;
+    build.count = 0;
+    build.batched = 0;
+    build.error = false;
+
+    /* Header goes in last, so an interrupted build is never trusted */
+    hdr->magic = 0;
+    hdr->count = 0;
+    if (write(fd, hdr, sizeof (*hdr)) == sizeof (*hdr))
+    {
+        switch (job->codectype)
+        {
+        case AFMT_MPA_L1:
+        case AFMT_MPA_L2:
+        case AFMT_MPA_L3:
+            frames = scan_mp3_frames(audio_fd, job->first_frame_offset,
+                                     job->first_frame_offset + job->filesize,
+                                     add_frame, NULL,
+                                     scan_buf, sizeof (scan_buf));
+            break;
+        case AFMT_FLAC:
+            frames = scan_flac_frames(audio_fd, job->first_frame_offset,
+                                      add_frame, NULL,
+                                      scan_buf, sizeof (scan_buf));
+            break;
+        }
+    }
+
+    close(audio_fd);
+
+    if (frames <= 0 || !flush_points())
+        return false;
+
+    logf("%d frames, %u points", frames, build.count);
+
+    hdr->magic = SEEK_INDEX_MAGIC;
+    hdr->count = build.count;
+
+    return lseek(fd, 0, SEEK_SET) == 0 &&
+           write(fd, hdr, sizeof (*hdr)) == sizeof (*hdr);
+}
+
+/* Get the current stamp of an audio file and the name of its index */
+static bool get_index_stamp(const struct seek_index_job *job,
+                            struct seek_index_header *stamp,
+                            char *idxpath, size_t idxsize)
+{
+    uint32_t crc = crc_32(job->path, strlen(job->path), 0xffffffff);
+
+    memset(stamp, 0, sizeof (*stamp));
+    if (!get_file_stamp(job, stamp))
+        return false;
+
+    strmemccpy(stamp->path, job->path, sizeof (stamp->path));
+    snprintf(idxpath, idxsize, SEEK_INDEX_DIR "/%08lX.idx", (unsigned long)crc);
+    return true;
+}
+
+/* Open the index of a file if it is complete and up to date */
+static int open_index(const struct seek_index_job *job,
+                      struct seek_index_header *hdr)
+{
+    struct seek_index_header stamp;
+    char idxpath[MAX_PATH];
+
+    if (!get_index_stamp(job, &stamp, idxpath, sizeof (idxpath)))
+        return -1;
+
+    int fd = open(idxpath, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    if (read(fd, hdr, sizeof (*hdr)) == sizeof (*hdr) &&
+        hdr->magic == SEEK_INDEX_MAGIC &&
+        hdr->filesize == stamp.filesize &&
+        hdr->mtime == stamp.mtime &&
+        !strcmp(hdr->path, stamp.path))
+        return fd;
+
+    close(fd);
+    return -1;
+}
+
+/* Build the index of a job unless an earlier request already did */
+static void run_job(const struct seek_index_job *job)
+{
+    struct seek_index_header hdr;
+    char idxpath[MAX_PATH];
+    int fd = open_index(job, &hdr);
+
+    if (fd >= 0)
+    {
+        close(fd);
+        return;
+    }
+
+    if (!get_index_stamp(job, &hdr, idxpath, sizeof (idxpath)))
+        return;
+
+    if (!dir_exists(SEEK_INDEX_DIR))
+        mkdir(SEEK_INDEX_DIR);
+
+    fd = open(idxpath, O_RDWR|O_CREAT|O_TRUNC, 0666);
+    if (fd < 0)
+        return;
+
+    trigger_cpu_boost();
+    bool ok = build_index(fd, job, &hdr);
+    cancel_cpu_boost();
+
+    close(fd);
+    if (!ok)
+    {
+        logf("seek index build failed");
+        remove(idxpath);
+    }
+}
+
+static void seekindex_thread(void)
+{
+    struct queue_event ev;
+    struct seek_index_job job;
+
+    while (1)
+    {
+        queue_wait(&seekindex_queue, &ev);
+
+        switch (ev.id)
+        {
+            case SEEK_INDEX_BUILD:
+                /* The request may change again while this one runs */
+                job = request;
+                run_job(&job);
+                break;
+
+            case SYS_USB_CONNECTED:
+                usb_acknowledge(SYS_USB_CONNECTED_ACK);
+                usb_wait_for_disconnect(&seekindex_queue);
+                /* Files may have changed, look at everything again */
+                request.path[0] = '\0';
+                stamp_cache.job.path[0] = '\0';
+                break;
+        }
+    }
+}
+
+/* Have the index of a file built in the background */
+static void request_index(const struct seek_index_job *job)
+{
+    if (!strcmp(request.path, job->path))
+        return;
+
+    request = *job;
+
+    if (!seekindex_thread_started)
+    {
+        seekindex_thread_started = true;
+        queue_init(&seekindex_queue, true);
+        create_thread(seekindex_thread, seekindex_stack,
+                      sizeof (seekindex_stack), 0, seekindex_thread_name
+                      IF_PRIO(, PRIORITY_BACKGROUND) IF_COP(, CPU));
+    }
+
+    queue_post(&seekindex_queue, SEEK_INDEX_BUILD, 0);
+}
+
+static bool read_point(int fd, unsigned int i, struct seek_point *point)
+{
+    off_t pos = sizeof (struct seek_index_header) +
+                (off_t)i * sizeof (struct seek_point);
+
+    return lseek(fd, pos, SEEK_SET) == pos &&
+           read(fd, point, sizeof (*point)) == sizeof (*point);
+}
+
+/* Find the last indexed frame starting at or before sample, and the one
+   after it */
+bool seek_index_find(const struct mp3entry *id3, uint64_t sample,
+                     struct seek_point *before, struct seek_point *after)
+{
+    static struct seek_index_job job; /* spare the codec's stack */
+    struct seek_index_header hdr;
+    struct seek_point point;
+    bool ok = false;
+
+    strmemccpy(job.path, id3->path, sizeof (job.path));
+    job.codectype = id3->codectype;
+    job.first_frame_offset = id3->first_frame_offset;
+    job.filesize = id3->filesize;
+
+    int fd = open_index(&job, &hdr);
+    if (fd < 0)
+    {
+        request_index(&job);
+        return false;
+    }
+
+    unsigned int lo = 0, hi = hdr.count;
+
+    /* The first point is always the first frame, at sample 0 */
+    while (hi - lo > 1)
+    {
+        unsigned int mid = lo + (hi - lo) / 2;
+
+        if (!read_point(fd, mid, &point))
+            goto out;
+
+        if (point.sample <= sample)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    if (!read_point(fd, lo, before))
+        goto out;
+
+    if (hi >= hdr.count || !read_point(fd, hi, after))
+        after->sample = after->offset = 0;
+
+    ok = true;
+out:
+    close(fd);
+    return ok;
+}
@@ -87,6 +87,12 @@
 #include "debug.h"
 #include "dircache.h"
 #include "errno.h"
+#ifdef TAGCACHE_SORTIDX_MMAP
+#include <sys/mman.h>
+#endif
+#ifdef TAGCACHE_SCAN_THREADS
+#include <pthread.h>
+#endif
 
 #ifndef __PCTOOL__
 #include "lang.h"
@@ -136,6 +142,14 @@
 /* Idle time before committing events in the command queue. */
 #define TAGCACHE_COMMAND_QUEUE_COMMIT_DELAY  HZ*2
 
+/* Largest update appended to the sorted tags without resorting them. */
+#define TAGCACHE_DELTA_COMMIT_MAX 1000
+
+/* Resort with the next commit once the appended entries would exceed 1/n
+ * of the sorted ones. There is no separate merge, the unsorted tail never
+ * grows past that. */
+#define TAGCACHE_DELTA_MERGE_RATIO 8
+
 /* Dont commit database_tmp data. */
 #define TAGCACHE_FILE_NOCOMMIT  "database_commit.ignore"
 
@@ -148,6 +162,15 @@
 /* The main database string data. */
 #define TAGCACHE_FILE_INDEX      "database_%d.tcd"
 
+/* Sorted index (string -> master index postings) of a sorted tag. */
+#define TAGCACHE_FILE_SORTIDX    "database_sort_%d.tcd"
+
+/* Unsorted data appended to the sorted tags since the last full commit. */
+#define TAGCACHE_FILE_DELTA      "database_delta.tcd"
+
+/* Word index (word -> tag file postings) of a tag searchable by words. */
+#define TAGCACHE_FILE_WORDIDX    "database_words_%d.tcd"
+
 /* ASCII dumpfile of the DB contents. */
 #define TAGCACHE_FILE_CHANGELOG  "database_changelog.txt"
 
@@ -206,6 +229,11 @@ static int tempbuf_handle;
     (1LU << tag_albumartist) | (1LU << tag_grouping) | \
     (1LU << tag_virt_canonicalartist))
 
+/* Tags getting a word index for tagcache_search_words(). */
+#define TAGCACHE_WORD_TAGS ((1LU << tag_artist) | (1LU << tag_album) | \
+    (1LU << tag_title))
+#define TAGCACHE_HAS_WORDIDX(tag) (BIT_N(tag) & TAGCACHE_WORD_TAGS)
+
 /* String presentation of the tags defined in tagcache.h. Must be in correct order! */
 static const char * const tags_str[] = { "artist", "album", "genre", "title",
     "filename", "composer", "comment", "albumartist", "grouping", "year",
@@ -234,6 +262,7 @@ static const char * const tag_type_str[] = {
     [clause_oneof] = "clause_oneof",
     [clause_begins_oneof] = "clause_begins_oneof",
     [clause_ends_oneof] = "clause_ends_oneof",
+    [clause_words] = "clause_words",
     [clause_logical_or] = "clause_logical_or"
  };
 #define logf_clauses logf
@@ -300,6 +329,50 @@ struct master_header {
 
 static struct master_header current_tcmh;
 
+/* Sorted index files follow the order of the sorted tag file they refer to;
+ * each string entry points to a run of postings (ascending idx_ids of the
+ * master index entries using that string). */
+struct sortidx_header {
+    struct tagcache_header tch; /* entry_count is the number of strings */
+    int32_t commitid;           /* Master commitid the index is valid for */
+    int32_t posting_count;      /* Number of postings following the entries */
+    int32_t master_count;       /* Master index entries covered by the index */
+};
+
+struct sortidx_entry {
+    int32_t tag_seek;           /* Location of the string in the tag file */
+    int32_t posting_start;      /* First posting of this string */
+    int32_t posting_count;      /* Number of postings of this string */
+};
+
+/* Word index files list every word of the strings of a tag in byte order;
+ * each word points to a run of postings (ascending tag file seeks of the
+ * strings containing it). The entries end with a sentinel, followed by the
+ * postings and then by the NUL-terminated words. */
+struct wordidx_header {
+    struct tagcache_header tch; /* entry_count is the number of words */
+    int32_t commitid;           /* Master commitid the index is valid for */
+    int32_t posting_count;      /* Number of postings following the entries */
+};
+
+struct wordidx_entry {
+    int32_t word_offset;        /* Location of the word after the postings */
+    int32_t posting_start;      /* First posting of this word */
+};
+
+/* Small commits append the new strings of the sorted tags to the end of
+ * their tag files instead of resorting them. The delta file remembers where
+ * the unsorted part starts until the next full commit merges it. */
+struct delta_header {
+    int32_t magic;              /* Header version number, 0 if no delta */
+    int32_t commitid;           /* Master commitid of the last full commit */
+    int32_t master_commitid;    /* Master commitid the delta is valid for */
+    int32_t entry_count;        /* Master index entries at the full commit */
+    int32_t tail_seek[TAG_COUNT]; /* Start of the unsorted strings, 0=none */
+};
+
+static struct delta_header tc_delta;
+
 #ifdef HAVE_TC_RAMCACHE
 
 #define TC_ALIGN_PTR(p, type, gap_out_p) \
@@ -399,6 +472,34 @@ static inline void str_setlen(char *buf, size_t len)
     buf[len] = '\0';
 }
 
+/* Characters of a word. Bytes of multibyte UTF-8 characters always are. */
+#define IS_WORD_CHAR(c) ((unsigned char)(c) >= 0x80 || isalnum((unsigned char)(c)))
+
+/**
+ * Copy the next word of str to buf for the word index, lowercasing ASCII
+ * letters and cutting it to bufsz - 1 bytes. Returns a pointer past the
+ * word or NULL if there are no more words.
+ */
+static const char *get_next_word(const char *str, char *buf, size_t bufsz)
+{
+    size_t len = 0;
+
+    while (*str != '\0' && !IS_WORD_CHAR(*str))
+        str++;
+
+    if (*str == '\0')
+        return NULL;
+
+    for (; IS_WORD_CHAR(*str); str++)
+    {
+        if (len < bufsz - 1)
+            buf[len++] = tolower((unsigned char)*str);
+    }
+
+    str_setlen(buf, len);
+    return str;
+}
+
 const char* tagcache_tag_to_str(int tag)
 {
     return tags_str[tag];
@@ -669,7 +770,9 @@ static void remove_files(void)
     tc_stat.ready = false;
     tc_stat.ramcache = false;
     tc_stat.econ = false;
+    tc_delta.magic = 0;
     remove_db_file(TAGCACHE_FILE_MASTER);
+    remove_db_file(TAGCACHE_FILE_DELTA);
     for (i = 0; i < TAG_COUNT; i++)
     {
         if (TAGCACHE_IS_NUMERIC(i))
@@ -678,7 +781,41 @@ static void remove_files(void)
         snprintf(buf, bufsz, "%s/" TAGCACHE_FILE_INDEX,
                  tc_stat.db_path, i);
         remove(buf);
+
+        if (TAGCACHE_IS_SORTED(i))
+        {
+            snprintf(buf, bufsz, "%s/" TAGCACHE_FILE_SORTIDX,
+                     tc_stat.db_path, i);
+            remove(buf);
+        }
+
+        if (TAGCACHE_HAS_WORDIDX(i))
+        {
+            snprintf(buf, bufsz, "%s/" TAGCACHE_FILE_WORDIDX,
+                     tc_stat.db_path, i);
+            remove(buf);
+        }
+    }
+}
+
+static void load_delta_header(void)
+{
+    int fd = open_db_fd(TAGCACHE_FILE_DELTA, O_RDONLY);
+
+    tc_delta.magic = 0;
+    if (fd < 0)
+        return;
+
+    /* A delta left behind by an interrupted commit is useless. */
+    if (read(fd, &tc_delta, sizeof(tc_delta)) != sizeof(tc_delta)
+        || tc_delta.magic != TAGCACHE_MAGIC
+        || tc_delta.master_commitid != current_tcmh.commitid)
+    {
+        logf("stale delta");
+        tc_delta.magic = 0;
     }
+
+    close(fd);
 }
 
 static bool check_all_headers(void)
@@ -699,6 +836,7 @@ static bool check_all_headers(void)
     }
 
     memcpy(&current_tcmh, &myhdr, sizeof(struct master_header));
+    load_delta_header();
 
     for (tag = 0; tag < TAG_COUNT; tag++)
     {
@@ -1379,6 +1517,52 @@ inline static bool str_begins_ends_oneof(const char *str, const char *list, bool
     return false;
 }
 
+static int split_words(const char *str, char words[][TAGCACHE_WORD_LEN])
+{
+    int count = 0;
+
+    while (count < TAGCACHE_MAX_WORDS
+           && (str = get_next_word(str, words[count], TAGCACHE_WORD_LEN)))
+        count++;
+
+    return count;
+}
+
+/**
+ * Check that every query word starts a word of str. When walking the
+ * postings of the index word 'word', also check that it is the smallest
+ * word of str starting with the query word 'driver', so that strings listed
+ * under several words starting with it are returned only once.
+ */
+static bool words_match(const char *query, const char *str,
+                        int driver, const char *word)
+{
+    char qwords[TAGCACHE_MAX_WORDS][TAGCACHE_WORD_LEN];
+    char buf[TAGCACHE_WORD_LEN];
+    char first[TAGCACHE_WORD_LEN];
+    unsigned int found = 0;
+    int i, count = split_words(query, qwords);
+
+    first[0] = '\0';
+    while ((str = get_next_word(str, buf, sizeof(buf))))
+    {
+        for (i = 0; i < count; i++)
+        {
+            if (strncmp(buf, qwords[i], strlen(qwords[i])) != 0)
+                continue;
+
+            found |= BIT_N(i);
+            if (i == driver && (first[0] == '\0' || strcmp(buf, first) < 0))
+                strmemccpy(first, buf, sizeof(first));
+        }
+    }
+
+    if (found != BIT_N(count) - 1)
+        return false;
+
+    return word == NULL || strcmp(first, word) == 0;
+}
+
 static bool check_against_clause(long numeric, const char *str,
                                  const struct tagcache_search_clause *clause)
 {
@@ -1437,6 +1621,8 @@ static bool check_against_clause(long numeric, const char *str,
             case clause_begins_oneof:
                 return str_begins_ends_oneof(str, clause->str,
                                              clause->type == clause_begins_oneof);
+            case clause_words:
+                return words_match(clause->str, str, -1, NULL);
             default:
                 logf("Incorrect tag: %d", clause->type);
         }
@@ -1606,1016 +1792,2032 @@ static bool add_uniqbuf(struct tagcache_search *tcs, uint32_t id)
     return true;
 }
 
-static bool build_lookup_list(struct tagcache_search *tcs)
+/* Add an index entry to the seek list if it passes the filters and clauses */
+static bool add_seeklist_entry(struct tagcache_search *tcs,
+                               struct index_entry *idx, int idx_id)
 {
-    struct index_entry entry;
-    int i, j;
+    struct tagcache_seeklist_entry *seeklist;
+    int j;
 
-    tcs->seek_list_count = 0;
+    /* Skip deleted files. */
+    if (idx->flag & FLAG_DELETED)
+        return false;
 
-#ifdef HAVE_TC_RAMCACHE
-    if (tcs->ramsearch)
+    /* Go through all filters.. */
+    for (j = 0; j < tcs->filter_count; j++)
     {
-        tcrc_buffer_lock(); /* lock because below makes a pointer to movable data */
+        if (idx->tag_seek[tcs->filter_tag[j]] != tcs->filter_seek[j])
+            return false;
+    }
 
-        for (i = tcs->seek_pos; i < current_tcmh.tch.entry_count; i++)
-        {
-            struct tagcache_seeklist_entry *seeklist;
-            /* idx points to movable data, don't yield or reload */
-            struct index_entry *idx = &tcramcache.hdr->indices[i];
-            if (tcs->seek_list_count == SEEK_LIST_SIZE)
-                break ;
+    /* Check for conditions. */
+    if (!check_clauses(tcs, idx, tcs->clause, tcs->clause_count))
+        return false;
 
-            /* Skip deleted files. */
-            if (idx->flag & FLAG_DELETED)
-                continue;
+    /* Add to the seek list if not already in uniq buffer (doesn't yield)*/
+    if (!add_uniqbuf(tcs, idx->tag_seek[tcs->type]))
+        return false;
 
-            /* Go through all filters.. */
-            for (j = 0; j < tcs->filter_count; j++)
-            {
-                if (idx->tag_seek[tcs->filter_tag[j]] != tcs->filter_seek[j])
-                {
-                    break ;
-                }
-            }
+    /* Lets add it. */
+    seeklist = &tcs->seeklist[tcs->seek_list_count];
+    seeklist->seek = idx->tag_seek[tcs->type];
+    seeklist->flag = idx->flag;
+    seeklist->idx_id = idx_id;
+    tcs->seek_list_count++;
 
-            if (j < tcs->filter_count)
-                continue ;
+    return true;
+}
 
-            /* Check for conditions. */
-            if (!check_clauses(tcs, idx, tcs->clause, tcs->clause_count))
-                continue;
-            /* Add to the seek list if not already in uniq buffer (doesn't yield)*/
-            if (!add_uniqbuf(tcs, idx->tag_seek[tcs->type]))
-                continue;
+static bool sortidx_read(struct tagcache_sortidx *si, long offset,
+                         void *buf, size_t size)
+{
+#ifdef TAGCACHE_SORTIDX_MMAP
+    if (si->map)
+    {
+        if (offset + (long)size > si->mapsize)
+            return false;
 
-            /* Lets add it. */
-            seeklist = &tcs->seeklist[tcs->seek_list_count];
-            seeklist->seek = idx->tag_seek[tcs->type];
-            seeklist->flag = idx->flag;
-            seeklist->idx_id = i;
-            tcs->seek_list_count++;
-        }
+        memcpy(buf, (char *)si->map + offset, size);
+        return true;
+    }
+#endif /* TAGCACHE_SORTIDX_MMAP */
 
-        tcrc_buffer_unlock();
+    if (lseek(si->fd, offset, SEEK_SET) != offset)
+        return false;
 
-        tcs->seek_pos = i;
+    return read(si->fd, buf, size) == (ssize_t)size;
+}
 
-        return tcs->seek_list_count > 0;
-    }
-#endif /* HAVE_TC_RAMCACHE */
+static inline bool sortidx_get_entry(struct tagcache_sortidx *si, int32_t i,
+                                     struct sortidx_entry *entry)
+{
+    return sortidx_read(si, sizeof(struct sortidx_header) +
+                        i * sizeof(struct sortidx_entry),
+                        entry, sizeof(struct sortidx_entry));
+}
 
-    if (tcs->masterfd < 0)
-    {
-        struct master_header tcmh;
-        tcs->masterfd = open_master_fd(&tcmh, false);
-    }
+/* Offset of posting i, with i == posting_count marking the end */
+static int32_t sortidx_posting_start(struct tagcache_sortidx *si, int32_t i)
+{
+    struct sortidx_entry entry;
 
-    lseek(tcs->masterfd, tcs->seek_pos * sizeof(struct index_entry) +
-            sizeof(struct master_header), SEEK_SET);
+    if (i >= si->count)
+        return si->posting_count;
 
-    while (read_index_entries(tcs->masterfd, &entry, 1) == sizeof(struct index_entry))
-    {
-        struct tagcache_seeklist_entry *seeklist;
+    if (!sortidx_get_entry(si, i, &entry))
+        return -1;
 
-        if (tcs->seek_list_count == SEEK_LIST_SIZE)
-            break ;
+    return entry.posting_start;
+}
 
-        i = tcs->seek_pos;
-        tcs->seek_pos++;
+static void sortidx_close(struct tagcache_sortidx *si)
+{
+#ifdef TAGCACHE_SORTIDX_MMAP
+    if (si->map)
+        munmap(si->map, si->mapsize);
+    si->map = NULL;
+#endif
 
-        /* Check if entry has been deleted. */
-        if (entry.flag & FLAG_DELETED)
-            continue;
+    if (si->fd >= 0)
+        close(si->fd);
+    si->fd = -1;
+}
 
-        /* Go through all filters.. */
-        for (j = 0; j < tcs->filter_count; j++)
-        {
-            if (entry.tag_seek[tcs->filter_tag[j]] != tcs->filter_seek[j])
-                break ;
-        }
+static void sortidx_map(struct tagcache_sortidx *si, long size)
+{
+#ifdef TAGCACHE_SORTIDX_MMAP
+    si->mapsize = size;
+    si->map = mmap(NULL, si->mapsize, PROT_READ, MAP_SHARED, si->fd, 0);
+    if (si->map == MAP_FAILED)
+        si->map = NULL;
+#else
+    (void)si;
+    (void)size;
+#endif
+}
 
-        if (j < tcs->filter_count)
-            continue ;
+/* Open the sorted index of a tag. Entries from master_count on have been
+ * added by delta commits and are not part of the postings. */
+static bool sortidx_open(struct tagcache_sortidx *si, int tag,
+                         int32_t *master_count)
+{
+    struct sortidx_header hdr;
+    char fname[MAX_PATH];
 
-        /* Check for conditions. */
-        if (!check_clauses(tcs, &entry, tcs->clause, tcs->clause_count))
-            continue;
+    si->fd = open_pathfmt(fname, sizeof(fname), O_RDONLY,
+                          "%s/" TAGCACHE_FILE_SORTIDX, tc_stat.db_path, tag);
+    if (si->fd < 0)
+        return false;
 
-        /* Add to the seek list if not already in uniq buffer. */
-        if (!add_uniqbuf(tcs, entry.tag_seek[tcs->type]))
-            continue;
+    /* The index is only valid for the full commit it was built for. */
+    if (read(si->fd, &hdr, sizeof(hdr)) != sizeof(hdr)
+        || hdr.tch.magic != TAGCACHE_MAGIC
+        || (hdr.commitid != current_tcmh.commitid
+            && (tc_delta.magic != TAGCACHE_MAGIC
+                || hdr.commitid != tc_delta.commitid)))
+    {
+        logf("stale sorted index: %d", tag);
+        sortidx_close(si);
+        return false;
+    }
 
-        /* Lets add it. */
-        seeklist = &tcs->seeklist[tcs->seek_list_count];
-        seeklist->seek = entry.tag_seek[tcs->type];
-        seeklist->flag = entry.flag;
-        seeklist->idx_id = i;
-        tcs->seek_list_count++;
+    si->tag = tag;
+    si->count = hdr.tch.entry_count;
+    si->posting_count = hdr.posting_count;
+    si->posting_pos = 0;
+    si->posting_end = 0;
+    if (master_count)
+        *master_count = hdr.master_count;
 
-        yield();
+    sortidx_map(si, sizeof(hdr) + hdr.tch.datasize);
+    return true;
+}
+
+/* Read the tag string at seek. Returns NULL on error and an empty string
+ * for deleted strings. The entry length is returned in *length if given. */
+static const char *read_tag_str(bool ramsearch, int tagfd, int tag,
+                                int32_t seek, char *buf, long bufsz,
+                                int32_t *length)
+{
+    struct tagfile_entry tfe;
+
+#ifdef HAVE_TC_RAMCACHE
+    if (ramsearch)
+    {
+        struct tagfile_entry *ep = (struct tagfile_entry *)
+            &tcramcache.hdr->tags[tag][seek];
+        strmemccpy(buf, ep->tag_data, bufsz);
+        if (length)
+            *length = ep->tag_length;
+        return buf;
     }
+#else
+    (void)ramsearch;
+    (void)tag;
+#endif /* HAVE_TC_RAMCACHE */
 
-    return tcs->seek_list_count > 0;
+    lseek(tagfd, seek, SEEK_SET);
+    switch (read_tagfile_entry_and_tag(tagfd, &tfe, buf, bufsz))
+    {
+        case e_SUCCESS_LEN_ZERO:
+        case e_SUCCESS:
+            if (length)
+                *length = tfe.tag_length;
+            return buf;
+        default:
+            return NULL;
+    }
 }
 
+/* Read the string of a sorted index entry. Returns NULL on error and an
+ * empty string for entries deleted since the last commit. */
+static const char *sortidx_get_str(struct tagcache_sortidx *si,
+                                   bool ramsearch, int tagfd, int32_t i,
+                                   char *buf, long bufsz)
+{
+    struct sortidx_entry entry;
 
-bool tagcache_search(struct tagcache_search *tcs, int tag)
+    if (!sortidx_get_entry(si, i, &entry))
+        return NULL;
+
+    return read_tag_str(ramsearch, tagfd, si->tag, entry.tag_seek,
+                        buf, bufsz, NULL);
+}
+
+/**
+ * Binary search for the first string comparing greater than or equal to
+ * (upper: greater than) key, using the same order as the commit sort.
+ * Entries deleted after the commit no longer have postings in use so they
+ * may end up on either side of the boundary.
+ */
+static int32_t sortidx_bound(struct tagcache_sortidx *si,
+                             bool ramsearch, int tagfd,
+                             const char *key, size_t keylen, bool upper)
 {
-    /* NOTE: call tagcache_search_finish(&tcs) when finished or BAD things may happen (TM) */
-    struct tagcache_header tag_hdr;
-    struct master_header   master_hdr;
-    int i;
+    char buf[TAGCACHE_BUFSZ];
+    int32_t lo = 0, hi = si->count;
 
-    while (read_lock)
-        sleep(1);
+    while (lo < hi)
+    {
+        int32_t mid = lo + (hi - lo) / 2;
+        int32_t probe = mid;
+        const char *str;
+        int cmp;
 
-    memset(tcs, 0, sizeof(struct tagcache_search));
-    if (tc_stat.commit_step > 0 || !tc_stat.ready)
-        return false;
+        /* Skip over deleted strings. */
+        while ((str = sortidx_get_str(si, ramsearch, tagfd, probe,
+                                      buf, sizeof(buf)))
+               && *str == '\0')
+        {
+            if (++probe >= hi)
+                break;
+        }
 
-    tcs->position = sizeof(struct tagcache_header);
-    tcs->type = tag;
-    tcs->seek_pos = 0;
-    tcs->list_position = 0;
-    tcs->seek_list_count = 0;
-    tcs->filter_count = 0;
-    tcs->masterfd = -1;
+        if (str == NULL)
+            return -1;
 
-    for (i = 0; i < TAG_COUNT; i++)
-        tcs->idxfd[i] = -1;
+        if (probe >= hi)
+        {
+            hi = mid;
+            continue;
+        }
 
-#ifndef HAVE_TC_RAMCACHE
-    tcs->ramsearch = false;
-#else
-    tcs->ramsearch = tc_stat.ramcache;
-    if (tcs->ramsearch)
-    {
-        tcs->entry_count = tcramcache.hdr->entry_count[tcs->type];
+        if (strcmp(str, UNTAGGED) == 0)
+            cmp = -1;
+        else
+            cmp = strncasecmp(str, key, keylen);
+
+        if (upper ? cmp <= 0 : cmp < 0)
+            lo = probe + 1;
+        else
+            hi = mid;
     }
-    else
-#endif
+
+    return lo;
+}
+
+/* Find the postings of a sorted index matching a filter or a clause. */
+static bool sortidx_find(struct tagcache_search *tcs,
+                         struct tagcache_sortidx *si, int32_t seek,
+                         const struct tagcache_search_clause *clause)
+{
+    int32_t lo, hi;
+
+    if (clause == NULL)
     {
-        /* Always open as R/W so we can pass tcs to functions that modify data also
-         * without failing. */
-        tcs->masterfd = open_master_fd(&master_hdr, true);
-        if (tcs->masterfd < 0)
-            return false;
+        struct sortidx_entry entry;
 
-        if (!TAGCACHE_IS_NUMERIC(tcs->type))
+        lo = 0;
+        hi = si->count;
+        while (lo < hi)
         {
-            tcs->idxfd[tcs->type] = open_tag_fd(&tag_hdr, tcs->type, false);
-            if (tcs->idxfd[tcs->type] < 0)
+            int32_t mid = lo + (hi - lo) / 2;
+
+            if (!sortidx_get_entry(si, mid, &entry))
                 return false;
 
-            tcs->entry_count = tag_hdr.entry_count;
+            if (entry.tag_seek < seek)
+                lo = mid + 1;
+            else
+                hi = mid;
         }
-        else
+
+        si->posting_pos = si->posting_end = 0;
+        if (lo < si->count)
         {
-            tcs->entry_count = master_hdr.tch.entry_count;
+            if (!sortidx_get_entry(si, lo, &entry))
+                return false;
+
+            if (entry.tag_seek == seek)
+            {
+                si->posting_pos = entry.posting_start;
+                si->posting_end = entry.posting_start + entry.posting_count;
+            }
         }
+
+        return true;
     }
 
-    tcs->valid = true;
-    tcs->initialized = true;
-    write_lock++;
+    size_t keylen = clause->type == clause_is ? TAG_MAXLEN : strlen(clause->str);
 
-    return true;
-}
+    if (!tcs->ramsearch && !open_files(tcs, si->tag))
+        return false;
 
-void tagcache_search_set_uniqbuf(struct tagcache_search *tcs,
-                                 void *buffer, long length)
-{
-    tcs->unique_list = (uint32_t *)buffer;
-    tcs->unique_list_capacity = length / sizeof(*tcs->unique_list);
-    tcs->unique_list_count = 0;
-    memset(tcs->unique_list, 0, tcs->unique_list_capacity);
+    lo = sortidx_bound(si, tcs->ramsearch, tcs->idxfd[si->tag],
+                       clause->str, keylen, false);
+    hi = sortidx_bound(si, tcs->ramsearch, tcs->idxfd[si->tag],
+                       clause->str, keylen, true);
+    if (lo < 0 || hi < 0)
+        return false;
+
+    si->posting_pos = sortidx_posting_start(si, lo);
+    si->posting_end = lo < hi ? sortidx_posting_start(si, hi) : si->posting_pos;
+
+    return si->posting_pos >= 0 && si->posting_end >= 0;
 }
 
-bool tagcache_search_add_filter(struct tagcache_search *tcs,
-                                int tag, int seek)
+/* Can the clause be resolved by a binary search of the sorted index? */
+static bool sortidx_usable_clause(const struct tagcache_search_clause *clause)
 {
-    if (tcs->filter_count == TAGCACHE_MAX_FILTERS)
-        return false;
-
-    if (TAGCACHE_IS_NUMERIC_OR_NONUNIQUE(tag))
+    if (clause->numeric || clause->str == NULL
+        || !TAGCACHE_IS_SORTED(clause->tag))
         return false;
 
-    tcs->filter_tag[tcs->filter_count] = tag;
-    tcs->filter_seek[tcs->filter_count] = seek;
-    tcs->filter_count++;
-
-    return true;
+    /* UNTAGGED is sorted first regardless of its collation */
+    switch (clause->type)
+    {
+        case clause_is:
+            return strcasecmp(clause->str, UNTAGGED) != 0;
+        case clause_begins_with:
+            return strncasecmp(clause->str, UNTAGGED, strlen(clause->str)) != 0;
+        default:
+            return false;
+    }
 }
 
-bool tagcache_search_add_clause(struct tagcache_search *tcs,
-                                struct tagcache_search_clause *clause)
+/**
+ * Pick the sorted index giving the fewest postings to visit among the
+ * filters and the clauses that every result has to match.
+ */
+static void sortidx_plan(struct tagcache_search *tcs)
 {
+    struct tagcache_sortidx *best = &tcs->sortidx;
+    struct tagcache_sortidx si;
+    int32_t master_count, best_master_count = 0;
+    bool use_clauses = true;
     int i;
-    int clause_count = tcs->clause_count;
 
-    if (clause_count >= TAGCACHE_MAX_CLAUSES)
+    best->fd = -1;
+    for (i = 0; i < tcs->clause_count; i++)
     {
-        logf("Too many clauses");
-        return false;
+        if (tcs->clause[i]->type == clause_logical_or)
+            use_clauses = false;
     }
 
-    if (clause->type != clause_logical_or)
+    for (i = 0; i < tcs->filter_count + tcs->clause_count; i++)
     {
-        /* BUGFIX OR'd clauses seem to be mishandled once made into a filter */
-        if (clause_count <= 1 || tcs->clause[clause_count - 1]->type != clause_logical_or)
+        const struct tagcache_search_clause *clause = NULL;
+        int32_t seek = 0;
+        int tag;
+
+        if (i < tcs->filter_count)
         {
-            /* Check if there is already a similar filter in present (filters are
-             * much faster than clauses).
-             */
-            for (i = 0; i < tcs->filter_count; i++)
-            {
-                if (tcs->filter_tag[i] == clause->tag)
-                {
-                    return true;
-                }
-            }
+            tag = tcs->filter_tag[i];
+            seek = tcs->filter_seek[i];
+            if (!TAGCACHE_IS_SORTED(tag))
+                continue;
+        }
+        else
+        {
+            clause = tcs->clause[i - tcs->filter_count];
+            if (!use_clauses || !sortidx_usable_clause(clause))
+                continue;
+            tag = clause->tag;
         }
 
-        if (!TAGCACHE_IS_NUMERIC(clause->tag) && tcs->idxfd[clause->tag] < 0)
+        memset(&si, 0, sizeof(si));
+        if (!sortidx_open(&si, tag, &master_count))
+            continue;
+
+        if (sortidx_find(tcs, &si, seek, clause) &&
+            (best->fd < 0 || si.posting_end - si.posting_pos <
+                             best->posting_end - best->posting_pos))
         {
-            char fname[MAX_PATH];
-            tcs->idxfd[clause->tag] = open_pathfmt(fname, sizeof(fname), O_RDONLY,
-                                                   "%s/" TAGCACHE_FILE_INDEX,
-                                                   tc_stat.db_path, clause->tag);
+            sortidx_close(best);
+            *best = si;
+            best_master_count = master_count;
+        }
+        else
+        {
+            sortidx_close(&si);
         }
     }
 
-    tcs->clause[tcs->clause_count] = clause;
-    tcs->clause_count++;
-
-    return true;
+    if (best->fd >= 0)
+    {
+        /* Entries added by delta commits aren't indexed, the linear
+           scan picks them up after the postings. */
+        tcs->seek_pos = best_master_count;
+        logf("sorted index %d: %ld postings", best->tag,
+             (long)(best->posting_end - best->posting_pos));
+    }
 }
 
-static bool get_next(struct tagcache_search *tcs, bool is_numeric, char *buf, long bufsz)
+static bool build_lookup_list_sortidx(struct tagcache_search *tcs)
 {
-    struct tagfile_entry entry;
-#if defined(HAVE_TC_RAMCACHE) && defined(HAVE_DIRCACHE)
-    long flag = 0;
-#endif
-
-    if (tcs->idxfd[tcs->type] < 0 && !is_numeric
-#ifdef HAVE_TC_RAMCACHE
-        && !tcs->ramsearch
-#endif
-        )
-        return false;
+    struct tagcache_sortidx *si = &tcs->sortidx;
+    int32_t postings[SEEK_LIST_SIZE];
+    int i;
 
-    /* Relative fetch. */
-    if (tcs->filter_count > 0 || tcs->clause_count > 0 || is_numeric
-#if defined(HAVE_TC_RAMCACHE) && defined(HAVE_DIRCACHE)
-        /* We need to retrieve flag status for dircache. */
-        || (tcs->ramsearch && tcs->type == tag_filename)
-#endif
-        )
+    while (tcs->seek_list_count < SEEK_LIST_SIZE
+           && si->posting_pos < si->posting_end)
     {
-        struct tagcache_seeklist_entry *seeklist;
+        int count = MIN(SEEK_LIST_SIZE, si->posting_end - si->posting_pos);
 
-        /* Check for end of list. */
-        if (tcs->list_position == tcs->seek_list_count)
+        if (!sortidx_read(si, sizeof(struct sortidx_header) +
+                          si->count * sizeof(struct sortidx_entry) +
+                          si->posting_pos * sizeof(int32_t),
+                          postings, count * sizeof(int32_t)))
         {
-            tcs->list_position = 0;
-
-            /* Try to fetch more. */
-            if (!build_lookup_list(tcs))
-            {
-                tcs->valid = false;
-                return false;
-            }
+            logf("sorted index: read error");
+            si->posting_pos = si->posting_end;
+            break;
         }
 
-        seeklist = &tcs->seeklist[tcs->list_position];
-#if defined(HAVE_TC_RAMCACHE) && defined(HAVE_DIRCACHE)
-        flag = seeklist->flag;
+#ifdef HAVE_TC_RAMCACHE
+        if (tcs->ramsearch)
+            tcrc_buffer_lock(); /* idx below points to movable data */
 #endif
-        tcs->position = seeklist->seek;
-        tcs->idx_id = seeklist->idx_id;
-        tcs->list_position++;
-    }
-    else
-    {
-        if (tcs->entry_count == 0)
+
+        for (i = 0; i < count && tcs->seek_list_count < SEEK_LIST_SIZE; i++)
         {
-            tcs->valid = false;
-            return false;
-        }
+            struct index_entry entry, *idx = &entry;
+            int idx_id = postings[i];
 
-        tcs->entry_count--;
-    }
+            if (idx_id < 0 || idx_id >= current_tcmh.tch.entry_count)
+                continue;
 
-    tcs->result_seek = tcs->position;
+#ifdef HAVE_TC_RAMCACHE
+            if (tcs->ramsearch)
+                idx = &tcramcache.hdr->indices[idx_id];
+            else
+#endif
+            if (!get_index(tcs->masterfd, idx_id, &entry, false))
+                continue;
 
-    if (is_numeric)
-    {
-        snprintf(buf, bufsz, "%ld", tcs->position);
-        tcs->result = buf;
-        tcs->result_len = strlen(buf) + 1;
-        return true;
-    }
+            add_seeklist_entry(tcs, idx, idx_id);
+        }
 
-    /* Direct fetch. */
 #ifdef HAVE_TC_RAMCACHE
-    if (tcs->ramsearch)
-    {
-#ifdef HAVE_DIRCACHE
-        if (tcs->type == tag_filename && (flag & FLAG_DIRCACHE))
-        {
-            ssize_t len = dircache_get_fileref_path(&tcrc_dcfrefs[tcs->idx_id],
-                                                    buf, bufsz);
-            if (len >= 0)
-            {
-                tcs->result_len = len + 1;
-                tcs->result     = buf;
-                tcs->ramresult  = false;
-                return true;
-            }
-            /* else do it the hard way */
-        }
-#endif /* HAVE_DIRCACHE */
+        if (tcs->ramsearch)
+            tcrc_buffer_unlock();
+#endif
 
-        if (tcs->type != tag_filename)
-        {
-            struct tagfile_entry *ep;
+        si->posting_pos += i;
+        yield();
+    }
 
-            ep = (struct tagfile_entry *)&tcramcache.hdr->tags[tcs->type][tcs->position];
-            /* don't return ep->tag_data directly as it may move */
-            tcs->result_len = strlcpy(buf, ep->tag_data, bufsz) + 1;
-            tcs->result = buf;
-            tcs->idx_id = ep->idx_id;
-            tcs->ramresult = false; /* was true before we copied to buf too */
+    return tcs->seek_list_count > 0;
+}
 
-            /* Increase position for the next run. This may get overwritten. */
-            tcs->position += sizeof(struct tagfile_entry) + ep->tag_length;
+static bool wordidx_open(struct tagcache_sortidx *si, int tag)
+{
+    struct wordidx_header hdr;
+    char fname[MAX_PATH];
 
-            return true;
-        }
-    }
-#endif /* HAVE_TC_RAMCACHE */
+    si->fd = open_pathfmt(fname, sizeof(fname), O_RDONLY,
+                          "%s/" TAGCACHE_FILE_WORDIDX, tc_stat.db_path, tag);
+    if (si->fd < 0)
+        return false;
 
-    if (!open_files(tcs, tcs->type))
+    if (read(si->fd, &hdr, sizeof(hdr)) != sizeof(hdr)
+        || hdr.tch.magic != TAGCACHE_MAGIC
+        || (hdr.commitid != current_tcmh.commitid
+            && (tc_delta.magic != TAGCACHE_MAGIC
+                || hdr.commitid != tc_delta.commitid)))
     {
-        tcs->valid = false;
+        logf("stale word index: %d", tag);
+        sortidx_close(si);
         return false;
     }
 
-    /* Seek stream to the correct position and continue to direct fetch. */
-    lseek(tcs->idxfd[tcs->type], tcs->position, SEEK_SET);
+    si->tag = tag;
+    si->count = hdr.tch.entry_count;
+    si->posting_count = hdr.posting_count;
+    si->posting_pos = 0;
+    si->posting_end = 0;
 
-    switch (read_tagfile_entry_and_tag(tcs->idxfd[tcs->type], &entry, buf, bufsz))
-    {
-        case e_SUCCESS_LEN_ZERO:
-        case e_SUCCESS:
-             break;
-        case e_ENTRY_SIZEMISMATCH:
-            logf("read error #5");
-            tcs->valid = false;
-            return false;
-        case e_TAG_TOOLONG:
-            tcs->valid = false;
-            logf("too long tag #2");
-            logf("P:%lX/%lX", tcs->position, entry.tag_length);
-            return false;
-        case e_TAG_SIZEMISMATCH:
-            tcs->valid = false;
-            logf("read error #4");
-            return false;
-    }
+    sortidx_map(si, sizeof(hdr) + hdr.tch.datasize);
+    return true;
+}
 
-    /**
-     Update the position for the next read (this may be overridden
-     if filters or clauses are being used).
-     */
-    tcs->position += sizeof(struct tagfile_entry) + entry.tag_length;
-    str_setlen(buf, entry.tag_length);
+/* Read word i of a word index and the range of its postings. */
+static bool wordidx_get_word(struct tagcache_sortidx *si, int32_t i,
+                             char *buf, size_t bufsz,
+                             int32_t *posting_start, int32_t *posting_end)
+{
+    struct wordidx_entry entry[2]; /* The last word is followed by a sentinel */
+    long len;
 
-    tcs->result = buf;
-    tcs->result_len = entry.tag_length + 1;
-    tcs->idx_id = entry.idx_id;
-    tcs->ramresult = false;
+    if (!sortidx_read(si, sizeof(struct wordidx_header) +
+                      i * sizeof(struct wordidx_entry),
+                      entry, sizeof(entry)))
+        return false;
 
+    len = entry[1].word_offset - entry[0].word_offset;
+    if (len <= 0 || len > (long)bufsz
+        || !sortidx_read(si, sizeof(struct wordidx_header) +
+                         (si->count + 1) * sizeof(struct wordidx_entry) +
+                         si->posting_count * sizeof(int32_t) +
+                         entry[0].word_offset, buf, len))
+        return false;
+
+    str_setlen(buf, len - 1);
+    if (posting_start)
+        *posting_start = entry[0].posting_start;
+    if (posting_end)
+        *posting_end = entry[1].posting_start;
     return true;
 }
 
-bool tagcache_get_next(struct tagcache_search *tcs, char *buf, long size)
+/* Binary search for the first word starting with key (upper: the first
+ * word after the words starting with key). */
+static int32_t wordidx_bound(struct tagcache_sortidx *si,
+                             const char *key, bool upper)
 {
-    if (tcs->valid && tagcache_is_usable())
+    char buf[TAGCACHE_WORD_LEN];
+    size_t keylen = strlen(key);
+    int32_t lo = 0, hi = si->count;
+
+    while (lo < hi)
     {
-        bool is_numeric = TAGCACHE_IS_NUMERIC(tcs->type);
-        while (get_next(tcs, is_numeric, buf, size))
-        {
-            if (tcs->result_len > 1)
-                return true;
-        }
+        int32_t mid = lo + (hi - lo) / 2;
+        int cmp;
+
+        if (!wordidx_get_word(si, mid, buf, sizeof(buf), NULL, NULL))
+            return -1;
+
+        cmp = strncmp(buf, key, keylen);
+        if (upper ? cmp <= 0 : cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
-#ifdef LOGF_ENABLE
-    if (tcs->unique_list_count > 0)
-        logf(" uniqbuf: %d used / %d avail", tcs->unique_list_count, tcs->unique_list_capacity);
-#endif
 
-    return false;
+    return lo;
 }
 
-bool tagcache_retrieve(struct tagcache_search *tcs, int idxid,
-                       int tag, char *buf, long size)
+static void add_words_entry(struct tagcache_search *tcs, int32_t seek)
 {
-    struct index_entry idx;
-
-    *buf = '\0';
-    if (!get_index(tcs->masterfd, idxid, &idx, true))
-        return false;
+    struct tagcache_seeklist_entry *seeklist;
 
-    return retrieve(tcs, IF_DIRCACHE(idxid,) &idx, tag, buf, size);
+    seeklist = &tcs->seeklist[tcs->seek_list_count++];
+    seeklist->seek = seek;
+    seeklist->flag = 0;
+    seeklist->idx_id = -1;
 }
 
-void tagcache_search_finish(struct tagcache_search *tcs)
+/* Is the string at seek in the sorted part of the tag and used by an entry
+ * not deleted since the last full commit? */
+static bool sortidx_str_used(struct tagcache_search *tcs,
+                             struct tagcache_sortidx *si, int32_t seek,
+                             char *buf, long bufsz)
 {
-    int i;
+    struct sortidx_entry entry;
+    struct index_entry idx;
+    const char *str;
+    int32_t lo, hi, i, idx_id;
+    int tagfd = tcs->idxfd[tcs->type];
 
-    if (!tcs->initialized)
-        return;
+    str = read_tag_str(tcs->ramsearch, tagfd, tcs->type, seek, buf, bufsz,
+                       NULL);
+    if (str == NULL)
+        return false;
 
-    if (tcs->masterfd >= 0)
+    /* Strings only differing in case sort together. UNTAGGED is sorted
+       first regardless of its collation. */
+    if (strcasecmp(str, UNTAGGED) == 0)
     {
-        close(tcs->masterfd);
-        tcs->masterfd = -1;
+        lo = 0;
+        hi = 1;
+    }
+    else
+    {
+        lo = sortidx_bound(si, tcs->ramsearch, tagfd, str, TAG_MAXLEN, false);
+        hi = sortidx_bound(si, tcs->ramsearch, tagfd, str, TAG_MAXLEN, true);
     }
 
-    for (i = 0; i < TAG_COUNT; i++)
+    for (i = MAX(lo, 0); i < MIN(hi, si->count); i++)
     {
-        if (tcs->idxfd[i] >= 0)
-        {
-            close(tcs->idxfd[i]);
-            tcs->idxfd[i] = -1;
-        }
+        if (!sortidx_get_entry(si, i, &entry))
+            return false;
+
+        if (entry.tag_seek == seek)
+            break;
     }
 
-    tcs->ramsearch = false;
-    tcs->valid = false;
-    tcs->initialized = 0;
-    if (write_lock > 0)
-        write_lock--;
-}
+    if (lo < 0 || i >= MIN(hi, si->count))
+        return false;
 
-#if defined(HAVE_TC_RAMCACHE) && defined(HAVE_DIRCACHE)
-static struct tagfile_entry *get_tag(const struct index_entry *entry, int tag)
-{
-    return (struct tagfile_entry *)&tcramcache.hdr->tags[tag][entry->tag_seek[tag]];
-}
+    for (i = 0; i < entry.posting_count; i++)
+    {
+        if (!sortidx_read(si, sizeof(struct sortidx_header) +
+                          si->count * sizeof(struct sortidx_entry) +
+                          (entry.posting_start + i) * sizeof(int32_t),
+                          &idx_id, sizeof(idx_id)))
+            return false;
 
-static long get_tag_numeric(const struct index_entry *entry, int tag, int idx_id)
-{
-    return check_virtual_tags(tag, idx_id, entry);
-}
+        if (idx_id >= 0 && idx_id < current_tcmh.tch.entry_count
+            && get_index(tcs->masterfd, idx_id, &idx, tcs->ramsearch))
+            return true;
+    }
 
-static char* get_tag_string(const struct index_entry *entry, int tag)
-{
-    char* s = get_tag(entry, tag)->tag_data;
-    return strcmp(s, UNTAGGED) ? s : NULL;
+    return false;
 }
 
-bool tagcache_fill_tags(struct mp3entry *id3, const char *filename)
+/**
+ * Drop the strings of the seek list whose entries have all been deleted,
+ * as the word index still lists them until the next full commit. Strings
+ * are looked up in the postings of the sorted index, entries added by
+ * delta commits since are scanned once for the whole list.
+ */
+static void words_drop_unused(struct tagcache_search *tcs,
+                              char *buf, long bufsz)
 {
-    struct index_entry *entry;
-    int idx_id;
-
-    if (!tc_stat.ready || !tc_stat.ramcache)
-        return false;
+    struct tagcache_sortidx si;
+    struct index_entry idx;
+    bool used[SEEK_LIST_SIZE];
+    int32_t master_count, idx_id;
+    int i, j, unused = 0;
+
+    /* Without the sorted index rely on delete_entry() having blanked
+       strings no longer in use. */
+    memset(&si, 0, sizeof(si));
+    if (!sortidx_open(&si, tcs->type, &master_count))
+        return;
 
-    /* Find the corresponding entry in tagcache. */
+    if (tcs->masterfd < 0)
+    {
+        struct master_header tcmh;
+        tcs->masterfd = open_master_fd(&tcmh, false);
+    }
 
-    if (filename != NULL)
-        memset(id3, 0, sizeof(struct mp3entry));
-    else /* Note: caller clears id3 prior to call */
-        filename = id3->path;
+    for (i = 0; i < tcs->seek_list_count; i++)
+    {
+        used[i] = sortidx_str_used(tcs, &si, tcs->seeklist[i].seek,
+                                   buf, bufsz);
+        if (!used[i])
+            unused++;
+    }
 
-    idx_id = find_entry_ram(filename);
-    if (idx_id < 0)
-        return false;
+    sortidx_close(&si);
 
-    entry = &tcramcache.hdr->indices[idx_id];
-   
-    char* buf = id3->id3v2buf;
-    ssize_t remaining = sizeof(id3->id3v2buf);
+    for (idx_id = master_count;
+         unused > 0 && idx_id < current_tcmh.tch.entry_count; idx_id++)
+    {
+        if (!get_index(tcs->masterfd, idx_id, &idx, tcs->ramsearch))
+            continue;
 
-    /* this macro sets id3 strings by copying to the id3v2buf */
-#define SET(x, y) do                                                           \
-    {                                                                          \
-        if (remaining > 0)                                                     \
-        {                                                                      \
-            x          = NULL; /* initialize with null if tag doesn't exist */ \
-            char* src = get_tag_string(entry, y);                              \
-            if (src)                                                           \
-            {                                                                  \
-                x = buf;                                                       \
-                size_t len = strlcpy(buf, src, remaining) +1;                  \
-                buf += len; remaining -= len;                                  \
-            }                                                                  \
-        }                                                                      \
-    } while(0)
+        for (i = 0; i < tcs->seek_list_count; i++)
+        {
+            if (!used[i] && idx.tag_seek[tcs->type] == tcs->seeklist[i].seek)
+            {
+                used[i] = true;
+                unused--;
+            }
+        }
+    }
 
+    for (i = 0, j = 0; i < tcs->seek_list_count; i++)
+    {
+        if (used[i])
+            tcs->seeklist[j++] = tcs->seeklist[i];
+    }
 
-    SET(id3->title,         tag_title);
-    SET(id3->artist,        tag_artist);
-    SET(id3->album,         tag_album);
-    SET(id3->genre_string,  tag_genre);
-    SET(id3->composer,      tag_composer);
-    SET(id3->comment,       tag_comment);
-    SET(id3->albumartist,   tag_albumartist);
-    SET(id3->grouping,      tag_grouping);
+    tcs->seek_list_count = j;
+}
 
-    id3->length     = get_tag_numeric(entry, tag_length, idx_id);
-    id3->playcount  = get_tag_numeric(entry, tag_playcount, idx_id);
-    id3->rating     = get_tag_numeric(entry, tag_rating, idx_id);
-    id3->lastplayed = get_tag_numeric(entry, tag_lastplayed, idx_id);
-    id3->score      = get_tag_numeric(entry, tag_virt_autoscore, idx_id) / 10;
-    id3->year       = get_tag_numeric(entry, tag_year, idx_id);
+static bool build_lookup_list_words(struct tagcache_search *tcs)
+{
+    struct tagcache_sortidx *si = &tcs->sortidx;
+    int32_t postings[SEEK_LIST_SIZE];
+    char buf[TAGCACHE_BUFSZ];
+    const char *str;
+    int32_t length;
+    int i, count = 0;
 
-    id3->discnum = get_tag_numeric(entry, tag_discnumber, idx_id);
-    id3->tracknum = get_tag_numeric(entry, tag_tracknumber, idx_id);
-    id3->bitrate = get_tag_numeric(entry, tag_bitrate, idx_id);
-    if (id3->bitrate == 0)
-        id3->bitrate = 1;
+    if (!tcs->ramsearch && !open_files(tcs, tcs->type))
+        return false;
 
-    if (global_settings.autoresume_enable)
+    while (true)
     {
-        id3->elapsed = get_tag_numeric(entry, tag_lastelapsed, idx_id);
-        logf("tagcache_fill_tags: Set elapsed for %s to %lX\n",
-             id3->title, id3->elapsed);
+        /* Candidates from the word index... */
+        while (si->fd >= 0 && tcs->seek_list_count < SEEK_LIST_SIZE)
+        {
+            if (si->posting_pos == si->posting_end)
+            {
+                if (tcs->word_pos >= tcs->word_end)
+                    break;
 
-        id3->offset = get_tag_numeric(entry, tag_lastoffset, idx_id);
-        logf("tagcache_fill_tags: Set offset for %s to %lX\n",
-             id3->title, id3->offset);
-    }
+                if (!wordidx_get_word(si, tcs->word_pos++, tcs->word,
+                                      sizeof(tcs->word), &si->posting_pos,
+                                      &si->posting_end))
+                {
+                    logf("word index: read error");
+                    tcs->word_pos = tcs->word_end;
+                    si->posting_pos = si->posting_end;
+                    break;
+                }
 
-    return true;
-}
-#endif /* defined(HAVE_TC_RAMCACHE) && defined(HAVE_DIRCACHE) */
+                continue;
+            }
 
-static inline void write_item(const char *item)
-{
-    int len = strlen(item) + 1;
+            count = MIN(SEEK_LIST_SIZE - tcs->seek_list_count,
+                        si->posting_end - si->posting_pos);
+            if (!sortidx_read(si, sizeof(struct wordidx_header) +
+                              (si->count + 1) * sizeof(struct wordidx_entry) +
+                              si->posting_pos * sizeof(int32_t),
+                              postings, count * sizeof(int32_t)))
+            {
+                logf("word index: read error");
+                tcs->word_pos = tcs->word_end;
+                si->posting_pos = si->posting_end;
+                break;
+            }
 
-    data_size += len;
-    write(cachefd, item, len);
-}
+            for (i = 0; i < count; i++)
+            {
+                str = read_tag_str(tcs->ramsearch, tcs->idxfd[tcs->type],
+                                   tcs->type, postings[i], buf, sizeof(buf),
+                                   NULL);
+                if (str && words_match(tcs->words, str, tcs->words_driver,
+                                       tcs->word))
+                    add_words_entry(tcs, postings[i]);
+            }
 
-static int check_if_empty(char **tag)
-{
-    int length;
+            si->posting_pos += count;
+            yield();
+        }
 
-    if (*tag == NULL || **tag == '\0')
-    {
-        *tag = UNTAGGED;
-        return sizeof(UNTAGGED); /* Tag length */
-    }
+        /* ...and from the strings not covered by it. */
+        while (tcs->seek_list_count < SEEK_LIST_SIZE
+               && tcs->seek_pos > 0 && tcs->seek_pos < tcs->words_end)
+        {
+            str = read_tag_str(tcs->ramsearch, tcs->idxfd[tcs->type],
+                               tcs->type, tcs->seek_pos, buf, sizeof(buf),
+                               &length);
+            if (str == NULL)
+            {
+                logf("word search: read error");
+                tcs->seek_pos = 0;
+                break;
+            }
 
-    length = strlen(*tag);
-    if (length > TAG_MAXLEN)
-    {
-        logf("over length tag: %s", *tag);
-        length = TAG_MAXLEN;
-        str_setlen((*tag), length);
+            if (words_match(tcs->words, str, -1, NULL))
+                add_words_entry(tcs, tcs->seek_pos);
+
+            tcs->seek_pos += sizeof(struct tagfile_entry) + length;
+            if (++count % SEEK_LIST_SIZE == 0)
+                yield();
+        }
+
+        if (tcs->seek_list_count == 0)
+            break;
+
+        words_drop_unused(tcs, buf, sizeof(buf));
+
+        /* Don't end the search while there are candidates left. */
+        if (tcs->seek_list_count > 0
+            || ((si->fd < 0 || (si->posting_pos == si->posting_end
+                                && tcs->word_pos >= tcs->word_end))
+                && (tcs->seek_pos <= 0 || tcs->seek_pos >= tcs->words_end)))
+            break;
     }
 
-    return length + 1;
+    return tcs->seek_list_count > 0;
 }
 
-/* GCC 3.4.6 for Coldfire can choose to inline this function. Not a good
- * idea, as it uses lots of stack and is called from a recursive function
- * (check_dir).
- */
-static void NO_INLINE add_tagcache(char *path, unsigned long mtime)
+static bool build_lookup_list(struct tagcache_search *tcs)
 {
-    #define ADD_TAG(entry, tag, data) \
-        /* Adding tag */                              \
-        entry.tag_length[tag] = check_if_empty(data); \
-        entry.tag_offset[tag] = offset;               \
-        offset += entry.tag_length[tag]
+    struct index_entry entry;
+    int i;
 
-    struct mp3entry id3;
-    struct temp_file_entry entry;
-    bool ret;
-    int idx_id = -1;
-    char tracknumfix[3];
-    int offset = 0;
-    int path_length = strlen(path);
-    bool has_artist;
-    bool has_grouping;
+    tcs->seek_list_count = 0;
 
-#ifdef SIMULATOR
-    /* Crude logging for the sim - to aid in debugging */
-    int logfd = open(ROCKBOX_DIR "/database.log",
-                     O_WRONLY | O_APPEND | O_CREAT, 0666);
-    if (logfd >= 0)
+    if (tcs->words)
+        return build_lookup_list_words(tcs);
+
+    if (!tcs->sortidx_checked)
     {
-        write(logfd, path, strlen(path));
-        write(logfd, "\n", 1);
-        close(logfd);
+        tcs->sortidx_checked = true;
+        sortidx_plan(tcs);
     }
-#endif /* SIMULATOR */
-
-    if (cachefd < 0)
-        return ;
 
-    /* Check for overlength file path. */
-    if (path_length > TAG_MAXLEN)
+    if (tcs->sortidx.fd >= 0)
     {
-        /* Path can't be shortened. */
-        logf("Too long path: %s", path);
-        return ;
+        build_lookup_list_sortidx(tcs);
+        if (tcs->seek_list_count == SEEK_LIST_SIZE
+            || tcs->sortidx.posting_pos < tcs->sortidx.posting_end)
+            return true;
     }
 
-    /* Check if the file is supported. */
-    if (probe_file_format(path) == AFMT_UNKNOWN)
-        return ;
-
-    /* Check if the file is already cached. */
-#if defined(HAVE_TC_RAMCACHE) && defined(HAVE_DIRCACHE)
-    idx_id = find_entry_ram(path);
-#endif
-
-    /* Be sure the entry doesn't exist. */
-    if (filenametag_fd >= 0 && idx_id < 0)
-        idx_id = find_entry_disk(path, false);
-
-    /* Check if file has been modified. */
-    if (idx_id >= 0)
+#ifdef HAVE_TC_RAMCACHE
+    if (tcs->ramsearch)
     {
-        struct index_entry idx;
-
-        /* TODO: Mark that the index exists (for fast reverse scan) */
-        //found_idx[idx_id/8] |= idx_id%8;
+        tcrc_buffer_lock(); /* lock because below makes a pointer to movable data */
 
-        if (!get_index(-1, idx_id, &idx, true))
+        for (i = tcs->seek_pos; i < current_tcmh.tch.entry_count; i++)
         {
-            logf("failed to retrieve index entry");
-            return ;
-        }
+            if (tcs->seek_list_count == SEEK_LIST_SIZE)
+                break ;
 
-        if ((unsigned long)idx.tag_seek[tag_mtime] == mtime)
-        {
-            /* No changes to file. */
-            return ;
+            /* idx points to movable data, don't yield or reload */
+            add_seeklist_entry(tcs, &tcramcache.hdr->indices[i], i);
         }
 
-        /* Metadata might have been changed. Delete the entry. */
-        logf("Re-adding: %s", path);
-        if (!delete_entry(idx_id))
-        {
-            logf("delete_entry failed: %d", idx_id);
-            return ;
-        }
-    }
+        tcrc_buffer_unlock();
 
-    /*memset(&id3, 0, sizeof(struct mp3entry)); -- get_metadata does this for us */
-    memset(&entry, 0, sizeof(struct temp_file_entry));
-    memset(&tracknumfix, 0, sizeof(tracknumfix));
-    ret = get_metadata_ex(&id3, -1, path, METADATA_EXCLUDE_ID3_PATH);
+        tcs->seek_pos = i;
 
-    if (!ret)
-    {
-        logf("get_metadata fail: %s", path);
-        return ;
+        return tcs->seek_list_count > 0;
     }
+#endif /* HAVE_TC_RAMCACHE */
 
-    logf("-> %s", path);
-
-    if (id3.tracknum <= 0)              /* Track number missing? */
+    if (tcs->masterfd < 0)
     {
-        id3.tracknum = -1;
+        struct master_header tcmh;
+        tcs->masterfd = open_master_fd(&tcmh, false);
     }
 
-    /* Numeric tags */
-    entry.tag_offset[tag_year] = id3.year;
-    entry.tag_offset[tag_discnumber] = id3.discnum;
-    entry.tag_offset[tag_tracknumber] = id3.tracknum;
-    entry.tag_offset[tag_length] = id3.length;
-    entry.tag_offset[tag_bitrate] = id3.bitrate;
-    entry.tag_offset[tag_mtime] = mtime;
+    lseek(tcs->masterfd, tcs->seek_pos * sizeof(struct index_entry) +
+            sizeof(struct master_header), SEEK_SET);
 
-    /* String tags. */
-    has_artist = id3.artist != NULL
-        && strlen(id3.artist) > 0;
-    has_grouping = id3.grouping != NULL
-        && strlen(id3.grouping) > 0;
-
-    ADD_TAG(entry, tag_filename, &path);
-    ADD_TAG(entry, tag_title, &id3.title);
-    ADD_TAG(entry, tag_artist, &id3.artist);
-    ADD_TAG(entry, tag_album, &id3.album);
-    ADD_TAG(entry, tag_genre, &id3.genre_string);
-    ADD_TAG(entry, tag_composer, &id3.composer);
-    ADD_TAG(entry, tag_comment, &id3.comment);
-    ADD_TAG(entry, tag_albumartist, &id3.albumartist);
-    if (has_artist)
-    {
-        ADD_TAG(entry, tag_virt_canonicalartist, &id3.artist);
-    }
-    else
-    {
-        ADD_TAG(entry, tag_virt_canonicalartist, &id3.albumartist);
-    }
-    if (has_grouping)
-    {
-        ADD_TAG(entry, tag_grouping, &id3.grouping);
-    }
-    else
+    while (read_index_entries(tcs->masterfd, &entry, 1) == sizeof(struct index_entry))
     {
-        ADD_TAG(entry, tag_grouping, &id3.title);
-    }
-    entry.data_length = offset;
+        if (tcs->seek_list_count == SEEK_LIST_SIZE)
+            break ;
 
-    /* Write the header */
-    write(cachefd, &entry, sizeof(struct temp_file_entry));
+        i = tcs->seek_pos;
+        tcs->seek_pos++;
 
-    /* And tags also... Correct order is critical */
-    write_item(path);
-    write_item(id3.title);
-    write_item(id3.artist);
-    write_item(id3.album);
-    write_item(id3.genre_string);
-    write_item(id3.composer);
-    write_item(id3.comment);
-    write_item(id3.albumartist);
-    if (has_artist)
-    {
-        write_item(id3.artist);
-    }
-    else
-    {
-        write_item(id3.albumartist);
-    }
-    if (has_grouping)
-    {
-        write_item(id3.grouping);
+        if (add_seeklist_entry(tcs, &entry, i))
+            yield();
     }
-    else
-    {
-        write_item(id3.title);
-    }
-
-    total_entry_count++;
 
-    #undef ADD_TAG
+    return tcs->seek_list_count > 0;
 }
-#endif /*!defined(PLUGIN)*/
 
 
-static bool tempbuf_insert(char *str, int id, int idx_id, bool unique)
+bool tagcache_search(struct tagcache_search *tcs, int tag)
 {
-    struct tempbuf_searchidx *index = (struct tempbuf_searchidx *)tempbuf;
-    int len = strlen(str)+1;
+    /* NOTE: call tagcache_search_finish(&tcs) when finished or BAD things may happen (TM) */
+    struct tagcache_header tag_hdr;
+    struct master_header   master_hdr;
     int i;
-    unsigned *crcbuf = (unsigned *)&tempbuf[tempbuf_size-4];
-    unsigned crc32 = 0xffffffff;
-    char chr_lower;
-    for (i = 0; str[i] != '\0' && i < len -1; i++)
-    {
-        chr_lower = tolower(str[i]);
-        crc32 = crc_32(&chr_lower, 1, crc32);
-    }
 
-    if (unique)
-    {
-        /* Check if the crc does not exist -> entry does not exist for sure. */
-        for (i = 0; i < tempbufidx; i++)
-        {
-            if (crcbuf[-i] != crc32)
-                continue;
+    while (read_lock)
+        sleep(1);
 
-            if (!strcasecmp(str, index[i].str))
-            {
-                if (id < 0 || id >= lookup_buffer_depth)
-                {
-                    logf("lookup buf overf.: %d", id);
-                    return false;
-                }
+    memset(tcs, 0, sizeof(struct tagcache_search));
+    if (tc_stat.commit_step > 0 || !tc_stat.ready)
+        return false;
 
-                lookup[id] = &index[i];
-                return true;
-            }
-        }
-    }
+    tcs->position = sizeof(struct tagcache_header);
+    tcs->type = tag;
+    tcs->seek_pos = 0;
+    tcs->list_position = 0;
+    tcs->seek_list_count = 0;
+    tcs->filter_count = 0;
+    tcs->masterfd = -1;
+    tcs->sortidx.fd = -1;
 
-    /* Insert to CRC buffer. */
-    crcbuf[-tempbufidx] = crc32;
-    tempbuf_left -= 4;
+    for (i = 0; i < TAG_COUNT; i++)
+        tcs->idxfd[i] = -1;
 
-    /* Insert it to the buffer. */
-    tempbuf_left -= len;
-    if (tempbuf_left - 4 < 0 || tempbufidx >= commit_entry_count)
+#ifndef HAVE_TC_RAMCACHE
+    tcs->ramsearch = false;
+#else
+    tcs->ramsearch = tc_stat.ramcache;
+    if (tcs->ramsearch)
     {
-        logf("temp buf error rem: %ld idx: %d / %d",
-             tempbuf_left, tempbufidx, commit_entry_count-1);
-        return false;
+        tcs->entry_count = tcramcache.hdr->entry_count[tcs->type];
     }
-    if (id >= lookup_buffer_depth)
+    else
+#endif
     {
-        logf("lookup buf overf. #2: %d", id);
-        return false;
-    }
+        /* Always open as R/W so we can pass tcs to functions that modify data also
+         * without failing. */
+        tcs->masterfd = open_master_fd(&master_hdr, true);
+        if (tcs->masterfd < 0)
+            return false;
 
-    if (id >= 0)
-    {
-        lookup[id] = &index[tempbufidx];
-        index[tempbufidx].idlist.id = id;
+        if (!TAGCACHE_IS_NUMERIC(tcs->type))
+        {
+            tcs->idxfd[tcs->type] = open_tag_fd(&tag_hdr, tcs->type, false);
+            if (tcs->idxfd[tcs->type] < 0)
+                return false;
+
+            tcs->entry_count = tag_hdr.entry_count;
+        }
+        else
+        {
+            tcs->entry_count = master_hdr.tch.entry_count;
+        }
     }
-    else
-        index[tempbufidx].idlist.id = -1;
 
-    index[tempbufidx].idlist.next = NULL;
-    index[tempbufidx].idx_id = idx_id;
-    index[tempbufidx].seek = -1;
-    index[tempbufidx].str = &tempbuf[tempbuf_pos];
-    memcpy(index[tempbufidx].str, str, len);
-    tempbuf_pos += len;
-    tempbufidx++;
+    tcs->valid = true;
+    tcs->initialized = true;
+    write_lock++;
 
     return true;
 }
 
-static int compare(const void *p1, const void *p2)
+void tagcache_search_set_uniqbuf(struct tagcache_search *tcs,
+                                 void *buffer, long length)
 {
-    do_timed_yield();
+    tcs->unique_list = (uint32_t *)buffer;
+    tcs->unique_list_capacity = length / sizeof(*tcs->unique_list);
+    tcs->unique_list_count = 0;
+    memset(tcs->unique_list, 0, tcs->unique_list_capacity);
+}
 
-    struct tempbuf_searchidx *e1 = (struct tempbuf_searchidx *)p1;
-    struct tempbuf_searchidx *e2 = (struct tempbuf_searchidx *)p2;
+bool tagcache_search_add_filter(struct tagcache_search *tcs,
+                                int tag, int seek)
+{
+    if (tcs->filter_count == TAGCACHE_MAX_FILTERS)
+        return false;
 
-    if (strcmp(e1->str, UNTAGGED) == 0)
-    {
-        if (strcmp(e2->str, UNTAGGED) == 0)
-            return 0;
-        return -1;
-    }
-    else if (strcmp(e2->str, UNTAGGED) == 0)
-        return 1;
+    if (TAGCACHE_IS_NUMERIC_OR_NONUNIQUE(tag))
+        return false;
 
-    return strncasecmp(e1->str, e2->str, TAG_MAXLEN);
+    tcs->filter_tag[tcs->filter_count] = tag;
+    tcs->filter_seek[tcs->filter_count] = seek;
+    tcs->filter_count++;
+
+    return true;
 }
 
-static int tempbuf_sort(int fd)
+bool tagcache_search_add_clause(struct tagcache_search *tcs,
+                                struct tagcache_search_clause *clause)
 {
-    struct tempbuf_searchidx *index = (struct tempbuf_searchidx *)tempbuf;
-    struct tagfile_entry fe;
     int i;
-    int length;
+    int clause_count = tcs->clause_count;
 
-    /* Generate reverse lookup entries. */
-    for (i = 0; i < lookup_buffer_depth; i++)
+    if (clause_count >= TAGCACHE_MAX_CLAUSES)
     {
-        struct tempbuf_id_list *idlist;
+        logf("Too many clauses");
+        return false;
+    }
 
-        if (!lookup[i])
-            continue;
+    if (clause->type != clause_logical_or)
+    {
+        /* BUGFIX OR'd clauses seem to be mishandled once made into a filter */
+        if (clause_count <= 1 || tcs->clause[clause_count - 1]->type != clause_logical_or)
+        {
+            /* Check if there is already a similar filter in present (filters are
+             * much faster than clauses).
+             */
+            for (i = 0; i < tcs->filter_count; i++)
+            {
+                if (tcs->filter_tag[i] == clause->tag)
+                {
+                    return true;
+                }
+            }
+        }
 
-        if (lookup[i]->idlist.id == i)
-            continue;
+        if (!TAGCACHE_IS_NUMERIC(clause->tag) && tcs->idxfd[clause->tag] < 0)
+        {
+            char fname[MAX_PATH];
+            tcs->idxfd[clause->tag] = open_pathfmt(fname, sizeof(fname), O_RDONLY,
+                                                   "%s/" TAGCACHE_FILE_INDEX,
+                                                   tc_stat.db_path, clause->tag);
+        }
+    }
 
-        idlist = &lookup[i]->idlist;
-        while (idlist->next != NULL)
-            idlist = idlist->next;
+    tcs->clause[tcs->clause_count] = clause;
+    tcs->clause_count++;
 
-        ALIGN_BUFFER(tempbuf_pos, tempbuf_left, alignof(struct tempbuf_id_list));
-        tempbuf_left -= sizeof(struct tempbuf_id_list);
-        if (tempbuf_left < 0)
-            return -1;
+    return true;
+}
 
-        idlist->next = (struct tempbuf_id_list *)&tempbuf[tempbuf_pos];
-        tempbuf_pos += sizeof(struct tempbuf_id_list);
+/**
+ * Search the strings of a sorted tag containing words starting with each
+ * of the given words, ignoring case and punctuation ("bea abb" finds
+ * "ABBA - The Best of Beatles"). Each string is returned once, in no
+ * particular order. The words are used until tagcache_search_finish().
+ */
+bool tagcache_search_words(struct tagcache_search *tcs, int tag,
+                           const char *words)
+{
+    struct tagcache_sortidx *si = &tcs->sortidx;
+    struct tagcache_header tch;
+    char qwords[TAGCACHE_MAX_WORDS][TAGCACHE_WORD_LEN];
+    int32_t lo, hi, start, end, best = -1;
+    int i, count, fd;
 
-        idlist = idlist->next;
-        idlist->id = i;
-        idlist->next = NULL;
+    if (!TAGCACHE_IS_SORTED(tag) || !tagcache_search(tcs, tag))
+        return false;
 
-        do_timed_yield();
+    count = split_words(words, qwords);
+    fd = open_tag_fd(&tch, tag, false);
+    if (count == 0 || fd < 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        tagcache_search_finish(tcs);
+        return false;
     }
 
-    qsort(index, tempbufidx, sizeof(struct tempbuf_searchidx), compare);
-    memset(lookup, 0, lookup_buffer_depth * sizeof(struct tempbuf_searchidx **));
+    close(fd);
+    tcs->words = words;
+    tcs->words_end = sizeof(struct tagcache_header) + tch.datasize;
 
-    for (i = 0; i < tempbufidx; i++)
+    /* Without a word index, scan all the strings. */
+    tcs->seek_pos = sizeof(struct tagcache_header);
+    if (!TAGCACHE_HAS_WORDIDX(tag) || !wordidx_open(si, tag))
+        return true;
+
+    /* Walk the postings of the rarest query word and check the others on
+       the strings found. Strings added by delta commits come last. */
+    for (i = 0; i < count; i++)
     {
-        struct tempbuf_id_list *idlist = &index[i].idlist;
+        lo = wordidx_bound(si, qwords[i], false);
+        hi = wordidx_bound(si, qwords[i], true);
+        if (lo < 0 || hi < 0)
+            break;
 
-        /* Fix the lookup list. */
-        while (idlist != NULL)
+        start = end = 0;
+        if (lo < hi
+            && (!wordidx_get_word(si, lo, tcs->word, sizeof(tcs->word),
+                                  &start, NULL)
+                || !wordidx_get_word(si, hi - 1, tcs->word, sizeof(tcs->word),
+                                     NULL, &end)))
+            break;
+
+        if (best < 0 || end - start < best)
         {
-            if (idlist->id >= 0)
-                lookup[idlist->id] = &index[i];
-            idlist = idlist->next;
+            best = end - start;
+            tcs->words_driver = i;
+            tcs->word_pos = lo;
+            tcs->word_end = hi;
         }
+    }
 
-        index[i].seek = lseek(fd, 0, SEEK_CUR);
-        length = strlen(index[i].str) + 1;
-        fe.tag_length = length;
-        fe.idx_id = index[i].idx_id;
+    if (i < count)
+    {
+        logf("word index: read error");
+        sortidx_close(si);
+        return true;
+    }
+
+    tcs->seek_pos = tc_delta.magic == TAGCACHE_MAGIC ?
+                    tc_delta.tail_seek[tag] : 0;
+    logf("word index %d: %ld postings", tag, (long)best);
+
+    return true;
+}
+
+static bool get_next(struct tagcache_search *tcs, bool is_numeric, char *buf, long bufsz)
+{
+    struct tagfile_entry entry;
+#if defined(HAVE_TC_RAMCACHE) && defined(HAVE_DIRCACHE)
+    long flag = 0;
+#endif
+
+    if (tcs->idxfd[tcs->type] < 0 && !is_numeric
+#ifdef HAVE_TC_RAMCACHE
+        && !tcs->ramsearch
+#endif
+        )
+        return false;
+
+    /* Relative fetch. */
+    if (tcs->filter_count > 0 || tcs->clause_count > 0 || is_numeric
+        || tcs->words
+#if defined(HAVE_TC_RAMCACHE) && defined(HAVE_DIRCACHE)
+        /* We need to retrieve flag status for dircache. */
+        || (tcs->ramsearch && tcs->type == tag_filename)
+#endif
+        )
+    {
+        struct tagcache_seeklist_entry *seeklist;
 
-        /* Check the chunk alignment. */
-        if ((fe.tag_length + sizeof(struct tagfile_entry))
-            % TAGFILE_ENTRY_CHUNK_LENGTH)
+        /* Check for end of list. */
+        if (tcs->list_position == tcs->seek_list_count)
         {
-            fe.tag_length += TAGFILE_ENTRY_CHUNK_LENGTH -
-                ((fe.tag_length + sizeof(struct tagfile_entry))
-                 % TAGFILE_ENTRY_CHUNK_LENGTH);
+            tcs->list_position = 0;
+
+            /* Try to fetch more. */
+            if (!build_lookup_list(tcs))
+            {
+                tcs->valid = false;
+                return false;
+            }
         }
 
-        if (write_tagfile_entry(fd, &fe) != sizeof(struct tagfile_entry))
+        seeklist = &tcs->seeklist[tcs->list_position];
+#if defined(HAVE_TC_RAMCACHE) && defined(HAVE_DIRCACHE)
+        flag = seeklist->flag;
+#endif
+        tcs->position = seeklist->seek;
+        tcs->idx_id = seeklist->idx_id;
+        tcs->list_position++;
+    }
+    else
+    {
+        if (tcs->entry_count == 0)
         {
-            logf("tempbuf_sort: write error #1");
-            return -1;
+            tcs->valid = false;
+            return false;
+        }
+
+        tcs->entry_count--;
+    }
+
+    tcs->result_seek = tcs->position;
+
+    if (is_numeric)
+    {
+        snprintf(buf, bufsz, "%ld", tcs->position);
+        tcs->result = buf;
+        tcs->result_len = strlen(buf) + 1;
+        return true;
+    }
+
+    /* Direct fetch. */
+#ifdef HAVE_TC_RAMCACHE
+    if (tcs->ramsearch)
+    {
+#ifdef HAVE_DIRCACHE
+        if (tcs->type == tag_filename && (flag & FLAG_DIRCACHE))
+        {
+            ssize_t len = dircache_get_fileref_path(&tcrc_dcfrefs[tcs->idx_id],
+                                                    buf, bufsz);
+            if (len >= 0)
+            {
+                tcs->result_len = len + 1;
+                tcs->result     = buf;
+                tcs->ramresult  = false;
+                return true;
+            }
+            /* else do it the hard way */
         }
+#endif /* HAVE_DIRCACHE */
 
-        if (write(fd, index[i].str, length) != length)
+        if (tcs->type != tag_filename)
         {
-            logf("tempbuf_sort: write error #2");
-            return -2;
+            struct tagfile_entry *ep;
+
+            ep = (struct tagfile_entry *)&tcramcache.hdr->tags[tcs->type][tcs->position];
+            /* don't return ep->tag_data directly as it may move */
+            tcs->result_len = strlcpy(buf, ep->tag_data, bufsz) + 1;
+            tcs->result = buf;
+            tcs->idx_id = ep->idx_id;
+            tcs->ramresult = false; /* was true before we copied to buf too */
+
+            /* Increase position for the next run. This may get overwritten. */
+            tcs->position += sizeof(struct tagfile_entry) + ep->tag_length;
+
+            return true;
         }
+    }
+#endif /* HAVE_TC_RAMCACHE */
 
-        /* Write some padding. */
-        if (fe.tag_length - length > 0)
-            write(fd, "XXXXXXXX", fe.tag_length - length);
+    if (!open_files(tcs, tcs->type))
+    {
+        tcs->valid = false;
+        return false;
     }
 
-    return i;
+    /* Seek stream to the correct position and continue to direct fetch. */
+    lseek(tcs->idxfd[tcs->type], tcs->position, SEEK_SET);
+
+    switch (read_tagfile_entry_and_tag(tcs->idxfd[tcs->type], &entry, buf, bufsz))
+    {
+        case e_SUCCESS_LEN_ZERO:
+        case e_SUCCESS:
+             break;
+        case e_ENTRY_SIZEMISMATCH:
+            logf("read error #5");
+            tcs->valid = false;
+            return false;
+        case e_TAG_TOOLONG:
+            tcs->valid = false;
+            logf("too long tag #2");
+            logf("P:%lX/%lX", tcs->position, entry.tag_length);
+            return false;
+        case e_TAG_SIZEMISMATCH:
+            tcs->valid = false;
+            logf("read error #4");
+            return false;
+    }
+
+    /**
+     Update the position for the next read (this may be overridden
+     if filters or clauses are being used).
+     */
+    tcs->position += sizeof(struct tagfile_entry) + entry.tag_length;
+    str_setlen(buf, entry.tag_length);
+
+    tcs->result = buf;
+    tcs->result_len = entry.tag_length + 1;
+    tcs->idx_id = entry.idx_id;
+    tcs->ramresult = false;
+
+    return true;
 }
 
-inline static struct tempbuf_searchidx* tempbuf_locate(int id)
+bool tagcache_get_next(struct tagcache_search *tcs, char *buf, long size)
 {
-    if (id < 0 || id >= lookup_buffer_depth)
-        return NULL;
+    if (tcs->valid && tagcache_is_usable())
+    {
+        bool is_numeric = TAGCACHE_IS_NUMERIC(tcs->type);
+        while (get_next(tcs, is_numeric, buf, size))
+        {
+            if (tcs->result_len > 1)
+                return true;
+        }
+    }
+#ifdef LOGF_ENABLE
+    if (tcs->unique_list_count > 0)
+        logf(" uniqbuf: %d used / %d avail", tcs->unique_list_count, tcs->unique_list_capacity);
+#endif
 
-    return lookup[id];
+    return false;
 }
 
-
-inline static int tempbuf_find_location(int id)
+bool tagcache_retrieve(struct tagcache_search *tcs, int idxid,
+                       int tag, char *buf, long size)
 {
-    struct tempbuf_searchidx *entry;
+    struct index_entry idx;
 
-    entry = tempbuf_locate(id);
-    if (entry == NULL)
-        return -1;
+    *buf = '\0';
+    if (!get_index(tcs->masterfd, idxid, &idx, true))
+        return false;
 
-    return entry->seek;
+    return retrieve(tcs, IF_DIRCACHE(idxid,) &idx, tag, buf, size);
 }
 
-static bool build_numeric_indices(struct tagcache_header *h, int tmpfd)
+void tagcache_search_finish(struct tagcache_search *tcs)
 {
-    struct master_header tcmh;
-    struct index_entry idx;
-    int masterfd;
-    int masterfd_pos;
-    struct temp_file_entry *entrybuf = (struct temp_file_entry *)tempbuf;
-    int max_entries;
-    int entries_processed = 0;
-    int i, j;
+    int i;
 
-    max_entries = tempbuf_size / sizeof(struct temp_file_entry) - 1;
+    if (!tcs->initialized)
+        return;
 
-    logf("Building numeric indices...");
-    lseek(tmpfd, sizeof(struct tagcache_header), SEEK_SET);
+    if (tcs->masterfd >= 0)
+    {
+        close(tcs->masterfd);
+        tcs->masterfd = -1;
+    }
 
-    if ( (masterfd = open_master_fd(&tcmh, true)) < 0)
-        return false;
+    sortidx_close(&tcs->sortidx);
 
-    masterfd_pos = lseek(masterfd, tcmh.tch.entry_count * sizeof(struct index_entry),
-                         SEEK_CUR);
-    if (masterfd_pos < 0)
+    for (i = 0; i < TAG_COUNT; i++)
     {
-        logf("we can't append!");
-        close(masterfd);
-        return false;
+        if (tcs->idxfd[i] >= 0)
+        {
+            close(tcs->idxfd[i]);
+            tcs->idxfd[i] = -1;
+        }
     }
 
-    while (entries_processed < h->entry_count && !USR_CANCEL)
-    {
-        int count = MIN(h->entry_count - entries_processed, max_entries);
+    tcs->ramsearch = false;
+    tcs->valid = false;
+    tcs->initialized = 0;
+    if (write_lock > 0)
+        write_lock--;
+}
 
-        /* Read in as many entries as possible. */
-        for (i = 0; i < count; i++)
-        {
-            struct temp_file_entry *tfe = &entrybuf[i];
-            int datastart;
+#if defined(HAVE_TC_RAMCACHE) && defined(HAVE_DIRCACHE)
+static struct tagfile_entry *get_tag(const struct index_entry *entry, int tag)
+{
+    return (struct tagfile_entry *)&tcramcache.hdr->tags[tag][entry->tag_seek[tag]];
+}
 
-            /* Read in numeric data. */
-            if (read(tmpfd, tfe, sizeof(struct temp_file_entry)) !=
-                sizeof(struct temp_file_entry))
-            {
-                logf("read fail #1");
-                close(masterfd);
-                return false;
-            }
+static long get_tag_numeric(const struct index_entry *entry, int tag, int idx_id)
+{
+    return check_virtual_tags(tag, idx_id, entry);
+}
 
-            datastart = lseek(tmpfd, 0, SEEK_CUR);
+static char* get_tag_string(const struct index_entry *entry, int tag)
+{
+    char* s = get_tag(entry, tag)->tag_data;
+    return strcmp(s, UNTAGGED) ? s : NULL;
+}
 
-            /**
-             * Read string data from the following tags:
-             * - tag_filename
+bool tagcache_fill_tags(struct mp3entry *id3, const char *filename)
+{
+    struct index_entry *entry;
+    int idx_id;
+
+    if (!tc_stat.ready || !tc_stat.ramcache)
+        return false;
+
+    /* Find the corresponding entry in tagcache. */
+
+    if (filename != NULL)
+        memset(id3, 0, sizeof(struct mp3entry));
+    else /* Note: caller clears id3 prior to call */
+        filename = id3->path;
+
+    idx_id = find_entry_ram(filename);
+    if (idx_id < 0)
+        return false;
+
+    entry = &tcramcache.hdr->indices[idx_id];
+   
+    char* buf = id3->id3v2buf;
+    ssize_t remaining = sizeof(id3->id3v2buf);
+
+    /* this macro sets id3 strings by copying to the id3v2buf */
+#define SET(x, y) do                                                           \
+    {                                                                          \
+        if (remaining > 0)                                                     \
+        {                                                                      \
+            x          = NULL; /* initialize with null if tag doesn't exist */ \
+            char* src = get_tag_string(entry, y);                              \
+            if (src)                                                           \
+            {                                                                  \
+                x = buf;                                                       \
+                size_t len = strlcpy(buf, src, remaining) +1;                  \
+                buf += len; remaining -= len;                                  \
+            }                                                                  \
+        }                                                                      \
+    } while(0)
+
+
+    SET(id3->title,         tag_title);
+    SET(id3->artist,        tag_artist);
+    SET(id3->album,         tag_album);
+    SET(id3->genre_string,  tag_genre);
+    SET(id3->composer,      tag_composer);
+    SET(id3->comment,       tag_comment);
+    SET(id3->albumartist,   tag_albumartist);
+    SET(id3->grouping,      tag_grouping);
+
+    id3->length     = get_tag_numeric(entry, tag_length, idx_id);
+    id3->playcount  = get_tag_numeric(entry, tag_playcount, idx_id);
+    id3->rating     = get_tag_numeric(entry, tag_rating, idx_id);
+    id3->lastplayed = get_tag_numeric(entry, tag_lastplayed, idx_id);
+    id3->score      = get_tag_numeric(entry, tag_virt_autoscore, idx_id) / 10;
+    id3->year       = get_tag_numeric(entry, tag_year, idx_id);
+
+    id3->discnum = get_tag_numeric(entry, tag_discnumber, idx_id);
+    id3->tracknum = get_tag_numeric(entry, tag_tracknumber, idx_id);
+    id3->bitrate = get_tag_numeric(entry, tag_bitrate, idx_id);
+    if (id3->bitrate == 0)
+        id3->bitrate = 1;
+
+    if (global_settings.autoresume_enable)
+    {
+        id3->elapsed = get_tag_numeric(entry, tag_lastelapsed, idx_id);
+        logf("tagcache_fill_tags: Set elapsed for %s to %lX\n",
+             id3->title, id3->elapsed);
+
+        id3->offset = get_tag_numeric(entry, tag_lastoffset, idx_id);
+        logf("tagcache_fill_tags: Set offset for %s to %lX\n",
+             id3->title, id3->offset);
+    }
+
+    return true;
+}
+#endif /* defined(HAVE_TC_RAMCACHE) && defined(HAVE_DIRCACHE) */
+
+static inline void write_item(const char *item)
+{
+    int len = strlen(item) + 1;
+
+    data_size += len;
+    write(cachefd, item, len);
+}
+
+static int check_if_empty(char **tag)
+{
+    int length;
+
+    if (*tag == NULL || **tag == '\0')
+    {
+        *tag = UNTAGGED;
+        return sizeof(UNTAGGED); /* Tag length */
+    }
+
+    length = strlen(*tag);
+    if (length > TAG_MAXLEN)
+    {
+        logf("over length tag: %s", *tag);
+        length = TAG_MAXLEN;
+        str_setlen((*tag), length);
+    }
+
+    return length + 1;
+}
+
+/* Write the tags of a new file to the temporary db file. */
+static void add_tagcache_entry(char *path, unsigned long mtime,
+                               struct mp3entry *id3)
+{
+    #define ADD_TAG(entry, tag, data) \
+        /* Adding tag */                              \
+        entry.tag_length[tag] = check_if_empty(data); \
+        entry.tag_offset[tag] = offset;               \
+        offset += entry.tag_length[tag]
+
+    struct temp_file_entry entry;
+    int offset = 0;
+    bool has_artist;
+    bool has_grouping;
+
+    memset(&entry, 0, sizeof(struct temp_file_entry));
+
+    logf("-> %s", path);
+
+    if (id3->tracknum <= 0)              /* Track number missing? */
+    {
+        id3->tracknum = -1;
+    }
+
+    /* Numeric tags */
+    entry.tag_offset[tag_year] = id3->year;
+    entry.tag_offset[tag_discnumber] = id3->discnum;
+    entry.tag_offset[tag_tracknumber] = id3->tracknum;
+    entry.tag_offset[tag_length] = id3->length;
+    entry.tag_offset[tag_bitrate] = id3->bitrate;
+    entry.tag_offset[tag_mtime] = mtime;
+
+    /* String tags. */
+    has_artist = id3->artist != NULL
+        && strlen(id3->artist) > 0;
+    has_grouping = id3->grouping != NULL
+        && strlen(id3->grouping) > 0;
+
+    ADD_TAG(entry, tag_filename, &path);
+    ADD_TAG(entry, tag_title, &id3->title);
+    ADD_TAG(entry, tag_artist, &id3->artist);
+    ADD_TAG(entry, tag_album, &id3->album);
+    ADD_TAG(entry, tag_genre, &id3->genre_string);
+    ADD_TAG(entry, tag_composer, &id3->composer);
+    ADD_TAG(entry, tag_comment, &id3->comment);
+    ADD_TAG(entry, tag_albumartist, &id3->albumartist);
+    if (has_artist)
+    {
+        ADD_TAG(entry, tag_virt_canonicalartist, &id3->artist);
+    }
+    else
+    {
+        ADD_TAG(entry, tag_virt_canonicalartist, &id3->albumartist);
+    }
+    if (has_grouping)
+    {
+        ADD_TAG(entry, tag_grouping, &id3->grouping);
+    }
+    else
+    {
+        ADD_TAG(entry, tag_grouping, &id3->title);
+    }
+    entry.data_length = offset;
+
+    /* Write the header */
+    write(cachefd, &entry, sizeof(struct temp_file_entry));
+
+    /* And tags also... Correct order is critical */
+    write_item(path);
+    write_item(id3->title);
+    write_item(id3->artist);
+    write_item(id3->album);
+    write_item(id3->genre_string);
+    write_item(id3->composer);
+    write_item(id3->comment);
+    write_item(id3->albumartist);
+    if (has_artist)
+    {
+        write_item(id3->artist);
+    }
+    else
+    {
+        write_item(id3->albumartist);
+    }
+    if (has_grouping)
+    {
+        write_item(id3->grouping);
+    }
+    else
+    {
+        write_item(id3->title);
+    }
+
+    total_entry_count++;
+
+    #undef ADD_TAG
+}
+
+#ifdef TAGCACHE_SCAN_THREADS
+/**
+ * Metadata parsing of the database tool can run in a pool of threads.
+ * The directory scan keeps doing all database lookups and opens the files,
+ * the threads only parse them and the results get written to the temporary
+ * file by the scanning thread in the order they were queued. The db comes
+ * out exactly the same as from a serial scan.
+ */
+#define SCAN_QUEUE_SIZE 16   /* Files being parsed at once (open fds) */
+#define SCAN_THREADS_MAX 16
+
+struct scan_job {
+    int fd;
+    unsigned long mtime;
+    bool done;
+    bool ret;
+    char path[TAG_MAXLEN+1];
+    struct mp3entry id3;
+};
+
+static struct scan_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t threads[SCAN_THREADS_MAX];
+    int thread_count;
+    bool quit;
+    unsigned int head;   /* Next job to write */
+    unsigned int next;   /* Next job to parse */
+    unsigned int tail;   /* Next free job */
+    struct scan_job jobs[SCAN_QUEUE_SIZE];
+} scan_pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static int scan_thread_count;
+
+void tagcache_set_scan_threads(int count)
+{
+    scan_thread_count = MIN(MAX(count, 0), SCAN_THREADS_MAX);
+}
+
+static void * scan_thread(void *arg)
+{
+    struct scan_job *job;
+    (void)arg;
+
+    pthread_mutex_lock(&scan_pool.lock);
+    while (1)
+    {
+        while (!scan_pool.quit && scan_pool.next == scan_pool.tail)
+            pthread_cond_wait(&scan_pool.cond, &scan_pool.lock);
+
+        if (scan_pool.next == scan_pool.tail)
+            break;
+
+        job = &scan_pool.jobs[scan_pool.next++ % SCAN_QUEUE_SIZE];
+        pthread_mutex_unlock(&scan_pool.lock);
+
+        job->ret = get_metadata_ex(&job->id3, job->fd, job->path,
+                                   METADATA_EXCLUDE_ID3_PATH);
+
+        pthread_mutex_lock(&scan_pool.lock);
+        job->done = true;
+        pthread_cond_broadcast(&scan_pool.cond);
+    }
+    pthread_mutex_unlock(&scan_pool.lock);
+
+    return NULL;
+}
+
+/* Write the parsed jobs in queue order, waiting for at least one if asked. */
+static void scan_write_jobs(bool wait)
+{
+    struct scan_job *job;
+
+    pthread_mutex_lock(&scan_pool.lock);
+    while (scan_pool.head != scan_pool.tail)
+    {
+        job = &scan_pool.jobs[scan_pool.head % SCAN_QUEUE_SIZE];
+        if (!job->done)
+        {
+            if (!wait)
+                break;
+
+            pthread_cond_wait(&scan_pool.cond, &scan_pool.lock);
+            continue;
+        }
+
+        pthread_mutex_unlock(&scan_pool.lock);
+
+        close(job->fd);
+        if (job->ret)
+            add_tagcache_entry(job->path, job->mtime, &job->id3);
+        else
+            logf("get_metadata fail: %s", job->path);
+
+        pthread_mutex_lock(&scan_pool.lock);
+        scan_pool.head++;
+        wait = false;
+    }
+    pthread_mutex_unlock(&scan_pool.lock);
+}
+
+static void scan_queue_file(const char *path, unsigned long mtime)
+{
+    struct scan_job *job;
+    int fd;
+
+    if (scan_pool.tail - scan_pool.head == SCAN_QUEUE_SIZE)
+        scan_write_jobs(true);
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        logf("get_metadata fail: %s", path);
+        return ;
+    }
+
+    job = &scan_pool.jobs[scan_pool.tail % SCAN_QUEUE_SIZE];
+    job->fd = fd;
+    job->mtime = mtime;
+    job->done = false;
+    strmemccpy(job->path, path, sizeof(job->path));
+
+    pthread_mutex_lock(&scan_pool.lock);
+    scan_pool.tail++;
+    pthread_cond_signal(&scan_pool.cond);
+    pthread_mutex_unlock(&scan_pool.lock);
+
+    /* Keep the queue short so results don't wait for the writer. */
+    scan_write_jobs(false);
+}
+
+static void scan_threads_start(void)
+{
+    int i;
+
+    scan_pool.quit = false;
+    scan_pool.head = scan_pool.next = scan_pool.tail = 0;
+    scan_pool.thread_count = 0;
+
+    for (i = 0; i < scan_thread_count; i++)
+    {
+        if (pthread_create(&scan_pool.threads[i], NULL, scan_thread, NULL))
+            break;
+
+        scan_pool.thread_count++;
+    }
+
+    logf("%d scan threads", scan_pool.thread_count);
+}
+
+static void scan_threads_stop(void)
+{
+    int i;
+
+    if (scan_pool.thread_count == 0)
+        return ;
+
+    scan_write_jobs(false);
+    while (scan_pool.head != scan_pool.tail)
+        scan_write_jobs(true);
+
+    pthread_mutex_lock(&scan_pool.lock);
+    scan_pool.quit = true;
+    pthread_cond_broadcast(&scan_pool.cond);
+    pthread_mutex_unlock(&scan_pool.lock);
+
+    for (i = 0; i < scan_pool.thread_count; i++)
+        pthread_join(scan_pool.threads[i], NULL);
+
+    scan_pool.thread_count = 0;
+}
+#endif /* TAGCACHE_SCAN_THREADS */
+
+/* GCC 3.4.6 for Coldfire can choose to inline this function. Not a good
+ * idea, as it uses lots of stack and is called from a recursive function
+ * (check_dir).
+ */
+static void NO_INLINE add_tagcache(char *path, unsigned long mtime)
+{
+    struct mp3entry id3;
+    bool ret;
+    int idx_id = -1;
+    int path_length = strlen(path);
+
+#ifdef SIMULATOR
+    /* Crude logging for the sim - to aid in debugging */
+    int logfd = open(ROCKBOX_DIR "/database.log",
+                     O_WRONLY | O_APPEND | O_CREAT, 0666);
+    if (logfd >= 0)
+    {
+        write(logfd, path, strlen(path));
+        write(logfd, "\n", 1);
+        close(logfd);
+    }
+#endif /* SIMULATOR */
+
+    if (cachefd < 0)
+        return ;
+
+    /* Check for overlength file path. */
+    if (path_length > TAG_MAXLEN)
+    {
+        /* Path can't be shortened. */
+        logf("Too long path: %s", path);
+        return ;
+    }
+
+    /* Check if the file is supported. */
+    if (probe_file_format(path) == AFMT_UNKNOWN)
+        return ;
+
+    /* Check if the file is already cached. */
+#if defined(HAVE_TC_RAMCACHE) && defined(HAVE_DIRCACHE)
+    idx_id = find_entry_ram(path);
+#endif
+
+    /* Be sure the entry doesn't exist. */
+    if (filenametag_fd >= 0 && idx_id < 0)
+        idx_id = find_entry_disk(path, false);
+
+    /* Check if file has been modified. */
+    if (idx_id >= 0)
+    {
+        struct index_entry idx;
+
+        /* TODO: Mark that the index exists (for fast reverse scan) */
+        //found_idx[idx_id/8] |= idx_id%8;
+
+        if (!get_index(-1, idx_id, &idx, true))
+        {
+            logf("failed to retrieve index entry");
+            return ;
+        }
+
+        if ((unsigned long)idx.tag_seek[tag_mtime] == mtime)
+        {
+            /* No changes to file. */
+            return ;
+        }
+
+        /* Metadata might have been changed. Delete the entry. */
+        logf("Re-adding: %s", path);
+        if (!delete_entry(idx_id))
+        {
+            logf("delete_entry failed: %d", idx_id);
+            return ;
+        }
+    }
+
+#ifdef TAGCACHE_SCAN_THREADS
+    if (scan_pool.thread_count > 0)
+    {
+        scan_queue_file(path, mtime);
+        return ;
+    }
+#endif
+
+    /*memset(&id3, 0, sizeof(struct mp3entry)); -- get_metadata does this for us */
+    ret = get_metadata_ex(&id3, -1, path, METADATA_EXCLUDE_ID3_PATH);
+
+    if (!ret)
+    {
+        logf("get_metadata fail: %s", path);
+        return ;
+    }
+
+    add_tagcache_entry(path, mtime, &id3);
+}
+#endif /*!defined(PLUGIN)*/
+
+
+/* Case insensitive checksum of a tag string for quick duplicate checks. */
+static unsigned tag_crc32_nocase(const char *str)
+{
+    unsigned crc32 = 0xffffffff;
+    char chr_lower;
+
+    for (; *str != '\0'; str++)
+    {
+        chr_lower = tolower(*str);
+        crc32 = crc_32(&chr_lower, 1, crc32);
+    }
+
+    return crc32;
+}
+
+static bool tempbuf_insert(char *str, int id, int idx_id, bool unique)
+{
+    struct tempbuf_searchidx *index = (struct tempbuf_searchidx *)tempbuf;
+    int len = strlen(str)+1;
+    int i;
+    unsigned *crcbuf = (unsigned *)&tempbuf[tempbuf_size-4];
+    unsigned crc32 = tag_crc32_nocase(str);
+
+    if (unique)
+    {
+        /* Check if the crc does not exist -> entry does not exist for sure. */
+        for (i = 0; i < tempbufidx; i++)
+        {
+            if (crcbuf[-i] != crc32)
+                continue;
+
+            if (!strcasecmp(str, index[i].str))
+            {
+                if (id < 0 || id >= lookup_buffer_depth)
+                {
+                    logf("lookup buf overf.: %d", id);
+                    return false;
+                }
+
+                lookup[id] = &index[i];
+                return true;
+            }
+        }
+    }
+
+    /* Insert to CRC buffer. */
+    crcbuf[-tempbufidx] = crc32;
+    tempbuf_left -= 4;
+
+    /* Insert it to the buffer. */
+    tempbuf_left -= len;
+    if (tempbuf_left - 4 < 0 || tempbufidx >= commit_entry_count)
+    {
+        logf("temp buf error rem: %ld idx: %d / %d",
+             tempbuf_left, tempbufidx, commit_entry_count-1);
+        return false;
+    }
+    if (id >= lookup_buffer_depth)
+    {
+        logf("lookup buf overf. #2: %d", id);
+        return false;
+    }
+
+    if (id >= 0)
+    {
+        lookup[id] = &index[tempbufidx];
+        index[tempbufidx].idlist.id = id;
+    }
+    else
+        index[tempbufidx].idlist.id = -1;
+
+    index[tempbufidx].idlist.next = NULL;
+    index[tempbufidx].idx_id = idx_id;
+    index[tempbufidx].seek = -1;
+    index[tempbufidx].str = &tempbuf[tempbuf_pos];
+    memcpy(index[tempbufidx].str, str, len);
+    tempbuf_pos += len;
+    tempbufidx++;
+
+    return true;
+}
+
+static int compare(const void *p1, const void *p2)
+{
+    do_timed_yield();
+
+    struct tempbuf_searchidx *e1 = (struct tempbuf_searchidx *)p1;
+    struct tempbuf_searchidx *e2 = (struct tempbuf_searchidx *)p2;
+
+    if (strcmp(e1->str, UNTAGGED) == 0)
+    {
+        if (strcmp(e2->str, UNTAGGED) == 0)
+            return 0;
+        return -1;
+    }
+    else if (strcmp(e2->str, UNTAGGED) == 0)
+        return 1;
+
+    return strncasecmp(e1->str, e2->str, TAG_MAXLEN);
+}
+
+/* Write a tag string padded to TAGFILE_ENTRY_CHUNK_LENGTH. */
+static int write_tagfile_entry_padded(int fd, const char *str, int32_t idx_id)
+{
+    struct tagfile_entry fe;
+    int length = strlen(str) + 1;
+
+    fe.tag_length = length;
+    fe.idx_id = idx_id;
+
+    /* Check the chunk alignment. */
+    if ((fe.tag_length + sizeof(struct tagfile_entry))
+        % TAGFILE_ENTRY_CHUNK_LENGTH)
+    {
+        fe.tag_length += TAGFILE_ENTRY_CHUNK_LENGTH -
+            ((fe.tag_length + sizeof(struct tagfile_entry))
+             % TAGFILE_ENTRY_CHUNK_LENGTH);
+    }
+
+    if (write_tagfile_entry(fd, &fe) != sizeof(struct tagfile_entry))
+    {
+        logf("write error #1");
+        return -1;
+    }
+
+    if (write(fd, str, length) != length)
+    {
+        logf("write error #2");
+        return -2;
+    }
+
+    /* Write some padding. */
+    if (fe.tag_length - length > 0)
+        write(fd, "XXXXXXXX", fe.tag_length - length);
+
+    return 0;
+}
+
+static int tempbuf_sort(int fd)
+{
+    struct tempbuf_searchidx *index = (struct tempbuf_searchidx *)tempbuf;
+    int i, rc;
+
+    /* Generate reverse lookup entries. */
+    for (i = 0; i < lookup_buffer_depth; i++)
+    {
+        struct tempbuf_id_list *idlist;
+
+        if (!lookup[i])
+            continue;
+
+        if (lookup[i]->idlist.id == i)
+            continue;
+
+        idlist = &lookup[i]->idlist;
+        while (idlist->next != NULL)
+            idlist = idlist->next;
+
+        ALIGN_BUFFER(tempbuf_pos, tempbuf_left, alignof(struct tempbuf_id_list));
+        tempbuf_left -= sizeof(struct tempbuf_id_list);
+        if (tempbuf_left < 0)
+            return -1;
+
+        idlist->next = (struct tempbuf_id_list *)&tempbuf[tempbuf_pos];
+        tempbuf_pos += sizeof(struct tempbuf_id_list);
+
+        idlist = idlist->next;
+        idlist->id = i;
+        idlist->next = NULL;
+
+        do_timed_yield();
+    }
+
+    qsort(index, tempbufidx, sizeof(struct tempbuf_searchidx), compare);
+    memset(lookup, 0, lookup_buffer_depth * sizeof(struct tempbuf_searchidx **));
+
+    for (i = 0; i < tempbufidx; i++)
+    {
+        struct tempbuf_id_list *idlist = &index[i].idlist;
+
+        /* Fix the lookup list. */
+        while (idlist != NULL)
+        {
+            if (idlist->id >= 0)
+                lookup[idlist->id] = &index[i];
+            idlist = idlist->next;
+        }
+
+        index[i].seek = lseek(fd, 0, SEEK_CUR);
+        rc = write_tagfile_entry_padded(fd, index[i].str, index[i].idx_id);
+        if (rc < 0)
+        {
+            logf("tempbuf_sort: write error");
+            return rc;
+        }
+    }
+
+    return i;
+}
+
+inline static struct tempbuf_searchidx* tempbuf_locate(int id)
+{
+    if (id < 0 || id >= lookup_buffer_depth)
+        return NULL;
+
+    return lookup[id];
+}
+
+
+inline static int tempbuf_find_location(int id)
+{
+    struct tempbuf_searchidx *entry;
+
+    entry = tempbuf_locate(id);
+    if (entry == NULL)
+        return -1;
+
+    return entry->seek;
+}
+
+static bool build_numeric_indices(struct tagcache_header *h, int tmpfd)
+{
+    struct master_header tcmh;
+    struct index_entry idx;
+    int masterfd;
+    int masterfd_pos;
+    struct temp_file_entry *entrybuf = (struct temp_file_entry *)tempbuf;
+    int max_entries;
+    int entries_processed = 0;
+    int i, j;
+
+    max_entries = tempbuf_size / sizeof(struct temp_file_entry) - 1;
+
+    logf("Building numeric indices...");
+    lseek(tmpfd, sizeof(struct tagcache_header), SEEK_SET);
+
+    if ( (masterfd = open_master_fd(&tcmh, true)) < 0)
+        return false;
+
+    masterfd_pos = lseek(masterfd, tcmh.tch.entry_count * sizeof(struct index_entry),
+                         SEEK_CUR);
+    if (masterfd_pos < 0)
+    {
+        logf("we can't append!");
+        close(masterfd);
+        return false;
+    }
+
+    while (entries_processed < h->entry_count && !USR_CANCEL)
+    {
+        int count = MIN(h->entry_count - entries_processed, max_entries);
+
+        /* Read in as many entries as possible. */
+        for (i = 0; i < count; i++)
+        {
+            struct temp_file_entry *tfe = &entrybuf[i];
+            int datastart;
+
+            /* Read in numeric data. */
+            if (read(tmpfd, tfe, sizeof(struct temp_file_entry)) !=
+                sizeof(struct temp_file_entry))
+            {
+                logf("read fail #1");
+                close(masterfd);
+                return false;
+            }
+
+            datastart = lseek(tmpfd, 0, SEEK_CUR);
+
+            /**
+             * Read string data from the following tags:
+             * - tag_filename
              * - tag_artist
              * - tag_album
              * - tag_title
@@ -2644,545 +3846,1255 @@ static bool build_numeric_indices(struct tagcache_header *h, int tmpfd)
     tfe->tag_offset[tag] = crc_32(build_idx_buf, strlen(build_idx_buf), 0xffffffff); \
     lseek(tmpfd, datastart, SEEK_SET)
 
-            tmpdb_read_string_tag(tag_filename);
-            tmpdb_read_string_tag(tag_artist);
-            tmpdb_read_string_tag(tag_album);
-            tmpdb_read_string_tag(tag_title);
+            tmpdb_read_string_tag(tag_filename);
+            tmpdb_read_string_tag(tag_artist);
+            tmpdb_read_string_tag(tag_album);
+            tmpdb_read_string_tag(tag_title);
+
+            /* Seek to the end of the string data. */
+            lseek(tmpfd, tfe->data_length, SEEK_CUR);
+        }
+
+        /* Backup the master index position. */
+        masterfd_pos = lseek(masterfd, 0, SEEK_CUR);
+        lseek(masterfd, sizeof(struct master_header), SEEK_SET);
+
+        /* Check if we can resurrect some deleted runtime statistics data. */
+        for (i = 0; i < tcmh.tch.entry_count && !USR_CANCEL; i++)
+        {
+            /* Read the index entry. */
+            if (read_index_entries(masterfd, &idx, 1) != sizeof(struct index_entry))
+            {
+                logf("read fail #3");
+                close(masterfd);
+                return false;
+            }
+
+            /**
+             * Skip unless the entry is marked as being deleted
+             * or the data has already been resurrected.
+             */
+            if (!(idx.flag & FLAG_DELETED) || (idx.flag & FLAG_RESURRECTED))
+                continue;
+
+            /* Now try to match the entry. */
+            /**
+             * To succesfully match a song, the following conditions
+             * must apply:
+             *
+             * For numeric fields: tag_length
+             * - Full identical match is required
+             *
+             * If tag_filename matches, no further checking necessary.
+             *
+             * For string hashes: tag_artist, tag_album, tag_title
+             * - All three of these must match
+             */
+            for (j = 0; j < count; j++)
+            {
+                struct temp_file_entry *tfe = &entrybuf[j];
+
+                /* Try to match numeric fields first. */
+                if (tfe->tag_offset[tag_length] != idx.tag_seek[tag_length])
+                    continue;
+
+                /* Now it's time to do the hash matching. */
+                if (tfe->tag_offset[tag_filename] != idx.tag_seek[tag_filename])
+                {
+                    int match_count = 0;
+
+                    /* No filename match, check if we can match two other tags. */
+#define tmpdb_match(tag) \
+    if (tfe->tag_offset[tag] == idx.tag_seek[tag]) \
+        match_count++
+
+                    tmpdb_match(tag_artist);
+                    tmpdb_match(tag_album);
+                    tmpdb_match(tag_title);
+
+                    if (match_count < 3)
+                    {
+                        /* Still no match found, give up. */
+                        continue;
+                    }
+                }
+
+                /* A match found, now copy & resurrect the statistical data. */
+#define tmpdb_copy_tag(tag) \
+    tfe->tag_offset[tag] = idx.tag_seek[tag]
+
+                tmpdb_copy_tag(tag_playcount);
+                tmpdb_copy_tag(tag_rating);
+                tmpdb_copy_tag(tag_playtime);
+                tmpdb_copy_tag(tag_lastplayed);
+                tmpdb_copy_tag(tag_commitid);
+                tmpdb_copy_tag(tag_lastelapsed);
+                tmpdb_copy_tag(tag_lastoffset);
+
+                /* Avoid processing this entry again. */
+                idx.flag |= FLAG_RESURRECTED;
+
+                lseek(masterfd, -(off_t)sizeof(struct index_entry), SEEK_CUR);
+                if (write_index_entries(masterfd, &idx, 1) != sizeof(struct index_entry))
+                {
+                    logf("masterfd writeback fail #1");
+                    close(masterfd);
+                    return false;
+                }
+
+                logf("Entry resurrected");
+            }
+        }
+
+
+        /* Restore the master index position. */
+        lseek(masterfd, masterfd_pos, SEEK_SET);
+
+        /* Commit the data to the index. */
+        for (i = 0; i < count && !USR_CANCEL; i++)
+        {
+            int loc = lseek(masterfd, 0, SEEK_CUR);
+
+            if (read_index_entries(masterfd, &idx, 1) != sizeof(struct index_entry))
+            {
+                logf("read fail #3");
+                close(masterfd);
+                return false;
+            }
+
+            for (j = 0; j < TAG_COUNT; j++)
+            {
+                if (!TAGCACHE_IS_NUMERIC(j))
+                    continue;
+
+                idx.tag_seek[j] = entrybuf[i].tag_offset[j];
+            }
+            idx.flag = entrybuf[i].flag;
+
+            if (idx.tag_seek[tag_commitid])
+            {
+                /* Data has been resurrected. */
+                idx.flag |= FLAG_DIRTYNUM;
+            }
+            else if (tc_stat.ready && current_tcmh.commitid > 0)
+            {
+                idx.tag_seek[tag_commitid] = current_tcmh.commitid;
+                idx.flag |= FLAG_DIRTYNUM;
+            }
+
+            /* Write back the updated index. */
+            lseek(masterfd, loc, SEEK_SET);
+            if (write_index_entries(masterfd, &idx, 1) != sizeof(struct index_entry))
+            {
+                logf("write fail");
+                close(masterfd);
+                return false;
+            }
+        }
+
+        entries_processed += count;
+        logf("%d/%ld entries processed", entries_processed, h->entry_count);
+    }
+
+    close(masterfd);
+
+    return true;
+}
+
+/**
+ * Return values:
+ *     > 0   success
+ *    == 0   temporary failure
+ *     < 0   fatal error
+ */
+static int build_index(int index_type, struct tagcache_header *h, int tmpfd)
+{
+    int i;
+    struct tagcache_header tch;
+    struct master_header   tcmh;
+    struct index_entry idxbuf[IDX_BUF_DEPTH];
+    int idxbuf_pos;
+    int fd = -1, masterfd;
+    bool error = false;
+    int init;
+    int masterfd_pos;
+
+    logf("Building index: %d", index_type);
+
+    /* Check the number of entries we need to allocate ram for. */
+    commit_entry_count = h->entry_count + 1;
+
+    masterfd = open_master_fd(&tcmh, false);
+    if (masterfd >= 0)
+    {
+        commit_entry_count += tcmh.tch.entry_count;
+        close(masterfd);
+    }
+    else
+        remove_files(); /* Just to be sure we are clean. */
+
+    /* Open the index file, which contains the tag names. */
+    fd = open_tag_fd(&tch, index_type, true);
+    if (fd >= 0)
+    {
+        logf("tch.datasize=%ld", tch.datasize);
+        lookup_buffer_depth = 1 +
+        /* First part */ commit_entry_count +
+        /* Second part */ (tch.datasize / TAGFILE_ENTRY_CHUNK_LENGTH);
+    }
+    else
+    {
+        lookup_buffer_depth = 1 +
+        /* First part */ commit_entry_count +
+        /* Second part */ 0;
+    }
+
+    logf("lookup_buffer_depth=%ld", lookup_buffer_depth);
+    logf("commit_entry_count=%ld", commit_entry_count);
+
+    /* Allocate buffer for all index entries from both old and new
+     * tag files. */
+    tempbufidx = 0;
+    tempbuf_pos = commit_entry_count * sizeof(struct tempbuf_searchidx);
+
+    /* Allocate lookup buffer. The first portion of commit_entry_count
+     * contains the new tags in the temporary file and the second
+     * part for locating entries already in the db.
+     *
+     *  New tags  Old tags
+     * +---------+---------------------------+
+     * |  index  | position/ENTRY_CHUNK_SIZE |  lookup buffer
+     * +---------+---------------------------+
+     *
+     * Old tags are inserted to a temporary buffer with position:
+     *     tempbuf_insert(position/ENTRY_CHUNK_SIZE, ...);
+     * And new tags with index:
+     *     tempbuf_insert(idx, ...);
+     *
+     * The buffer is sorted and written into tag file:
+     *     tempbuf_sort(...);
+     * leaving master index locations messed up.
+     *
+     * That is fixed using the lookup buffer for old tags:
+     *     new_seek = tempbuf_find_location(old_seek, ...);
+     * and for new tags:
+     *     new_seek = tempbuf_find_location(idx);
+     */
+    lookup = (struct tempbuf_searchidx **)&tempbuf[tempbuf_pos];
+    tempbuf_pos += lookup_buffer_depth * sizeof(void **);
+    memset(lookup, 0, lookup_buffer_depth * sizeof(void **));
+
+    /* And calculate the remaining data space used mainly for storing
+     * tag data (strings). */
+    tempbuf_left = tempbuf_size - tempbuf_pos - 8;
+    if (tempbuf_left - TAGFILE_ENTRY_AVG_LENGTH * commit_entry_count < 0)
+    {
+        logf("Buffer way too small!");
+        close(fd);
+        return 0;
+    }
+
+    if (fd >= 0)
+    {
+        /**
+         * If tag file contains unique tags (sorted index), we will load
+         * it entirely into memory so we can resort it later for use with
+         * chunked browsing.
+         */
+        if (TAGCACHE_IS_SORTED(index_type))
+        {
+            logf("loading tags...");
+            for (i = 0; i < tch.entry_count && !USR_CANCEL; i++)
+            {
+                struct tagfile_entry entry;
+                int loc = lseek(fd, 0, SEEK_CUR);
+                bool ret;
+                switch (read_tagfile_entry_and_tag(fd, &entry, build_idx_buf, build_idx_bufsz))
+                {
+                    case e_SUCCESS_LEN_ZERO: /* Skip deleted entries. */
+                        continue;
+                    case e_SUCCESS:
+                         break;
+                    case e_ENTRY_SIZEMISMATCH:
+                        logf("read error #7");
+                        close(fd);
+                        return -2;
+                    case e_TAG_TOOLONG:
+                        logf("too long tag #3");
+                        close(fd);
+                        return -2;
+                    case e_TAG_SIZEMISMATCH:
+                        logf("read error #8");
+                        close(fd);
+                        return -2;
+                }
+
+                /**
+                 * Save the tag and tag id in the memory buffer. Tag id
+                 * is saved so we can later reindex the master lookup
+                 * table when the index gets resorted.
+                 */
+                ret = tempbuf_insert(build_idx_buf, loc/TAGFILE_ENTRY_CHUNK_LENGTH
+                                     + commit_entry_count, entry.idx_id,
+                                     TAGCACHE_IS_UNIQUE(index_type));
+                if (!ret)
+                {
+                    close(fd);
+                    return -3;
+                }
+                do_timed_yield();
+            }
+            logf("done");
+        }
+        else
+            tempbufidx = tch.entry_count;
+    }
+    else
+    {
+        logf("Create New Index: %d", index_type);
+        /**
+         * Creating new index file to store the tags. No need to preload
+         * anything whether the index type is sorted or not.
+         *
+         * Note: although we are creating a file under the db path, it must
+         * already exist by this point so no mkdir is required.
+         */
+        fd = open_pathfmt(build_idx_buf, build_idx_bufsz,
+                          O_WRONLY | O_CREAT | O_TRUNC,
+                          "%s/" TAGCACHE_FILE_INDEX,
+                          tc_stat.db_path, index_type);
+        if (fd < 0)
+        {
+            logf(TAGCACHE_FILE_INDEX " open fail", index_type);
+            return -2;
+        }
+
+        tch.magic = TAGCACHE_MAGIC;
+        tch.entry_count = 0;
+        tch.datasize = 0;
+
+        if (write_tagcache_header(fd, &tch) != sizeof(struct tagcache_header))
+        {
+            logf("header write failed");
+            close(fd);
+            return -2;
+        }
+    }
+
+    /* Loading the tag lookup file as "master file". */
+    logf("Loading index file");
+    masterfd = open_db_fd(TAGCACHE_FILE_MASTER, O_RDWR);
+
+    if (masterfd < 0)
+    {
+        logf("Creating new DB");
+        masterfd = open_db_fd(TAGCACHE_FILE_MASTER, O_WRONLY | O_CREAT | O_TRUNC);
+
+        if (masterfd < 0)
+        {
+            logf("Failure to create index file (%s)", TAGCACHE_FILE_MASTER);
+            close(fd);
+            return -2;
+        }
+
+        /* Write the header (write real values later). */
+        memset(&tcmh, 0, sizeof(struct master_header));
+        tcmh.tch = *h;
+        tcmh.tch.entry_count = 0;
+        tcmh.tch.datasize = 0;
+        tcmh.dirty = true;
+        write_master_header(masterfd, &tcmh);
+        init = true;
+        masterfd_pos = lseek(masterfd, 0, SEEK_CUR);
+    }
+    else
+    {
+        /**
+         * Master file already exists so we need to process the current
+         * file first.
+         */
+        init = false;
 
-            /* Seek to the end of the string data. */
-            lseek(tmpfd, tfe->data_length, SEEK_CUR);
+        if (read_master_header(masterfd, &tcmh) != sizeof(struct master_header) ||
+            tcmh.tch.magic != TAGCACHE_MAGIC)
+        {
+            logf("header error");
+            close(fd);
+            close(masterfd);
+            return -2;
         }
 
-        /* Backup the master index position. */
-        masterfd_pos = lseek(masterfd, 0, SEEK_CUR);
-        lseek(masterfd, sizeof(struct master_header), SEEK_SET);
+        /**
+         * If we reach end of the master file, we need to expand it to
+         * hold new tags. If the current index is not sorted, we can
+         * simply append new data to end of the file.
+         * However, if the index is sorted, we need to update all tag
+         * pointers in the master file for the current index.
+         */
+        masterfd_pos = lseek(masterfd, tcmh.tch.entry_count * sizeof(struct index_entry),
+            SEEK_CUR);
+        if (masterfd_pos == filesize(masterfd))
+        {
+            logf("appending...");
+            init = true;
+        }
+    }
 
-        /* Check if we can resurrect some deleted runtime statistics data. */
-        for (i = 0; i < tcmh.tch.entry_count && !USR_CANCEL; i++)
+    /**
+     * Load new unique tags in memory to be sorted later and added
+     * to the master lookup file.
+     */
+    if (TAGCACHE_IS_SORTED(index_type))
+    {
+        lseek(tmpfd, sizeof(struct tagcache_header), SEEK_SET);
+        /* h is the header of the temporary file containing new tags. */
+        logf("inserting new tags...");
+        for (i = 0; i < h->entry_count && !USR_CANCEL; i++)
         {
-            /* Read the index entry. */
-            if (read_index_entries(masterfd, &idx, 1) != sizeof(struct index_entry))
+            struct temp_file_entry entry;
+
+            if (read(tmpfd, &entry, sizeof(struct temp_file_entry)) !=
+                sizeof(struct temp_file_entry))
             {
                 logf("read fail #3");
-                close(masterfd);
-                return false;
+                error = true;
+                goto error_exit;
             }
 
-            /**
-             * Skip unless the entry is marked as being deleted
-             * or the data has already been resurrected.
-             */
-            if (!(idx.flag & FLAG_DELETED) || (idx.flag & FLAG_RESURRECTED))
-                continue;
+            /* Read data. */
+            if (entry.tag_length[index_type] >= build_idx_bufsz)
+            {
+                logf("too long entry!");
+                error = true;
+                goto error_exit;
+            }
 
-            /* Now try to match the entry. */
-            /**
-             * To succesfully match a song, the following conditions
-             * must apply:
-             *
-             * For numeric fields: tag_length
-             * - Full identical match is required
-             *
-             * If tag_filename matches, no further checking necessary.
-             *
-             * For string hashes: tag_artist, tag_album, tag_title
-             * - All three of these must match
-             */
-            for (j = 0; j < count; j++)
+            lseek(tmpfd, entry.tag_offset[index_type], SEEK_CUR);
+            if (read(tmpfd, build_idx_buf, entry.tag_length[index_type]) !=
+                entry.tag_length[index_type])
             {
-                struct temp_file_entry *tfe = &entrybuf[j];
+                logf("read fail #4");
+                error = true;
+                goto error_exit;
+            }
+            str_setlen(build_idx_buf, entry.tag_length[index_type]);
 
-                /* Try to match numeric fields first. */
-                if (tfe->tag_offset[tag_length] != idx.tag_seek[tag_length])
-                    continue;
+#if defined(PLUGIN)
+            if (user_check_tag(index_type, build_idx_buf))
+#endif /*defined(PLUGIN)*/
+            {
+                if (TAGCACHE_IS_UNIQUE(index_type))
+                    error = !tempbuf_insert(build_idx_buf, i, -1, true);
+                else
+                    error = !tempbuf_insert(build_idx_buf, i,
+                                            tcmh.tch.entry_count + i, false);
 
-                /* Now it's time to do the hash matching. */
-                if (tfe->tag_offset[tag_filename] != idx.tag_seek[tag_filename])
+                if (error)
                 {
-                    int match_count = 0;
+                    logf("insert error");
+                    goto error_exit;
+                }
+            }
+            /* Skip to next. */
+            lseek(tmpfd, entry.data_length - entry.tag_offset[index_type] -
+                    entry.tag_length[index_type], SEEK_CUR);
+            do_timed_yield();
+        }
+        logf("done");
 
-                    /* No filename match, check if we can match two other tags. */
-#define tmpdb_match(tag) \
-    if (tfe->tag_offset[tag] == idx.tag_seek[tag]) \
-        match_count++
+        /* Sort the buffer data and write it to the index file. */
+        lseek(fd, sizeof(struct tagcache_header), SEEK_SET);
+        /**
+         * We need to truncate the index file now. There can be junk left
+         * at the end of file (however, we _should_ always follow the
+         * entry_count and don't crash with that).
+         */
+        ftruncate(fd, lseek(fd, 0, SEEK_CUR));
 
-                    tmpdb_match(tag_artist);
-                    tmpdb_match(tag_album);
-                    tmpdb_match(tag_title);
+        i = tempbuf_sort(fd);
+        if (i < 0)
+            goto error_exit;
+        logf("sorted %d tags", i);
 
-                    if (match_count < 3)
-                    {
-                        /* Still no match found, give up. */
-                        continue;
-                    }
+        /**
+         * Now update all indexes in the master lookup file.
+         */
+        logf("updating indices...");
+        lseek(masterfd, sizeof(struct master_header), SEEK_SET);
+        for (i = 0; i < tcmh.tch.entry_count && !USR_CANCEL; i += idxbuf_pos)
+        {
+            int j;
+            int loc = lseek(masterfd, 0, SEEK_CUR);
+
+            idxbuf_pos = MIN(tcmh.tch.entry_count - i, IDX_BUF_DEPTH);
+
+            if (read_index_entries(masterfd, idxbuf, idxbuf_pos) !=
+                (ssize_t)sizeof(struct index_entry) * idxbuf_pos)
+            {
+                logf("read fail #5");
+                error = true;
+                goto error_exit ;
+            }
+            lseek(masterfd, loc, SEEK_SET);
+
+            for (j = 0; j < idxbuf_pos; j++)
+            {
+                if (idxbuf[j].flag & FLAG_DELETED)
+                {
+                    /* We can just ignore deleted entries. */
+                    // idxbuf[j].tag_seek[index_type] = 0;
+                    continue;
                 }
 
-                /* A match found, now copy & resurrect the statistical data. */
-#define tmpdb_copy_tag(tag) \
-    tfe->tag_offset[tag] = idx.tag_seek[tag]
+                idxbuf[j].tag_seek[index_type] = tempbuf_find_location(
+                    idxbuf[j].tag_seek[index_type]/TAGFILE_ENTRY_CHUNK_LENGTH
+                    + commit_entry_count);
 
-                tmpdb_copy_tag(tag_playcount);
-                tmpdb_copy_tag(tag_rating);
-                tmpdb_copy_tag(tag_playtime);
-                tmpdb_copy_tag(tag_lastplayed);
-                tmpdb_copy_tag(tag_commitid);
-                tmpdb_copy_tag(tag_lastelapsed);
-                tmpdb_copy_tag(tag_lastoffset);
+                if (idxbuf[j].tag_seek[index_type] < 0)
+                {
+                    logf("update error: %ld/%d/%ld",
+                         idxbuf[j].flag, i+j, tcmh.tch.entry_count);
+                    error = true;
+                    goto error_exit;
+                }
+
+                do_timed_yield();
+            }
+
+            /* Write back the updated index. */
+            if (write_index_entries(masterfd, idxbuf, idxbuf_pos) !=
+                (ssize_t)sizeof(struct index_entry) * idxbuf_pos)
+            {
+                logf("write fail");
+                error = true;
+                goto error_exit;
+            }
+        }
+        logf("done");
+    }
+
+    /**
+     * Walk through the temporary file containing the new tags.
+     */
+    // build_normal_index(h, tmpfd, masterfd, idx);
+    logf("updating new indices...");
+    lseek(masterfd, masterfd_pos, SEEK_SET);
+    lseek(tmpfd, sizeof(struct tagcache_header), SEEK_SET);
+    lseek(fd, 0, SEEK_END);
+    for (i = 0; i < h->entry_count && !USR_CANCEL; i += idxbuf_pos)
+    {
+        int j;
+
+        idxbuf_pos = MIN(h->entry_count - i, IDX_BUF_DEPTH);
+        if (init)
+        {
+            memset(idxbuf, 0, sizeof(struct index_entry)*IDX_BUF_DEPTH);
+        }
+        else
+        {
+            int loc = lseek(masterfd, 0, SEEK_CUR);
+
+            if (read_index_entries(masterfd, idxbuf, idxbuf_pos) !=
+                (ssize_t)sizeof(struct index_entry) * idxbuf_pos)
+            {
+                logf("read fail #6");
+                error = true;
+                break ;
+            }
+            lseek(masterfd, loc, SEEK_SET);
+        }
+
+        /* Read entry headers. */
+        for (j = 0; j < idxbuf_pos; j++)
+        {
+            if (!TAGCACHE_IS_SORTED(index_type))
+            {
+                struct temp_file_entry entry;
+                struct tagfile_entry fe;
+
+                if (read(tmpfd, &entry, sizeof(struct temp_file_entry)) !=
+                    sizeof(struct temp_file_entry))
+                {
+                    logf("read fail #7");
+                    error = true;
+                    break ;
+                }
 
-                /* Avoid processing this entry again. */
-                idx.flag |= FLAG_RESURRECTED;
+                /* Read data. */
+                if (entry.tag_length[index_type] >= build_idx_bufsz)
+                {
+                    logf("too long entry!");
+                    logf("length=%d", entry.tag_length[index_type]);
+                    logf("pos=0x%02lx", lseek(tmpfd, 0, SEEK_CUR));
+                    error = true;
+                    break ;
+                }
 
-                lseek(masterfd, -(off_t)sizeof(struct index_entry), SEEK_CUR);
-                if (write_index_entries(masterfd, &idx, 1) != sizeof(struct index_entry))
+                lseek(tmpfd, entry.tag_offset[index_type], SEEK_CUR);
+                if (read(tmpfd, build_idx_buf, entry.tag_length[index_type]) !=
+                    entry.tag_length[index_type])
                 {
-                    logf("masterfd writeback fail #1");
-                    close(masterfd);
-                    return false;
+                    logf("read fail #8");
+                    logf("offset=0x%02lx", entry.tag_offset[index_type]);
+                    logf("length=0x%02x", entry.tag_length[index_type]);
+                    error = true;
+                    break ;
                 }
 
-                logf("Entry resurrected");
+                /* Write to index file. */
+                idxbuf[j].tag_seek[index_type] = lseek(fd, 0, SEEK_CUR);
+                fe.tag_length = entry.tag_length[index_type];
+                fe.idx_id = tcmh.tch.entry_count + i + j;
+                write_tagfile_entry(fd, &fe);
+                write(fd, build_idx_buf, fe.tag_length);
+                tempbufidx++;
+
+                /* Skip to next. */
+                lseek(tmpfd, entry.data_length - entry.tag_offset[index_type] -
+                      entry.tag_length[index_type], SEEK_CUR);
+            }
+            else
+            {
+                /* Locate the correct entry from the sorted array. */
+                idxbuf[j].tag_seek[index_type] = tempbuf_find_location(i + j);
+                if (idxbuf[j].tag_seek[index_type] < 0)
+                {
+                    logf("entry not found (%d)", j);
+                    error = true;
+                    break ;
+                }
             }
         }
 
+        /* Write index. */
+        if (write_index_entries(masterfd, idxbuf, idxbuf_pos) !=
+            (ssize_t)sizeof(struct index_entry) * idxbuf_pos)
+        {
+            logf("tagcache: write fail #4");
+            error = true;
+            break ;
+        }
 
-        /* Restore the master index position. */
-        lseek(masterfd, masterfd_pos, SEEK_SET);
+        do_timed_yield();
+    }
+    logf("done");
 
-        /* Commit the data to the index. */
-        for (i = 0; i < count && !USR_CANCEL; i++)
-        {
-            int loc = lseek(masterfd, 0, SEEK_CUR);
+    /* Finally write the header. */
+    tch.magic = TAGCACHE_MAGIC;
+    tch.entry_count = tempbufidx;
+    tch.datasize = lseek(fd, 0, SEEK_END) - sizeof(struct tagcache_header);
+    lseek(fd, 0, SEEK_SET);
+    write_tagcache_header(fd, &tch);
 
-            if (read_index_entries(masterfd, &idx, 1) != sizeof(struct index_entry))
-            {
-                logf("read fail #3");
-                close(masterfd);
-                return false;
-            }
+    if (index_type != tag_filename)
+        h->datasize += tch.datasize;
+    logf("s:%d/%ld/%ld", index_type, tch.datasize, h->datasize);
+    error_exit:
 
-            for (j = 0; j < TAG_COUNT; j++)
-            {
-                if (!TAGCACHE_IS_NUMERIC(j))
-                    continue;
+    close(fd);
+    close(masterfd);
 
-                idx.tag_seek[j] = entrybuf[i].tag_offset[j];
-            }
-            idx.flag = entrybuf[i].flag;
+    if (error)
+        return -2;
 
-            if (idx.tag_seek[tag_commitid])
-            {
-                /* Data has been resurrected. */
-                idx.flag |= FLAG_DIRTYNUM;
-            }
-            else if (tc_stat.ready && current_tcmh.commitid > 0)
-            {
-                idx.tag_seek[tag_commitid] = current_tcmh.commitid;
-                idx.flag |= FLAG_DIRTYNUM;
-            }
+    return 1;
+}
 
-            /* Write back the updated index. */
-            lseek(masterfd, loc, SEEK_SET);
-            if (write_index_entries(masterfd, &idx, 1) != sizeof(struct index_entry))
-            {
-                logf("write fail");
-                close(masterfd);
-                return false;
-            }
-        }
+static int sortidx_find_seek(const struct sortidx_entry *entries,
+                             int count, int32_t seek)
+{
+    int lo = 0, hi = count;
 
-        entries_processed += count;
-        logf("%d/%ld entries processed", entries_processed, h->entry_count);
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+
+        if (entries[mid].tag_seek < seek)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
 
-    close(masterfd);
+    if (lo < count && entries[lo].tag_seek == seek)
+        return lo;
 
-    return true;
+    return -1;
 }
 
 /**
- * Return values:
- *     > 0   success
- *    == 0   temporary failure
- *     < 0   fatal error
+ * Build the sorted index of a sorted tag file. The tag file itself is kept
+ * in sorted order by build_index(), so the string entries are simply listed
+ * in file order together with the master index entries using each string.
+ * Searches use it to resolve filters and equality/prefix clauses with a
+ * binary search instead of walking the whole master index.
  */
-static int build_index(int index_type, struct tagcache_header *h, int tmpfd)
+static bool build_sortidx(int index_type, int32_t commitid)
 {
-    int i;
     struct tagcache_header tch;
-    struct master_header   tcmh;
+    struct master_header tcmh;
+    struct sortidx_header sih;
     struct index_entry idxbuf[IDX_BUF_DEPTH];
-    int idxbuf_pos;
-    int fd = -1, masterfd;
-    bool error = false;
-    int init;
-    int masterfd_pos;
+    struct sortidx_entry *entries;
+    int32_t *map, *postings;
+    int fd, masterfd, sortfd = -1;
+    int i, j, count = 0, total = 0;
+    size_t need;
+    bool ok = false;
 
-    logf("Building index: %d", index_type);
+    logf("Building sorted index: %d", index_type);
 
-    /* Check the number of entries we need to allocate ram for. */
-    commit_entry_count = h->entry_count + 1;
+    fd = open_tag_fd(&tch, index_type, false);
+    if (fd < 0)
+        return false;
 
     masterfd = open_master_fd(&tcmh, false);
-    if (masterfd >= 0)
+    if (masterfd < 0)
     {
-        commit_entry_count += tcmh.tch.entry_count;
-        close(masterfd);
+        close(fd);
+        return false;
     }
-    else
-        remove_files(); /* Just to be sure we are clean. */
 
-    /* Open the index file, which contains the tag names. */
-    fd = open_tag_fd(&tch, index_type, true);
-    if (fd >= 0)
-    {
-        logf("tch.datasize=%ld", tch.datasize);
-        lookup_buffer_depth = 1 +
-        /* First part */ commit_entry_count +
-        /* Second part */ (tch.datasize / TAGFILE_ENTRY_CHUNK_LENGTH);
-    }
-    else
+    /* entries | idx_id -> entry map | postings */
+    need = tch.entry_count * sizeof(struct sortidx_entry)
+         + tcmh.tch.entry_count * sizeof(int32_t) * 2;
+    if (need > tempbuf_size)
     {
-        lookup_buffer_depth = 1 +
-        /* First part */ commit_entry_count +
-        /* Second part */ 0;
+        logf("sorted index: buffer too small (%lu)", (unsigned long)need);
+        goto exit;
     }
 
-    logf("lookup_buffer_depth=%ld", lookup_buffer_depth);
-    logf("commit_entry_count=%ld", commit_entry_count);
-
-    /* Allocate buffer for all index entries from both old and new
-     * tag files. */
-    tempbufidx = 0;
-    tempbuf_pos = commit_entry_count * sizeof(struct tempbuf_searchidx);
-
-    /* Allocate lookup buffer. The first portion of commit_entry_count
-     * contains the new tags in the temporary file and the second
-     * part for locating entries already in the db.
-     *
-     *  New tags  Old tags
-     * +---------+---------------------------+
-     * |  index  | position/ENTRY_CHUNK_SIZE |  lookup buffer
-     * +---------+---------------------------+
-     *
-     * Old tags are inserted to a temporary buffer with position:
-     *     tempbuf_insert(position/ENTRY_CHUNK_SIZE, ...);
-     * And new tags with index:
-     *     tempbuf_insert(idx, ...);
-     *
-     * The buffer is sorted and written into tag file:
-     *     tempbuf_sort(...);
-     * leaving master index locations messed up.
-     *
-     * That is fixed using the lookup buffer for old tags:
-     *     new_seek = tempbuf_find_location(old_seek, ...);
-     * and for new tags:
-     *     new_seek = tempbuf_find_location(idx);
-     */
-    lookup = (struct tempbuf_searchidx **)&tempbuf[tempbuf_pos];
-    tempbuf_pos += lookup_buffer_depth * sizeof(void **);
-    memset(lookup, 0, lookup_buffer_depth * sizeof(void **));
+    entries = (struct sortidx_entry *)tempbuf;
+    map = (int32_t *)&entries[tch.entry_count];
+    postings = &map[tcmh.tch.entry_count];
 
-    /* And calculate the remaining data space used mainly for storing
-     * tag data (strings). */
-    tempbuf_left = tempbuf_size - tempbuf_pos - 8;
-    if (tempbuf_left - TAGFILE_ENTRY_AVG_LENGTH * commit_entry_count < 0)
+    for (i = 0; i < tch.entry_count && !USR_CANCEL; i++)
     {
-        logf("Buffer way too small!");
-        close(fd);
-        return 0;
-    }
+        struct tagfile_entry entry;
+        int loc = lseek(fd, 0, SEEK_CUR);
 
-    if (fd >= 0)
-    {
-        /**
-         * If tag file contains unique tags (sorted index), we will load
-         * it entirely into memory so we can resort it later for use with
-         * chunked browsing.
-         */
-        if (TAGCACHE_IS_SORTED(index_type))
+        switch (read_tagfile_entry_and_tag(fd, &entry,
+                                           build_idx_buf, build_idx_bufsz))
         {
-            logf("loading tags...");
-            for (i = 0; i < tch.entry_count && !USR_CANCEL; i++)
-            {
-                struct tagfile_entry entry;
-                int loc = lseek(fd, 0, SEEK_CUR);
-                bool ret;
-                switch (read_tagfile_entry_and_tag(fd, &entry, build_idx_buf, build_idx_bufsz))
-                {
-                    case e_SUCCESS_LEN_ZERO: /* Skip deleted entries. */
-                        continue;
-                    case e_SUCCESS:
-                         break;
-                    case e_ENTRY_SIZEMISMATCH:
-                        logf("read error #7");
-                        close(fd);
-                        return -2;
-                    case e_TAG_TOOLONG:
-                        logf("too long tag #3");
-                        close(fd);
-                        return -2;
-                    case e_TAG_SIZEMISMATCH:
-                        logf("read error #8");
-                        close(fd);
-                        return -2;
-                }
+            case e_SUCCESS_LEN_ZERO: /* Skip deleted entries. */
+                continue;
+            case e_SUCCESS:
+                break;
+            default:
+                logf("sorted index: read error");
+                goto exit;
+        }
 
-                /**
-                 * Save the tag and tag id in the memory buffer. Tag id
-                 * is saved so we can later reindex the master lookup
-                 * table when the index gets resorted.
-                 */
-                ret = tempbuf_insert(build_idx_buf, loc/TAGFILE_ENTRY_CHUNK_LENGTH
-                                     + commit_entry_count, entry.idx_id,
-                                     TAGCACHE_IS_UNIQUE(index_type));
-                if (!ret)
-                {
-                    close(fd);
-                    return -3;
-                }
-                do_timed_yield();
+        entries[count].tag_seek = loc;
+        entries[count].posting_start = 0;
+        entries[count].posting_count = 0;
+        count++;
+        do_timed_yield();
+    }
+
+    /* Map every master index entry to its string and count the postings. */
+    lseek(masterfd, sizeof(struct master_header), SEEK_SET);
+    for (i = 0; i < tcmh.tch.entry_count && !USR_CANCEL; i += IDX_BUF_DEPTH)
+    {
+        int depth = MIN(tcmh.tch.entry_count - i, IDX_BUF_DEPTH);
+
+        if (read_index_entries(masterfd, idxbuf, depth) !=
+            (ssize_t)sizeof(struct index_entry) * depth)
+        {
+            logf("sorted index: read fail");
+            goto exit;
+        }
+
+        for (j = 0; j < depth; j++)
+        {
+            int k = -1;
+
+            if (!(idxbuf[j].flag & FLAG_DELETED))
+            {
+                k = sortidx_find_seek(entries, count,
+                                      idxbuf[j].tag_seek[index_type]);
+                if (k >= 0)
+                    entries[k].posting_count++;
             }
-            logf("done");
+
+            map[i + j] = k;
         }
-        else
-            tempbufidx = tch.entry_count;
+
+        do_timed_yield();
     }
-    else
+
+    if (USR_CANCEL)
+        goto exit;
+
+    for (i = 0; i < count; i++)
     {
-        logf("Create New Index: %d", index_type);
-        /**
-         * Creating new index file to store the tags. No need to preload
-         * anything whether the index type is sorted or not.
-         *
-         * Note: although we are creating a file under the db path, it must
-         * already exist by this point so no mkdir is required.
-         */
-        fd = open_pathfmt(build_idx_buf, build_idx_bufsz,
+        entries[i].posting_start = total;
+        total += entries[i].posting_count;
+        entries[i].posting_count = 0;
+    }
+
+    for (i = 0; i < tcmh.tch.entry_count; i++)
+    {
+        int k = map[i];
+
+        if (k >= 0)
+            postings[entries[k].posting_start + entries[k].posting_count++] = i;
+    }
+
+    sortfd = open_pathfmt(build_idx_buf, build_idx_bufsz,
                           O_WRONLY | O_CREAT | O_TRUNC,
-                          "%s/" TAGCACHE_FILE_INDEX,
+                          "%s/" TAGCACHE_FILE_SORTIDX,
                           tc_stat.db_path, index_type);
-        if (fd < 0)
-        {
-            logf(TAGCACHE_FILE_INDEX " open fail", index_type);
-            return -2;
-        }
+    if (sortfd < 0)
+    {
+        logf(TAGCACHE_FILE_SORTIDX " open fail", index_type);
+        goto exit;
+    }
 
-        tch.magic = TAGCACHE_MAGIC;
-        tch.entry_count = 0;
-        tch.datasize = 0;
+    sih.tch.magic = TAGCACHE_MAGIC;
+    sih.tch.entry_count = count;
+    sih.tch.datasize = count * sizeof(struct sortidx_entry)
+                     + total * sizeof(int32_t);
+    sih.commitid = commitid;
+    sih.posting_count = total;
+    sih.master_count = tcmh.tch.entry_count;
 
-        if (write_tagcache_header(fd, &tch) != sizeof(struct tagcache_header))
-        {
-            logf("header write failed");
-            close(fd);
-            return -2;
-        }
+    if (write(sortfd, &sih, sizeof(sih)) != sizeof(sih)
+        || write(sortfd, entries, count * sizeof(struct sortidx_entry)) !=
+           (ssize_t)(count * sizeof(struct sortidx_entry))
+        || write(sortfd, postings, total * sizeof(int32_t)) !=
+           (ssize_t)(total * sizeof(int32_t)))
+    {
+        logf("sorted index: write fail");
+        goto exit;
     }
 
-    /* Loading the tag lookup file as "master file". */
-    logf("Loading index file");
-    masterfd = open_db_fd(TAGCACHE_FILE_MASTER, O_RDWR);
+    logf("sorted index %d: %d strings, %d postings", index_type, count, total);
+    ok = true;
 
-    if (masterfd < 0)
+exit:
+    if (sortfd >= 0)
+        close(sortfd);
+    close(masterfd);
+    close(fd);
+
+    if (!ok)
     {
-        logf("Creating new DB");
-        masterfd = open_db_fd(TAGCACHE_FILE_MASTER, O_WRONLY | O_CREAT | O_TRUNC);
+        /* A stale index is ignored anyway, but don't leave a broken one. */
+        snprintf(build_idx_buf, build_idx_bufsz, "%s/" TAGCACHE_FILE_SORTIDX,
+                 tc_stat.db_path, index_type);
+        remove(build_idx_buf);
+    }
 
-        if (masterfd < 0)
-        {
-            logf("Failure to create index file (%s)", TAGCACHE_FILE_MASTER);
-            close(fd);
-            return -2;
-        }
+    return ok;
+}
 
-        /* Write the header (write real values later). */
-        memset(&tcmh, 0, sizeof(struct master_header));
-        tcmh.tch = *h;
-        tcmh.tch.entry_count = 0;
-        tcmh.tch.datasize = 0;
-        tcmh.dirty = true;
-        write_master_header(masterfd, &tcmh);
-        init = true;
-        masterfd_pos = lseek(masterfd, 0, SEEK_CUR);
+struct wordidx_pair {
+    const char *word;
+    int32_t seek;
+};
+
+static int wordidx_pair_cmp(const void *a, const void *b)
+{
+    const struct wordidx_pair *p1 = a, *p2 = b;
+    int cmp = strcmp(p1->word, p2->word);
+
+    if (cmp != 0)
+        return cmp;
+
+    return p1->seek < p2->seek ? -1 : p1->seek > p2->seek;
+}
+
+/* Buffered writes of the word index, using build_idx_buf */
+static int wordidx_buf_len;
+
+static bool wordidx_write(int fd, const void *data, size_t size)
+{
+    if (wordidx_buf_len + size > (size_t)build_idx_bufsz || data == NULL)
+    {
+        if (write(fd, build_idx_buf, wordidx_buf_len) != wordidx_buf_len)
+            return false;
+        wordidx_buf_len = 0;
     }
-    else
+
+    if (data)
     {
-        /**
-         * Master file already exists so we need to process the current
-         * file first.
-         */
-        init = false;
+        memcpy(&build_idx_buf[wordidx_buf_len], data, size);
+        wordidx_buf_len += size;
+    }
 
-        if (read_master_header(masterfd, &tcmh) != sizeof(struct master_header) ||
-            tcmh.tch.magic != TAGCACHE_MAGIC)
+    return true;
+}
+
+/**
+ * Build the word index of a tag: every word of its strings with the list of
+ * strings (tag file seeks) containing it. tagcache_search_words() binary
+ * searches the words instead of checking every string of the tag.
+ */
+static bool build_wordidx(int index_type, int32_t commitid)
+{
+    struct tagcache_header tch;
+    struct wordidx_header wih;
+    struct wordidx_entry wie;
+    struct wordidx_pair *pairs;
+    char word[TAGCACHE_WORD_LEN];
+    char *pool;
+    const char *str;
+    int fd, wordfd = -1;
+    int i, pass, count = 0, words = 0, total = 0, poolsize = 0;
+    bool ok = false;
+
+    logf("Building word index: %d", index_type);
+
+    fd = open_tag_fd(&tch, index_type, false);
+    if (fd < 0)
+        return false;
+
+    /* (word, seek) pairs | ... | words */
+    pairs = (struct wordidx_pair *)tempbuf;
+    pool = tempbuf + tempbuf_size;
+
+    for (i = 0; i < tch.entry_count && !USR_CANCEL; i++)
+    {
+        struct tagfile_entry entry;
+        int loc = lseek(fd, 0, SEEK_CUR);
+
+        switch (read_tagfile_entry_and_tag(fd, &entry,
+                                           build_idx_buf, build_idx_bufsz))
         {
-            logf("header error");
-            close(fd);
-            close(masterfd);
-            return -2;
+            case e_SUCCESS_LEN_ZERO: /* Skip deleted entries. */
+                continue;
+            case e_SUCCESS:
+                break;
+            default:
+                logf("word index: read error");
+                goto exit;
         }
 
-        /**
-         * If we reach end of the master file, we need to expand it to
-         * hold new tags. If the current index is not sorted, we can
-         * simply append new data to end of the file.
-         * However, if the index is sorted, we need to update all tag
-         * pointers in the master file for the current index.
-         */
-        masterfd_pos = lseek(masterfd, tcmh.tch.entry_count * sizeof(struct index_entry),
-            SEEK_CUR);
-        if (masterfd_pos == filesize(masterfd))
+        str = build_idx_buf;
+        while ((str = get_next_word(str, word, sizeof(word))))
         {
-            logf("appending...");
-            init = true;
+            size_t len = strlen(word) + 1;
+
+            if ((char *)&pairs[count + 1] > pool - len)
+            {
+                logf("word index: buffer too small");
+                goto exit;
+            }
+
+            pool -= len;
+            memcpy(pool, word, len);
+            pairs[count].word = pool;
+            pairs[count].seek = loc;
+            count++;
         }
+
+        do_timed_yield();
     }
 
-    /**
-     * Load new unique tags in memory to be sorted later and added
-     * to the master lookup file.
-     */
-    if (TAGCACHE_IS_SORTED(index_type))
+    if (USR_CANCEL)
+        goto exit;
+
+    qsort(pairs, count, sizeof(*pairs), wordidx_pair_cmp);
+
+    /* Drop repeated words of a string and count the distinct words. */
+    for (i = 0; i < count; i++)
     {
-        lseek(tmpfd, sizeof(struct tagcache_header), SEEK_SET);
-        /* h is the header of the temporary file containing new tags. */
-        logf("inserting new tags...");
-        for (i = 0; i < h->entry_count && !USR_CANCEL; i++)
+        if (total > 0 && pairs[i].seek == pairs[total - 1].seek
+            && strcmp(pairs[i].word, pairs[total - 1].word) == 0)
+            continue;
+
+        if (total == 0 || strcmp(pairs[i].word, pairs[total - 1].word) != 0)
         {
-            struct temp_file_entry entry;
+            words++;
+            poolsize += strlen(pairs[i].word) + 1;
+        }
 
-            if (read(tmpfd, &entry, sizeof(struct temp_file_entry)) !=
-                sizeof(struct temp_file_entry))
+        pairs[total++] = pairs[i];
+    }
+
+    wordfd = open_pathfmt(build_idx_buf, build_idx_bufsz,
+                          O_WRONLY | O_CREAT | O_TRUNC,
+                          "%s/" TAGCACHE_FILE_WORDIDX,
+                          tc_stat.db_path, index_type);
+    if (wordfd < 0)
+    {
+        logf(TAGCACHE_FILE_WORDIDX " open fail", index_type);
+        goto exit;
+    }
+
+    wih.tch.magic = TAGCACHE_MAGIC;
+    wih.tch.entry_count = words;
+    wih.tch.datasize = (words + 1) * sizeof(struct wordidx_entry)
+                     + total * sizeof(int32_t) + poolsize;
+    wih.commitid = commitid;
+    wih.posting_count = total;
+
+    wordidx_buf_len = 0;
+    if (!wordidx_write(wordfd, &wih, sizeof(wih)))
+        goto write_fail;
+
+    /* Entries, postings and words each take a pass over the pairs. */
+    for (pass = 0; pass < 3; pass++)
+    {
+        wie.word_offset = 0;
+        for (i = 0; i < total; i++)
+        {
+            bool first = i == 0
+                         || strcmp(pairs[i].word, pairs[i - 1].word) != 0;
+
+            if (pass == 0 && first)
             {
-                logf("read fail #3");
-                error = true;
-                goto error_exit;
+                wie.posting_start = i;
+                if (!wordidx_write(wordfd, &wie, sizeof(wie)))
+                    goto write_fail;
+                wie.word_offset += strlen(pairs[i].word) + 1;
             }
-
-            /* Read data. */
-            if (entry.tag_length[index_type] >= build_idx_bufsz)
+            else if (pass == 1)
             {
-                logf("too long entry!");
-                error = true;
-                goto error_exit;
+                if (!wordidx_write(wordfd, &pairs[i].seek, sizeof(int32_t)))
+                    goto write_fail;
             }
-
-            lseek(tmpfd, entry.tag_offset[index_type], SEEK_CUR);
-            if (read(tmpfd, build_idx_buf, entry.tag_length[index_type]) !=
-                entry.tag_length[index_type])
+            else if (pass == 2 && first)
             {
-                logf("read fail #4");
-                error = true;
-                goto error_exit;
+                if (!wordidx_write(wordfd, pairs[i].word,
+                                   strlen(pairs[i].word) + 1))
+                    goto write_fail;
             }
-            str_setlen(build_idx_buf, entry.tag_length[index_type]);
+        }
+
+        if (pass == 0)
+        {
+            /* Sentinel */
+            wie.posting_start = total;
+            if (!wordidx_write(wordfd, &wie, sizeof(wie)))
+                goto write_fail;
+        }
+    }
+
+    if (!wordidx_write(wordfd, NULL, 0))
+        goto write_fail;
+
+    logf("word index %d: %d words, %d postings", index_type, words, total);
+    ok = true;
+    goto exit;
+
+write_fail:
+    logf("word index: write fail");
+
+exit:
+    if (wordfd >= 0)
+        close(wordfd);
+    close(fd);
+
+    if (!ok)
+    {
+        /* Searches scan the strings without it. */
+        snprintf(build_idx_buf, build_idx_bufsz, "%s/" TAGCACHE_FILE_WORDIDX,
+                 tc_stat.db_path, index_type);
+        remove(build_idx_buf);
+    }
+
+    return ok;
+}
+
+#if !defined(PLUGIN)
+/* Can the new entries be appended to the sorted tags without resorting? */
+static bool use_delta_commit(const struct tagcache_header *h)
+{
+    struct tagcache_sortidx si;
+    int32_t sorted_count = current_tcmh.tch.entry_count;
+    int tag;
+
+#ifdef __PCTOOL__
+    /* The database is always built in one go. */
+    return false;
+#endif
+
+    if (!tc_stat.ready || h->entry_count <= 0
+        || h->entry_count > TAGCACHE_DELTA_COMMIT_MAX)
+        return false;
+
+    if (tc_delta.magic == TAGCACHE_MAGIC)
+        sorted_count = tc_delta.entry_count;
+
+    if ((current_tcmh.tch.entry_count - sorted_count + h->entry_count)
+        * TAGCACHE_DELTA_MERGE_RATIO > sorted_count)
+        return false;
+
+    /* New strings are looked up from the sorted index. */
+    for (tag = 0; tag < TAG_COUNT; tag++)
+    {
+        if (!TAGCACHE_IS_UNIQUE(tag))
+            continue;
+
+        memset(&si, 0, sizeof(si));
+        if (!sortidx_open(&si, tag, NULL))
+            return false;
+
+        sortidx_close(&si);
+    }
+
+    return true;
+}
+
+/* Location of str in the sorted part of a tag file, or -1 if not found. */
+static int32_t delta_find_sorted(struct tagcache_sortidx *si, int fd,
+                                 const char *str)
+{
+    struct sortidx_entry entry;
+    char buf[TAGCACHE_BUFSZ];
+    const char *s;
+    int32_t i;
+
+    /* UNTAGGED is sorted first regardless of its collation */
+    i = strcasecmp(str, UNTAGGED) ? sortidx_bound(si, false, fd, str,
+                                                  TAG_MAXLEN, false) : 0;
+
+    for (; i >= 0 && i < si->count; i++)
+    {
+        s = sortidx_get_str(si, false, fd, i, buf, sizeof(buf));
+        if (s == NULL)
+            break;
+
+        if (*s == '\0') /* Skip deleted strings. */
+            continue;
+
+        if (strcasecmp(s, str) == 0 && sortidx_get_entry(si, i, &entry))
+            return entry.tag_seek;
+
+        break;
+    }
+
+    return -1;
+}
+
+struct delta_str {
+    int32_t seek;
+    unsigned crc;
+    const char *str;
+};
+
+/* Strings appended since the last full commit, for removing duplicates. */
+static struct delta_str *delta_strs;
+static int delta_str_count;
+static char *delta_str_end;
+
+static bool delta_str_insert(const char *str, int32_t seek)
+{
+    int len = strlen(str) + 1;
+    struct delta_str *ds = &delta_strs[delta_str_count];
+
+    if ((char *)(ds + 1) > delta_str_end - len)
+    {
+        logf("delta: buffer full");
+        return false;
+    }
 
-#if defined(PLUGIN)
-            if (user_check_tag(index_type, build_idx_buf))
-#endif /*defined(PLUGIN)*/
-            {
-                if (TAGCACHE_IS_UNIQUE(index_type))
-                    error = !tempbuf_insert(build_idx_buf, i, -1, true);
-                else
-                    error = !tempbuf_insert(build_idx_buf, i,
-                                            tcmh.tch.entry_count + i, false);
+    delta_str_end -= len;
+    memcpy(delta_str_end, str, len);
 
-                if (error)
-                {
-                    logf("insert error");
-                    goto error_exit;
-                }
-            }
-            /* Skip to next. */
-            lseek(tmpfd, entry.data_length - entry.tag_offset[index_type] -
-                    entry.tag_length[index_type], SEEK_CUR);
-            do_timed_yield();
-        }
-        logf("done");
+    ds->seek = seek;
+    ds->crc = tag_crc32_nocase(str);
+    ds->str = delta_str_end;
+    delta_str_count++;
 
-        /* Sort the buffer data and write it to the index file. */
-        lseek(fd, sizeof(struct tagcache_header), SEEK_SET);
-        /**
-         * We need to truncate the index file now. There can be junk left
-         * at the end of file (however, we _should_ always follow the
-         * entry_count and don't crash with that).
-         */
-        ftruncate(fd, lseek(fd, 0, SEEK_CUR));
+    return true;
+}
 
-        i = tempbuf_sort(fd);
-        if (i < 0)
-            goto error_exit;
-        logf("sorted %d tags", i);
+static int32_t delta_str_find(const char *str)
+{
+    unsigned crc32 = tag_crc32_nocase(str);
+    int i;
 
-        /**
-         * Now update all indexes in the master lookup file.
-         */
-        logf("updating indices...");
-        lseek(masterfd, sizeof(struct master_header), SEEK_SET);
-        for (i = 0; i < tcmh.tch.entry_count && !USR_CANCEL; i += idxbuf_pos)
-        {
-            int j;
-            int loc = lseek(masterfd, 0, SEEK_CUR);
+    for (i = 0; i < delta_str_count; i++)
+    {
+        if (delta_strs[i].crc == crc32 && !strcasecmp(str, delta_strs[i].str))
+            return delta_strs[i].seek;
+    }
 
-            idxbuf_pos = MIN(tcmh.tch.entry_count - i, IDX_BUF_DEPTH);
+    return -1;
+}
 
-            if (read_index_entries(masterfd, idxbuf, idxbuf_pos) !=
-                (ssize_t)sizeof(struct index_entry) * idxbuf_pos)
-            {
-                logf("read fail #5");
-                error = true;
-                goto error_exit ;
-            }
-            lseek(masterfd, loc, SEEK_SET);
+/**
+ * Append the new tags of a sorted tag to the end of the tag file, reusing
+ * the strings already in the database. The tag file stays sorted up to
+ * tc_delta.tail_seek, which keeps the sorted index of the last full commit
+ * valid for looking up the old strings.
+ *
+ * Return values as for build_index().
+ */
+static int build_delta_index(int index_type, struct tagcache_header *h,
+                             int tmpfd)
+{
+    struct tagcache_header tch;
+    struct master_header tcmh;
+    struct index_entry idxbuf[IDX_BUF_DEPTH];
+    struct tagcache_sortidx si;
+    bool unique = TAGCACHE_IS_UNIQUE(index_type);
+    int fd, masterfd = -1;
+    int i, j, idxbuf_pos;
+    int masterfd_pos;
+    bool init;
+    int ret = -2;
 
-            for (j = 0; j < idxbuf_pos; j++)
-            {
-                if (idxbuf[j].flag & FLAG_DELETED)
-                {
-                    /* We can just ignore deleted entries. */
-                    // idxbuf[j].tag_seek[index_type] = 0;
-                    continue;
-                }
+    logf("Building delta index: %d", index_type);
 
-                idxbuf[j].tag_seek[index_type] = tempbuf_find_location(
-                    idxbuf[j].tag_seek[index_type]/TAGFILE_ENTRY_CHUNK_LENGTH
-                    + commit_entry_count);
+    fd = open_tag_fd(&tch, index_type, true);
+    if (fd < 0)
+        return -2;
 
-                if (idxbuf[j].tag_seek[index_type] < 0)
-                {
-                    logf("update error: %ld/%d/%ld",
-                         idxbuf[j].flag, i+j, tcmh.tch.entry_count);
-                    error = true;
-                    goto error_exit;
-                }
+    memset(&si, 0, sizeof(si));
+    si.fd = -1;
+    if (unique && !sortidx_open(&si, index_type, NULL))
+        goto exit;
 
-                do_timed_yield();
-            }
+    delta_strs = (struct delta_str *)tempbuf;
+    delta_str_count = 0;
+    delta_str_end = tempbuf + tempbuf_size;
 
-            /* Write back the updated index. */
-            if (write_index_entries(masterfd, idxbuf, idxbuf_pos) !=
-                (ssize_t)sizeof(struct index_entry) * idxbuf_pos)
+    /* Load the strings appended by the previous delta commits. */
+    if (unique && tc_delta.tail_seek[index_type] > 0)
+    {
+        int32_t end = tch.datasize + sizeof(struct tagcache_header);
+        int32_t loc = lseek(fd, tc_delta.tail_seek[index_type], SEEK_SET);
+
+        while (loc < end && !USR_CANCEL)
+        {
+            struct tagfile_entry entry;
+
+            switch (read_tagfile_entry_and_tag(fd, &entry,
+                                               build_idx_buf, build_idx_bufsz))
             {
-                logf("write fail");
-                error = true;
-                goto error_exit;
+                case e_SUCCESS:
+                    if (!delta_str_insert(build_idx_buf, loc))
+                    {
+                        ret = 0;
+                        goto exit;
+                    }
+                    break;
+                case e_SUCCESS_LEN_ZERO: /* Skip deleted entries. */
+                    break;
+                default:
+                    logf("delta: read error");
+                    goto exit;
             }
+
+            loc = lseek(fd, 0, SEEK_CUR);
         }
-        logf("done");
     }
 
-    /**
-     * Walk through the temporary file containing the new tags.
-     */
-    // build_normal_index(h, tmpfd, masterfd, idx);
-    logf("updating new indices...");
-    lseek(masterfd, masterfd_pos, SEEK_SET);
+    masterfd = open_master_fd(&tcmh, true);
+    if (masterfd < 0)
+        goto exit;
+
+    /* Earlier tags of this commit may have expanded the master file. */
+    masterfd_pos = lseek(masterfd, tcmh.tch.entry_count
+                         * sizeof(struct index_entry), SEEK_CUR);
+    init = masterfd_pos == filesize(masterfd);
+
     lseek(tmpfd, sizeof(struct tagcache_header), SEEK_SET);
-    lseek(fd, 0, SEEK_END);
     for (i = 0; i < h->entry_count && !USR_CANCEL; i += idxbuf_pos)
     {
-        int j;
-
         idxbuf_pos = MIN(h->entry_count - i, IDX_BUF_DEPTH);
         if (init)
         {
@@ -3190,113 +5102,118 @@ static int build_index(int index_type, struct tagcache_header *h, int tmpfd)
         }
         else
         {
-            int loc = lseek(masterfd, 0, SEEK_CUR);
-
+            lseek(masterfd, masterfd_pos, SEEK_SET);
             if (read_index_entries(masterfd, idxbuf, idxbuf_pos) !=
                 (ssize_t)sizeof(struct index_entry) * idxbuf_pos)
             {
-                logf("read fail #6");
-                error = true;
-                break ;
+                logf("delta: read fail #1");
+                goto exit;
             }
-            lseek(masterfd, loc, SEEK_SET);
         }
 
-        /* Read entry headers. */
         for (j = 0; j < idxbuf_pos; j++)
         {
-            if (!TAGCACHE_IS_SORTED(index_type))
-            {
-                struct temp_file_entry entry;
-                struct tagfile_entry fe;
+            struct temp_file_entry entry;
+            int32_t seek = -1;
 
-                if (read(tmpfd, &entry, sizeof(struct temp_file_entry)) !=
-                    sizeof(struct temp_file_entry))
-                {
-                    logf("read fail #7");
-                    error = true;
-                    break ;
-                }
+            if (read(tmpfd, &entry, sizeof(struct temp_file_entry)) !=
+                sizeof(struct temp_file_entry))
+            {
+                logf("delta: read fail #2");
+                goto exit;
+            }
 
-                /* Read data. */
-                if (entry.tag_length[index_type] >= build_idx_bufsz)
-                {
-                    logf("too long entry!");
-                    logf("length=%d", entry.tag_length[index_type]);
-                    logf("pos=0x%02lx", lseek(tmpfd, 0, SEEK_CUR));
-                    error = true;
-                    break ;
-                }
+            if (entry.tag_length[index_type] >= build_idx_bufsz)
+            {
+                logf("too long entry!");
+                goto exit;
+            }
 
-                lseek(tmpfd, entry.tag_offset[index_type], SEEK_CUR);
-                if (read(tmpfd, build_idx_buf, entry.tag_length[index_type]) !=
-                    entry.tag_length[index_type])
-                {
-                    logf("read fail #8");
-                    logf("offset=0x%02lx", entry.tag_offset[index_type]);
-                    logf("length=0x%02x", entry.tag_length[index_type]);
-                    error = true;
-                    break ;
-                }
+            lseek(tmpfd, entry.tag_offset[index_type], SEEK_CUR);
+            if (read(tmpfd, build_idx_buf, entry.tag_length[index_type]) !=
+                entry.tag_length[index_type])
+            {
+                logf("delta: read fail #3");
+                goto exit;
+            }
+            str_setlen(build_idx_buf, entry.tag_length[index_type]);
 
-                /* Write to index file. */
-                idxbuf[j].tag_seek[index_type] = lseek(fd, 0, SEEK_CUR);
-                fe.tag_length = entry.tag_length[index_type];
-                fe.idx_id = tcmh.tch.entry_count + i + j;
-                write_tagfile_entry(fd, &fe);
-                write(fd, build_idx_buf, fe.tag_length);
-                tempbufidx++;
+            /* Skip to next. */
+            lseek(tmpfd, entry.data_length - entry.tag_offset[index_type] -
+                  entry.tag_length[index_type], SEEK_CUR);
 
-                /* Skip to next. */
-                lseek(tmpfd, entry.data_length - entry.tag_offset[index_type] -
-                      entry.tag_length[index_type], SEEK_CUR);
+            if (unique)
+            {
+                seek = delta_find_sorted(&si, fd, build_idx_buf);
+                if (seek < 0)
+                    seek = delta_str_find(build_idx_buf);
             }
-            else
+
+            if (seek < 0)
             {
-                /* Locate the correct entry from the sorted array. */
-                idxbuf[j].tag_seek[index_type] = tempbuf_find_location(i + j);
-                if (idxbuf[j].tag_seek[index_type] < 0)
+                seek = lseek(fd, 0, SEEK_END);
+                if (write_tagfile_entry_padded(fd, build_idx_buf, unique ?
+                        -1 : tcmh.tch.entry_count + i + j) < 0)
+                    goto exit;
+
+                if (unique && !delta_str_insert(build_idx_buf, seek))
                 {
-                    logf("entry not found (%d)", j);
-                    error = true;
-                    break ;
+                    ret = 0;
+                    goto exit;
                 }
+
+                if (tc_delta.tail_seek[index_type] == 0)
+                    tc_delta.tail_seek[index_type] = seek;
+                tch.entry_count++;
             }
+
+            idxbuf[j].tag_seek[index_type] = seek;
         }
 
-        /* Write index. */
+        lseek(masterfd, masterfd_pos, SEEK_SET);
         if (write_index_entries(masterfd, idxbuf, idxbuf_pos) !=
             (ssize_t)sizeof(struct index_entry) * idxbuf_pos)
         {
-            logf("tagcache: write fail #4");
-            error = true;
-            break ;
+            logf("delta: write fail");
+            goto exit;
         }
+        masterfd_pos += sizeof(struct index_entry) * idxbuf_pos;
 
         do_timed_yield();
     }
-    logf("done");
 
     /* Finally write the header. */
-    tch.magic = TAGCACHE_MAGIC;
-    tch.entry_count = tempbufidx;
     tch.datasize = lseek(fd, 0, SEEK_END) - sizeof(struct tagcache_header);
     lseek(fd, 0, SEEK_SET);
     write_tagcache_header(fd, &tch);
 
-    if (index_type != tag_filename)
-        h->datasize += tch.datasize;
+    h->datasize += tch.datasize;
     logf("s:%d/%ld/%ld", index_type, tch.datasize, h->datasize);
-    error_exit:
+    ret = 1;
 
+exit:
+    sortidx_close(&si);
+    if (masterfd >= 0)
+        close(masterfd);
     close(fd);
-    close(masterfd);
 
-    if (error)
-        return -2;
+    return ret;
+}
 
-    return 1;
+static bool write_delta_header(void)
+{
+    int fd = open_db_fd(TAGCACHE_FILE_DELTA, O_WRONLY | O_CREAT | O_TRUNC);
+    bool ok;
+
+    if (fd < 0)
+        return false;
+
+    ok = write(fd, &tc_delta, sizeof(tc_delta)) == sizeof(tc_delta);
+    close(fd);
+
+    return ok;
 }
+#endif /*!defined(PLUGIN)*/
 
 static bool commit(void)
 {
@@ -3305,6 +5222,7 @@ static bool commit(void)
     int i, len, rc;
     int tmpfd;
     int masterfd;
+    bool delta = false;
 #ifdef HAVE_DIRCACHE
     bool dircache_buffer_stolen = false;
 #endif
@@ -3355,6 +5273,10 @@ static bool commit(void)
     /* Fully initialize existing headers (if any) before going further. */
     tc_stat.ready = check_all_headers();
 
+#if !defined(PLUGIN)
+    delta = use_delta_commit(&tch);
+#endif
+
 #ifdef HAVE_EEPROM_SETTINGS
     remove_db_file(TAGCACHE_STATEFILE);
 #endif
@@ -3408,7 +5330,17 @@ static bool commit(void)
         goto commit_error;
     }
 
-    logf("commit %ld entries...", tch.entry_count);
+    logf("commit %ld entries%s...", tch.entry_count, delta ? " (delta)" : "");
+
+#if !defined(PLUGIN)
+    if (delta && tc_delta.magic != TAGCACHE_MAGIC)
+    {
+        memset(&tc_delta, 0, sizeof(tc_delta));
+        tc_delta.magic = TAGCACHE_MAGIC;
+        tc_delta.commitid = current_tcmh.commitid;
+        tc_delta.entry_count = current_tcmh.tch.entry_count;
+    }
+#endif
 
     /* Mark DB dirty so it will stay disabled if commit fails. */
     current_tcmh.dirty = true;
@@ -3427,6 +5359,11 @@ static bool commit(void)
             continue;
 
         tc_stat.commit_step++;
+#if !defined(PLUGIN)
+        if (delta && TAGCACHE_IS_SORTED(i))
+            ret = build_delta_index(i, &tch, tmpfd);
+        else
+#endif
         ret = build_index(i, &tch, tmpfd);
         if (ret <= 0)
         {
@@ -3472,6 +5409,30 @@ static bool commit(void)
         write_master_header(masterfd, &tcmh);
         close(masterfd);
 
+#if !defined(PLUGIN)
+        if (delta)
+        {
+            /* Without the delta the sorted indices just go stale. */
+            tc_delta.master_commitid = tcmh.commitid;
+            if (!write_delta_header())
+                logf("delta header write failed");
+        }
+#endif
+        if (!delta)
+        {
+            remove_db_file(TAGCACHE_FILE_DELTA);
+            tc_delta.magic = 0;
+
+            /* Searches still work without them, so failures aren't fatal. */
+            for (i = 0; i < TAG_COUNT && !USR_CANCEL; i++)
+            {
+                if (TAGCACHE_IS_SORTED(i))
+                    build_sortidx(i, tcmh.commitid);
+                if (TAGCACHE_HAS_WORDIDX(i))
+                    build_wordidx(i, tcmh.commitid);
+            }
+        }
+
         logf("tagcache committed");
         tagcache_commit_finalize();
 
@@ -3493,6 +5454,10 @@ static bool commit(void)
     } /*!USR_CANCEL*/
 
 commit_error:
+    /* Drop whatever a failed delta commit changed in memory. */
+    if (!rc)
+        load_delta_header();
+
 #ifdef HAVE_TC_RAMCACHE
     if (ramcache_buffer_stolen)
     {
@@ -4991,6 +6956,10 @@ void do_tagcache_build(const char *path[])
 
     ret = true;
 
+#ifdef TAGCACHE_SCAN_THREADS
+    scan_threads_start();
+#endif
+
     roots_ll[0].path = path[0];
     roots_ll[0].next = NULL;
 
@@ -5061,6 +7030,10 @@ void do_tagcache_build(const char *path[])
     }
     free_search_roots(&roots_ll[0]);
 
+#ifdef TAGCACHE_SCAN_THREADS
+    scan_threads_stop();
+#endif
+
     /* Write the header. */
     header.magic = TAGCACHE_MAGIC;
     header.datasize = data_size;
@@ -5418,6 +7391,11 @@ void tagcache_reverse_scan(void)
     logf("Checking for deleted files");
     check_deleted_files();
 }
+
+int tagcache_get_added_count(void)
+{
+    return total_entry_count;
+}
 #endif
 
 bool tagcache_is_initialized(void)
@@ -5432,6 +7410,12 @@ bool tagcache_is_usable(void)
 {
     return tc_stat.initialized && tc_stat.ready;
 }
+/* Are there unsorted strings at the end of the tag file? */
+bool tagcache_sort_pending(int tag)
+{
+    return tc_delta.magic == TAGCACHE_MAGIC && tag >= 0 && tag < TAG_COUNT
+        && tc_delta.tail_seek[tag] > 0;
+}
 #ifdef HAVE_TC_RAMCACHE
 bool tagcache_is_in_ram(void)
 {
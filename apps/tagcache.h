@@ -51,6 +51,11 @@ enum tag_type { tag_artist = 0, tag_album, tag_genre, tag_title,
 #define TAGCACHE_MAX_FILTERS 4
 #define TAGCACHE_MAX_CLAUSES 32
 
+/* Query words used by tagcache_search_words() (the rest are ignored). */
+#define TAGCACHE_MAX_WORDS 4
+/* Words are compared up to this length (including the \0). */
+#define TAGCACHE_WORD_LEN 32
+
 /* Tag to be used on untagged files. */
 #define UNTAGGED "<Untagged>"
 /* Maximum length of a single tag. */
@@ -74,7 +79,7 @@ enum clause { clause_none, clause_is, clause_is_not, clause_gt, clause_gteq,
     clause_lt, clause_lteq, clause_contains, clause_not_contains, 
     clause_begins_with, clause_not_begins_with, clause_ends_with,
     clause_not_ends_with, clause_oneof,
-    clause_begins_oneof, clause_ends_oneof,
+    clause_begins_oneof, clause_ends_oneof, clause_words,
     clause_logical_or };
 
 struct tagcache_stat {
@@ -118,6 +123,30 @@ struct tagcache_search_clause
     char *str;
 };
 
+/* Map the sorted tag indices into memory instead of reading them */
+#if defined(APPLICATION) && !defined(__PCTOOL__) && !defined(WIN32)
+#define TAGCACHE_SORTIDX_MMAP
+#endif
+
+/* Parse metadata in worker threads when building the db on a PC */
+#if defined(__PCTOOL__) && !defined(WIN32)
+#define TAGCACHE_SCAN_THREADS
+#endif
+
+/* Sorted tag index used to narrow down a search (internal) */
+struct tagcache_sortidx {
+    int fd;
+    int tag;
+    int32_t count;          /* Number of strings in the index */
+    int32_t posting_count;  /* Number of postings in the index */
+    int32_t posting_pos;    /* Next posting to visit */
+    int32_t posting_end;    /* End of the postings to visit */
+#ifdef TAGCACHE_SORTIDX_MMAP
+    void *map;
+    long mapsize;
+#endif
+};
+
 struct tagcache_seeklist_entry {
     int32_t seek;
     int32_t flag;
@@ -144,6 +173,14 @@ struct tagcache_search {
     uint32_t *unique_list;
     int unique_list_capacity;
     int unique_list_count;
+    struct tagcache_sortidx sortidx;
+    bool sortidx_checked;
+    const char *words;
+    int words_driver;
+    int32_t word_pos;
+    int32_t word_end;
+    int32_t words_end;
+    char word[TAGCACHE_WORD_LEN];
 
     /* Exported variables. */
     bool ramsearch;      /* Is ram copy of the tagcache being used. */
@@ -162,6 +199,12 @@ void tagcache_reverse_scan(void);
 /* call this directly instead of tagcache_build in order to not pull
  * on global_settings */
 void do_tagcache_build(const char *path[]);
+/* Number of files added by the last do_tagcache_build() */
+int tagcache_get_added_count(void);
+#ifdef TAGCACHE_SCAN_THREADS
+/* Parse the metadata of new files in that many threads, 0 to disable. */
+void tagcache_set_scan_threads(int count);
+#endif
 #endif
 
 const char* tagcache_tag_to_str(int tag);
@@ -176,6 +219,8 @@ bool tagcache_search_add_filter(struct tagcache_search *tcs,
                                 int tag, int seek);
 bool tagcache_search_add_clause(struct tagcache_search *tcs,
                                 struct tagcache_search_clause *clause);
+bool tagcache_search_words(struct tagcache_search *tcs, int tag,
+                           const char *words);
 bool tagcache_get_next(struct tagcache_search *tcs, char *buf, long size);
 bool tagcache_retrieve(struct tagcache_search *tcs, int idxid, 
                        int tag, char *buf, long size);
@@ -209,6 +254,7 @@ void tagcache_init(void) INIT_ATTR;
 bool tagcache_is_initialized(void);
 bool tagcache_is_fully_initialized(void);
 bool tagcache_is_usable(void);
+bool tagcache_sort_pending(int tag);
 void tagcache_start_scan(void);
 void tagcache_stop_scan(void);
 bool tagcache_update(void);
@@ -462,6 +462,7 @@ static int get_clause(int *condition)
         CLAUSE('<', ' ', clause_lt),
         CLAUSE('<', '=', clause_lteq),
         CLAUSE('~', ' ', clause_contains),
+        CLAUSE('~', '~', clause_words),
         CLAUSE('!', '~', clause_not_contains),
         CLAUSE('^', ' ', clause_begins_with),
         CLAUSE('!', '^', clause_not_begins_with),
@@ -1447,12 +1448,30 @@ static void tcs_get_basename(struct tagcache_search *tcs, bool is_basename)
     }
 }
 
+/* Word searches ("~~") typed in for the tag of the top level itself can be
+ * looked up in the word index instead of checking every string. */
+static const char *get_search_words(int level, int tag)
+{
+    struct tagcache_search_clause *clause;
+
+    if (level > 0 || csi->clause_count[0] != 1)
+        return NULL;
+
+    clause = csi->clause[0][0];
+    if (clause->tag != tag || clause->type != clause_words
+        || clause->source != source_runtime || clause->str[0] == '\0')
+        return NULL;
+
+    return clause->str;
+}
+
 static int retrieve_entries(struct tree_context *c, int offset, bool init)
 {
     char tcs_buf[TAGCACHE_BUFSZ];
     const long tcs_bufsz = sizeof(tcs_buf);
     struct tagcache_search tcs;
     struct display_format *fmt;
+    const char *words = NULL;
     int i;
     int namebufused = 0;
     int total_count = 0;
@@ -1485,13 +1504,27 @@ static int retrieve_entries(struct tree_context *c, int offset, bool init)
         tag = tag_filename;
     }
 
-    if (!tagcache_search(&tcs, tag))
+    /* because tagcache saves the clauses and the search words, we need to
+     * lock the buffer for the entire duration of the search */
+    core_pin(tagtree_handle);
+
+    if (!is_basename)
+        words = get_search_words(level, tag);
+
+    if (words && !tagcache_search_words(&tcs, tag, words))
+        words = NULL;
+
+    if (!words && !tagcache_search(&tcs, tag))
+    {
+        core_unpin(tagtree_handle);
         return -1;
+    }
 
     /* Prevent duplicate entries in the search list. */
     tagcache_search_set_uniqbuf(&tcs, uniqbuf, UNIQBUF_SIZE);
 
-    if (level || is_basename|| csi->clause_count[0] || TAGCACHE_IS_NUMERIC(tag))
+    if (level || is_basename|| csi->clause_count[0] || TAGCACHE_IS_NUMERIC(tag)
+        || tagcache_sort_pending(tag))
         sort = true;
 
     for (i = 0; i < level; i++)
@@ -1514,10 +1547,7 @@ static int retrieve_entries(struct tree_context *c, int offset, bool init)
         }
     }
 
-    /* because tagcache saves the clauses, we need to lock the buffer
-     * for the entire duration of the search */
-    core_pin(tagtree_handle);
-    for (i = 0; i <= level; i++)
+    for (i = 0; i <= level && !words; i++)
     {
         int j;
 
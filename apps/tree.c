@@ -1302,8 +1302,11 @@ static int ft_play_filename(char *dir, char *file, int attr)
 }
 
 /* These two functions are called by the USB and shutdown handlers */
-void tree_flush(void)
+void tree_flush(bool shutdown)
 {
+#ifndef DIRCACHE_PERSIST
+    (void)shutdown;
+#endif
      tc.is_browsing = false;/* clear browse to prevent reentry to a possibly missing file */
 #ifdef HAVE_TAGCACHE
     tagcache_shutdown();
@@ -1315,21 +1318,19 @@ void tree_flush(void)
 
 #ifdef HAVE_DIRCACHE
     int old_val = global_status.dircache_size;
-#ifdef HAVE_EEPROM_SETTINGS
-    bool savecache = false;
-#endif
 
     if (global_settings.dircache)
     {
-        dircache_suspend();
+    #ifdef DIRCACHE_PERSIST
+        /* at shutdown the cache stays up to date until it is saved */
+        if (!shutdown)
+    #endif
+            dircache_suspend();
 
         struct dircache_info info;
         dircache_get_info(&info);
 
         global_status.dircache_size = info.last_size;
-    #ifdef HAVE_EEPROM_SETTINGS
-        savecache = firmware_settings.initialized;
-    #endif
     }
     else
     {
@@ -1338,14 +1339,26 @@ void tree_flush(void)
 
     if (old_val != global_status.dircache_size)
         status_save();
-
-    #ifdef HAVE_EEPROM_SETTINGS
-        if (savecache)
-            dircache_save();
-    #endif
 #endif /* HAVE_DIRCACHE */
 }
 
+#ifdef DIRCACHE_PERSIST
+/* save the dircache for the next boot; call last thing at shutdown since
+   nothing may be written to the disk after this */
+void tree_save_dircache(void)
+{
+    if (!global_settings.dircache)
+        return;
+
+#ifdef HAVE_EEPROM_SETTINGS
+    if (firmware_settings.initialized)
+#endif
+        dircache_save();
+
+    dircache_suspend();
+}
+#endif /* DIRCACHE_PERSIST */
+
 void tree_restore(void)
 {
 #ifdef HAVE_EEPROM_SETTINGS
@@ -130,7 +130,10 @@ char *getcwd(char *buf, getcwd_size_t size);
 void reload_directory(void);
 bool check_rockboxdir(void);
 struct tree_context* tree_get_context(void);
-void tree_flush(void);
+void tree_flush(bool shutdown);
+#ifdef HAVE_DIRCACHE
+void tree_save_dircache(void);
+#endif
 void tree_restore(void);
 
 bool bookmark_play(char* resume_file, int index, unsigned long elapsed,
@@ -67,7 +67,7 @@ bool call_storage_idle_notifys(bool force)
     }
     lock_until = current_tick + 30*HZ;
 
-    send_event(DISK_EVENT_SPINUP, NULL);
+    send_event(DISK_EVENT_SPINUP, &force);
     
     return true;
 }
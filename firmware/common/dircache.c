@@ -212,7 +212,7 @@ static struct dircache
     size_t       sizeused;            /* bytes of .size bytes actually used */
     union {
     unsigned int numentries;          /* entry count (including holes) */
-#ifdef HAVE_EEPROM_SETTINGS
+#ifdef DIRCACHE_PERSIST
     size_t       sizeentries;         /* used when persisting */
 #endif
     };
@@ -246,6 +246,7 @@ static struct dircache_runinfo
     bool         enabled;          /* dircache master enable switch */
     unsigned int thread_id;        /* current/last thread id */
     bool         thread_done;      /* thread has exited */
+    bool         written;          /* storage written since boot */
     /* cache buffer info */
     int          handle;           /* buflib buffer handle */
     size_t       bufsize;          /* size of buflib allocation - 1 */
@@ -255,6 +256,13 @@ static struct dircache_runinfo
     unsigned char         *pname;  /* alias of .p to assist name resolution */
     };
     struct buflib_callbacks ops;   /* buflib ops callbacks */
+    /* name hash index */
+    int          hash_handle;      /* buflib handle of the slot table */
+    unsigned int hash_mask;        /* number of slots - 1 */
+    unsigned int hash_count;       /* number of slots in use */
+    bool         hash_full;        /* an entry was left out of the table */
+    unsigned long hash_lookups;    /* lookups made */
+    unsigned long hash_probes;     /* slots examined by lookups */
     /* per-volume data */
     struct dircache_runinfo_volume
     {
@@ -294,7 +302,7 @@ static struct dircache_runinfo
 #define DIRCACHE_STUFFED(reserve_used) \
     ((reserve_used) > 3*DIRCACHE_RESERVE / 4)
 
-#ifdef HAVE_EEPROM_SETTINGS
+#ifdef DIRCACHE_PERSIST
 /**
  * remove the snapshot file
  */
@@ -310,7 +318,7 @@ static int open_dircache_file(int oflag)
 {
     return open(DIRCACHE_FILE, oflag, 0666);
 }
-#endif /* HAVE_EEPROM_SETTINGS */
+#endif /* DIRCACHE_PERSIST */
 
 #ifdef DIRCACHE_DUMPSTER
 /**
@@ -737,6 +745,213 @@ static void entry_name_copy(char *dst, const struct dircache_entry *ce)
     *dst = '\0';
 }
 
+/**
+ * get a pointer to the entry's name and its length (not null-terminated)
+ */
+static const unsigned char * entry_name_ptr(const struct dircache_entry *ce,
+                                            size_t *lenp)
+{
+    if (LIKELY(!ce->tinyname))
+    {
+        *lenp = CE_NAMESIZE(ce->namelen);
+        return get_name(ce->name);
+    }
+
+    size_t len = 0;
+    while (len < MAX_TINYNAME && ce->namebuf[len])
+        len++;
+
+    *lenp = len;
+    return ce->namebuf;
+}
+
+/* Entries are hashed by parent index and name, folding case the same way
+ * strcasecmp() does, into an open-addressed table of slots holding the entry
+ * index in the low 24 bits and the top 8 bits of the hash in the rest. The
+ * table lives in its own buflib allocation, sized after a build for the
+ * entries present plus whatever the reserve could add; if it still fills
+ * past 3/4 then further entries are left out and a miss can no longer be
+ * trusted until the next build. */
+#define NAMEHASH_IDX_MASK   0x00ffffff
+#define NAMEHASH_TAG_MASK   0xff000000
+#define NAMEHASH_MIN_SLOTS  256
+
+static uint32_t namehash_key(int up, const unsigned char *name, size_t len)
+{
+    uint32_t h = 2166136261u ^ ((uint32_t)up * 0x9e3779b1u);
+
+    while (len--)
+    {
+        unsigned char c = *name++;
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+
+        h = (h ^ c) * 16777619u;
+    }
+
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    return h;
+}
+
+static uint32_t namehash_entry_key(const struct dircache_entry *ce)
+{
+    size_t len;
+    const unsigned char *name = entry_name_ptr(ce, &len);
+    return namehash_key(ce->up, name, len);
+}
+
+static inline uint32_t * namehash_table(void)
+{
+    int handle = dircache_runinfo.hash_handle;
+    return handle > 0 ? core_get_data(handle) : NULL;
+}
+
+/**
+ * empty the table
+ */
+static void namehash_clear(void)
+{
+    uint32_t *table = namehash_table();
+    if (table)
+        memset(table, 0, (dircache_runinfo.hash_mask + 1)*sizeof (uint32_t));
+
+    dircache_runinfo.hash_count = 0;
+    dircache_runinfo.hash_full  = false;
+}
+
+/**
+ * add a newly linked entry to the table
+ */
+static void namehash_insert(const struct dircache_entry *ce, int idx)
+{
+    uint32_t *table = namehash_table();
+    if (!table || dircache_runinfo.hash_full)
+        return;
+
+    unsigned int mask = dircache_runinfo.hash_mask;
+    if (dircache_runinfo.hash_count >= (mask + 1) / 4 * 3)
+    {
+        logf("name hash full");
+        dircache_runinfo.hash_full = true;
+        return;
+    }
+
+    uint32_t h = namehash_entry_key(ce);
+    unsigned int slot = h & mask;
+
+    while (table[slot])
+        slot = (slot + 1) & mask;
+
+    table[slot] = (h & NAMEHASH_TAG_MASK) | idx;
+    dircache_runinfo.hash_count++;
+}
+
+/**
+ * take an entry out of the table before it is unlinked from its parent
+ */
+static void namehash_remove(const struct dircache_entry *ce, int idx)
+{
+    uint32_t *table = namehash_table();
+    if (!table)
+        return;
+
+    unsigned int mask = dircache_runinfo.hash_mask;
+    unsigned int slot = namehash_entry_key(ce) & mask;
+
+    while (1)
+    {
+        uint32_t s = table[slot];
+        if (!s)
+            return; /* not there (left out) */
+
+        if ((int)(s & NAMEHASH_IDX_MASK) == idx)
+            break;
+
+        slot = (slot + 1) & mask;
+    }
+
+    /* shift back any following slots that may now sit closer to home so
+       that no chain is broken */
+    unsigned int hole = slot;
+
+    while (1)
+    {
+        slot = (slot + 1) & mask;
+
+        uint32_t s = table[slot];
+        if (!s)
+            break;
+
+        unsigned int home =
+            namehash_entry_key(get_entry(s & NAMEHASH_IDX_MASK)) & mask;
+
+        if (((slot - home) & mask) >= ((slot - hole) & mask))
+        {
+            table[hole] = s;
+            hole = slot;
+        }
+    }
+
+    table[hole] = 0;
+    dircache_runinfo.hash_count--;
+}
+
+/**
+ * (re)size the table for the current cache contents and fill it
+ *
+ * Note this must be called with the dircache_lock() active.
+ */
+static void namehash_build(void)
+{
+    if (dircache_runinfo.suspended || !dircache_runinfo.handle)
+        return;
+
+    size_t count = dircache.numentries + DIRCACHE_RESERVE / ENTRYSIZE;
+    unsigned int slots = NAMEHASH_MIN_SLOTS;
+    while (slots / 4 * 3 < count)
+        slots *= 2;
+
+    if (!dircache_runinfo.hash_handle || dircache_runinfo.hash_mask != slots - 1)
+    {
+        int handle = dircache_runinfo.hash_handle;
+        dircache_runinfo.hash_handle = 0;
+        dircache_unlock();
+
+        if (handle > 0)
+            core_free(handle);
+
+        handle = core_alloc(slots*sizeof (uint32_t));
+
+        dircache_lock();
+
+        if (handle > 0 && dircache_runinfo.suspended)
+        {
+            dircache_unlock();
+            core_free(handle);
+            handle = 0;
+            dircache_lock();
+        }
+
+        if (handle <= 0)
+            return;
+
+        dircache_runinfo.hash_handle = handle;
+        dircache_runinfo.hash_mask = slots - 1;
+    }
+
+    namehash_clear();
+
+    FOR_EACH_CACHE_ENTRY(ce)
+    {
+        if (ce->up)
+            namehash_insert(ce, get_index(ce));
+    }
+
+    logf("name hash: %u/%u", dircache_runinfo.hash_count, slots);
+}
+
 /**
  * set the namesfree hint to a new position
  */
@@ -1048,6 +1263,8 @@ static int create_entry(const char *basename,
 static void remove_entry(struct dircache_runinfo_volume *dcrivolp,
                          struct dircache_entry *ce, int *prevp)
 {
+    namehash_remove(ce, *prevp);
+
     /* unlink it from its list */
     *prevp = ce->next;
 
@@ -1318,6 +1535,7 @@ static void sab_process_sub(struct sab *sabp)
             ce->next = prev;
             *compp->prevp = idx;
             compp->prevp = &ce->next;
+            namehash_insert(ce, idx);
 
             if (!(fatentp->attr & ATTR_DIRECTORY))
                 ce->filesize = fatentp->filesize;
@@ -1548,6 +1766,33 @@ void dircache_rewinddir_dirent(struct dirscan_info *scanp)
     dircache_dcfile_init(&scanp->dcscan);
 }
 
+/**
+ * fill in the information file API internal scanning wants about an entry
+ */
+static int get_entry_internal(int idx, const struct dircache_entry *ce,
+                              struct file_base_info *infop,
+                              struct fat_direntry *fatent)
+{
+    /* FS entry information that we maintain */
+    entry_name_copy(fatent->name, ce);
+    fatent->shortname[0]     = '\0';
+    fatent->attr             = ce->attr;
+    /* file code file scanning does not need time information */
+    fatent->filesize         = (ce->attr & ATTR_DIRECTORY) ? 0 : ce->filesize;
+    fatent->firstcluster     = ce->firstcluster;
+
+    /* FS entry directory information */
+    infop->fatfile.e.entry   = ce->direntry;
+    infop->fatfile.e.entries = ce->direntries;
+
+    /* dircache file binding information */
+    infop->dcfile.idx        = idx;
+    infop->dcfile.serialnum  = ce->serialnum;
+
+    /* return whether this needs decoding */
+    return ce->direntries == 1 ? 2 : 1;
+}
+
 /**
  * this function is the back end to file API internal scanning, which requires
  * much more detail about the directory entries; this is allowed to make
@@ -1606,24 +1851,7 @@ int dircache_readdir_internal(struct filestr_base *stream,
         goto read_eod;
     }
 
-    /* FS entry information that we maintain */
-    entry_name_copy(fatent->name, ce);
-    fatent->shortname[0]     = '\0';
-    fatent->attr             = ce->attr;
-    /* file code file scanning does not need time information */
-    fatent->filesize         = (ce->attr & ATTR_DIRECTORY) ? 0 : ce->filesize;
-    fatent->firstcluster     = ce->firstcluster;
-
-    /* FS entry directory information */
-    infop->fatfile.e.entry   = ce->direntry;
-    infop->fatfile.e.entries = ce->direntries;
-
-    /* dircache file binding information */
-    infop->dcfile.idx        = idx;
-    infop->dcfile.serialnum  = ce->serialnum;
-
-    /* return whether this needs decoding */
-    int rc = ce->direntries == 1 ? 2 : 1;
+    int rc = get_entry_internal(idx, ce, infop, fatent);
 
     if (frontier == FRONTIER_SETTLED)
     {
@@ -1643,6 +1871,78 @@ read_eod:
     return 0;    
 }
 
+/**
+ * find the entry named 'name' in the directory open on 'stream' using the
+ * name hash instead of scanning for it; returns what
+ * dircache_readdir_internal() would have for the entry when found, 0 if it
+ * surely doesn't exist or < 0 if only a scan can tell
+ */
+int dircache_lookup_internal(struct filestr_base *stream,
+                             struct file_base_info *infop,
+                             const char *name, unsigned int callflags,
+                             struct fat_direntry *fatent)
+{
+    /* call with writer exclusion */
+    struct file_base_info *dirinfop = stream->infop;
+
+    uint32_t *table = namehash_table();
+    if (!table || !dirinfop->dcfile.serialnum)
+        return -1;
+
+    /* names of entries without a long name are matched after decoding them,
+       which, for anything but ASCII, needs the real scan */
+    bool rawname = callflags & FF_NOISO;
+    if (!rawname)
+    {
+        rawname = true;
+        for (const unsigned char *p = name; *p; p++)
+        {
+            if (*p >= 0x80)
+                rawname = false;
+        }
+    }
+
+    int diridx = dirinfop->dcfile.idx;
+    size_t len = strlen(name);
+    uint32_t h = namehash_key(diridx, (const unsigned char *)name, len);
+    unsigned int mask = dircache_runinfo.hash_mask;
+    unsigned int slot = h & mask;
+
+    dircache_runinfo.hash_lookups++;
+
+    while (1)
+    {
+        uint32_t s = table[slot];
+        dircache_runinfo.hash_probes++;
+
+        if (!s)
+            break;
+
+        if (!((s ^ h) & NAMEHASH_TAG_MASK))
+        {
+            int idx = s & NAMEHASH_IDX_MASK;
+            struct dircache_entry *ce = get_entry(idx);
+            size_t celen;
+            const unsigned char *cename = entry_name_ptr(ce, &celen);
+
+            if (ce->up == diridx && celen == len &&
+                !strncasecmp((const char *)cename, name, len) &&
+                (rawname || ce->direntries > 1))
+            {
+                return get_entry_internal(idx, ce, infop, fatent);
+            }
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    if (rawname && !dircache_runinfo.hash_full &&
+        get_frontier(diridx) == FRONTIER_SETTLED)
+        return 0; /* everything in the directory is in the table */
+
+    return -1;
+}
+
 /**
  * rewind the scan position for an internal scan
  */
@@ -1826,6 +2126,7 @@ static void reset_cache(void)
     dircache.namesfree    = 0;
     dircache.nextnamefree = 0;
     *get_name(dircache.names - 1) = 0;
+    namehash_clear();
     /* dircache.last_serialnum stays */
     /* dircache.reserve_used stays */
     /* dircache.last_size stays */
@@ -1897,7 +2198,7 @@ static int prepare_build(bool *realloced)
     /* called holding dircache lock */
     size_t size = dircache.last_size;
 
-#ifdef HAVE_EEPROM_SETTINGS
+#ifdef DIRCACHE_PERSIST
     if (realloced)
     {
         dircache_unlock();
@@ -1907,7 +2208,7 @@ static int prepare_build(bool *realloced)
         if (dircache_runinfo.suspended)
             return -1;
     }
-#endif /* HAVE_EEPROM_SETTINGS */
+#endif /* DIRCACHE_PERSIST */
 
     bool stuffed = DIRCACHE_STUFFED(dircache.reserve_used);
     if (dircache_runinfo.bufsize > size && !stuffed)
@@ -2052,6 +2353,8 @@ static void dircache_thread(void)
         /* if it was reallocated, compact it */
         if (realloced)
             compact_cache();
+
+        namehash_build();
      }
 
      dircache_unlock();
@@ -2109,6 +2412,15 @@ void dircache_mount(void)
 void dircache_unmount(IF_MV_NONVOID(int volume))
 {
     /* call with writer exclusion */
+#ifdef DIRCACHE_PERSIST
+    /* anything could happen to it before it's mounted again (USB...) */
+    FOR_EACH_VOLUME(IF_MV(volume), i)
+    {
+        if (fat_ismounted(IF_MV(i)))
+            dircache_runinfo.written = true;
+    }
+#endif /* DIRCACHE_PERSIST */
+
     if (dircache_runinfo.suspended)
         return;
 
@@ -2133,13 +2445,18 @@ static void dircache_suspend_internal(bool freeit)
     clear_dircache_queue();
 
     /* grab the buffer away into our control; the cache won't need it now */
-    int handle = 0;
+    int handle = 0, hash_handle = 0;
     if (freeit)
+    {
         handle = reset_buffer();
+        hash_handle = dircache_runinfo.hash_handle;
+        dircache_runinfo.hash_handle = 0;
+    }
 
     dircache_unlock();
 
     core_free(handle);
+    core_free(hash_handle);
 
     thread_wait(thread_id);
 
@@ -2320,6 +2637,8 @@ void dircache_fileop_create(struct file_base_info *dirinfop,
     logf("dc create: %u \"%s\"",
          (unsigned int)bindp->info.dcfile.serialnum, basename);
 
+    dircache_runinfo.written = true;
+
     if (!dirinfop->dcfile.serialnum)
     {
         /* no parent binding => no child binding */
@@ -2351,6 +2670,7 @@ void dircache_fileop_create(struct file_base_info *dirinfop,
         ce->filesize = dinp->size;
 
     insert_file_entry(dirinfop, ce);
+    namehash_insert(ce, idx);
 
     /* file binding will have been queued when it was opened; just resolve */
     infop->dcfile.idx       = idx;
@@ -2374,6 +2694,8 @@ void dircache_fileop_remove(struct file_base_binding *bindp)
     /* requires write exclusion */
     logf("dc remove: %u\n", (unsigned int)bindp->info.dcfile.serialnum);
 
+    dircache_runinfo.written = true;
+
     if (!bindp->info.dcfile.serialnum)
         return; /* no binding yet */
 
@@ -2393,6 +2715,8 @@ void dircache_fileop_rename(struct file_base_info *dirinfop,
     logf("dc rename: %u \"%s\"",
          (unsigned int)bindp->info.dcfile.serialnum, basename);
 
+    dircache_runinfo.written = true;
+
     if (!dirinfop->dcfile.serialnum)
     {
         /* new parent directory not cached; there is nowhere to put it so
@@ -2433,6 +2757,7 @@ void dircache_fileop_rename(struct file_base_info *dirinfop,
         dc_serial_t serialnum = next_serialnum();
         ce->serialnum = serialnum;
         bindp->info.dcfile.serialnum = serialnum;
+        namehash_insert(ce, bindp->info.dcfile.idx);
     }
     else
     {
@@ -2452,6 +2777,8 @@ void dircache_fileop_sync(struct file_base_binding *bindp,
     struct file_base_info *infop = &bindp->info;
     logf("dc sync: %u\n", (unsigned int)infop->dcfile.serialnum);
 
+    dircache_runinfo.written = true;
+
     if (!infop->dcfile.serialnum)
         return; /* binding unresolved */
 
@@ -2852,6 +3179,14 @@ void dircache_get_info(struct dircache_info *info)
     info->size_limit = DIRCACHE_LIMIT;
     info->reserve    = DIRCACHE_RESERVE;
 
+    /* name hash index */
+    info->hash_slots = dircache_runinfo.hash_handle > 0 ?
+                            dircache_runinfo.hash_mask + 1 : 0;
+    info->hash_used  = dircache_runinfo.hash_count;
+    info->hash_full  = dircache_runinfo.hash_full;
+    info->lookups    = dircache_runinfo.hash_lookups;
+    info->probes     = dircache_runinfo.hash_probes;
+
     /* report usage only if there is something ready or being built */
     if (status != DIRCACHE_IDLE)
     {
@@ -2984,23 +3319,33 @@ void dircache_dcfile_init(struct dircache_file *dcfilep)
     dcfilep->serialnum = 0;
 }
 
-#ifdef HAVE_EEPROM_SETTINGS
-
-#ifdef HAVE_HOTSWAP
-/* NOTE: This is hazardous to the filesystem of any sort of removable
-         storage unless it may be determined that the filesystem from save
-         to load is identical. If it's not possible to do so in a timely
-         manner, it's not worth persisting the cache. */
-  #warning "Don't do this; you'll find the consequences unpleasant."
-#endif
+#ifdef DIRCACHE_PERSIST
+/* NOTE: Loading a snapshot is hazardous to the filesystem unless it may be
+         determined that it is identical to what was saved. Each volume is
+         checked against its serial number, size and free space and the
+         root directory is compared against the cache. Anything written
+         before the load makes it stale too. */
 
 /* dircache persistence file header magic */
-#define DIRCACHE_MAGIC  0x00d0c0a1
+#define DIRCACHE_MAGIC    0x00d0c0a2
+/* dircache persistence file layout version */
+#define DIRCACHE_VERSION  1
+
+/* what a volume looked like when it was saved; all zero if not mounted */
+struct dircache_volstamp
+{
+    uint32_t volumeid;          /* volume serial number */
+    sector_t size;              /* size in KiB */
+    sector_t free;              /* free space in KiB */
+};
 
 /* dircache persistence file header */
 struct dircache_maindata
 {
     uint32_t        magic;      /* DIRCACHE_MAGIC */
+    uint16_t        version;    /* DIRCACHE_VERSION */
+    uint16_t        entrysize;  /* ENTRYSIZE */
+    struct dircache_volstamp stamps[NUM_VOLUMES]; /* volume identities */
     struct dircache dircache;   /* metadata of the cache! */
     uint32_t        datacrc;    /* CRC32 of data */
     uint32_t        hdrcrc;     /* CRC32 of header through datacrc */
@@ -3011,12 +3356,171 @@ struct dircache_maindata
  */
 static bool dircache_is_clean(bool saving)
 {
-    if (saving)
-        return dircache.dcvol[0].status == DIRCACHE_READY;
-    else
+    if (!saving)
     {
         return dircache.dcvol[0].status == DIRCACHE_IDLE &&
-               !dircache_runinfo.enabled;
+               !dircache_runinfo.enabled && !dircache_runinfo.written;
+    }
+
+    if (dircache.dcvol[0].status != DIRCACHE_READY)
+        return false;
+
+    /* every mounted volume must be completely cached */
+    FOR_EACH_VOLUME(-1, volume)
+    {
+        struct dircache_volume *dcvolp = DCVOL(volume);
+        if (dcvolp->status == DIRCACHE_SCANNING ||
+            (dcvolp->status == DIRCACHE_IDLE && volume_ismounted(IF_MV(volume))))
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * get the identity of a volume as it is right now
+ */
+static void get_volume_stamp(IF_MV(int volume,)
+                             struct dircache_volstamp *stampp)
+{
+    memset(stampp, 0, sizeof (*stampp));
+
+    if (fat_size(IF_MV(volume,) &stampp->size, &stampp->free))
+        stampp->volumeid = fat_get_volume_id(IF_MV(volume));
+}
+
+/**
+ * compare the root directory of a loaded volume with the storage medium;
+ * subdirectories whose time stamp changed are emptied for rescanning
+ *
+ * returns: < 0 if they differ, 0 if they're the same and > 0 if anything
+ *          needs rescanning
+ */
+static int check_root_dir(struct dircache_volume *dcvolp)
+{
+    struct fat_direntry *const fatentp = get_dir_fatent();
+    struct filestr_base stream;
+    struct file_base_info info;
+
+    int volume = IF_MV_VOL(dcvolp - dircache.dcvol);
+
+    if (fat_open_rootdir(IF_MV(volume,) &info.fatfile) < 0)
+        return -1;
+
+    info.dcfile.idx       = -volume - 1;
+    info.dcfile.serialnum = dcvolp->serialnum;
+
+    filestr_base_init(&stream);
+    fileobj_fileop_open(&stream, &info, FO_DIRECTORY);
+    fat_rewind(&stream.fatstr);
+    uncached_rewinddir_internal(&info);
+
+    int rc = 0;
+    int idx = dcvolp->root_down;
+
+    while (1)
+    {
+        int rdrc = uncached_readdir_internal(&stream, &info, fatentp);
+        struct dircache_entry *ce = get_entry(idx);
+
+        if (rdrc <= 0)
+        {
+            if (rdrc < 0 || ce)
+                rc = -1; /* read error or entries are missing */
+
+            break;
+        }
+
+        if (!ce)
+        {
+            rc = -1; /* entry was added */
+            break;
+        }
+
+        size_t namelen;
+        const unsigned char *name = entry_name_ptr(ce, &namelen);
+
+        if (ce->direntry     != info.fatfile.e.entry   ||
+            ce->direntries   != info.fatfile.e.entries ||
+            ce->attr         != fatentp->attr          ||
+            ce->firstcluster != fatentp->firstcluster  ||
+            strlen(fatentp->name) != namelen           ||
+            memcmp(fatentp->name, name, namelen))
+        {
+            rc = -1;
+            break;
+        }
+
+        bool stale = ce->wrtdate != fatentp->wrtdate ||
+                     ce->wrttime != fatentp->wrttime;
+
+        if (!(ce->attr & ATTR_DIRECTORY))
+        {
+            if (stale || ce->filesize != fatentp->filesize)
+            {
+                rc = -1;
+                break;
+            }
+        }
+        else if (stale)
+        {
+            /* something in it changed; scan it in again */
+            logf("dircache: rescanning \"%s\"", fatentp->name);
+            free_subentries(NULL, &ce->down);
+            ce->frontier = FRONTIER_NEW;
+            ce->wrtdate  = fatentp->wrtdate;
+            ce->wrttime  = fatentp->wrttime;
+            rc = 1;
+        }
+
+        idx = ce->next;
+    }
+
+    close_stream_internal(&stream);
+    return rc;
+}
+
+/**
+ * unlink the snapshot file's own entry from a loaded cache; it was saved while
+ * the file was still being written so what it says about it is out of date
+ */
+static void drop_dircache_file_entry(void)
+{
+    const char *path = DIRCACHE_FILE;
+    const char *name;
+    ssize_t len;
+    int *downp = &dircache.dcvol[0].root_down;
+
+    while ((len = parse_path_component(&path, &name)) > 0)
+    {
+        int *prevp = downp;
+        struct dircache_entry *ce;
+
+        while ((ce = get_entry(*prevp)))
+        {
+            size_t namelen;
+            const unsigned char *cename = entry_name_ptr(ce, &namelen);
+            if (namelen == (size_t)len && !strncasecmp(cename, name, len))
+                break;
+
+            prevp = &ce->next;
+        }
+
+        if (!ce)
+            break;
+
+        if (!*path)
+        {
+            int idx = *prevp;
+            *prevp = ce->next;
+            free_orphan_entry(NULL, ce, idx);
+            break;
+        }
+
+        if (!(ce->attr & ATTR_DIRECTORY))
+            break;
+
+        downp = &ce->down;
     }
 }
 
@@ -3047,7 +3551,9 @@ int dircache_load(void)
     }
 
     /* sanity check the header */
-    if (maindata.magic != DIRCACHE_MAGIC)
+    if (maindata.magic != DIRCACHE_MAGIC ||
+        maindata.version != DIRCACHE_VERSION ||
+        maindata.entrysize != ENTRYSIZE)
     {
         logf("dircache: invalid header magic");
         goto error_nolock;
@@ -3137,10 +3643,58 @@ int dircache_load(void)
         }
     }
 
+    /* make sure the volumes are still the ones that were saved */
+    bool rescan = false;
+
+    FOR_EACH_VOLUME(-1, volume)
+    {
+        struct dircache_volume *dcvolp = DCVOL(volume);
+        struct dircache_volstamp stamp;
+        get_volume_stamp(IF_MV(volume,) &stamp);
+
+        if (memcmp(&stamp, &maindata.stamps[volume], sizeof (stamp)))
+        {
+            logf("dircache: volume %d changed", volume);
+            goto error;
+        }
+
+        if (dcvolp->status == DIRCACHE_IDLE)
+            continue; /* wasn't mounted then; isn't now */
+
+        if (dcvolp->status != DIRCACHE_READY)
+            goto error;
+
+        int rcchk = check_root_dir(dcvolp);
+        if (rcchk < 0)
+        {
+            logf("dircache: volume %d root changed", volume);
+            goto error;
+        }
+
+        if (rcchk > 0)
+        {
+            dcvolp->status     = DIRCACHE_SCANNING;
+            dcvolp->start_tick = current_tick;
+            rescan = true;
+        }
+    }
+
     dircache.reserve_used = 0;
 
+    /* forget the snapshot file and delete it while the cache is still off so
+       that its stale entry can't be used to find it */
+    drop_dircache_file_entry();
+    close(fd);
+    fd = -1;
+    remove_dircache_file();
+
     /* enable the cache but do not try to build it */
     dircache_enable_internal(false);
+    namehash_build();
+
+    /* bring in whatever was dropped in the background */
+    if (rescan)
+        dircache_thread_post(NULL);
 
     /* cache successfully loaded */
     core_unpin(handle);
@@ -3148,7 +3702,10 @@ int dircache_load(void)
     rc = 0;
 error:
     if (rc < 0 && hasbuffer)
+    {
+        reset_cache();
         reset_buffer();
+    }
 
     dircache_unlock();
 
@@ -3157,9 +3714,11 @@ error_nolock:
         core_free(handle);
 
     if (fd >= 0)
+    {
         close(fd);
+        remove_dircache_file();
+    }
 
-    remove_dircache_file();
     return rc;
 }
 
@@ -3171,26 +3730,29 @@ int dircache_save(void)
 {
     logf("Saving directory cache");
 
-    int fd = open_dircache_file(O_WRONLY|O_CREAT|O_TRUNC|O_APPEND);
+    int fd = open_dircache_file(O_WRONLY|O_CREAT|O_TRUNC);
     if (fd < 0)
         return -1;
 
-    /* it seems the handle *must* exist if this function is called */
     dircache_lock();
-    core_pin(dircache_runinfo.handle);
 
     int rc = -1;
 
+    /* a ready cache always has its buffer */
     if (!dircache_is_clean(true))
-        goto error;
+        goto error_nopin;
+
+    core_pin(dircache_runinfo.handle);
 
     /* save the header structure along with the cache metadata */
     ssize_t size;
     uint32_t crc;
     struct dircache_maindata maindata =
     {
-        .magic    = DIRCACHE_MAGIC,
-        .dircache = dircache,
+        .magic     = DIRCACHE_MAGIC,
+        .version   = DIRCACHE_VERSION,
+        .entrysize = ENTRYSIZE,
+        .dircache  = dircache,
     };
 
     /* store the size since it better detects an invalid header */
@@ -3225,6 +3787,11 @@ int dircache_save(void)
     crc = crc_32(get_name(dircache.names), size, crc);
     maindata.datacrc = crc;
 
+    /* the volumes are stamped after the data is written out so that the
+       file itself is accounted for in the free space */
+    FOR_EACH_VOLUME(-1, volume)
+        get_volume_stamp(IF_MV(volume,) &maindata.stamps[volume]);
+
     /* rewrite the header with CRC info */
     if (lseek(fd, 0, SEEK_SET) != 0)
     {
@@ -3247,6 +3814,7 @@ int dircache_save(void)
     rc = 0;
 error:
     core_unpin(dircache_runinfo.handle);
+error_nopin:
     dircache_unlock();
 
     if (rc < 0)
@@ -3255,7 +3823,7 @@ error:
     close(fd);
     return rc;
 }
-#endif /* HAVE_EEPROM_SETTINGS */
+#endif /* DIRCACHE_PERSIST */
 
 /**
  * main one-time initialization function that must be called before any other
@@ -22,6 +22,7 @@
 #include <string.h>
 #include "config.h"
 #include "kernel.h"
+#include "thread.h"
 #include "storage.h"
 #include "debug.h"
 #include "disk_cache.h"
@@ -29,6 +30,7 @@
 #include "dir.h"
 #include "rb_namespace.h"
 #include "disk.h"
+#include "ata_idle_notify.h"
 
 #if defined(HAVE_BOOTDATA) && !defined(SIMULATOR) && !defined(BOOTLOADER)
 #include "bootdata.h"
@@ -305,6 +307,65 @@ bool disk_partinfo(int partition, struct partinfo *info)
     return true;
 }
 
+#if USING_STORAGE_CALLBACK
+/* Fill in the FAT free maps of the mounted volumes in the background once
+   the disk goes idle, before anything needs to allocate. The FAT is read a
+   few sectors at a time so file access never waits long on the locks. */
+#define FREEMAP_FILL_SECTORS    32
+
+static long freemap_stack[(DEFAULT_STACK_SIZE + 0x800)/sizeof(long)];
+static const char freemap_thread_name[] = "freemap";
+static unsigned int freemap_thread_id = 0;
+static bool freemap_thread_done = true;
+
+static void freemap_thread(void)
+{
+    for (int volume = 0; volume < NUM_VOLUMES; volume++)
+    {
+        while (1)
+        {
+            disk_writer_lock();
+            bool more = fat_fill_freemap(IF_MV(volume,) FREEMAP_FILL_SECTORS);
+            disk_writer_unlock();
+
+            if (!more)
+                break;
+
+            yield();
+        }
+    }
+
+    freemap_thread_done = true;
+}
+
+static void disk_fill_freemaps(unsigned short id, void *ev_data,
+                               void *user_data)
+{
+    /* a forced notify comes from a flush before shutdown or the like; wait
+       for the next real idle period */
+    if (*(bool *)ev_data)
+        return;
+
+    if (!freemap_thread_done)
+        return; /* still going; try again next time in case it's past a
+                   volume mounted since */
+
+    remove_event_ex(id, disk_fill_freemaps, user_data);
+
+    /* mustn't recreate until it exits so that the stack isn't reused */
+    if (freemap_thread_id)
+        thread_wait(freemap_thread_id);
+
+    freemap_thread_done = false;
+    freemap_thread_id = create_thread(
+        freemap_thread, freemap_stack, sizeof (freemap_stack), 0,
+        freemap_thread_name IF_PRIO(, PRIORITY_BACKGROUND) IF_COP(, CPU));
+
+    if (!freemap_thread_id)
+        freemap_thread_done = true;
+}
+#endif /* USING_STORAGE_CALLBACK */
+
 int disk_mount(int drive)
 {
     int mounted = 0; /* reset partition-on-drive flag */
@@ -383,6 +444,11 @@ int disk_mount(int drive)
         }
     }
 
+#if USING_STORAGE_CALLBACK
+    if (mounted)
+        add_event_ex(DISK_EVENT_SPINUP, false, disk_fill_freemaps, NULL);
+#endif
+
     disk_writer_unlock();
     return mounted;
 }
@@ -18,6 +18,7 @@
  * KIND, either express or implied.
  *
  ****************************************************************************/
+#include <string.h>
 #include "config.h"
 #include "debug.h"
 #include "system.h"
@@ -55,6 +56,13 @@
  *             001001 <- collision
  *             000000
  * volume map  111101 <- entry usage by the volume (OR of all map entries)
+ *
+ * Read-ahead and write coalescing: when DC_IO_SECTORS > 1, a miss may be
+ * filled with dc_cache_fill(), which reads a whole run of sectors around the
+ * missed one and places the others in the cache as LRU entries, so that they
+ * are the first to go if they are never probed. dc_commit_all() writes runs
+ * of adjacent dirty sectors with one request. Both go through a staging
+ * buffer since the cache buffers of neighbouring sectors are not contiguous.
  */
 
 enum dce_flags /* flags for each cache entry */
@@ -62,6 +70,7 @@ enum dce_flags /* flags for each cache entry */
     DCE_INUSE = 0x01, /* entry in use and valid */
     DCE_DIRTY = 0x02, /* entry is dirty in need of writeback */
     DCE_BUF   = 0x04, /* entry is being used as a general buffer */
+    DCE_AHEAD = 0x08, /* entry was read ahead and not probed since */
 };
 
 struct disk_cache_entry
@@ -87,6 +96,10 @@ static struct disk_cache_entry cache_entry[DC_NUM_ENTRIES];
 static cache_map_entry_t cache_map_entry[NUM_VOLUMES][DC_MAP_NUM_ENTRIES];
 static cache_map_entry_t cache_vol_map[NUM_VOLUMES] IBSS_ATTR;
 static uint8_t cache_buffer[DC_NUM_ENTRIES][DC_CACHE_BUFSIZE] CACHEALIGN_ATTR;
+#if DC_IO_SECTORS > 1
+static uint8_t cache_io_buffer[DC_IO_SECTORS][DC_CACHE_BUFSIZE] CACHEALIGN_ATTR;
+#endif
+static struct dc_info cache_info;
 struct mutex disk_cache_mutex SHAREDBSS_ATTR;
 
 #define CACHE_MAP_ENTRY(volume, mapnum) \
@@ -169,42 +182,49 @@ static inline void cache_discard_entry(struct disk_cache_entry *dce,
     dce->flags = 0;
 }
 
-/* search the cache for the specified sector, returning a buffer, either
-   to the specified sector, if it exists, or a new/evicted entry that must
-   be filled */
-void * dc_cache_probe(IF_MV(int volume,) sector_t sector,
-                      unsigned int *flagsp)
+/* write back a run of sectors and count it */
+static void cache_writeback(IF_MV(int volume,) sector_t sector,
+                            unsigned int count, void *buf)
+{
+    dc_writeback_callback(IF_MV(volume,) sector, count, buf);
+    cache_info.writes += count;
+    cache_info.write_ops++;
+}
+
+/* return the cache index of the specified sector or -1 if not cached */
+static int cache_find_entry(IF_MV(int volume,) sector_t sector)
 {
     unsigned int mapnum = map_sector(sector);
 
     FOR_EACH_BITARRAY_SET_BIT(&CACHE_MAP_ENTRY(volume, mapnum), index)
     {
-        struct disk_cache_entry *dce = &cache_entry[index];
-
-        if (dce->sector == sector)
-        {
-            *flagsp = DCE_INUSE;
-            touch_cache_entry(dce);
-            return cache_buffer[index];
-        }
+        if (cache_entry[index].sector == sector)
+            return index;
     }
 
-    /* sector not found so the LRU is the victim */
+    return -1;
+}
+
+/* reuse the LRU entry for the specified sector, making it the MRU; its
+   buffer must be filled by the caller */
+static unsigned int cache_claim_lru_entry(IF_MV(int volume,) sector_t sector)
+{
+    unsigned int mapnum = map_sector(sector);
     struct disk_cache_entry *dce = DCE_LRU();
     cache_lru.head = dce->node.next;
 
     unsigned int index = DCIDX_FROM_DCE(dce);
-    void *buf = cache_buffer[index];
     unsigned int old_flags = dce->flags;
 
     if (old_flags)
     {
         int old_volume = IF_MV_VOL(dce->volume);
-        sector_t sector = dce->sector;
-        unsigned int old_mapnum = map_sector(sector);
+        sector_t old_sector = dce->sector;
+        unsigned int old_mapnum = map_sector(old_sector);
 
         if (old_flags & DCE_DIRTY)
-            dc_writeback_callback(IF_MV(old_volume,) sector, buf);
+            cache_writeback(IF_MV(old_volume,) old_sector, 1,
+                            cache_buffer[index]);
 
         if (mapnum == old_mapnum IF_MV( && volume == old_volume ))
             goto finish_setup;
@@ -221,8 +241,95 @@ finish_setup:
 #endif
     dce->sector = sector;
 
+    return index;
+}
+
+/* search the cache for the specified sector, returning a buffer, either
+   to the specified sector, if it exists, or a new/evicted entry that must
+   be filled */
+void * dc_cache_probe(IF_MV(int volume,) sector_t sector,
+                      unsigned int *flagsp)
+{
+    int index = cache_find_entry(IF_MV(volume,) sector);
+
+    if (index >= 0)
+    {
+        struct disk_cache_entry *dce = &cache_entry[index];
+
+        if (dce->flags & DCE_AHEAD)
+        {
+            dce->flags &= ~DCE_AHEAD;
+            cache_info.readahead_hits++;
+        }
+
+        cache_info.hits++;
+        *flagsp = DCE_INUSE;
+        touch_cache_entry(dce);
+        return cache_buffer[index];
+    }
+
+    /* sector not found so the LRU is the victim */
+    cache_info.misses++;
     *flagsp = 0;
-    return buf;
+    return cache_buffer[cache_claim_lru_entry(IF_MV(volume,) sector)];
+}
+
+/* fill the buffer of a sector that just missed in dc_cache_probe(); the
+   uncached sectors of the run [start, start + count) that holds it are read
+   along with it if read-ahead is enabled */
+int dc_cache_fill(IF_MV(int volume,) void *buf, sector_t start,
+                  unsigned int count)
+{
+    unsigned int index = DCIDX_FROM_BUF(buf);
+    sector_t sector = cache_entry[index].sector;
+
+#if DC_IO_SECTORS > 1
+    if (count > 1 && count <= DC_IO_SECTORS &&
+        sector >= start && sector - start < count)
+    {
+        int rc = dc_read_callback(IF_MV(volume,) start, count,
+                                  cache_io_buffer);
+        if (rc < 0)
+            return rc;
+
+        memcpy(buf, cache_io_buffer[sector - start], DC_CACHE_BUFSIZE);
+
+        struct lldc_node *first = NULL;
+
+        for (unsigned int i = 0; i < count; i++)
+        {
+            struct disk_cache_entry *dce = DCE_LRU();
+
+            /* don't write anything back or take the caller's buffer just to
+               make room for a guess */
+            if ((dce->flags & DCE_DIRTY) || dce == &cache_entry[index])
+                break;
+
+            if (start + i == sector ||
+                cache_find_entry(IF_MV(volume,) start + i) >= 0)
+                continue;
+
+            unsigned int ahead = cache_claim_lru_entry(IF_MV(volume,)
+                                                       start + i);
+            cache_entry[ahead].flags |= DCE_AHEAD;
+            memcpy(cache_buffer[ahead], cache_io_buffer[i], DC_CACHE_BUFSIZE);
+            cache_info.readahead++;
+
+            if (!first)
+                first = &cache_entry[ahead].node;
+        }
+
+        /* the claimed entries are now the MRU ones in claiming order;
+           rotating the list back makes them the LRU ones instead */
+        if (first)
+            cache_lru.head = first;
+
+        return rc;
+    }
+#endif /* DC_IO_SECTORS > 1 */
+
+    (void)start; (void)count;
+    return dc_read_callback(IF_MV(volume,) sector, 1, buf);
 }
 
 /* mark in-use cache entry as dirty by buffer */
@@ -257,6 +364,54 @@ void dc_commit_all(IF_MV_NONVOID(int volume))
 {
     DEBUGF("dc_commit_all()\n");
 
+#if DC_IO_SECTORS > 1
+    /* gather the dirty entries in sector order so that each run of
+       adjacent sectors can be written with one request */
+    uint8_t dirty[DC_NUM_ENTRIES];
+    unsigned int count = 0;
+
+    FOR_EACH_BITARRAY_SET_BIT(&CACHE_VOL_MAP(volume), index)
+    {
+        if (!(cache_entry[index].flags & DCE_DIRTY))
+            continue;
+
+        sector_t sector = cache_entry[index].sector;
+        unsigned int i = count++;
+
+        for (; i > 0 && cache_entry[dirty[i - 1]].sector > sector; i--)
+            dirty[i] = dirty[i - 1];
+
+        dirty[i] = index;
+    }
+
+    for (unsigned int i = 0, run; i < count; i += run)
+    {
+        sector_t sector = cache_entry[dirty[i]].sector;
+        void *buf = cache_buffer[dirty[i]];
+
+        for (run = 1; run < DC_IO_SECTORS && i + run < count; run++)
+        {
+            if (cache_entry[dirty[i + run]].sector != sector + run)
+                break;
+        }
+
+        if (run > 1)
+        {
+            for (unsigned int j = 0; j < run; j++)
+            {
+                memcpy(cache_io_buffer[j], cache_buffer[dirty[i + j]],
+                       DC_CACHE_BUFSIZE);
+            }
+
+            buf = cache_io_buffer;
+        }
+
+        cache_writeback(IF_MV(volume,) sector, run, buf);
+
+        for (unsigned int j = 0; j < run; j++)
+            cache_entry[dirty[i + j]].flags &= ~DCE_DIRTY;
+    }
+#else /* DC_IO_SECTORS == 1 */
     FOR_EACH_BITARRAY_SET_BIT(&CACHE_VOL_MAP(volume), index)
     {
         struct disk_cache_entry *dce = &cache_entry[index];
@@ -264,11 +419,12 @@ void dc_commit_all(IF_MV_NONVOID(int volume))
 
         if (flags & DCE_DIRTY)
         {
-            dc_writeback_callback(IF_MV(volume,) dce->sector,
-                                  cache_buffer[index]);
+            cache_writeback(IF_MV(volume,) dce->sector, 1,
+                            cache_buffer[index]);
             dce->flags = flags & ~DCE_DIRTY;
         }
     }
+#endif /* DC_IO_SECTORS */
 }
 
 /* discard all cache entries from the specified volume */
@@ -299,7 +455,7 @@ void * dc_get_buffer(void)
         {
             /* must first commit this sector if dirty */
             if (flags & DCE_DIRTY)
-                dc_writeback_callback(IF_MV(dce->volume,) dce->sector, buf);
+                cache_writeback(IF_MV(dce->volume,) dce->sector, 1, buf);
 
             cache_discard_entry(dce, index);
         }
@@ -333,6 +489,14 @@ void dc_release_buffer(void *buf)
     dc_unlock_cache();
 }
 
+/* get the cache statistics */
+void dc_get_info(struct dc_info *info)
+{
+    dc_lock_cache();
+    *info = cache_info;
+    dc_unlock_cache();
+}
+
 /* one-time init at startup */
 void dc_init(void)
 {
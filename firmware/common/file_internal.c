@@ -454,7 +454,12 @@ static NO_INLINE int open_path_component(struct pathwalk *walkp,
     fat_filestr_init(&stream->fatstr, &parentp->info.fatfile);
     rewinddir_internal(&compp->info);
 
-    while ((rc = readdir_internal(stream, &compp->info, &dir_fatent)) > 0)
+    /* try the cache's name index before resorting to a directory scan */
+    rc = lookup_internal(stream, &compp->info, compname, callflags,
+                         &dir_fatent);
+
+    while (rc < 0 &&
+           (rc = readdir_internal(stream, &compp->info, &dir_fatent)) > 0)
     {
         if (rc > 1 && !(callflags & FF_NOISO))
             iso_decode_d_name(dir_fatent.name);
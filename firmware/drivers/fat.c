@@ -29,6 +29,7 @@
 #include "fs_attr.h"
 #include "pathfuncs.h"
 #include "disk_cache.h"
+#include "core_alloc.h"
 #include "file_internal.h" /* for struct filestr_cache */
 #include "storage.h"
 #include "timefuncs.h"
@@ -171,6 +172,13 @@ union raw_dirent
 #define FAT16_BAD_MARK              0xfff7
 #define FAT16_EOF_MARK              0xfff8
 
+/* FAT32 volumes keep a bitmap with one bit per FAT sector, set while the
+   sector may still hold a free entry, so allocation skips full stretches of
+   the FAT without reading them */
+#ifndef BOOTLOADER
+#define HAVE_FAT_FREEMAP
+#endif
+
 struct fsinfo
 {
     sector_t freecount; /* last known free cluster count */
@@ -206,6 +214,8 @@ struct fsinfo
 #endif /* HAVE_FAT16SUPPORT */
 struct bpb;
 static void update_fsinfo32(struct bpb *fat_bpb);
+static int fat_seek_internal(struct fat_filestr *filestr,
+                             unsigned long seeksector, bool extents);
 
 /* Note: This struct doesn't hold the raw values after mounting if
  * bpb_bytspersec isn't 512. All sector counts are normalized to 512 byte
@@ -237,6 +247,7 @@ static struct bpb
     unsigned long dataclusters;
     unsigned long fatrgnstart;
     unsigned long fatrgnend;
+    uint32_t      volumeid;       /* volume serial number */
     struct fsinfo fsinfo;
 #ifdef HAVE_FAT16SUPPORT
     unsigned int bpb_rootentcnt;    /* Number of dir entries in the root */
@@ -256,6 +267,11 @@ static struct bpb
     uint8_t volume;   /* on which volume is this located (shortcut) */
 #endif
     uint8_t mounted;  /* true if volume is mounted, false otherwise */
+#ifdef HAVE_FAT_FREEMAP
+    int freemap_handle; /* free FAT sector bitmap, 0 if none */
+    bool freemap_full;  /* every bit has been checked against the FAT */
+    unsigned long freemap_next; /* next FAT sector for fat_fill_freemap() */
+#endif
 #ifdef HAVE_FAT16SUPPORT
     /* some functions are different for different FAT types */
     long BPB_FN_DECL(get_next_cluster, long);
@@ -273,6 +289,16 @@ static uint8_t fat_bounce_buffers[NUM_VOLUMES][SECTOR_SIZE*FAT_BOUNCE_SECTORS] S
     (fat_bounce_buffers[IF_MV_VOL((bpb)->volume)])
 #endif
 
+/* Extent maps: how many files have their cluster runs remembered at once
+   and how many runs each can hold */
+#if MEMORYSIZE < 8 || defined(BOOTLOADER)
+#define FAT_EXTENT_MAPS     1
+#define FAT_EXTENT_MAP_SIZE 16
+#else
+#define FAT_EXTENT_MAPS     4
+#define FAT_EXTENT_MAP_SIZE 64
+#endif
+
 #define IS_FAT_SECTOR(bpb, sector) \
     (!((sector) >= (bpb)->fatrgnend || (sector) < (bpb)->fatrgnstart))
 
@@ -328,6 +354,39 @@ static void cache_discard(IF_MV_NONVOID(struct bpb *fat_bpb))
     dc_unlock_cache();
 }
 
+/* returns the run of sectors to read along with a sector missing from the
+ * cache: the aligned DC_IO_SECTORS around it, kept within the first FAT or
+ * within the sector's cluster so that file data, which is read and written
+ * around the cache, is never cached */
+static sector_t cache_readahead_run(struct bpb *fat_bpb, sector_t secnum,
+                                    unsigned int *countp)
+{
+    sector_t rgnstart, rgnend;
+
+    if (IS_FAT_SECTOR(fat_bpb, secnum))
+    {
+        rgnstart = fat_bpb->fatrgnstart;
+        rgnend   = fat_bpb->fatrgnend;
+    }
+    else if (secnum >= fat_bpb->firstdatasector)
+    {
+        rgnstart = secnum - (unsigned long)(secnum - fat_bpb->firstdatasector)
+                                % fat_bpb->bpb_secperclus;
+        rgnend   = rgnstart + fat_bpb->bpb_secperclus;
+    }
+    else
+    {
+        /* reserved sectors or the FAT16 root directory */
+        *countp = 1;
+        return secnum;
+    }
+
+    sector_t start = secnum - ((unsigned long)(secnum - rgnstart) &
+                               (DC_IO_SECTORS - 1));
+    *countp = MIN(rgnend - start, DC_IO_SECTORS);
+    return start;
+}
+
 /* caches a FAT or data area sector */
 static void * cache_sector(struct bpb *fat_bpb, sector_t secnum)
 {
@@ -336,8 +395,9 @@ static void * cache_sector(struct bpb *fat_bpb, sector_t secnum)
 
     if (!flags)
     {
-        int rc = storage_read_sectors(IF_MD(fat_bpb->drive,)
-                                      secnum + fat_bpb->startsector, 1, buf);
+        unsigned int count;
+        sector_t start = cache_readahead_run(fat_bpb, secnum, &count);
+        int rc = dc_cache_fill(IF_MV(fat_bpb->volume,) buf, start, count);
         if (UNLIKELY(rc < 0))
         {
             DEBUGF("%s() - Could not read sector %llu"
@@ -360,29 +420,59 @@ static void * cache_sector_buffer(IF_MV(struct bpb *fat_bpb,)
     return dc_cache_probe(IF_MV(fat_bpb->volume,) secnum, &flags);
 }
 
-/* flush a cache buffer to storage */
-void dc_writeback_callback(IF_MV(int volume,) sector_t sector, void *buf)
+/* fill cache buffers from storage */
+int dc_read_callback(IF_MV(int volume,) sector_t sector, unsigned int count,
+                     void *buf)
 {
     struct bpb * const fat_bpb = &fat_bpbs[IF_MV_VOL(volume)];
-    unsigned int copies = !IS_FAT_SECTOR(fat_bpb, sector) ?
-                                1 : fat_bpb->bpb_numfats;
+    return storage_read_sectors(IF_MD(fat_bpb->drive,)
+                                sector + fat_bpb->startsector, count, buf);
+}
 
-    sector += fat_bpb->startsector;
+/* flush cache buffers to storage */
+void dc_writeback_callback(IF_MV(int volume,) sector_t sector,
+                           unsigned int count, void *buf)
+{
+    struct bpb * const fat_bpb = &fat_bpbs[IF_MV_VOL(volume)];
 
-    while (1)
+    while (count)
     {
-        int rc = storage_write_sectors(IF_MD(fat_bpb->drive,) sector, 1, buf);
-        if (rc < 0)
+        /* a run is written per region since FAT sectors have copies */
+        unsigned int copies = 1;
+        unsigned int n = count;
+
+        if (IS_FAT_SECTOR(fat_bpb, sector))
         {
-            panicf("%s() - Could not write sector %llu"
-                   " (error %d)\n", __func__, (uint64_t)sector, rc);
+            copies = fat_bpb->bpb_numfats;
+            n = MIN(n, fat_bpb->fatrgnend - sector);
+        }
+        else if (sector < fat_bpb->fatrgnstart)
+        {
+            n = MIN(n, fat_bpb->fatrgnstart - sector);
         }
 
-        if (--copies == 0)
-            break;
+        sector_t wrsector = sector + fat_bpb->startsector;
+
+        while (1)
+        {
+            int rc = storage_write_sectors(IF_MD(fat_bpb->drive,) wrsector,
+                                           n, buf);
+            if (rc < 0)
+            {
+                panicf("%s() - Could not write sector %llu"
+                       " (error %d)\n", __func__, (uint64_t)wrsector, rc);
+            }
+
+            if (--copies == 0)
+                break;
+
+            /* Update next FAT */
+            wrsector += fat_bpb->fatsize;
+        }
 
-        /* Update next FAT */
-        sector += fat_bpb->fatsize;
+        sector += n;
+        count -= n;
+        buf = (uint8_t *)buf + n * SECTOR_SIZE;
     }
 }
 
@@ -977,6 +1067,161 @@ static void update_fsinfo32(struct bpb *fat_bpb)
     dc_dirty_buf(fsinfo);
 }
 
+#ifdef HAVE_FAT_FREEMAP
+/* The map holds no pointers and is re-fetched after anything that can
+   yield, so it may be moved at will */
+static int freemap_move_callback(int handle, void *current, void *new)
+{
+    (void)handle; (void)current; (void)new;
+    return BUFLIB_CB_OK;
+}
+
+/* The map is only a hint; drop it and fall back to scanning the FAT */
+static int freemap_shrink_callback(int handle, unsigned hints,
+                                   void *start, size_t old_size)
+{
+    (void)hints; (void)start; (void)old_size;
+
+    for (unsigned int i = 0; i < NUM_VOLUMES; i++)
+    {
+        if (fat_bpbs[i].freemap_handle == handle)
+            fat_bpbs[i].freemap_handle = core_free(handle);
+    }
+
+    return BUFLIB_CB_OK;
+}
+
+static struct buflib_callbacks freemap_ops =
+{
+    .move_callback   = freemap_move_callback,
+    .shrink_callback = freemap_shrink_callback,
+};
+
+static void freemap_init(struct bpb *fat_bpb)
+{
+    fat_bpb->freemap_handle = 0;
+    fat_bpb->freemap_full = false;
+    fat_bpb->freemap_next = 0;
+
+#ifdef HAVE_FAT16SUPPORT
+    if (fat_bpb->is_fat16)
+        return;
+#endif
+
+    unsigned long words = ALIGN_UP(fat_bpb->fatsize, 32) / 32;
+    int handle = core_alloc_ex(words * sizeof (uint32_t), &freemap_ops);
+    if (handle <= 0)
+        return;
+
+    /* everything might be free until a scan says otherwise; the padding
+       bits past the end of the FAT are never free */
+    uint32_t *map = core_get_data(handle);
+    memset(map, 0xff, words * sizeof (uint32_t));
+    if (fat_bpb->fatsize % 32)
+        map[words - 1] = (1u << (fat_bpb->fatsize % 32)) - 1;
+
+    fat_bpb->freemap_handle = handle;
+}
+
+static void freemap_free(struct bpb *fat_bpb)
+{
+    if (fat_bpb->freemap_handle > 0)
+        fat_bpb->freemap_handle = core_free(fat_bpb->freemap_handle);
+}
+
+static void freemap_set(struct bpb *fat_bpb, unsigned long sector, bool free)
+{
+    if (fat_bpb->freemap_handle <= 0)
+        return;
+
+    uint32_t *map = core_get_data(fat_bpb->freemap_handle);
+    uint32_t bit = 1u << (sector % 32);
+
+    if (free)
+        map[sector / 32] |= bit;
+    else
+        map[sector / 32] &= ~bit;
+}
+
+/* Return how many FAT sectors from sector on, wrapping around, are known
+   to be full; fatsize if all of them are */
+static unsigned long freemap_skip(struct bpb *fat_bpb, unsigned long sector)
+{
+    if (fat_bpb->freemap_handle <= 0)
+        return 0;
+
+    const uint32_t *map = core_get_data(fat_bpb->freemap_handle);
+    unsigned long words = ALIGN_UP(fat_bpb->fatsize, 32) / 32;
+    unsigned long w = sector / 32;
+    uint32_t bits = map[w] & (~0u << (sector % 32));
+
+    /* one extra word for the low bits of the first one after wrapping */
+    for (unsigned long i = 0; i <= words; i++)
+    {
+        if (bits)
+        {
+            unsigned long nr = w * 32 + __builtin_ctz(bits);
+            return (nr + fat_bpb->fatsize - sector) % fat_bpb->fatsize;
+        }
+
+        if (++w >= words)
+            w = 0;
+
+        bits = map[w];
+    }
+
+    return fat_bpb->fatsize;
+}
+/* Check up to 'count' more FAT sectors not yet known to be full, carrying
+   on where the last call stopped; the map starts out with all of them
+   possibly free */
+static void freemap_fill(struct bpb *fat_bpb, unsigned long count)
+{
+    unsigned long i;
+
+    for (i = fat_bpb->freemap_next;
+         i < fat_bpb->fatsize && fat_bpb->freemap_handle > 0; i++)
+    {
+        unsigned long skip = freemap_skip(fat_bpb, i);
+        if (skip)
+        {
+            i += skip - 1;
+            continue;
+        }
+
+        if (count-- == 0)
+        {
+            fat_bpb->freemap_next = i;
+            return;
+        }
+
+        uint32_t *sec = cache_sector(fat_bpb, i + fat_bpb->fatrgnstart);
+        if (!sec)
+            break; /* give up; unchecked sectors just stay possibly free */
+
+        bool free = false;
+
+        for (unsigned long j = 0; j < CLUSTERS_PER_FAT_SECTOR && !free; j++)
+        {
+            unsigned long c = i * CLUSTERS_PER_FAT_SECTOR + j;
+
+            if (c >= 2 && c <= fat_bpb->dataclusters + 1 &&
+                !(letoh32(sec[j]) & 0x0fffffff))
+                free = true;
+        }
+
+        freemap_set(fat_bpb, i, free);
+    }
+
+    fat_bpb->freemap_full = true;
+}
+#else
+#define freemap_init(bpb)
+#define freemap_free(bpb)
+#define freemap_set(bpb, sector, free)
+#define freemap_skip(bpb, sector)   0
+#endif /* HAVE_FAT_FREEMAP */
+
 static long get_next_cluster32(struct bpb *fat_bpb, long startcluster)
 {
     unsigned long entry = startcluster;
@@ -1012,6 +1257,18 @@ static long find_free_cluster32(struct bpb *fat_bpb, long startcluster)
     for (unsigned long i = 0; i < fat_bpb->fatsize; i++)
     {
         unsigned long nr = (i + sector) % fat_bpb->fatsize;
+
+        unsigned long skip = freemap_skip(fat_bpb, nr);
+        if (skip)
+        {
+            i += skip;
+            if (i >= fat_bpb->fatsize)
+                break;
+
+            nr = (i + sector) % fat_bpb->fatsize;
+            offset = 0;
+        }
+
         uint32_t *sec = cache_sector(fat_bpb, nr + fat_bpb->fatrgnstart);
         if (!sec)
             break;
@@ -1035,6 +1292,10 @@ static long find_free_cluster32(struct bpb *fat_bpb, long startcluster)
             }
         }
 
+        /* the whole sector was looked at and nothing is free in it */
+        if (offset == 0)
+            freemap_set(fat_bpb, nr, false);
+
         offset = 0;
     }
 
@@ -1079,6 +1340,8 @@ static int update_fat_entry32(struct bpb *fat_bpb, unsigned long entry,
         /* being freed */
         if (curval & 0x0fffffff)
             fat_bpb->fsinfo.freecount++;
+
+        freemap_set(fat_bpb, sector, true);
     }
 
     DEBUGF("%lu free clusters\n", (unsigned long)fat_bpb->fsinfo.freecount);
@@ -1101,6 +1364,8 @@ static void fat_recalc_free_internal32(struct bpb *fat_bpb)
         if (!sec)
             break;
 
+        unsigned long secfree = 0;
+
         for (unsigned long j = 0; j < CLUSTERS_PER_FAT_SECTOR; j++)
         {
             unsigned long c = i * CLUSTERS_PER_FAT_SECTOR + j;
@@ -1111,14 +1376,21 @@ static void fat_recalc_free_internal32(struct bpb *fat_bpb)
             if (letoh32(sec[j]) & 0x0fffffff)
                 continue;
 
-            free++;
+            secfree++;
             if (fat_bpb->fsinfo.nextfree == 0xffffffff)
                 fat_bpb->fsinfo.nextfree = c;
         }
+
+        /* the whole FAT is read anyway, so complete the free map too */
+        freemap_set(fat_bpb, i, secfree > 0);
+        free += secfree;
     }
 
     fat_bpb->fsinfo.freecount = free;
     update_fsinfo32(fat_bpb);
+#ifdef HAVE_FAT_FREEMAP
+    fat_bpb->freemap_full = true;
+#endif
 }
 
 static int fat_mount_internal(struct bpb *fat_bpb)
@@ -1227,6 +1499,7 @@ static int fat_mount_internal(struct bpb *fat_bpb)
         fat_bpb->bpb_rootclus = 0 - dirclusters; /* backwards, before the data */
         fat_bpb->rootdirsectornum = dirclusters * fat_bpb->bpb_secperclus
             - rootdirsectors;
+        fat_bpb->volumeid = BYTES2INT32(buf, BS_VOLID);
     }
     else
 #endif /* HAVE_FAT16SUPPORT */
@@ -1235,6 +1508,7 @@ static int fat_mount_internal(struct bpb *fat_bpb)
         fat_bpb->bpb_rootclus  = BYTES2INT32(buf, BPB_ROOTCLUS);
         fat_bpb->bpb_fsinfo    = secmult * BYTES2INT16(buf, BPB_FSINFO);
         fat_bpb->rootdirsector = cluster2sec(fat_bpb, fat_bpb->bpb_rootclus);
+        fat_bpb->volumeid      = BYTES2INT32(buf, BS_32_VOLID);
     }
 
     rc = bpb_is_sane(fat_bpb);
@@ -1316,13 +1590,13 @@ static union raw_dirent * cache_direntry(struct bpb *fat_bpb,
 
     if (fat_query_sectornum(filestr) != sector + 1)
     {
-        int rc = fat_seek(filestr, sector + 1);
+        int rc = fat_seek_internal(filestr, sector + 1, false);
         if (rc < 0)
         {
             if (rc == FAT_SEEK_EOF)
             {
                 DEBUGF("%s() - End of dir (entry %u)\n", __func__, entry);
-                fat_seek(filestr, sector);
+                fat_seek_internal(filestr, sector, false);
                 filestr->eof = true;
             }
 
@@ -1960,8 +2234,259 @@ static int free_direntries(struct bpb *fat_bpb, struct fat_file *file)
     return 1;
 }
 
+/* Extent maps
+ *
+ * Following a cluster chain costs one FAT lookup per cluster, so seeking far
+ * into a large file or reading it through means thousands of them. Each map
+ * holds the runs of contiguous clusters found so far in one file, in file
+ * order; it is shared by every stream of the file and filled in whenever its
+ * chain is followed. Seeks binary search it for the cluster or, failing
+ * that, for the nearest known cluster before it to continue from.
+ *
+ * Runs are only learned from chains that are followed, which appending
+ * doesn't disturb. Anything that frees clusters discards all maps of the
+ * volume. When a map is full, runs are dropped where the others are closest
+ * together, so that what is kept stays spread over the whole file.
+ */
+struct fat_extent
+{
+    long clusternum; /* number of the run's first cluster within the file */
+    long cluster;    /* the run's first cluster */
+    long count;      /* clusters in the run */
+};
+
+static struct fat_extent_map
+{
+#ifdef HAVE_MULTIVOLUME
+    int volume;
+#endif
+    long firstcluster;     /* file of this map, 0 if unused */
+    unsigned long lastuse; /* for LRU replacement */
+    int count;             /* runs in use */
+    struct fat_extent extents[FAT_EXTENT_MAP_SIZE];
+} fat_extent_maps[FAT_EXTENT_MAPS];
+
+static unsigned long fat_extent_use;
+
+/* find the map of a file, optionally taking over the LRU map for it */
+static struct fat_extent_map *
+extent_map_find(IF_MV(int volume,) long firstcluster, bool create)
+{
+    struct fat_extent_map *lru = &fat_extent_maps[0];
+
+    /* FAT16 root dir and empty files have no chain to map */
+    if (firstcluster <= 0)
+        return NULL;
+
+    for (unsigned int i = 0; i < FAT_EXTENT_MAPS; i++)
+    {
+        struct fat_extent_map *map = &fat_extent_maps[i];
+
+        if (map->firstcluster == firstcluster
+                IF_MV( && map->volume == volume ))
+        {
+            map->lastuse = ++fat_extent_use;
+            return map;
+        }
+
+        if (map->lastuse < lru->lastuse)
+            lru = map;
+    }
+
+    if (!create)
+        return NULL;
+
+#ifdef HAVE_MULTIVOLUME
+    lru->volume       = volume;
+#endif
+    lru->firstcluster = firstcluster;
+    lru->lastuse      = ++fat_extent_use;
+    lru->count        = 0;
+    return lru;
+}
+
+/* returns the index of the last run starting at or before clusternum, or
+   -1 if there is none */
+static int extent_search(const struct fat_extent_map *map, long clusternum)
+{
+    int lo = -1, hi = map->count;
+
+    while (hi - lo > 1)
+    {
+        int mid = lo + (hi - lo) / 2;
+
+        if (map->extents[mid].clusternum <= clusternum)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/* returns the file's cluster clusternum if it is known, or else the nearest
+   known one before it, with its number in *knownnum */
+static long extent_lookup(struct bpb *fat_bpb, long firstcluster,
+                          long clusternum, long *knownnum)
+{
+    long cluster = firstcluster;
+    *knownnum = 0;
+
+    dc_lock_cache();
+
+    struct fat_extent_map *map =
+        extent_map_find(IF_MV(fat_bpb->volume,) firstcluster, false);
+    int i = map ? extent_search(map, clusternum) : -1;
+
+    if (i >= 0)
+    {
+        struct fat_extent *ext = &map->extents[i];
+        long offset = MIN(clusternum - ext->clusternum, ext->count - 1);
+
+        *knownnum = ext->clusternum + offset;
+        cluster = ext->cluster + offset;
+    }
+
+    dc_unlock_cache();
+    (void)fat_bpb;
+    return cluster;
+}
+
+/* record that the file's cluster clusternum is cluster */
+static void extent_add(struct bpb *fat_bpb, long firstcluster,
+                       long clusternum, long cluster)
+{
+    dc_lock_cache();
+
+    struct fat_extent_map *map =
+        extent_map_find(IF_MV(fat_bpb->volume,) firstcluster, true);
+    if (!map)
+        goto out;
+
+    int i = extent_search(map, clusternum);
+    struct fat_extent *ext = i >= 0 ? &map->extents[i] : NULL;
+    struct fat_extent *next = i + 1 < map->count ?
+                                    &map->extents[i + 1] : NULL;
+
+    if (ext && clusternum < ext->clusternum + ext->count)
+        goto out; /* already known */
+
+    if (ext && clusternum == ext->clusternum + ext->count &&
+        cluster == ext->cluster + ext->count)
+    {
+        /* continues the run */
+        ext->count++;
+
+        if (next && next->clusternum == clusternum + 1 &&
+            next->cluster == cluster + 1)
+        {
+            /* and joins it with the following one */
+            ext->count += next->count;
+            memmove(next, next + 1,
+                    (map->count - i - 2) * sizeof (struct fat_extent));
+            map->count--;
+        }
+
+        goto out;
+    }
+
+    if (next && next->clusternum == clusternum + 1 &&
+        next->cluster == cluster + 1)
+    {
+        /* precedes the following run */
+        next->clusternum--;
+        next->cluster--;
+        next->count++;
+        goto out;
+    }
+
+    if (map->count >= FAT_EXTENT_MAP_SIZE)
+    {
+        /* full; drop the run whose loss leaves the smallest stretch of the
+           file without a known cluster, keeping the rest spread out */
+        int drop = 1;
+        long mingap = LONG_MAX;
+
+        for (int j = 1; j < map->count; j++)
+        {
+            const struct fat_extent *e = &map->extents[j];
+            long end = j + 1 < map->count ? e[1].clusternum :
+                                            e->clusternum + e->count;
+            long gap = end - e[-1].clusternum - e[-1].count;
+
+            if (gap < mingap)
+            {
+                mingap = gap;
+                drop = j;
+            }
+        }
+
+        memmove(&map->extents[drop], &map->extents[drop + 1],
+                (map->count - drop - 1) * sizeof (struct fat_extent));
+        map->count--;
+
+        i = extent_search(map, clusternum);
+    }
+
+    ext = &map->extents[i + 1];
+    memmove(ext + 1, ext, (map->count - i - 1) * sizeof (struct fat_extent));
+    ext->clusternum = clusternum;
+    ext->cluster    = cluster;
+    ext->count      = 1;
+    map->count++;
+
+out:
+    dc_unlock_cache();
+    (void)fat_bpb;
+}
+
+/* forget all runs on the volume since clusters were freed */
+static void extent_discard_all(struct bpb *fat_bpb)
+{
+    dc_lock_cache();
+
+    for (unsigned int i = 0; i < FAT_EXTENT_MAPS; i++)
+    {
+        struct fat_extent_map *map = &fat_extent_maps[i];
+
+    #ifdef HAVE_MULTIVOLUME
+        if (map->volume != fat_bpb->volume)
+            continue;
+    #endif
+        map->firstcluster = 0;
+        map->lastuse      = 0;
+    }
+
+    dc_unlock_cache();
+    (void)fat_bpb;
+}
+
+/* get the cluster following the file's cluster clusternum, from the map if
+   it is known there */
+static long next_file_cluster(struct bpb *fat_bpb, long firstcluster,
+                              long cluster, long clusternum)
+{
+    long knownnum;
+    long next = extent_lookup(fat_bpb, firstcluster, clusternum + 1,
+                              &knownnum);
+
+    if (knownnum == clusternum + 1)
+        return next;
+
+    next = get_next_cluster(fat_bpb, cluster);
+    if (next > 0)
+    {
+        extent_add(fat_bpb, firstcluster, clusternum, cluster);
+        extent_add(fat_bpb, firstcluster, clusternum + 1, next);
+    }
+
+    return next;
+}
+
 static int free_cluster_chain(struct bpb *fat_bpb, long startcluster)
 {
+    extent_discard_all(fat_bpb);
+
     for (long last = startcluster, next; last; last = next)
     {
         next = get_next_cluster(fat_bpb, last);
@@ -2332,6 +2857,7 @@ int fat_closewrite(struct fat_filestr *filestr, uint32_t size,
     if (!size && file->firstcluster)
     {
         /* empty file */
+        extent_discard_all(fat_bpb);
         rc = update_fat_entry(fat_bpb, file->firstcluster, 0);
         if (rc < 0)
             FAT_ERROR(rc * 10 - 2);
@@ -2541,8 +3067,10 @@ long fat_readwrite(struct fat_filestr *filestr, unsigned long sectorcount,
         if (++sectornum >= fat_bpb->bpb_secperclus)
         {
             /* out of sectors in this cluster; get the next cluster */
-            long newcluster = write ? next_write_cluster(fat_bpb, cluster) :
-                                      get_next_cluster(fat_bpb, cluster);
+            long newcluster = write ?
+                next_write_cluster(fat_bpb, cluster) :
+                next_file_cluster(fat_bpb, file->firstcluster, cluster,
+                                  clusternum);
             if (newcluster)
             {
                 cluster = newcluster;
@@ -2623,7 +3151,10 @@ void fat_seek_to_stream(struct fat_filestr *filestr,
     filestr->eof         = filestr_seek_to->eof;
 }
 
-int fat_seek(struct fat_filestr *filestr, unsigned long seeksector)
+/* seek a file or directory stream; files can use and fill the extent
+   maps, directories don't so that browsing leaves them to files */
+static int fat_seek_internal(struct fat_filestr *filestr,
+                             unsigned long seeksector, bool extents)
 {
     const struct fat_file * const file = filestr->fatfilep;
     struct bpb * const fat_bpb = FAT_BPB(file->volume);
@@ -2658,18 +3189,33 @@ int fat_seek(struct fat_filestr *filestr, unsigned long seeksector)
         clusternum = seeksector / fat_bpb->bpb_secperclus;
         sectornum = seeksector % fat_bpb->bpb_secperclus;
 
-        long numclusters = clusternum;
+        long knownnum = 0;
 
         if (filestr->clusternum && clusternum >= filestr->clusternum)
         {
             /* seek forward from current position */
             cluster = filestr->lastcluster;
-            numclusters -= filestr->clusternum;
+            knownnum = filestr->clusternum;
+        }
+
+        if (extents)
+        {
+            /* or from the closest cluster in the extent map */
+            long mapnum;
+            long mapcluster = extent_lookup(fat_bpb, file->firstcluster,
+                                            clusternum, &mapnum);
+            if (mapnum > knownnum)
+            {
+                cluster = mapcluster;
+                knownnum = mapnum;
+            }
         }
 
-        for (long i = 0; i < numclusters; i++)
+        for (long i = knownnum; i < clusternum; i++)
         {
-            cluster = get_next_cluster(fat_bpb, cluster);
+            cluster = extents ?
+                next_file_cluster(fat_bpb, file->firstcluster, cluster, i) :
+                get_next_cluster(fat_bpb, cluster);
 
             if (!cluster)
             {
@@ -2695,6 +3241,11 @@ fat_error:
     return rc;
 }
 
+int fat_seek(struct fat_filestr *filestr, unsigned long seeksector)
+{
+    return fat_seek_internal(filestr, seeksector, true);
+}
+
 int fat_truncate(const struct fat_filestr *filestr)
 {
     DEBUGF("%s(): %lX\n", __func__, filestr->lastcluster);
@@ -2895,6 +3446,8 @@ int fat_mount(IF_MV(int volume,) IF_MD(int drive,) unsigned long startsector)
     /* it worked */
     fat_bpb->mounted = true;
 
+    freemap_init(fat_bpb);
+
     /* calculate freecount if unset */
     if (fat_bpb->fsinfo.freecount == 0xffffffff)
         fat_recalc_free(IF_MV(fat_bpb->volume));
@@ -2918,6 +3471,8 @@ int fat_unmount(IF_MV_NONVOID(int volume))
 
     /* free the entries for this volume */
     cache_discard(IF_MV(fat_bpb));
+    extent_discard_all(fat_bpb);
+    freemap_free(fat_bpb);
     fat_bpb->mounted = false;
 
     return 0;
@@ -2950,6 +3505,17 @@ unsigned int fat_get_cluster_size(IF_MV_NONVOID(int volume))
     return size;
 }
 
+uint32_t fat_get_volume_id(IF_MV_NONVOID(int volume))
+{
+    uint32_t id = 0;
+
+    struct bpb * const fat_bpb = FAT_BPB(volume);
+    if (fat_bpb)
+        id = fat_bpb->volumeid;
+
+    return id;
+}
+
 void fat_recalc_free(IF_MV_NONVOID(int volume))
 {
     struct bpb * const fat_bpb = FAT_BPB(volume);
@@ -2961,6 +3527,28 @@ void fat_recalc_free(IF_MV_NONVOID(int volume))
     dc_unlock_cache();
 }
 
+/* Fill in the free map of a FAT32 volume, so that allocations skip the full
+   parts of the FAT from the start instead of finding them as they go. Reads
+   at most 'count' FAT sectors per call; returns true while more remain. */
+bool fat_fill_freemap(IF_MV(int volume,) unsigned long count)
+{
+#ifdef HAVE_FAT_FREEMAP
+    struct bpb * const fat_bpb = FAT_BPB(volume);
+    if (!fat_bpb || fat_bpb->freemap_handle <= 0 || fat_bpb->freemap_full)
+        return false;
+
+    dc_lock_cache();
+    freemap_fill(fat_bpb, count);
+    dc_unlock_cache();
+
+    return !fat_bpb->freemap_full && fat_bpb->freemap_handle > 0;
+#else
+    IF_MV((void)volume;)
+    (void)count;
+    return false;
+#endif /* HAVE_FAT_FREEMAP */
+}
+
 bool fat_size(IF_MV(int volume,) sector_t *size, sector_t *free)
 {
     struct bpb * const fat_bpb = FAT_BPB(volume);
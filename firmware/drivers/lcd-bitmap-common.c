@@ -391,6 +391,10 @@ static void LCDFN(putsxyofs)(int x, int y, int ofs, const unsigned char *str)
     int vp_flags = LCDFN(current_viewport)->flags;
     int rtl_next_non_diac_width, last_non_diacritic_width;
 
+    /* load all missing glyphs at once rather than one by one below */
+    ucs = bidi_l2v(str, 1);
+    font_prefetch(pf, ucs);
+
     if ((vp_flags & VP_FLAG_ALIGNMENT_MASK) != 0)
     {
         int w;
@@ -423,7 +427,7 @@ static void LCDFN(putsxyofs)(int x, int y, int ofs, const unsigned char *str)
     rtl_next_non_diac_width = 0;
     last_non_diacritic_width = 0;
     /* Mark diacritic and rtl flags for each character */
-    for (ucs = bidi_l2v(str, 1); *ucs; ucs++)
+    for (; *ucs; ucs++)
     {
         bool is_rtl, is_diac;
         const unsigned char *bits;
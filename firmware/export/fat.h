@@ -172,7 +172,9 @@ int fat_unmount(IF_MV_NONVOID(int volume));
 int fat_get_bytes_per_sector(IF_MV_NONVOID(int volume));
 #endif /* MAX_LOG_SECTOR_SIZE */
 unsigned int fat_get_cluster_size(IF_MV_NONVOID(int volume));
+uint32_t fat_get_volume_id(IF_MV_NONVOID(int volume));
 void fat_recalc_free(IF_MV_NONVOID(int volume));
+bool fat_fill_freemap(IF_MV(int volume,) unsigned long count);
 bool fat_size(IF_MV(int volume,) sector_t *size, sector_t *free);
 
 /** Misc. **/
@@ -111,10 +111,23 @@ struct font {
     uint32_t file_width_offset;    /* offset to file width data    */
     uint32_t file_offset_offset;   /* offset to file offset data   */
     int long_offset;
+    unsigned long glyph_reads;       /* reads of glyph data from the file */
+    unsigned long glyphs_prefetched; /* glyphs loaded by font_prefetch() */
 #endif    
     
 };
 
+/* glyph cache statistics of a font that is cached from its file */
+struct font_cache_info
+{
+    int capacity;             /* glyphs that fit in the cache */
+    int used;                 /* glyphs in the cache */
+    unsigned long hits;       /* glyph lookups served by the cache */
+    unsigned long misses;     /* glyph lookups that loaded it */
+    unsigned long reads;      /* reads of glyph data from the file */
+    unsigned long prefetched; /* glyphs loaded by font_prefetch() */
+};
+
 /* font routines*/
 void font_init(void) INIT_ATTR;
 bool font_filename_matches_loaded_id(int font_id, const char *filename);
@@ -136,5 +149,8 @@ int font_getstringnsize(const unsigned char *str, size_t maxbytes, int *w, int *
 int font_getstringsize(const unsigned char *str, int *w, int *h, int fontnumber);
 int font_get_width(struct font* ft, unsigned short ch);
 const unsigned char * font_get_bits(struct font* ft, unsigned short ch);
+/* Loads the uncached glyphs of a string with as few reads as possible */
+void font_prefetch(struct font* ft, const unsigned short *str);
+bool font_get_cache_info(int font_id, struct font_cache_info *info);
 
 #endif
@@ -360,9 +360,9 @@ static size_t font_glyphs_to_bufsize(struct font *pf, int glyphs)
 {
     size_t bufsize;
 
-    /* LRU bytes per glyph */
+    /* LRU and hash index bytes per glyph */
     bufsize = LRU_SLOT_OVERHEAD + sizeof(struct font_cache_entry) + 
-        sizeof( unsigned short);
+        2 * sizeof( unsigned short);
     /* Image bytes per glyph */
     bufsize += glyph_bytes(pf, pf->maxwidth);
     bufsize *= glyphs;
@@ -544,6 +544,8 @@ int font_load_ex( const char *path, size_t buf_size, int glyphs )
 
     pf->fd = fd;
     pf->fd_width = pf->fd_offset = -1;
+    pf->glyph_reads = 0;
+    pf->glyphs_prefetched = 0;
     pf->handle = handle;
     pf->disabled = false;
 
@@ -737,6 +739,7 @@ load_cache_entry(struct font_cache_entry* p, void* callback_data)
             fd = pf->fd;
         lseek(fd, width_offset, SEEK_SET);
         read(fd, &(p->width), 1);
+        pf->glyph_reads++;
     }
     else
     {
@@ -754,6 +757,7 @@ load_cache_entry(struct font_cache_entry* p, void* callback_data)
         else
             fd = pf->fd;
         lseek(fd, offset, SEEK_SET);
+        pf->glyph_reads++;
         unsigned char tmp[2];
         if (read (fd, tmp, 2) == 2)
         {
@@ -773,10 +777,243 @@ load_cache_entry(struct font_cache_entry* p, void* callback_data)
     lseek(pf->fd, file_offset, SEEK_SET);
     int src_bytes = glyph_bytes(pf, p->width);
     read(pf->fd, p->bitmap, src_bytes);
+    pf->glyph_reads++;
 
     lock_font_handle(pf->handle, false);
 }
 
+/* Glyphs loaded by one prefetch pass */
+#define PREFETCH_GLYPHS  32
+/* Largest read of glyph data made by a prefetch pass, one sector */
+#define PREFETCH_BUFSIZE 512
+
+struct glyph_fetch
+{
+    unsigned short char_code;
+    unsigned char width;
+    unsigned short bytes;           /* size of bitmap */
+    int32_t offset;                 /* file offset of bitmap */
+    const unsigned char *bitmap;    /* bitmap in the read buffer */
+};
+
+static int glyph_fetch_code_cmp(const void *a, const void *b)
+{
+    return ((const struct glyph_fetch *)a)->char_code -
+           ((const struct glyph_fetch *)b)->char_code;
+}
+
+static int glyph_fetch_offset_cmp(const void *a, const void *b)
+{
+    int32_t oa = ((const struct glyph_fetch *)a)->offset;
+    int32_t ob = ((const struct glyph_fetch *)b)->offset;
+    return oa < ob ? -1 : (oa > ob ? 1 : 0);
+}
+
+/*
+ * Reads the elements of a width or offset table for a sorted list of glyphs,
+ * with one read for each run of glyphs whose elements fit in the buffer.
+ * Returns false if a read fails.
+ */
+static bool prefetch_table(struct font *pf, int fd, uint32_t table,
+                           int elsize, struct glyph_fetch *g, int count,
+                           unsigned char *buf)
+{
+    for (int i = 0; i < count; )
+    {
+        int first = g[i].char_code;
+        int j = i + 1;
+        while (j < count &&
+               (g[j].char_code - first + 1) * elsize <= PREFETCH_BUFSIZE)
+            j++;
+
+        int size = (g[j-1].char_code - first + 1) * elsize;
+        if (lseek(fd, table + first * elsize, SEEK_SET) < 0 ||
+            read(fd, buf, size) != size)
+            return false;
+
+        pf->glyph_reads++;
+
+        for (; i < j; i++)
+        {
+            const unsigned char *p = buf + (g[i].char_code - first) * elsize;
+
+            if (elsize == 1)
+                g[i].width = *p;
+            else if (elsize == 2)
+                g[i].offset = p[0] | (p[1] << 8);
+            else
+                g[i].offset = p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Fills a cache entry from a prefetched glyph
+ */
+static void prefetch_cache_entry(struct font_cache_entry* p,
+                                 void* callback_data)
+{
+    struct glyph_fetch *g = callback_data;
+
+    p->width = g->width;
+    memcpy(p->bitmap, g->bitmap, g->bytes);
+}
+
+/*
+ * Loads a batch of missing glyphs sorted by char code, reading the tables
+ * and bitmaps in coalesced ranges
+ */
+static void prefetch_glyphs(struct font *pf, struct glyph_fetch *g, int count)
+{
+    unsigned char buf[PREFETCH_BUFSIZE];
+
+    qsort(g, count, sizeof (*g), glyph_fetch_code_cmp);
+
+    for (int i = 0; i < count; i++)
+    {
+        g[i].width = pf->maxwidth;
+        g[i].offset = 0;
+    }
+
+    /* on a failed read, leave all of them to load_cache_entry() */
+    if (pf->file_width_offset &&
+        !prefetch_table(pf, pf->fd_width >= 0 ? pf->fd_width : pf->fd,
+                        pf->file_width_offset, 1, g, count, buf))
+        return;
+
+    if (pf->file_offset_offset &&
+        !prefetch_table(pf, pf->fd_offset >= 0 ? pf->fd_offset : pf->fd,
+                        pf->file_offset_offset,
+                        pf->long_offset ? sizeof(int32_t) : sizeof(int16_t),
+                        g, count, buf))
+        return;
+
+    for (int i = 0; i < count; i++)
+    {
+        g[i].bytes = glyph_bytes(pf, g[i].width);
+        if (!pf->file_offset_offset)
+            g[i].offset = g[i].char_code * g[i].bytes;
+    }
+
+    /* bitmaps are usually in char code order already */
+    qsort(g, count, sizeof (*g), glyph_fetch_offset_cmp);
+
+    int i = 0;
+
+    while (i < count)
+    {
+        /* left to load_cache_entry() if it won't fit the buffer */
+        if (g[i].bytes > PREFETCH_BUFSIZE)
+        {
+            i++;
+            continue;
+        }
+
+        int32_t first = g[i].offset;
+        int32_t end = first + g[i].bytes;
+        int j = i + 1;
+
+        while (j < count)
+        {
+            int32_t gend = g[j].offset + g[j].bytes;
+            if (gend - first > PREFETCH_BUFSIZE)
+                break;
+
+            end = MAX(end, gend);
+            j++;
+        }
+
+        int size = end - first;
+        if (lseek(pf->fd, FONT_HEADER_SIZE + first, SEEK_SET) < 0 ||
+            read(pf->fd, buf, size) != size)
+            return;
+
+        pf->glyph_reads++;
+
+        for (; i < j; i++)
+        {
+            g[i].bitmap = buf + (g[i].offset - first);
+            font_cache_get(&pf->cache, g[i].char_code, false,
+                           prefetch_cache_entry, &g[i]);
+            pf->glyphs_prefetched++;
+        }
+    }
+}
+
+/*
+ * Loads the glyphs of a string that aren't cached yet in as few reads as
+ * possible, before rendering it glyph by glyph
+ */
+void font_prefetch(struct font* pf, const unsigned short *str)
+{
+    if (pf->fd < 0 || pf == &sysfont)
+        return;
+
+    struct glyph_fetch g[PREFETCH_GLYPHS];
+    /* leave room for what's on screen already */
+    int max = MIN(PREFETCH_GLYPHS, pf->cache._capacity / 2);
+    int count = 0;
+
+    if (max < 2)
+        return;
+
+    lock_font_handle(pf->handle, true);
+
+    for (; *str; str++)
+    {
+        unsigned short char_code = *str;
+
+        if (char_code < pf->firstchar || char_code >= pf->firstchar+pf->size)
+            char_code = pf->defaultchar;
+        char_code -= pf->firstchar;
+
+        if (font_cache_touch(&pf->cache, char_code))
+            continue;
+
+        int i;
+        for (i = 0; i < count && g[i].char_code != char_code; i++);
+        if (i < count)
+            continue; /* already wanted */
+
+        g[count++].char_code = char_code;
+        if (count >= max)
+        {
+            prefetch_glyphs(pf, g, count);
+            count = 0;
+        }
+    }
+
+    if (count > 1)
+        prefetch_glyphs(pf, g, count);
+
+    lock_font_handle(pf->handle, false);
+}
+
+/*
+ * Returns glyph cache statistics of a cached font
+ */
+bool font_get_cache_info(int font_id, struct font_cache_info *info)
+{
+    if (font_id < 0 || font_id >= MAXFONTS || buflib_allocations[font_id] <= 0)
+        return false;
+
+    struct buflib_alloc_data *pdata = core_get_data(buflib_allocations[font_id]);
+    struct font *pf = &pdata->font;
+
+    if (!pf->height || (pf->fd < 0 && !pf->disabled))
+        return false; /* not cached */
+
+    info->capacity   = pf->cache._capacity;
+    info->used       = pf->cache._size;
+    info->hits       = pf->cache._hits;
+    info->misses     = pf->cache._misses;
+    info->reads      = pf->glyph_reads;
+    info->prefetched = pf->glyphs_prefetched;
+    return true;
+}
+
 /*
  * Converts cbuf into a font cache
  */
@@ -955,7 +1192,7 @@ static void glyph_cache_load(const char *font_path, struct font *pf)
         int i, size, fd;
         unsigned char tmp[2];
         unsigned short ch;
-        unsigned short glyphs[MAX_SORT];
+        unsigned short glyphs[MAX_SORT + 1];
         unsigned short glyphs_lru_order[MAX_SORT];
         int glyph_file_skip=0, glyph_file_size=0;
         
@@ -994,9 +1231,9 @@ static void glyph_cache_load(const char *font_path, struct font *pf)
                 qsort((void *)glyphs, size, sizeof(unsigned short), 
                       ushortcmp );
 
-                /* load font bitmaps */
-                for( i = 0; i < size ; i++ )
-                         font_get_bits(pf, glyphs[i]);
+                /* load font bitmaps in batches */
+                glyphs[size] = 0;
+                font_prefetch(pf, glyphs);
                 
                 /* redo to fix lru order */
                 for ( i = 0; i < size ; i++)
@@ -47,78 +47,118 @@ void font_cache_create(
     if (font_cache_entry_size % 2 != 0)
         font_cache_entry_size++;
 
-    int cache_size = buf_size /
-        (font_cache_entry_size + LRU_SLOT_OVERHEAD + sizeof(short));
+    int slot_size = font_cache_entry_size + LRU_SLOT_OVERHEAD;
 
-    fcache->_size = 1;
+    /* guess at the entry count assuming two index slots per entry, size the
+       index for it and give the entries whatever remains */
+    int cache_size = buf_size / (slot_size + 2 * sizeof(short));
+    int index_size = 1;
+    while (index_size < cache_size + cache_size / 2)
+        index_size *= 2;
+
+    cache_size = (buf_size - index_size * (int)sizeof(short)) / slot_size;
+
+    /* keep the index at most 3/4 full */
+    if (cache_size > index_size / 4 * 3)
+        cache_size = index_size / 4 * 3;
+
+    fcache->_size = 0;
     fcache->_capacity = cache_size;
-    fcache->_prev_result = 0;
-    fcache->_prev_char_code = 0;
+    fcache->_mask = index_size - 1;
+    fcache->_hits = 0;
+    fcache->_misses = 0;
 
     /* set up index */
     fcache->_index = buf;
+    memset(fcache->_index, 0xff, index_size * sizeof(short));
 
     /* set up lru list */
     unsigned char* lru_buf = buf;
-    lru_buf += sizeof(short) * cache_size;
+    lru_buf += sizeof(short) * index_size;
     lru_create(&fcache->_lru, lru_buf, cache_size, font_cache_entry_size);
 
     /* initialise cache */
     lru_traverse(&fcache->_lru, font_cache_lru_init);
-    short i;
-    for (i = 0; i < cache_size; i++)
-        fcache->_index[i] = i; /* small cheat here */
 }
 
 /*************************************************************************
- * Binary search that attempts a primary lucky guess that succeeds
- * when there are consecutive codes in the cache between previous 
- * search and new search. Returns a negative of insertion point if 
- * not found.
+ * Home slot of a char code in the index. Char codes in use tend to be
+ * clustered so they are spread out by a multiplicative hash.
+ ************************************************************************/
+static inline int index_slot(struct font_cache* fcache,
+                             unsigned short char_code)
+{
+    return ((char_code * 0x9e3779b1u) >> 16) & fcache->_mask;
+}
+
+/*************************************************************************
+ * Linear probing search of the index. Returns the slot of the char code
+ * or of the empty slot where it would go.
  ************************************************************************/
 static int search(struct font_cache* fcache,
-                  unsigned short char_code,
-                  int size,
-                  int *p_insertion_point )
+                  unsigned short char_code)
+{
+    int slot = index_slot(fcache, char_code);
+
+    while (fcache->_index[slot] >= 0)
+    {
+        struct font_cache_entry *p =
+            lru_data(&fcache->_lru, fcache->_index[slot]);
+        if (p->_char_code == char_code)
+            break;
+
+        slot = (slot + 1) & fcache->_mask;
+    }
+
+    return slot;
+}
+
+/*************************************************************************
+ * Remove the entry in the given index slot, shifting back any entries
+ * that probed past it so that no search stops short of them.
+ ************************************************************************/
+static void index_remove(struct font_cache* fcache, int slot)
 {
-    struct font_cache_entry *p;
-    int left, right, mid=-1, c;
-    left = 0;
-    right = size;
-    
-    /* go for a lucky guess */
-    mid = char_code + 
-        fcache->_prev_result - fcache->_prev_char_code;
-            
-    /* check bounds */        
-    if ( mid < 0 || mid > right )
-            mid = ( left + right ) / 2;
-
-    do
+    int next = slot;
+
+    while (1)
     {
-        p = lru_data(&fcache->_lru, fcache->_index[mid]);
-        c = p->_char_code - char_code;
+        next = (next + 1) & fcache->_mask;
+
+        short lru_handle = fcache->_index[next];
+        if (lru_handle < 0)
+            break;
 
-        if (c == 0)
+        struct font_cache_entry *p = lru_data(&fcache->_lru, lru_handle);
+        int home = index_slot(fcache, p->_char_code);
+
+        /* move it unless its home lies cyclically in (slot, next] */
+        if (((next - home) & fcache->_mask) >= ((next - slot) & fcache->_mask))
         {
-            fcache->_prev_result = mid;
-            fcache->_prev_char_code = char_code;
-            *p_insertion_point = mid;
-            return 1;
+            fcache->_index[slot] = lru_handle;
+            slot = next;
         }
-        if (c < 0)
-            left = mid + 1;
-        else
-            right = mid - 1;
-
-        mid = (left + right) / 2;
     }
-    while (left <= right);
-    
-    /* not found */
-    *p_insertion_point = mid;
-    return 0;
+
+    fcache->_index[slot] = -1;
 }
+
+/*******************************************************************************
+ * font_cache_touch
+ ******************************************************************************/
+bool font_cache_touch(
+    struct font_cache* fcache,
+    unsigned short char_code)
+{
+    short lru_handle = fcache->_index[search(fcache, char_code)];
+
+    if (lru_handle < 0)
+        return false;
+
+    lru_touch(&fcache->_lru, lru_handle);
+    return true;
+}
+
 /*******************************************************************************
  * font_cache_get
  ******************************************************************************/
@@ -130,71 +170,35 @@ struct font_cache_entry* font_cache_get(
     void *callback_data)
 {
     struct font_cache_entry* p;
-    int insertion_point;
-    int index_to_replace;
-    
-    /* check bounds */
-    p = lru_data(&fcache->_lru, fcache->_index[0]);
-    if( char_code < p->_char_code )
-        insertion_point = -1;
-    else
+    int slot = search(fcache, char_code);
+    short lru_handle = fcache->_index[slot];
+
+    if (lru_handle >= 0)
     {
-        p = lru_data(&fcache->_lru, fcache->_index[fcache->_capacity - 1]);
-        if( char_code > p->_char_code )
-        {
-            insertion_point = fcache->_capacity - 1;
-        }
-        else
-        {
-            if( search(fcache, char_code, fcache->_size - 1, &insertion_point))
-            {
-                short lru_handle = fcache->_index[insertion_point];
-                p = lru_data(&fcache->_lru, lru_handle);
-                if (p->_char_code == char_code)
-                {
-                    lru_touch(&fcache->_lru, lru_handle);
-                    return lru_data(&fcache->_lru, lru_handle);
-                }
-            }
-            else
-            {
-                p = lru_data(&fcache->_lru, 
-                fcache->_index[insertion_point+1]);
-                if ( char_code > p->_char_code )
-                     insertion_point++;
-            }
-        }
+        fcache->_hits++;
+        lru_touch(&fcache->_lru, lru_handle);
+        return lru_data(&fcache->_lru, lru_handle);
     }
-    
+
     /* not found */
+    fcache->_misses++;
+
     if (cache_only)
         return NULL;
 
-    /* find index to replace */
+    /* replace the least recently used entry */
     short lru_handle_to_replace = fcache->_lru._head;
     p = lru_data(&fcache->_lru, lru_handle_to_replace);
-    search(fcache, p->_char_code, fcache->_size - 1, &index_to_replace);
-    if (insertion_point < index_to_replace)
-    {
-        /* shift memory up */
-        memmove(fcache->_index + insertion_point + 2,
-                fcache->_index + insertion_point + 1,
-                (index_to_replace - insertion_point - 1) * sizeof(short));
 
-        /* add to index */
-        fcache->_index[insertion_point + 1] = lru_handle_to_replace;
-    }
-    else if (insertion_point > index_to_replace)
+    if (p->_char_code != 0xffff)
     {
-        /* shift memory down */
-        memmove(fcache->_index + index_to_replace,
-                fcache->_index + index_to_replace + 1,
-                (insertion_point - index_to_replace) * sizeof(short));
-
-        /* add to index */
-        fcache->_index[insertion_point] = lru_handle_to_replace;
+        index_remove(fcache, search(fcache, p->_char_code));
+        /* the slot for the new one may have been shifted */
+        slot = search(fcache, char_code);
     }
 
+    fcache->_index[slot] = lru_handle_to_replace;
+
     /* load new entry into cache */
     lru_touch(&fcache->_lru, lru_handle_to_replace);
 
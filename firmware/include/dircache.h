@@ -75,6 +75,14 @@ typedef uint32_t dc_serial_t;
 #if CONFIG_PLATFORM & PLATFORM_NATIVE
 /* native dircache is lower-level than on a hosted target */
 #define DIRCACHE_NATIVE
+/* the cache may be saved at shutdown and loaded at the next boot; not where
+   the disk could be changed in between by swapping it or by a USB host, as
+   the check at load only compares the root directory, unless the bootloader
+   keeps track of a clean disk for us */
+#if defined(HAVE_EEPROM_SETTINGS) || \
+    (!defined(HAVE_HOTSWAP) && defined(USB_NONE))
+#define DIRCACHE_PERSIST
+#endif
 #endif
 
 struct dircache_file
@@ -124,6 +132,10 @@ int dircache_readdir_internal(struct filestr_base *stream,
                               struct file_base_info *infop,
                               struct fat_direntry *fatent);
 void dircache_rewinddir_internal(struct file_base_info *info);
+int dircache_lookup_internal(struct filestr_base *stream,
+                             struct file_base_info *infop,
+                             const char *name, unsigned int callflags,
+                             struct fat_direntry *fatent);
 #endif /* DIRCACHE_NATIVE */
 
 
@@ -190,6 +202,11 @@ struct dircache_info
     size_t       reserve_used;   /* amount of reserve used */
     unsigned int entry_count;    /* number of cache entries */
     long         build_ticks;    /* total time used to build cache */
+    unsigned int hash_slots;     /* size of the name hash table */
+    unsigned int hash_used;      /* name hash slots in use */
+    bool         hash_full;      /* name hash is missing some entries */
+    unsigned long lookups;       /* name hash lookups made */
+    unsigned long probes;        /* slots examined by those lookups */
 };
 
 void dircache_get_info(struct dircache_info *info);
@@ -201,10 +218,10 @@ void dircache_dump(void);
 /** Misc. stuff **/
 void dircache_dcfile_init(struct dircache_file *dcfilep);
 
-#ifdef HAVE_EEPROM_SETTINGS
+#ifdef DIRCACHE_PERSIST
 int dircache_load(void);
 int dircache_save(void);
-#endif /* HAVE_EEPROM_SETTINGS */
+#endif /* DIRCACHE_PERSIST */
 
 void dircache_init(size_t last_size) INIT_ATTR;
 
@@ -300,6 +300,19 @@ static inline void rewinddir_internal(struct file_base_info *infop)
 #endif
 }
 
+static inline int lookup_internal(struct filestr_base *stream,
+                                  struct file_base_info *infop,
+                                  const char *name, unsigned int callflags,
+                                  struct fat_direntry *fatent)
+{
+#ifdef HAVE_DIRCACHE
+    return dircache_lookup_internal(stream, infop, name, callflags, fatent);
+#else
+    (void)stream; (void)infop; (void)name; (void)callflags; (void)fatent;
+    return -1; /* nothing to look it up in; scan for it */
+#endif
+}
+
 
 /** Misc. stuff **/
 
@@ -38,6 +38,8 @@ static inline void dc_unlock_cache(void)
 
 void * dc_cache_probe(IF_MV(int volume,) sector_t secnum,
                       unsigned int *flags);
+int dc_cache_fill(IF_MV(int volume,) void *buf, sector_t start,
+                  unsigned int count);
 void dc_dirty_buf(void *buf);
 void dc_discard_buf(void *buf);
 void dc_commit_all(IF_MV_NONVOID(int volume));
@@ -45,9 +47,12 @@ void dc_discard_all(IF_MV_NONVOID(int volume));
 
 void dc_init(void) INIT_ATTR;
 
-/* in addition to filling, writeback is implemented by the client */
+/* reading and writing back runs of count sectors to and from a contiguous
+   buffer is implemented by the client */
+extern int dc_read_callback(IF_MV(int volume, ) sector_t sector,
+                            unsigned int count, void *buf);
 extern void dc_writeback_callback(IF_MV(int volume, ) sector_t sector,
-                                  void *buf);
+                                  unsigned int count, void *buf);
 
 
 /** These synchronize and can be called by anyone **/
@@ -57,4 +62,17 @@ void * dc_get_buffer(void);
 /* return buffer to the cache by buffer */
 void dc_release_buffer(void *buf);
 
+struct dc_info
+{
+    unsigned long hits;           /* probes that found their sector */
+    unsigned long misses;         /* probes that took a new entry */
+    unsigned long readahead;      /* sectors read ahead of a miss */
+    unsigned long readahead_hits; /* of those, sectors probed later */
+    unsigned long writes;         /* sectors written back */
+    unsigned long write_ops;      /* write requests they took */
+};
+
+/* get the cache statistics */
+void dc_get_info(struct dc_info *info);
+
 #endif /* DISK_CACHE_H */
@@ -31,9 +31,10 @@ struct font_cache
     struct lru _lru;
     int _size;
     int _capacity;
-    int _prev_char_code;
-    int _prev_result;
-    short *_index; /* index of lru handles in char_code order */
+    int _mask; /* index size - 1 */
+    short *_index; /* open addressed hash of lru handles by char_code */
+    unsigned long _hits; /* lookups that found the entry */
+    unsigned long _misses; /* lookups that didn't */
 };
 
 struct font_cache_entry
@@ -48,6 +49,12 @@ struct font_cache_entry
 void font_cache_create(
     struct font_cache* fcache, void* buf, int buf_size, int bitmap_bytes_size);
 
+/* Mark the entry for the given char_code as most recently used if it is
+ * cached, without counting a lookup
+ *
+ * Returns true if it is cached */
+bool font_cache_touch(struct font_cache* fcache, unsigned short char_code);
+
 /* Get font cache entry for the given char_code
  *
  * cache_only: true if only a cache lookup should be performed and loading on miss should be avoided
@@ -111,4 +111,13 @@
 /* this _could_ be larger than a sector if that would ever be useful */
 #define DC_CACHE_BUFSIZE    SECTOR_SIZE
 
+/* Largest run of sectors read around a cache miss or written back by one
+ * request, a power of two. Runs are staged in a buffer of their own, which
+ * small targets and bootloaders do without; 1 disables both. */
+#if MEMORYSIZE < 8 || defined(BOOTLOADER)
+#define DC_IO_SECTORS       1
+#else
+#define DC_IO_SECTORS       8
+#endif
+
 #endif /* FS_DEFINES_H */
@@ -80,7 +80,7 @@
  * when this happens please take the opportunity to sort in
  * any new functions "waiting" at the end of the list.
  */
-#define CODEC_API_VERSION 50
+#define CODEC_API_VERSION 51
 
 /* reasons for calling codec main entrypoint */
 enum codec_entry_call_reason {
@@ -223,6 +223,13 @@ struct codec_api {
 
     /* new stuff at the end, sort into place next time
        the API gets incompatible */
+
+    /* Find the indexed frames either side of <sample> in the current track,
+       building the index on first use. <after> has an offset of zero if
+       <sample> lies past the last point. Returns false if there is no
+       index for this file. */
+    bool (*seek_index_find)(uint64_t sample, struct seek_point *before,
+                            struct seek_point *after);
 };
 
 /* codec header */
@@ -44,8 +44,9 @@ static int32_t decoded6[MAX_BLOCKSIZE] IBSS_ATTR_FLAC_XXLARGE_IRAM;
       uint64_t offset
       uint32_t blocksize
 
-   We also limit the sample and offset values to 32-bits - Rockbox doesn't
-   support files bigger than 2GB on FAT32 filesystems.
+   We limit the offset values to 32-bits - Rockbox doesn't support files
+   bigger than 4GB on FAT32 filesystems. Sample numbers keep all 36 bits,
+   since 32 bits only cover about six hours at 192kHz.
 
    The reference FLAC encoder produces a seek table with points every
    10 seconds, but this can be overridden by the user when encoding a file.
@@ -58,23 +59,31 @@ static int32_t decoded6[MAX_BLOCKSIZE] IBSS_ATTR_FLAC_XXLARGE_IRAM;
       Total duration is: 48694 seconds (about 810 minutes - 13.5 hours)
       Total number of seek points: 4869
 
-   Therefore we limit the number of seek points to 5000.  This is a
-   very extreme case, and requires 5000*8=40000 bytes of storage.
+   Therefore we limit the number of seek points to 5000, which needs
+   5000*12=60000 bytes of storage.
 
-   If we come across a FLAC file with more than this number of seekpoints, we
-   just use the first 5000.
+   Tables can be much larger than that when they were written with a
+   custom spacing, so if we come across one with more seekpoints we keep
+   every n-th point, spread evenly over the whole file. Bisection between
+   the points we kept finds the exact frame. Files with no table at all use
+   the player's seek index instead.
 
 */
 
 struct FLACseekpoints {
     uint32_t sample;
     uint32_t offset;
-    uint16_t blocksize;
+    uint16_t sample_hi;
 };
 
 static struct FLACseekpoints seekpoints[MAX_SUPPORTED_SEEKTABLE_SIZE];
 static int nseekpoints;
 
+static inline uint64_t seekpoint_sample(int i)
+{
+    return ((uint64_t)seekpoints[i].sample_hi << 32) | seekpoints[i].sample;
+}
+
 static int8_t *bit_buffer;
 static size_t buff_size;
 
@@ -84,7 +93,7 @@ static bool flac_init(FLACContext* fc, int first_frame_offset)
     bool found_streaminfo=false;
     uint32_t seekpoint_hi,seekpoint_lo;
     uint32_t offset_hi,offset_lo;
-    uint16_t blocksize;
+    uint32_t npoints, stride, point;
     int endofmetadata=0;
     uint32_t blocklength;
 
@@ -164,9 +173,9 @@ static bool flac_init(FLACContext* fc, int first_frame_offset)
                     return false;
             }
 
-            /* totalsamples is a 36-bit field, but we assume <= 32 bits are
-               used */
-            fc->totalsamples = (buf[14] << 24) | (buf[15] << 16)
+            /* totalsamples is a 36-bit field */
+            fc->totalsamples = ((uint64_t)(buf[13] & 0x0f) << 32) |
+                               ((uint32_t)buf[14] << 24) | (buf[15] << 16)
                                | (buf[16] << 8) | buf[17];
 
             /* Calculate track length (in ms) and estimate the bitrate
@@ -175,11 +184,19 @@ static bool flac_init(FLACContext* fc, int first_frame_offset)
 
             found_streaminfo=true;
         } else if ((buf[0] & 0x7f) == 3) { /* 3 is the SEEKTABLE block */
-            while ((nseekpoints < MAX_SUPPORTED_SEEKTABLE_SIZE) &&
-                   (blocklength >= 18)) {
+            /* Decimate tables that are too big to keep whole */
+            npoints = blocklength / 18;
+            stride = (npoints + MAX_SUPPORTED_SEEKTABLE_SIZE - 1) /
+                     MAX_SUPPORTED_SEEKTABLE_SIZE;
+
+            for (point = 0; (nseekpoints < MAX_SUPPORTED_SEEKTABLE_SIZE) &&
+                            (blocklength >= 18); point++) {
                 if (ci->read_filebuf(buf,18) < 18) return false;
                 blocklength-=18;
 
+                if (point % stride != 0)
+                    continue;
+
                 seekpoint_hi=(buf[0] << 24) | (buf[1] << 16) |
                              (buf[2] << 8) | buf[3];
                 seekpoint_lo=(buf[4] << 24) | (buf[5] << 16) |
@@ -189,14 +206,12 @@ static bool flac_init(FLACContext* fc, int first_frame_offset)
                 offset_lo=(buf[12] << 24) | (buf[13] << 16) |
                              (buf[14] << 8) | buf[15];
 
-                blocksize=(buf[16] << 8) | buf[17];
-
-                /* Only store seekpoints where the high 32 bits are zero */
-                if ((seekpoint_hi == 0) && (seekpoint_lo != 0xffffffff) &&
-                    (offset_hi == 0)) {
+                /* Only store seekpoints within a 36-bit sample number and a
+                   32-bit offset, which also skips the placeholder points */
+                if ((seekpoint_hi <= 0xf) && (offset_hi == 0)) {
                         seekpoints[nseekpoints].sample=seekpoint_lo;
+                        seekpoints[nseekpoints].sample_hi=seekpoint_hi;
                         seekpoints[nseekpoints].offset=offset_lo;
-                        seekpoints[nseekpoints].blocksize=blocksize;
                         nseekpoints++;
                 }
             }
@@ -271,14 +286,14 @@ static bool frame_sync(FLACContext* fc) {
 }
 
 /* Seek to sample - adapted from libFLAC 1.1.3b2+ */
-static bool flac_seek(FLACContext* fc, uint32_t target_sample) {
+static bool flac_seek(FLACContext* fc, uint64_t target_sample) {
     off_t orig_pos = ci->curpos;
     off_t pos = -1;
     unsigned long lower_bound, upper_bound;
-    unsigned long lower_bound_sample, upper_bound_sample;
-    int i;
+    uint64_t lower_bound_sample, upper_bound_sample;
+    int lo, hi;
     unsigned approx_bytes_per_frame;
-    uint32_t this_frame_sample = fc->samplenumber;
+    uint64_t this_frame_sample = fc->samplenumber;
     unsigned this_block_size = fc->blocksize;
     bool needs_seek = true, first_seek = true;
 
@@ -299,24 +314,40 @@ static bool flac_seek(FLACContext* fc, uint32_t target_sample) {
 
     /* Refine the bounds if we have a seektable with suitable points. */
     if(nseekpoints > 0) {
-        /* Find the closest seek point <= target_sample, if it exists. */
-        for(i = nseekpoints-1; i >= 0; i--) {
-            if(seekpoints[i].sample <= target_sample)
-                break;
+        /* Binary search for the first seek point > target_sample; the one
+           before it is the closest seek point <= target_sample. */
+        lo = 0;
+        hi = nseekpoints;
+        while(lo < hi) {
+            int mid = (lo + hi) / 2;
+            if(seekpoint_sample(mid) <= target_sample)
+                lo = mid + 1;
+            else
+                hi = mid;
         }
-        if(i >= 0) { /* i.e. we found a suitable seek point... */
-            lower_bound = fc->metadatalength + seekpoints[i].offset;
-            lower_bound_sample = seekpoints[i].sample;
+
+        if(lo > 0) { /* i.e. we found a suitable seek point... */
+            lower_bound = fc->metadatalength + seekpoints[lo-1].offset;
+            lower_bound_sample = seekpoint_sample(lo-1);
         }
 
-        /* Find the closest seek point > target_sample, if it exists. */
-        for(i = 0; i < nseekpoints; i++) {
-            if(seekpoints[i].sample > target_sample)
-                break;
+        if(lo < nseekpoints) { /* i.e. we found a suitable seek point... */
+            upper_bound = fc->metadatalength + seekpoints[lo].offset;
+            upper_bound_sample = seekpoint_sample(lo);
         }
-        if(i < nseekpoints) { /* i.e. we found a suitable seek point... */
-            upper_bound = fc->metadatalength + seekpoints[i].offset;
-            upper_bound_sample = seekpoints[i].sample;
+    }
+    else {
+        /* No seek table, so use the player's index of the frames. Its
+           offsets are from the start of the file. */
+        struct seek_point before, after;
+
+        if(ci->seek_index_find(target_sample, &before, &after)) {
+            lower_bound = before.offset;
+            lower_bound_sample = before.sample;
+            if(after.offset != 0) {
+                upper_bound = after.offset;
+                upper_bound_sample = after.sample;
+            }
         }
     }
 
@@ -329,10 +360,17 @@ static bool flac_seek(FLACContext* fc, uint32_t target_sample) {
 
         /* Calculate new seek position */
         if(needs_seek) {
+            uint64_t distance = target_sample - lower_bound_sample;
+            uint64_t span = upper_bound_sample - lower_bound_sample;
+
+            /* Keep the interpolation within 64 bits */
+            while(span > 0xffffffff) {
+                distance >>= 1;
+                span >>= 1;
+            }
+
             pos = (off_t)(lower_bound +
-              (((target_sample - lower_bound_sample) *
-              (int64_t)(upper_bound - lower_bound)) /
-              (upper_bound_sample - lower_bound_sample)) -
+              ((distance * (upper_bound - lower_bound)) / span) -
               approx_bytes_per_frame);
 
             if(pos >= (off_t)upper_bound)
@@ -463,7 +501,7 @@ enum codec_status codec_main(enum codec_entry_call_reason reason)
 enum codec_status codec_run(void)
 {
     int8_t *buf;
-    uint32_t samplesdone;
+    uint64_t samplesdone;
     uint32_t elapsedtime;
     size_t bytesleft;
     int consumed;
@@ -493,10 +531,10 @@ enum codec_status codec_run(void)
     if (samplesdone || !elapsedtime) {
         flac_seek_offset(&fc, samplesdone);
         samplesdone=fc.samplenumber+fc.blocksize;
-        elapsedtime=((uint64_t)samplesdone*1000)/(ci->id3->frequency);
+        elapsedtime=(samplesdone*1000)/(ci->id3->frequency);
     }
-    else if (!flac_seek(&fc,(uint32_t)((uint64_t)elapsedtime
-                            *ci->id3->frequency/1000))) {
+    else if (!flac_seek(&fc,(uint64_t)elapsedtime
+                            *ci->id3->frequency/1000)) {
         elapsedtime = 0;
     }
 
@@ -513,8 +551,8 @@ enum codec_status codec_run(void)
 
         /* Deal with any pending seek requests */
         if (action == CODEC_ACTION_SEEK_TIME) {
-            if (flac_seek(&fc,(uint32_t)(((uint64_t)param
-                *ci->id3->frequency)/1000))) {
+            if (flac_seek(&fc,((uint64_t)param
+                *ci->id3->frequency)/1000)) {
                 /* Refill the input buffer */
                 buf = ci->request_buffer(&bytesleft, MAX_FRAMESIZE);
             }
@@ -539,7 +577,7 @@ enum codec_status codec_run(void)
 
         /* Update the elapsed-time indicator */
         samplesdone=fc.samplenumber+fc.blocksize;
-        elapsedtime=((uint64_t)samplesdone*1000)/(ci->id3->frequency);
+        elapsedtime=(samplesdone*1000)/(ci->id3->frequency);
         ci->set_elapsed(elapsedtime);
 
         ci->advance_buffer(consumed);
@@ -396,8 +396,42 @@ enum codec_status codec_main(enum codec_entry_call_reason reason)
     return CODEC_OK;
 }
 
-bool seek_by_time(int64_t* samplesdone, unsigned long current_frequency, unsigned long elapsed_ms)
+/* Frames decoded ahead of the target after an indexed seek, so that the
+   bit reservoir and the synthesis filter are primed by the time it plays */
+#define SEEK_PREROLL_FRAMES 2
+
+/* Seek exactly using the seek index. Decoding restarts at an indexed frame
+   before the target and *samples_to_skip is set to drop everything that
+   decodes ahead of it. */
+static bool seek_by_index(int64_t* samplesdone, unsigned long current_frequency,
+                          unsigned long elapsed_ms, int start_skip,
+                          int *samples_to_skip)
 {
+    struct seek_point before, after;
+    unsigned long target = (uint64_t)elapsed_ms * current_frequency / 1000;
+    unsigned long decoded = target + start_skip;
+    unsigned long preroll = SEEK_PREROLL_FRAMES * 1152;
+
+    if (!ci->id3->vbr || ci->id3->is_asf_stream ||
+        !ci->seek_index_find(decoded > preroll ? decoded - preroll : 0,
+                             &before, &after))
+        return false;
+
+    if (!ci->seek_buffer(before.offset))
+        return false;
+
+    *samples_to_skip = decoded - before.sample;
+    *samplesdone = target;
+    ci->set_elapsed(elapsed_ms);
+    return true;
+}
+
+bool seek_by_time(int64_t* samplesdone, unsigned long current_frequency,
+                  unsigned long elapsed_ms, int start_skip,
+                  int *samples_to_skip)
+{
+    *samples_to_skip = elapsed_ms ? 0 : start_skip;
+
     if (ci->id3->is_asf_stream) {
         asf_waveformatex_t *wfx = (asf_waveformatex_t *)(ci->id3->toc);
         int elapsedtime = asf_seek(elapsed_ms, wfx);
@@ -412,7 +446,9 @@ bool seek_by_time(int64_t* samplesdone, unsigned long current_frequency, unsigne
             ci->set_elapsed(elapsedtime);
             reset_stream_buffer();
         }
-    } else {
+    } else if (!elapsed_ms || !seek_by_index(samplesdone, current_frequency,
+                                             elapsed_ms, start_skip,
+                                             samples_to_skip)) {
         int newpos = elapsed_ms ? get_file_pos(elapsed_ms) : (int)(ci->id3->first_frame_offset);
 
         *samplesdone = ((int64_t)elapsed_ms) * current_frequency / 1000;
@@ -431,6 +467,7 @@ enum codec_status codec_run(void)
     size_t size;
     int file_end;
     int samples_to_skip; /* samples to skip in total for this file (at start) */
+    int resume_skip = 0;
     char *inputbuffer;
     int64_t samplesdone;
     int stop_skip, start_skip;
@@ -449,6 +486,28 @@ enum codec_status codec_run(void)
     current_frequency = ci->id3->frequency;
     codec_set_replaygain(ci->id3);
 
+    if (ci->id3->lead_trim >= 0 && ci->id3->tail_trim >= 0) {
+        stop_skip = ci->id3->tail_trim - mpeg_latency[ci->id3->layer];
+        if (stop_skip < 0) stop_skip = 0;
+        start_skip = ci->id3->lead_trim + mpeg_latency[ci->id3->layer];
+    } else {
+        stop_skip = 0;
+        /* We want to skip this amount anyway */
+        start_skip = mpeg_latency[ci->id3->layer];
+    }
+
+    /* Libmad will not decode the last frame without 8 bytes of extra padding
+       in the buffer. So, we can trick libmad into not decoding the last frame
+       if we are to skip it entirely and then cut the appropriate samples from
+       final frame that we did decode. Note, if all tags (ID3, APE) are not
+       properly stripped from the end of the file, this trick will not work. */
+    if (stop_skip >= mpeg_framesize[ci->id3->layer]) {
+        padding = 0;
+        stop_skip -= mpeg_framesize[ci->id3->layer];
+    } else {
+        padding = MAD_BUFFER_GUARD;
+    }
+
      if (ci->id3->offset) {
 
         if (ci->id3->is_asf_stream) {
@@ -474,37 +533,17 @@ enum codec_status codec_run(void)
     }
     else if (ci->id3->elapsed)
          /* Have elapsed time but not offset */
-        seek_by_time(&samplesdone, current_frequency, ci->id3->elapsed);
+        seek_by_time(&samplesdone, current_frequency, ci->id3->elapsed,
+                     start_skip, &resume_skip);
     else
         ci->seek_buffer(ci->id3->first_frame_offset);
 
-    if (ci->id3->lead_trim >= 0 && ci->id3->tail_trim >= 0) {
-        stop_skip = ci->id3->tail_trim - mpeg_latency[ci->id3->layer];
-        if (stop_skip < 0) stop_skip = 0;
-        start_skip = ci->id3->lead_trim + mpeg_latency[ci->id3->layer];
-    } else {
-        stop_skip = 0;
-        /* We want to skip this amount anyway */
-        start_skip = mpeg_latency[ci->id3->layer];
-    }
-
-    /* Libmad will not decode the last frame without 8 bytes of extra padding
-       in the buffer. So, we can trick libmad into not decoding the last frame
-       if we are to skip it entirely and then cut the appropriate samples from
-       final frame that we did decode. Note, if all tags (ID3, APE) are not
-       properly stripped from the end of the file, this trick will not work. */
-    if (stop_skip >= mpeg_framesize[ci->id3->layer]) {
-        padding = 0;
-        stop_skip -= mpeg_framesize[ci->id3->layer];
-    } else {
-        padding = MAD_BUFFER_GUARD;
-    }
-
     samplesdone = ((int64_t)ci->id3->elapsed) * current_frequency / 1000;
 
-    /* Don't skip any samples unless we start at the beginning. */
+    /* Don't skip any samples unless we start at the beginning, or the seek
+       index put us ahead of the resume point. */
     if (samplesdone > 0)
-        samples_to_skip = 0;
+        samples_to_skip = resume_skip;
     else
         samples_to_skip = start_skip;
 
@@ -524,13 +563,8 @@ enum codec_status codec_run(void)
             mad_synth_thread_wait_pcm();
             mad_synth_thread_unwait_pcm();
 
-            if (param == 0) {
-                samples_to_skip = start_skip;
-            } else {
-                samples_to_skip = 0;
-            }
-
-            bool success = seek_by_time(&samplesdone, current_frequency, param);
+            bool success = seek_by_time(&samplesdone, current_frequency, param,
+                                        start_skip, &samples_to_skip);
             ci->seek_complete();
             if (!success)
                 break;
@@ -566,7 +600,15 @@ enum codec_status codec_run(void)
                 file_end++;
                 continue;
             } else if (MAD_RECOVERABLE(stream.error)) {
-                /* Probably syncing after a seek */
+                /* Probably syncing after a seek. A frame that is missing
+                   its reservoir still takes its place in the output, so
+                   count it against the samples being skipped. */
+                if (stream.error == MAD_ERROR_BADDATAPTR &&
+                    samples_to_skip > 0) {
+                    samples_to_skip -= 32 * MAD_NSBSAMPLES(&frame.header);
+                    if (samples_to_skip < 0)
+                        samples_to_skip = 0;
+                }
                 continue;
             } else {
                 /* Some other unrecoverable error */
@@ -618,7 +660,7 @@ enum codec_status codec_run(void)
         file_end = 0;
 
         framelength = synth.pcm.length - samples_to_skip;
-        if (framelength < 0) {
+        if (framelength <= 0) {
             framelength = 0;
             samples_to_skip -= synth.pcm.length;
         }
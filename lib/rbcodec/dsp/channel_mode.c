@@ -25,6 +25,7 @@
 #include "fracmul.h"
 #include "dsp_proc_entry.h"
 #include "channel_mode.h"
+#include "dsp_simd.h"
 #include <string.h>
 
 #if 0
@@ -77,6 +78,13 @@ void channel_mode_proc_mono(struct dsp_proc_entry *this,
     int32_t *sr = buf->p32[1];
     int count = buf->remcount;
 
+#ifdef HAVE_DSP_SIMD
+    int n = dsp_simd_mono(sl, sr, count);
+    sl += n, sr += n;
+    if ((count -= n) <= 0)
+        return;
+#endif
+
     do
     {
         int32_t lr = *sl / 2 + *sr / 2;
@@ -101,6 +109,13 @@ void channel_mode_proc_custom(struct dsp_proc_entry *this,
     const int32_t gain  = data->sw_gain;
     const int32_t cross = data->sw_cross;
 
+#ifdef HAVE_DSP_SIMD
+    int n = dsp_simd_custom(sl, sr, count, gain, cross);
+    sl += n, sr += n;
+    if ((count -= n) <= 0)
+        return;
+#endif
+
     do
     {
         int32_t l = *sl;
@@ -119,6 +134,13 @@ void channel_mode_proc_karaoke(struct dsp_proc_entry *this,
     int32_t *sr = buf->p32[1];
     int count = buf->remcount;
 
+#ifdef HAVE_DSP_SIMD
+    int n = dsp_simd_karaoke(sl, sr, count);
+    sl += n, sr += n;
+    if ((count -= n) <= 0)
+        return;
+#endif
+
     do
     {
         int32_t ch = *sl / 2 - *sr / 2;
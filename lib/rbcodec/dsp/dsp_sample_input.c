@@ -26,6 +26,7 @@
 #include "dsp_core.h"
 #include "dsp_sample_io.h"
 #include "dsp_proc_entry.h"
+#include "dsp_simd.h"
 
 #if 0
 #undef DEBUGF
@@ -96,6 +97,13 @@ static void sample_input_mono16(struct sample_io_data *this,
 
     dsp_advance_buffer_input(src, count, sizeof (int16_t));
 
+#ifdef HAVE_DSP_SIMD
+    int n = dsp_simd_input_16(s, d, count);
+    s += n, d += n;
+    if ((count -= n) <= 0)
+        return;
+#endif
+
     do
     {
         *d++ = *s++ << scale;
@@ -120,6 +128,13 @@ static void sample_input_i_stereo16(struct sample_io_data *this,
 
     dsp_advance_buffer_input(src, count, 2*sizeof (int16_t));
 
+#ifdef HAVE_DSP_SIMD
+    int n = dsp_simd_input_i_stereo16(s, dl, dr, count);
+    s += 2*n, dl += n, dr += n;
+    if ((count -= n) <= 0)
+        return;
+#endif
+
     do
     {
         *dl++ = *s++ << scale;
@@ -146,6 +161,14 @@ static void sample_input_ni_stereo16(struct sample_io_data *this,
 
     dsp_advance_buffer_input(src, count, sizeof (int16_t));
 
+#ifdef HAVE_DSP_SIMD
+    dsp_simd_input_16(sl, dl, count);
+    int n = dsp_simd_input_16(sr, dr, count);
+    sl += n, sr += n, dl += n, dr += n;
+    if ((count -= n) <= 0)
+        return;
+#endif
+
     do
     {
         *dl++ = *sl++ << scale;
@@ -188,6 +211,13 @@ static void sample_input_i_stereo32(struct sample_io_data *this,
 
     dsp_advance_buffer_input(src, count, 2*sizeof (int32_t));
 
+#ifdef HAVE_DSP_SIMD
+    int n = dsp_simd_input_i_stereo32(s, dl, dr, count);
+    s += 2*n, dl += n, dr += n;
+    if ((count -= n) <= 0)
+        return;
+#endif
+
     do
     {
         *dl++ = *s++;
@@ -25,6 +25,7 @@
 #include "dsp_sample_io.h"
 #include "dsp_proc_entry.h"
 #include "dsp-util.h"
+#include "dsp_simd.h"
 #include <string.h>
 
 #if 0
@@ -55,6 +56,13 @@ void sample_output_mono(struct sample_io_data *this,
     int scale = src->format.output_scale;
     int32_t dc_bias = 1L << (scale - 1);
 
+#ifdef HAVE_DSP_SIMD
+    int n = dsp_simd_output_mono(s0, d, count, scale);
+    s0 += n, d += 2*n;
+    if ((count -= n) <= 0)
+        return;
+#endif
+
     do
     {
         int32_t lr = clip_sample_16((*s0++ + dc_bias) >> scale);
@@ -75,6 +83,13 @@ void sample_output_stereo(struct sample_io_data *this,
     int scale = src->format.output_scale;
     int32_t dc_bias = 1L << (scale - 1);
 
+#ifdef HAVE_DSP_SIMD
+    int n = dsp_simd_output_stereo(s0, s1, d, count, scale);
+    s0 += n, s1 += n, d += 2*n;
+    if ((count -= n) <= 0)
+        return;
+#endif
+
     do
     {
         *d++ = clip_sample_16((*s0++ + dc_bias) >> scale);
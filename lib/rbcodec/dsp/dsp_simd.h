@@ -0,0 +1,316 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * Copyright (C) 2026 The Rockbox Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+#ifndef DSP_SIMD_H
+#define DSP_SIMD_H
+
+/* SSE2 and NEON versions of the sample conversion and channel mixing loops
+ * for hosted targets without assembly routines. Each helper handles whole
+ * vectors of samples and returns how many it did; the caller's C loop
+ * finishes the rest. Results are bit-exact with the C code:
+ *
+ * - 16-bit input is sign-extended and shifted left by WORD_SHIFT
+ * - output adds the rounding bias, shifts arithmetically and saturates to
+ *   16 bits, which is what clip_sample_16() does
+ * - x / 2 truncates towards zero as C division does
+ * - FRACMUL() is the 64-bit product shifted right by 31 and truncated
+ */
+#if !defined(CPU_COLDFIRE) && !defined(CPU_ARM)
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define DSP_SIMD_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define DSP_SIMD_NEON
+#endif
+#endif /* CPU */
+
+#if defined(DSP_SIMD_SSE2) || defined(DSP_SIMD_NEON)
+#define HAVE_DSP_SIMD
+
+#include "dsp_sample_io.h"
+
+#ifdef DSP_SIMD_SSE2
+/* x / 2 rounded towards zero */
+static inline __m128i simd_half(__m128i x)
+{
+    return _mm_srai_epi32(_mm_add_epi32(x, _mm_srli_epi32(x, 31)), 1);
+}
+
+/* FRACMUL() of four lanes. SSE2 only has an unsigned 32x32->64 multiply so
+ * the signed product is had by correcting the upper halves. */
+static inline __m128i simd_fracmul(__m128i a, __m128i b)
+{
+    const __m128i hi = _mm_set_epi32(-1, 0, -1, 0);
+    __m128i fix = _mm_add_epi32(_mm_and_si128(_mm_srai_epi32(a, 31), b),
+                                _mm_and_si128(_mm_srai_epi32(b, 31), a));
+    __m128i ev = _mm_mul_epu32(a, b);
+    __m128i od = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+
+    ev = _mm_srli_epi64(_mm_sub_epi64(ev, _mm_slli_epi64(fix, 32)), 31);
+    od = _mm_slli_epi64(_mm_sub_epi64(od, _mm_and_si128(fix, hi)), 1);
+
+    return _mm_or_si128(_mm_andnot_si128(hi, ev), _mm_and_si128(hi, od));
+}
+#else /* DSP_SIMD_NEON */
+static inline int32x4_t simd_half(int32x4_t x)
+{
+    uint32x4_t sign = vshrq_n_u32(vreinterpretq_u32_s32(x), 31);
+    return vshrq_n_s32(vaddq_s32(x, vreinterpretq_s32_u32(sign)), 1);
+}
+
+/* The doubling multiply saturates only for INT32_MIN * INT32_MIN, which
+ * the gains never are */
+static inline int32x4_t simd_fracmul(int32x4_t a, int32x4_t b)
+{
+    return vqdmulhq_s32(a, b);
+}
+#endif /* DSP_SIMD_* */
+
+/* 16-bit mono (or one channel) to 32-bit */
+static inline int dsp_simd_input_16(const int16_t *s, int32_t *d, int count)
+{
+    int n = count & ~7;
+
+    for (int i = 0; i < n; i += 8)
+    {
+#ifdef DSP_SIMD_SSE2
+        __m128i x = _mm_loadu_si128((const __m128i *)&s[i]);
+        __m128i z = _mm_setzero_si128();
+        _mm_storeu_si128((__m128i *)&d[i],
+            _mm_srai_epi32(_mm_unpacklo_epi16(z, x), 16 - WORD_SHIFT));
+        _mm_storeu_si128((__m128i *)&d[i+4],
+            _mm_srai_epi32(_mm_unpackhi_epi16(z, x), 16 - WORD_SHIFT));
+#else
+        int16x8_t x = vld1q_s16(&s[i]);
+        vst1q_s32(&d[i], vshll_n_s16(vget_low_s16(x), WORD_SHIFT));
+        vst1q_s32(&d[i+4], vshll_n_s16(vget_high_s16(x), WORD_SHIFT));
+#endif
+    }
+
+    return n;
+}
+
+/* 16-bit interleaved stereo to 32-bit noninterleaved */
+static inline int dsp_simd_input_i_stereo16(const int16_t *s, int32_t *dl,
+                                            int32_t *dr, int count)
+{
+    int n = count & ~3;
+
+    for (int i = 0; i < n; i += 4)
+    {
+#ifdef DSP_SIMD_SSE2
+        /* Each 32-bit lane holds L in the low half, R in the high half */
+        __m128i x = _mm_loadu_si128((const __m128i *)&s[2*i]);
+        __m128i l = _mm_srai_epi32(_mm_slli_epi32(x, 16), 16 - WORD_SHIFT);
+        __m128i r = _mm_srai_epi32(x, 16);
+        _mm_storeu_si128((__m128i *)&dl[i], l);
+        _mm_storeu_si128((__m128i *)&dr[i], _mm_slli_epi32(r, WORD_SHIFT));
+#else
+        int16x4x2_t x = vld2_s16(&s[2*i]);
+        vst1q_s32(&dl[i], vshll_n_s16(x.val[0], WORD_SHIFT));
+        vst1q_s32(&dr[i], vshll_n_s16(x.val[1], WORD_SHIFT));
+#endif
+    }
+
+    return n;
+}
+
+/* 32-bit interleaved stereo to 32-bit noninterleaved */
+static inline int dsp_simd_input_i_stereo32(const int32_t *s, int32_t *dl,
+                                            int32_t *dr, int count)
+{
+    int n = count & ~3;
+
+    for (int i = 0; i < n; i += 4)
+    {
+#ifdef DSP_SIMD_SSE2
+        /* L0 R0 L1 R1 -> L0 L1 R0 R1 */
+        __m128i a = _mm_shuffle_epi32(
+            _mm_loadu_si128((const __m128i *)&s[2*i]), _MM_SHUFFLE(3,1,2,0));
+        __m128i b = _mm_shuffle_epi32(
+            _mm_loadu_si128((const __m128i *)&s[2*i+4]), _MM_SHUFFLE(3,1,2,0));
+        _mm_storeu_si128((__m128i *)&dl[i], _mm_unpacklo_epi64(a, b));
+        _mm_storeu_si128((__m128i *)&dr[i], _mm_unpackhi_epi64(a, b));
+#else
+        int32x4x2_t x = vld2q_s32(&s[2*i]);
+        vst1q_s32(&dl[i], x.val[0]);
+        vst1q_s32(&dr[i], x.val[1]);
+#endif
+    }
+
+    return n;
+}
+
+/* 32-bit mono to 16-bit interleaved stereo output */
+static inline int dsp_simd_output_mono(const int32_t *s, int16_t *d,
+                                       int count, int scale)
+{
+    int n = count & ~3;
+    int32_t dc_bias = 1L << (scale - 1);
+
+#ifdef DSP_SIMD_SSE2
+    __m128i bias = _mm_set1_epi32(dc_bias);
+    __m128i shift = _mm_cvtsi32_si128(scale);
+
+    for (int i = 0; i < n; i += 4)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)&s[i]);
+        x = _mm_sra_epi32(_mm_add_epi32(x, bias), shift);
+        x = _mm_packs_epi32(x, x);
+        _mm_storeu_si128((__m128i *)&d[2*i], _mm_unpacklo_epi16(x, x));
+    }
+#else
+    int32x4_t bias = vdupq_n_s32(dc_bias);
+    int32x4_t shift = vdupq_n_s32(-scale);
+
+    for (int i = 0; i < n; i += 4)
+    {
+        int32x4_t x = vshlq_s32(vaddq_s32(vld1q_s32(&s[i]), bias), shift);
+        int16x4_t y = vqmovn_s32(x);
+        vst2_s16(&d[2*i], (int16x4x2_t){{ y, y }});
+    }
+#endif
+
+    return n;
+}
+
+/* 32-bit noninterleaved stereo to 16-bit interleaved stereo output */
+static inline int dsp_simd_output_stereo(const int32_t *sl,
+                                         const int32_t *sr, int16_t *d,
+                                         int count, int scale)
+{
+    int n = count & ~3;
+    int32_t dc_bias = 1L << (scale - 1);
+
+#ifdef DSP_SIMD_SSE2
+    __m128i bias = _mm_set1_epi32(dc_bias);
+    __m128i shift = _mm_cvtsi32_si128(scale);
+
+    for (int i = 0; i < n; i += 4)
+    {
+        __m128i l = _mm_loadu_si128((const __m128i *)&sl[i]);
+        __m128i r = _mm_loadu_si128((const __m128i *)&sr[i]);
+        l = _mm_sra_epi32(_mm_add_epi32(l, bias), shift);
+        r = _mm_sra_epi32(_mm_add_epi32(r, bias), shift);
+        _mm_storeu_si128((__m128i *)&d[2*i],
+            _mm_unpacklo_epi16(_mm_packs_epi32(l, l), _mm_packs_epi32(r, r)));
+    }
+#else
+    int32x4_t bias = vdupq_n_s32(dc_bias);
+    int32x4_t shift = vdupq_n_s32(-scale);
+
+    for (int i = 0; i < n; i += 4)
+    {
+        int32x4_t l = vshlq_s32(vaddq_s32(vld1q_s32(&sl[i]), bias), shift);
+        int32x4_t r = vshlq_s32(vaddq_s32(vld1q_s32(&sr[i]), bias), shift);
+        vst2_s16(&d[2*i], (int16x4x2_t){{ vqmovn_s32(l), vqmovn_s32(r) }});
+    }
+#endif
+
+    return n;
+}
+
+/* SOUND_CHAN_MONO: l = r = l/2 + r/2 */
+static inline int dsp_simd_mono(int32_t *sl, int32_t *sr, int count)
+{
+    int n = count & ~3;
+
+    for (int i = 0; i < n; i += 4)
+    {
+#ifdef DSP_SIMD_SSE2
+        __m128i l = _mm_loadu_si128((const __m128i *)&sl[i]);
+        __m128i r = _mm_loadu_si128((const __m128i *)&sr[i]);
+        __m128i lr = _mm_add_epi32(simd_half(l), simd_half(r));
+        _mm_storeu_si128((__m128i *)&sl[i], lr);
+        _mm_storeu_si128((__m128i *)&sr[i], lr);
+#else
+        int32x4_t lr = vaddq_s32(simd_half(vld1q_s32(&sl[i])),
+                                 simd_half(vld1q_s32(&sr[i])));
+        vst1q_s32(&sl[i], lr);
+        vst1q_s32(&sr[i], lr);
+#endif
+    }
+
+    return n;
+}
+
+/* SOUND_CHAN_KARAOKE: l = l/2 - r/2, r = -l */
+static inline int dsp_simd_karaoke(int32_t *sl, int32_t *sr, int count)
+{
+    int n = count & ~3;
+
+    for (int i = 0; i < n; i += 4)
+    {
+#ifdef DSP_SIMD_SSE2
+        __m128i l = _mm_loadu_si128((const __m128i *)&sl[i]);
+        __m128i r = _mm_loadu_si128((const __m128i *)&sr[i]);
+        __m128i ch = _mm_sub_epi32(simd_half(l), simd_half(r));
+        _mm_storeu_si128((__m128i *)&sl[i], ch);
+        _mm_storeu_si128((__m128i *)&sr[i],
+                         _mm_sub_epi32(_mm_setzero_si128(), ch));
+#else
+        int32x4_t ch = vsubq_s32(simd_half(vld1q_s32(&sl[i])),
+                                 simd_half(vld1q_s32(&sr[i])));
+        vst1q_s32(&sl[i], ch);
+        vst1q_s32(&sr[i], vnegq_s32(ch));
+#endif
+    }
+
+    return n;
+}
+
+/* SOUND_CHAN_CUSTOM: stereo width by straight and cross gains */
+static inline int dsp_simd_custom(int32_t *sl, int32_t *sr, int count,
+                                  int32_t gain, int32_t cross)
+{
+    int n = count & ~3;
+
+#ifdef DSP_SIMD_SSE2
+    __m128i g = _mm_set1_epi32(gain);
+    __m128i c = _mm_set1_epi32(cross);
+
+    for (int i = 0; i < n; i += 4)
+    {
+        __m128i l = _mm_loadu_si128((const __m128i *)&sl[i]);
+        __m128i r = _mm_loadu_si128((const __m128i *)&sr[i]);
+        _mm_storeu_si128((__m128i *)&sl[i],
+            _mm_add_epi32(simd_fracmul(l, g), simd_fracmul(r, c)));
+        _mm_storeu_si128((__m128i *)&sr[i],
+            _mm_add_epi32(simd_fracmul(r, g), simd_fracmul(l, c)));
+    }
+#else
+    int32x4_t g = vdupq_n_s32(gain);
+    int32x4_t c = vdupq_n_s32(cross);
+
+    for (int i = 0; i < n; i += 4)
+    {
+        int32x4_t l = vld1q_s32(&sl[i]);
+        int32x4_t r = vld1q_s32(&sr[i]);
+        vst1q_s32(&sl[i], vaddq_s32(simd_fracmul(l, g), simd_fracmul(r, c)));
+        vst1q_s32(&sr[i], vaddq_s32(simd_fracmul(r, g), simd_fracmul(l, c)));
+    }
+#endif
+
+    return n;
+}
+#endif /* HAVE_DSP_SIMD */
+
+#endif /* DSP_SIMD_H */
@@ -32,6 +32,10 @@
 /**
  * Linear interpolation resampling that introduces a one sample delay because
  * of our inability to look into the future at the end of a frame.
+ *
+ * Where memory allows, the audio DSP may instead use a windowed-sinc
+ * polyphase filter (RESAMPLE_QUALITY_MEDIUM/HIGH). Its latency is half the
+ * filter length.
  */
 
 #if 1 /* Set to '0' to enable debug messages */
@@ -56,16 +60,257 @@ static struct resample_data
     unsigned int frequency_out;     /* Resampler output samplerate */
     struct dsp_buffer resample_buf; /* Buffer descriptor for resampled data */
     int32_t *resample_out_p[2];     /* Actual output buffer pointers */
+    unsigned int quality;           /* Requested enum resample_quality */
+#ifdef HAVE_RESAMPLE_SINC
+    struct sinc_data *sinc;         /* Polyphase filter (audio DSP only) */
+    bool sinc_active;               /* Using sinc rather than Hermite */
+#endif
 } resample_data[DSP_COUNT] IBSS_ATTR;
 
 /* Actual worker function. Implemented here or in target assembly code. */
 int resample_hermite(struct resample_data *data, struct dsp_buffer *src,
                      struct dsp_buffer *dst);
 
+#ifdef HAVE_RESAMPLE_SINC
+#define SINC_TAPS_MAX       32  /* Taps per phase at RESAMPLE_QUALITY_HIGH */
+#define SINC_PHASES_EXACT  160  /* Most phases for an exact ratio (44.1->48) */
+#define SINC_INTERP_SHIFT    6  /* log2 of phases for arbitrary ratios */
+#define SINC_IN_COUNT      512  /* Input samples filtered per call */
+#define SINC_ROLLOFF  0xf333    /* Cutoff relative to Nyquist (.95, s15.16) */
+
+/* Polyphase filter state. Ratios with a small enough integer form (L/M)
+ * step through the phases exactly; anything else (including pitch-shifted
+ * rates) runs 64 phases over a s15.16 phase and linearly interpolates
+ * between the outputs of neighbouring phases. */
+static struct sinc_data
+{
+    unsigned int taps;         /* Taps per phase; 0 = no table */
+    unsigned int phases;       /* Phases in table (+1 if interpolating) */
+    unsigned int interp_shift; /* Phase to table index shift; 0 = exact */
+    uint32_t cutoff;           /* Cutoff the table was made for (s15.16) */
+    uint32_t phase_count;      /* Phases per input sample (L) */
+    uint32_t step_int;         /* Whole input samples per output */
+    uint32_t step_frac;        /* Phases per output after step_int */
+    uint32_t phase;            /* Current phase, < phase_count */
+    uint32_t pos;              /* Window start of next output in buf */
+    int32_t  coefs[(SINC_PHASES_EXACT + 1)*SINC_TAPS_MAX]; /* s1.30 */
+    int32_t  buf[2][SINC_TAPS_MAX - 1 + SINC_IN_COUNT]; /* history + input */
+} sinc_data;
+
+static void sinc_flush(struct sinc_data *s)
+{
+    s->phase = 0;
+    s->pos = 0;
+    memset(s->buf, 0, sizeof (s->buf));
+}
+
+/* Blackman-windowed sinc for tap offset t (s15.16 input samples) with
+ * cutoff fc (s15.16, relative to input Nyquist); unnormalized s1.30 */
+static int32_t sinc_coef(int32_t t, uint32_t fc, unsigned int taps)
+{
+    static const int32_t pi = 0x3243f; /* s15.16 */
+    int32_t x = (int64_t)t * fc >> 16;
+    long c1, c2, sinx;
+
+    if (x != 0)
+    {
+        /* sin(pi*x)/(pi*x) where pi*x is x/2 turns */
+        sinx = fp_sincos((uint32_t)x << 15, &c1);
+        sinx = ((int64_t)sinx << 15) / ((int64_t)x * pi >> 16);
+    }
+    else
+    {
+        sinx = 1L << 30;
+    }
+
+    /* w = 0.42 + 0.5*cos(2*pi*t/N) + 0.08*cos(4*pi*t/N) */
+    uint32_t wphase = ((int64_t)t << 16) / (int)taps;
+    fp_sincos(wphase, &c1);
+    fp_sincos(wphase << 1, &c2);
+    int32_t w = 0x1ae147ae + (c1 >> 2) + ((int64_t)c2 * 0x051eb852 >> 31);
+
+    return ((int64_t)sinx * w >> 30) * fc >> 16;
+}
+
+/* Build the filter table with each phase normalized to unity gain */
+static void sinc_make_table(struct sinc_data *s)
+{
+    unsigned int taps = s->taps;
+    unsigned int res = s->interp_shift ? (1u << SINC_INTERP_SHIFT) :
+                                         s->phase_count;
+
+    for (unsigned int p = 0; p < s->phases; p++)
+    {
+        int32_t *c = &s->coefs[p*taps];
+        int32_t frac = (p << 16) / res;
+        int64_t sum = 0;
+
+        /* Output lies between taps taps/2 - 1 and taps/2 */
+        for (unsigned int i = 0; i < taps; i++)
+        {
+            c[i] = sinc_coef(((int32_t)(i - taps/2 + 1) << 16) - frac,
+                             s->cutoff, taps);
+            sum += c[i];
+        }
+
+        for (unsigned int i = 0; i < taps; i++)
+            c[i] = ((int64_t)c[i] << 30) / sum;
+    }
+}
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+    while (b != 0)
+    {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+/* Set up stepping for fin -> fout and rebuild the table if needed */
+static void sinc_new_delta(struct resample_data *data, unsigned int fin,
+                           unsigned int fout, bool reset)
+{
+    struct sinc_data *s = data->sinc;
+    unsigned int taps = data->quality == RESAMPLE_QUALITY_HIGH ?
+                            SINC_TAPS_MAX : SINC_TAPS_MAX/2;
+    uint32_t g = gcd(fin, fout);
+    uint32_t l = fout / g, m = fin / g;
+    uint32_t cutoff = SINC_ROLLOFF;
+    unsigned int phases, interp_shift;
+
+    /* Lowpass at the output Nyquist when downsampling; quantized so that
+     * small pitch changes reuse the table */
+    if (fout < fin)
+        cutoff = ((uint64_t)fp_div(fout, fin, 16) * SINC_ROLLOFF >> 16) & ~0xff;
+
+    if (l <= SINC_PHASES_EXACT)
+    {
+        phases = l;
+        interp_shift = 0;
+    }
+    else
+    {
+        l = 1u << 16;
+        m = data->delta;
+        phases = (1u << SINC_INTERP_SHIFT) + 1;
+        interp_shift = 16 - SINC_INTERP_SHIFT;
+    }
+
+    if (reset || taps != s->taps)
+        sinc_flush(s); /* stale or history length differs */
+    else if (l != s->phase_count)
+        s->phase = 0;  /* phase units differ */
+
+    s->phase_count = l;
+    s->step_int = m / l;
+    s->step_frac = m % l;
+
+    if (taps != s->taps || phases != s->phases ||
+        interp_shift != s->interp_shift || cutoff != s->cutoff)
+    {
+        s->taps = taps;
+        s->phases = phases;
+        s->interp_shift = interp_shift;
+        s->cutoff = cutoff;
+        sinc_make_table(s);
+    }
+}
+
+/* Dot product of one phase with the window; independent accumulators so
+ * that the compiler may vectorize or pipeline it. taps is a multiple of 4. */
+static inline int32_t sinc_dot(const int32_t *x, const int32_t *c,
+                               unsigned int taps)
+{
+    int64_t acc0 = 0, acc1 = 0, acc2 = 0, acc3 = 0;
+
+    for (unsigned int i = 0; i < taps; i += 4)
+    {
+        acc0 += (int64_t)x[i+0] * c[i+0];
+        acc1 += (int64_t)x[i+1] * c[i+1];
+        acc2 += (int64_t)x[i+2] * c[i+2];
+        acc3 += (int64_t)x[i+3] * c[i+3];
+    }
+
+    return (acc0 + acc1 + acc2 + acc3) >> 30;
+}
+
+static int resample_sinc(struct resample_data *data, struct dsp_buffer *src,
+                         struct dsp_buffer *dst)
+{
+    struct sinc_data *s = data->sinc;
+    int ch = src->format.num_channels - 1;
+    uint32_t count = MIN(src->remcount, SINC_IN_COUNT);
+    unsigned int taps = s->taps, hist = taps - 1;
+    unsigned int shift = s->interp_shift;
+    uint32_t phase, pos;
+    int32_t *d;
+
+    do
+    {
+        int32_t *buf = s->buf[ch];
+
+        memcpy(&buf[hist], src->p32[ch], count*sizeof (int32_t));
+
+        d = dst->p32[ch];
+        int32_t *dmax = d + dst->bufcount;
+
+        /* Restore state */
+        phase = s->phase;
+        pos = s->pos;
+
+        while (pos < count && d < dmax)
+        {
+            const int32_t *x = &buf[pos];
+
+            if (shift == 0)
+            {
+                *d++ = sinc_dot(x, &s->coefs[phase*taps], taps);
+            }
+            else
+            {
+                const int32_t *c = &s->coefs[(phase >> shift)*taps];
+                int32_t frac = (phase << (31 - shift)) & 0x7fffffff;
+                int32_t y0 = sinc_dot(x, c, taps);
+                int32_t y1 = sinc_dot(x, c + taps, taps);
+                *d++ = y0 + FRACMUL(y1 - y0, frac);
+            }
+
+            pos += s->step_int;
+            phase += s->step_frac;
+
+            if (phase >= s->phase_count)
+            {
+                phase -= s->phase_count;
+                pos++;
+            }
+        }
+
+        /* Keep the last hist samples before the consumed point */
+        memmove(buf, &buf[MIN(pos, count)], hist*sizeof (int32_t));
+    }
+    while (--ch >= 0);
+
+    count = MIN(pos, count);
+    s->phase = phase;
+    s->pos = pos - count;
+
+    dst->remcount = d - dst->p32[0];
+    return count;
+}
+#endif /* HAVE_RESAMPLE_SINC */
+
 static void resample_flush_data(struct resample_data *data)
 {
     data->phase = 0;
     memset(&data->history, 0, sizeof (data->history));
+#ifdef HAVE_RESAMPLE_SINC
+    if (data->sinc)
+        sinc_flush(data->sinc);
+#endif
 }
 
 static void resample_flush(struct dsp_proc_entry *this)
@@ -94,6 +339,14 @@ static bool resample_new_delta(struct resample_data *data,
         return false;
     }
 
+#ifdef HAVE_RESAMPLE_SINC
+    bool was_active = data->sinc_active;
+    data->sinc_active = data->sinc && data->quality != RESAMPLE_QUALITY_LOW;
+
+    if (data->sinc_active)
+        sinc_new_delta(data, frequency, fout, !was_active);
+#endif
+
     return true;
 }
 
@@ -212,7 +465,12 @@ static void resample_process(struct dsp_proc_entry *this,
     {
         dst->bufcount = RESAMPLE_BUF_COUNT;
 
+#ifdef HAVE_RESAMPLE_SINC
+        int consumed = data->sinc_active ? resample_sinc(data, src, dst) :
+                                           resample_hermite(data, src, dst);
+#else
         int consumed = resample_hermite(data, src, dst);
+#endif
 
         /* Advance src by consumed amount */
         if (consumed > 0)
@@ -272,6 +530,12 @@ void dsp_resample_init(struct dsp_config *dsp, unsigned int dsp_id)
     case CODEC_IDX_AUDIO:
         lbuf = resample_out_bufs[0];
         rbuf = resample_out_bufs[1];
+#ifdef HAVE_RESAMPLE_SINC
+        resample_data[dsp_id].sinc = &sinc_data;
+#if (CONFIG_PLATFORM & PLATFORM_HOSTED)
+        resample_data[dsp_id].quality = RESAMPLE_QUALITY_HIGH;
+#endif
+#endif
         break;
 
     case CODEC_IDX_VOICE:
@@ -331,6 +595,20 @@ static intptr_t resample_configure(struct dsp_proc_entry *this,
     case DSP_SET_OUT_FREQUENCY:
         dsp_proc_want_format_update(dsp, DSP_PROC_RESAMPLE);
         break;
+
+    case RESAMPLE_SET_QUALITY:
+    {
+        struct resample_data *data = (void *)this->data;
+        unsigned int quality = MIN((unsigned int)value, RESAMPLE_QUALITY_HIGH);
+
+        if (quality != data->quality)
+        {
+            data->quality = quality;
+            data->frequency = 0; /* force new settings */
+            dsp_proc_want_format_update(dsp, DSP_PROC_RESAMPLE);
+        }
+        break;
+    }
     }
 
     return retval;
@@ -21,6 +21,23 @@
 #ifndef _DSP_RESAMPLE_H
 #define _DSP_RESAMPLE_H
 
+/* Interpolation used when resampling */
+enum resample_quality
+{
+    RESAMPLE_QUALITY_LOW = 0, /* 4-point Hermite spline */
+    RESAMPLE_QUALITY_MEDIUM,  /* 16-tap windowed sinc */
+    RESAMPLE_QUALITY_HIGH,    /* 32-tap windowed sinc */
+};
+
+/* Polyphase sinc filters need tables too large for the smallest targets;
+ * they fall back to RESAMPLE_QUALITY_LOW */
+#if (CONFIG_PLATFORM & PLATFORM_HOSTED) || MEMORYSIZE > 8
+#define HAVE_RESAMPLE_SINC
+#endif
+
+/* Message used with dsp_configure() to select an enum resample_quality */
+#define RESAMPLE_SET_QUALITY (DSP_PROC_SETTING+DSP_PROC_RESAMPLE)
+
 void dsp_resample_init(struct dsp_config *dsp, unsigned int dsp_id) INIT_ATTR;
 
 #endif /* _DSP_RESAMPLE_H */
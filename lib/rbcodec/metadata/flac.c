@@ -187,3 +187,187 @@ bool get_flac_metadata(int fd, struct mp3entry* id3)
 
     return true;
 }
+
+/* Longest possible frame header: sync, 36-bit UTF-8 coded sample number,
+   16-bit block size and sample rate and the CRC-8 */
+#define FLAC_MAX_HEADER 16
+
+static unsigned int flac_crc8(const unsigned char *buf, int len)
+{
+    unsigned int crc = 0;
+
+    while (len--)
+    {
+        crc ^= *buf++;
+        for (int i = 0; i < 8; i++)
+            crc = ((crc << 1) ^ ((crc & 0x80) ? 0x07 : 0)) & 0xff;
+    }
+
+    return crc;
+}
+
+/* Check for a frame header at buf and decode its frame or sample number
+   and block size. Returns the header length, or 0 if there is none. */
+static int flac_frame_header(const unsigned char *buf, int len,
+                             uint64_t *number, unsigned int *blocksize,
+                             unsigned int min_blocksize)
+{
+    int bs_code, rate_code, n, i;
+    uint64_t v;
+
+    if (len < 6 || buf[0] != 0xff || (buf[1] & 0xfe) != 0xf8)
+        return 0;
+
+    bs_code = buf[2] >> 4;
+    rate_code = buf[2] & 0xf;
+    if (rate_code == 15 || (buf[3] >> 4) >= 11 || (buf[3] & 1) ||
+        ((buf[3] >> 1) & 7) == 3 || ((buf[3] >> 1) & 7) == 7)
+        return 0;
+
+    /* UTF-8 style coded number, up to 36 bits */
+    v = buf[4];
+    n = 0;
+    if (v & 0x80)
+    {
+        if (v < 0xc0 || v == 0xff)
+            return 0;
+        for (n = 1; v & (0x40 >> n); n++);
+        v &= 0x3f >> n;
+    }
+
+    /* Room for the optional block size and sample rate and the CRC */
+    if (len < 5 + n + 5)
+        return 0;
+
+    for (i = 5; i < 5 + n; i++)
+    {
+        if ((buf[i] & 0xc0) != 0x80)
+            return 0;
+        v = (v << 6) | (buf[i] & 0x3f);
+    }
+
+    if (bs_code == 0)
+        *blocksize = min_blocksize;
+    else if (bs_code == 1)
+        *blocksize = 192;
+    else if (bs_code <= 5)
+        *blocksize = 576 << (bs_code - 2);
+    else if (bs_code == 6)
+        *blocksize = buf[i++] + 1;
+    else if (bs_code == 7)
+    {
+        *blocksize = ((buf[i] << 8) | buf[i + 1]) + 1;
+        i += 2;
+    }
+    else
+        *blocksize = 256 << (bs_code - 8);
+
+    if (rate_code == 12)
+        i++;
+    else if (rate_code == 13 || rate_code == 14)
+        i += 2;
+
+    if (flac_crc8(buf, i + 1) != 0)
+        return 0;
+
+    *number = v;
+    return i + 1;
+}
+
+/* Walk the audio frames of the FLAC stream at startpos, calling scanfunc
+   with the first sample and the offset of each one. Frames have no length
+   field, so this looks for headers whose frame or sample number follows
+   on from the previous frame, which also rejects sync codes that turn up
+   in the audio data. Returns the number of frames found or -1 on error. */
+int scan_flac_frames(int fd, long startpos,
+                     bool (*scanfunc)(void *data, uint64_t sample,
+                                      unsigned long offset),
+                     void *data, unsigned char *buf, size_t buflen)
+{
+    unsigned int min_blocksize = 0, max_blocksize = 0;
+    uint64_t expected = 0, number, sample;
+    unsigned int blocksize;
+    bool last_metadata = false;
+    long base;
+    int fill = 0, pos = 0, num_frames = 0;
+    ssize_t n;
+
+    if (buflen < 64 || lseek(fd, startpos, SEEK_SET) < 0 ||
+        read(fd, buf, 4) != 4 || memcmp(buf, "fLaC", 4) != 0)
+        return -1;
+
+    while (!last_metadata)
+    {
+        unsigned long len;
+
+        if (read(fd, buf, 4) != 4)
+            return -1;
+
+        last_metadata = buf[0] & 0x80;
+        len = (buf[1] << 16) | (buf[2] << 8) | buf[3];
+
+        if ((buf[0] & 0x7f) == 0) /* STREAMINFO */
+        {
+            if (len < 34 || read(fd, buf, 34) != 34)
+                return -1;
+            min_blocksize = (buf[0] << 8) | buf[1];
+            max_blocksize = (buf[2] << 8) | buf[3];
+            len -= 34;
+        }
+
+        if (lseek(fd, len, SEEK_CUR) < 0)
+            return -1;
+    }
+
+    base = lseek(fd, 0, SEEK_CUR);
+
+    while (true)
+    {
+        n = read(fd, buf + fill, buflen - fill);
+        if (n < 0)
+            return -1;
+        fill += n;
+
+        /* Keep a whole header in view unless the file has ended */
+        while (pos < fill && (n == 0 || pos + FLAC_MAX_HEADER <= fill))
+        {
+            int len = flac_frame_header(buf + pos, fill - pos, &number,
+                                        &blocksize, min_blocksize);
+
+            if (len == 0)
+            {
+                pos++;
+                continue;
+            }
+
+            /* Same rule as the decoder: fixed block size streams count
+               frames rather than samples */
+            sample = number;
+            if (min_blocksize == max_blocksize)
+                sample *= min_blocksize;
+
+            if (sample != expected)
+            {
+                pos++;
+                continue;
+            }
+
+            if (!scanfunc(data, sample, base + pos))
+                return num_frames;
+
+            num_frames++;
+            expected = sample + blocksize;
+            pos += len;
+        }
+
+        if (n == 0)
+            break;
+
+        memmove(buf, buf + pos, fill - pos);
+        base += pos;
+        fill -= pos;
+        pos = 0;
+    }
+
+    return num_frames;
+}
@@ -336,4 +336,15 @@ const char * get_codec_string(int type);
 bool rbcodec_format_is_atomic(int afmt);
 bool format_buffers_with_offset(int afmt);
 
+/* A frame boundary recorded by a seek index */
+struct seek_point {
+    uint64_t sample; /* first sample of the frame */
+    uint32_t offset; /* file offset of the frame header */
+};
+
+int scan_flac_frames(int fd, long startpos,
+                     bool (*scanfunc)(void *data, uint64_t sample,
+                                      unsigned long offset),
+                     void *data, unsigned char *buf, size_t buflen);
+
 #endif
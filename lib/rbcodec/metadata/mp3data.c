@@ -308,7 +308,6 @@ unsigned long find_next_frame(int fd,
                              fileread, true);
 }
 
-#ifndef __PCTOOL__
 static int fnf_read_index;
 static int fnf_buf_len;
 static unsigned char *fnf_buf;
@@ -373,6 +372,49 @@ static unsigned long buf_find_next_frame(int fd, long *offset, long max_offset)
     return __find_next_frame(fd, offset, max_offset, 0, buf_getbyte, true);
 }
 
+/* Walk the frames between startpos and endpos, calling scanfunc with the
+   first sample and the offset of each one. Stops early if scanfunc returns
+   false. Returns the number of frames found or -1 on error. */
+int scan_mp3_frames(int fd, long startpos, long endpos,
+                    bool (*scanfunc)(void *data, uint64_t sample,
+                                     unsigned long offset),
+                    void *data, unsigned char* buf, size_t buflen)
+{
+    unsigned long header;
+    struct mp3info info;
+    uint64_t sample = 0;
+    long pos = startpos;
+    long bytes;
+    int num_frames = 0;
+
+    if(lseek(fd, startpos, SEEK_SET) < 0)
+        return -1;
+
+    buf_init(buf, buflen);
+
+    while(pos < endpos && (header = buf_find_next_frame(fd, &bytes, 0))) {
+        if(!mp3headerinfo(&info, header))
+            break;
+
+        pos += bytes;
+        if(pos + info.frame_size > endpos)
+            break;
+
+        if(!scanfunc(data, sample, pos))
+            break;
+
+        sample += info.frame_samples;
+        pos += info.frame_size;
+        num_frames++;
+
+        if(buf_seek(fd, info.frame_size-4) < 0)
+            break;
+    }
+
+    return num_frames;
+}
+
+#ifndef __PCTOOL__
 static size_t mem_buflen;
 static unsigned char* mem_buf;
 static size_t mem_pos;
@@ -27,6 +27,7 @@
 #define MPEG_VERSION2_5 2
 
 #include <string.h> /* size_t */
+#include <stdint.h>
 
 struct mp3info {
     /* Standard MP3 frame header fields */
@@ -75,6 +76,11 @@ int count_mp3_frames(int fd,  int startpos,  int filesize,
                      void (*progressfunc)(int),
                      unsigned char* buf, size_t buflen);
 
+int scan_mp3_frames(int fd, long startpos, long endpos,
+                    bool (*scanfunc)(void *data, uint64_t sample,
+                                     unsigned long offset),
+                    void *data, unsigned char* buf, size_t buflen);
+
 int create_xing_header(int fd, long startpos, long filesize,
                        unsigned char *buf, unsigned long num_frames,
                        unsigned long rec_time, unsigned long header_template,
@@ -0,0 +1,384 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ *
+ * Copyright (C) 2026 The Rockbox Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+
+/* Checks that the SIMD helpers of dsp_simd.h give the same samples as the C
+ * loops they replace, on random, silent and full scale input. Built and run
+ * by "make test-dsp-simd" in a warble build directory. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rbcodecconfig.h"
+#include "fixedpoint.h"
+#include "fracmul.h"
+#include "dsp_proc_entry.h"
+#include "dsp-util.h"
+#include "dsp_simd.h"
+
+#ifdef HAVE_DSP_SIMD
+
+#define MAX_COUNT 1024
+
+enum pattern { PAT_RANDOM, PAT_SILENCE, PAT_FULL_SCALE, PAT_COUNT };
+static const char * const pattern_names[PAT_COUNT] =
+    { "random", "silence", "full scale" };
+
+static const int counts[] = { 0, 1, 3, 4, 5, 7, 8, 9, 31, 64, 1000, 1024 };
+
+static uint32_t rng_state = 0x12345678;
+static int checks;
+
+static uint32_t rnd(void)
+{
+    /* xorshift32 */
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void fill16(int16_t *p, int count, enum pattern pat)
+{
+    for (int i = 0; i < count; i++)
+    {
+        switch (pat)
+        {
+        case PAT_RANDOM:
+            p[i] = rnd();
+            break;
+        case PAT_SILENCE:
+            p[i] = 0;
+            break;
+        default:
+            p[i] = (rnd() & 1) ? INT16_MAX : INT16_MIN;
+            break;
+        }
+    }
+}
+
+/* max keeps the C loops clear of signed overflow, which they never see in
+ * practice either */
+static void fill32(int32_t *p, int count, enum pattern pat, int32_t max)
+{
+    for (int i = 0; i < count; i++)
+    {
+        int32_t x;
+
+        switch (pat)
+        {
+        case PAT_RANDOM:
+            x = rnd();
+            break;
+        case PAT_SILENCE:
+            x = 0;
+            break;
+        default:
+            x = (rnd() & 1) ? INT32_MAX : INT32_MIN;
+            break;
+        }
+
+        p[i] = MIN(MAX(x, -max - 1), max);
+    }
+}
+
+/* The C loops of dsp_sample_input.c, dsp_sample_output.c and channel_mode.c
+ * as they run after the SIMD helper, for the same number of samples. */
+static void c_input_16(const int16_t *s, int32_t *d, int count)
+{
+    const int scale = WORD_SHIFT;
+
+    while (count-- > 0)
+        *d++ = *s++ << scale;
+}
+
+static void c_input_i_stereo16(const int16_t *s, int32_t *dl, int32_t *dr,
+                               int count)
+{
+    const int scale = WORD_SHIFT;
+
+    while (count-- > 0)
+    {
+        *dl++ = *s++ << scale;
+        *dr++ = *s++ << scale;
+    }
+}
+
+static void c_input_i_stereo32(const int32_t *s, int32_t *dl, int32_t *dr,
+                               int count)
+{
+    while (count-- > 0)
+    {
+        *dl++ = *s++;
+        *dr++ = *s++;
+    }
+}
+
+static void c_output_mono(const int32_t *s0, int16_t *d, int count, int scale)
+{
+    int32_t dc_bias = 1L << (scale - 1);
+
+    while (count-- > 0)
+    {
+        int32_t lr = clip_sample_16((*s0++ + dc_bias) >> scale);
+        *d++ = lr;
+        *d++ = lr;
+    }
+}
+
+static void c_output_stereo(const int32_t *s0, const int32_t *s1,
+                            int16_t *d, int count, int scale)
+{
+    int32_t dc_bias = 1L << (scale - 1);
+
+    while (count-- > 0)
+    {
+        *d++ = clip_sample_16((*s0++ + dc_bias) >> scale);
+        *d++ = clip_sample_16((*s1++ + dc_bias) >> scale);
+    }
+}
+
+static void c_mono(int32_t *sl, int32_t *sr, int count)
+{
+    while (count-- > 0)
+    {
+        int32_t lr = *sl / 2 + *sr / 2;
+        *sl++ = lr;
+        *sr++ = lr;
+    }
+}
+
+static void c_karaoke(int32_t *sl, int32_t *sr, int count)
+{
+    while (count-- > 0)
+    {
+        int32_t ch = *sl / 2 - *sr / 2;
+        *sl++ = ch;
+        *sr++ = -ch;
+    }
+}
+
+static void c_custom(int32_t *sl, int32_t *sr, int count,
+                     int32_t gain, int32_t cross)
+{
+    while (count-- > 0)
+    {
+        int32_t l = *sl;
+        int32_t r = *sr;
+        *sl++ = FRACMUL(l, gain) + FRACMUL(r, cross);
+        *sr++ = FRACMUL(r, gain) + FRACMUL(l, cross);
+    }
+}
+
+/* The helper has to do whole vectors only and leave the rest alone. */
+static void check_count(const char *name, int count, int n, int width)
+{
+    checks++;
+    if (n != (count & ~(width - 1)))
+    {
+        printf("%s: did %d of %d samples\n", name, n, count);
+        exit(1);
+    }
+}
+
+static void compare32(const char *name, enum pattern pat, int count,
+                      const int32_t *got, const int32_t *expect, int size)
+{
+    for (int i = 0; i < size; i++)
+    {
+        if (got[i] != expect[i])
+        {
+            printf("%s (%s, %d samples): sample %d is %08lx, not %08lx\n",
+                   name, pattern_names[pat], count, i,
+                   (unsigned long)(uint32_t)got[i],
+                   (unsigned long)(uint32_t)expect[i]);
+            exit(1);
+        }
+    }
+}
+
+static void compare16(const char *name, enum pattern pat, int count,
+                      const int16_t *got, const int16_t *expect, int size)
+{
+    for (int i = 0; i < size; i++)
+    {
+        if (got[i] != expect[i])
+        {
+            printf("%s (%s, %d samples): sample %d is %d, not %d\n",
+                   name, pattern_names[pat], count, i, got[i], expect[i]);
+            exit(1);
+        }
+    }
+}
+
+static void test_input(enum pattern pat, int count)
+{
+    static int16_t s16[2*MAX_COUNT];
+    static int32_t s32[2*MAX_COUNT];
+    static int32_t dl[MAX_COUNT], dr[MAX_COUNT];
+    static int32_t el[MAX_COUNT], er[MAX_COUNT];
+    int n;
+
+    fill16(s16, 2*count, pat);
+    fill32(s32, 2*count, pat, INT32_MAX);
+
+    memset(dl, 0x5a, sizeof(dl));
+    memset(el, 0x5a, sizeof(el));
+    n = dsp_simd_input_16(s16, dl, count);
+    check_count("input_16", count, n, 8);
+    c_input_16(s16, el, n);
+    compare32("input_16", pat, count, dl, el, MAX_COUNT);
+
+    memset(dl, 0x5a, sizeof(dl));
+    memset(dr, 0x5a, sizeof(dr));
+    memset(el, 0x5a, sizeof(el));
+    memset(er, 0x5a, sizeof(er));
+    n = dsp_simd_input_i_stereo16(s16, dl, dr, count);
+    check_count("input_i_stereo16", count, n, 4);
+    c_input_i_stereo16(s16, el, er, n);
+    compare32("input_i_stereo16 left", pat, count, dl, el, MAX_COUNT);
+    compare32("input_i_stereo16 right", pat, count, dr, er, MAX_COUNT);
+
+    memset(dl, 0x5a, sizeof(dl));
+    memset(dr, 0x5a, sizeof(dr));
+    memset(el, 0x5a, sizeof(el));
+    memset(er, 0x5a, sizeof(er));
+    n = dsp_simd_input_i_stereo32(s32, dl, dr, count);
+    check_count("input_i_stereo32", count, n, 4);
+    c_input_i_stereo32(s32, el, er, n);
+    compare32("input_i_stereo32 left", pat, count, dl, el, MAX_COUNT);
+    compare32("input_i_stereo32 right", pat, count, dr, er, MAX_COUNT);
+}
+
+static void test_output(enum pattern pat, int count, int scale)
+{
+    static int32_t sl[MAX_COUNT], sr[MAX_COUNT];
+    static int16_t d[2*MAX_COUNT], e[2*MAX_COUNT];
+    int32_t max = INT32_MAX - (1L << (scale - 1));
+    int n;
+
+    fill32(sl, count, pat, max);
+    fill32(sr, count, pat, max);
+
+    memset(d, 0x5a, sizeof(d));
+    memset(e, 0x5a, sizeof(e));
+    n = dsp_simd_output_mono(sl, d, count, scale);
+    check_count("output_mono", count, n, 4);
+    c_output_mono(sl, e, n, scale);
+    compare16("output_mono", pat, count, d, e, 2*MAX_COUNT);
+
+    memset(d, 0x5a, sizeof(d));
+    memset(e, 0x5a, sizeof(e));
+    n = dsp_simd_output_stereo(sl, sr, d, count, scale);
+    check_count("output_stereo", count, n, 4);
+    c_output_stereo(sl, sr, e, n, scale);
+    compare16("output_stereo", pat, count, d, e, 2*MAX_COUNT);
+}
+
+static void test_channel_mode(enum pattern pat, int count,
+                              int32_t gain, int32_t cross)
+{
+    static int32_t sl[MAX_COUNT], sr[MAX_COUNT];
+    static int32_t el[MAX_COUNT], er[MAX_COUNT];
+    int n;
+
+    fill32(sl, MAX_COUNT, pat, INT32_MAX);
+    fill32(sr, MAX_COUNT, pat, INT32_MAX);
+    memcpy(el, sl, sizeof(el));
+    memcpy(er, sr, sizeof(er));
+    n = dsp_simd_mono(sl, sr, count);
+    check_count("mono", count, n, 4);
+    c_mono(el, er, n);
+    compare32("mono left", pat, count, sl, el, MAX_COUNT);
+    compare32("mono right", pat, count, sr, er, MAX_COUNT);
+
+    fill32(sl, MAX_COUNT, pat, INT32_MAX);
+    fill32(sr, MAX_COUNT, pat, INT32_MAX);
+    memcpy(el, sl, sizeof(el));
+    memcpy(er, sr, sizeof(er));
+    n = dsp_simd_karaoke(sl, sr, count);
+    check_count("karaoke", count, n, 4);
+    c_karaoke(el, er, n);
+    compare32("karaoke left", pat, count, sl, el, MAX_COUNT);
+    compare32("karaoke right", pat, count, sr, er, MAX_COUNT);
+
+    fill32(sl, MAX_COUNT, pat, INT32_MAX);
+    fill32(sr, MAX_COUNT, pat, INT32_MAX);
+    memcpy(el, sl, sizeof(el));
+    memcpy(er, sr, sizeof(er));
+    n = dsp_simd_custom(sl, sr, count, gain, cross);
+    check_count("custom", count, n, 4);
+    c_custom(el, er, n, gain, cross);
+    compare32("custom left", pat, count, sl, el, MAX_COUNT);
+    compare32("custom right", pat, count, sr, er, MAX_COUNT);
+}
+
+int main(void)
+{
+    /* the output scales of 16-bit and 24/32-bit codecs and the extremes */
+    static const int scales[] = { 1, WORD_SHIFT, 13, 16, 28, 31 };
+    /* stereo width gains, |gain| + |cross| <= 1.0 so the sums can't
+     * overflow */
+    static const int32_t gains[][2] =
+    {
+        { INT32_MAX, 0 },
+        { 0x40000000, 0x3fffffff },
+        { 0x5fffffff, -0x20000000 },
+        { -0x40000000, 0x3fffffff },
+        { 0, 0 },
+    };
+
+    for (int pat = 0; pat < PAT_COUNT; pat++)
+    {
+        for (size_t c = 0; c < ARRAYLEN(counts); c++)
+        {
+            test_input(pat, counts[c]);
+
+            for (size_t s = 0; s < ARRAYLEN(scales); s++)
+                test_output(pat, counts[c], scales[s]);
+
+            for (size_t g = 0; g < ARRAYLEN(gains); g++)
+                test_channel_mode(pat, counts[c], gains[g][0], gains[g][1]);
+
+            /* and some random ones */
+            for (int g = 0; g < 4; g++)
+                test_channel_mode(pat, counts[c], (int32_t)rnd() / 4,
+                                  (int32_t)rnd() / 4);
+        }
+    }
+
+    printf("dsp_simd: %d checks passed (%s)\n", checks,
+#ifdef DSP_SIMD_SSE2
+           "SSE2"
+#else
+           "NEON"
+#endif
+           );
+    return 0;
+}
+
+#else /* !HAVE_DSP_SIMD */
+
+int main(void)
+{
+    printf("dsp_simd: no SIMD helpers for this target\n");
+    return 0;
+}
+
+#endif /* HAVE_DSP_SIMD */
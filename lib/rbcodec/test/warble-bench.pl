@@ -0,0 +1,368 @@
+#!/usr/bin/perl
+#             __________               __   ___.
+#   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+#   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+#   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+#   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+#                     \/            \/     \/    \/            \/
+# $Id$
+#
+# Runs warble -b over a corpus of test files with a set of DSP
+# configurations and writes one JSON object per run, so decode and DSP
+# performance can be compared between builds.
+#
+# The corpus is generated: WAV, AIFF and AU are written directly and every
+# other format the codecs handle is encoded from the WAV with ffmpeg or the
+# reference encoders, whichever are installed. Files in an extra corpus
+# directory (-c) are benchmarked as well.
+#
+# The seek profile times random seeks instead of decoding. With -S it also
+# runs on long 96 kHz/24-bit FLAC files without a seek table, with a normal
+# one and with one too big for the codec to keep in full.
+
+use strict;
+use warnings;
+use Getopt::Long;
+use File::Basename;
+use File::Path qw(make_path);
+use JSON::PP;
+
+my $corpus_dir = "";
+my $work_dir = "warble-bench";
+my $output = "-";
+my $codec_dir = "";
+my $runs = 3;
+my $seconds = 10;
+my $tag = "";
+my $only = "";
+my $seek_seconds = 0;
+
+sub usage {
+    print STDERR <<EOF;
+Usage: warble-bench.pl [options] WARBLE
+
+  -c DIR     Also benchmark every file in DIR
+  -d DIR     Codec directory, to report codecs left without a test file
+  -w DIR     Where to generate the corpus [$work_dir]
+  -o FILE    Write results to FILE, - for stdout [$output]
+  -n N       Runs per file and configuration; the fastest is kept [$runs]
+  -s N       Length of generated files in seconds [$seconds]
+  -t TAG     Tag added to every result, e.g. a commit id
+  -p LIST    Only run these comma-separated configurations
+  -S N       Also generate N second hi-res FLAC files for the seek profile
+EOF
+    exit 1;
+}
+
+GetOptions("c=s" => \$corpus_dir, "d=s" => \$codec_dir, "w=s" => \$work_dir,
+           "o=s" => \$output, "n=i" => \$runs, "s=i" => \$seconds,
+           "t=s" => \$tag, "p=s" => \$only,
+           "S=i" => \$seek_seconds) or usage();
+usage() if @ARGV != 1;
+my $warble = $ARGV[0];
+
+# name => [ warble flags, warble -c configuration ]
+my @configs = (
+    [ "raw",        "-f", "" ],
+    [ "dsp",        "",   "" ],
+    [ "eq",         "",   "eq=30" ],
+    [ "crossfeed",  "",   "crossfeed=1" ],
+    [ "compressor", "",   "compressor=-12" ],
+    [ "tdspeed",    "",   "tempo=1.25" ],
+    [ "resample",   "",   "rate=0.97" ],
+    [ "all",        "",   "eq=30:crossfeed=1:compressor=-12:" .
+                          "tempo=1.25:rate=0.97" ],
+    [ "seek",       "-f", "seeks=100" ],
+);
+
+if ($only ne "") {
+    my %want = map { $_ => 1 } split(/,/, $only);
+    @configs = grep { $want{$_->[0]} } @configs;
+}
+
+# ---- corpus generation ----
+
+# Deterministic two channel test signal: a few partials per channel plus
+# noise, so that codecs cannot take any shortcuts on silence.
+sub gen_signal {
+    my ($rate, $channels) = @_;
+    my $frames = $rate * $seconds;
+    my @partials = ([ 110, 0.30 ], [ 440, 0.20 ], [ 1760, 0.10 ],
+                    [ 7040, 0.05 ]);
+    my $seed = 12345;
+    my @s;
+
+    for my $i (0 .. $frames - 1) {
+        for my $ch (0 .. $channels - 1) {
+            my $v = 0;
+            for my $p (@partials) {
+                $v += $p->[1] * sin(6.283185307 * $p->[0] * (1 + $ch / 7) *
+                                    $i / $rate);
+            }
+            $seed = ($seed * 1103515245 + 12345) & 0x7fffffff;
+            $v += ($seed / 0x7fffffff - 0.5) * 0.1;
+            push @s, $v;
+        }
+    }
+
+    return \@s;
+}
+
+sub pcm_bytes {
+    my ($s, $bits, $big_endian) = @_;
+    my $max = (1 << ($bits - 1)) - 1;
+    my $data = "";
+
+    for my $v (@$s) {
+        my $x = int($v * $max);
+        if ($bits == 16) {
+            $data .= pack($big_endian ? "s>" : "s<", $x);
+        } else {
+            my $b = pack("l<", $x);
+            $data .= $big_endian ? reverse(substr($b, 0, 3))
+                                 : substr($b, 0, 3);
+        }
+    }
+
+    return $data;
+}
+
+sub write_file {
+    my ($name, $data) = @_;
+    open(my $fh, ">", $name) or die "$name: $!";
+    binmode($fh);
+    print $fh $data;
+    close($fh);
+}
+
+sub write_wav {
+    my ($name, $rate, $channels, $bits) = @_;
+    my $data = pcm_bytes(gen_signal($rate, $channels), $bits, 0);
+    my $align = $channels * $bits / 8;
+    write_file($name, "RIFF" . pack("V", 36 + length($data)) . "WAVE" .
+               "fmt " . pack("VvvVVvv", 16, 1, $channels, $rate,
+                             $rate * $align, $align, $bits) .
+               "data" . pack("V", length($data)) . $data);
+}
+
+# 80-bit IEEE extended sample rate for AIFF COMM chunks
+sub ieee_extended {
+    my ($v) = @_;
+    my $exp = 16383 + 31;
+    $v *= 2, $exp-- while $v < 2**31;
+    return pack("nNN", $exp, $v, 0);
+}
+
+sub write_aiff {
+    my ($name, $rate, $channels) = @_;
+    my $data = pcm_bytes(gen_signal($rate, $channels), 16, 1);
+    my $frames = length($data) / (2 * $channels);
+    my $comm = "COMM" . pack("NnNn", 18, $channels, $frames, 16) .
+               ieee_extended($rate);
+    my $ssnd = "SSND" . pack("NNN", 8 + length($data), 0, 0) . $data;
+    write_file($name, "FORM" . pack("N", 4 + length($comm) + length($ssnd)) .
+               "AIFF" . $comm . $ssnd);
+}
+
+sub write_au {
+    my ($name, $rate, $channels) = @_;
+    my $data = pcm_bytes(gen_signal($rate, $channels), 16, 1);
+    write_file($name, ".snd" . pack("NNNNN", 24, length($data), 3, $rate,
+                                    $channels) . $data);
+}
+
+sub have {
+    my ($prog) = @_;
+    return system("command -v $prog >/dev/null 2>&1") == 0;
+}
+
+sub run_quiet {
+    return system(join(" ", @_) . " >/dev/null 2>&1") == 0;
+}
+
+sub gen_corpus {
+    my ($dir) = @_;
+    my @files;
+
+    make_path($dir);
+
+    my $wav = "$dir/pcm16_44k.wav";
+    write_wav($wav, 44100, 2, 16) unless -f $wav;
+    push @files, $wav;
+
+    for ([ "pcm24_48k.wav", 48000, 2, 24 ], [ "pcm16_22k_mono.wav", 22050,
+          1, 16 ], [ "pcm16_96k.wav", 96000, 2, 16 ]) {
+        my ($name, @fmt) = @$_;
+        write_wav("$dir/$name", @fmt) unless -f "$dir/$name";
+        push @files, "$dir/$name";
+    }
+
+    write_aiff("$dir/pcm16.aiff", 44100, 2) unless -f "$dir/pcm16.aiff";
+    write_au("$dir/pcm16.au", 44100, 2) unless -f "$dir/pcm16.au";
+    push @files, "$dir/pcm16.aiff", "$dir/pcm16.au";
+
+    # file => [ ffmpeg arguments, fallback encoder command ]
+    my @encoded = (
+        [ "flac.flac",    "-c:a flac",                 "flac -s -o %o %i" ],
+        [ "mp3.mp3",      "-c:a libmp3lame -b:a 192k", "lame --quiet -b 192 %i %o" ],
+        [ "mp2.mp2",      "-c:a mp2 -b:a 192k",        "" ],
+        [ "vorbis.ogg",   "-c:a libvorbis -q:a 5",     "oggenc -Q -q 5 -o %o %i" ],
+        [ "opus.opus",    "-c:a libopus -b:a 128k",    "opusenc --quiet %i %o" ],
+        [ "speex.spx",    "-c:a libspeex -ar 16000 -ac 1", "speexenc %i %o" ],
+        [ "aac.m4a",      "-c:a aac -b:a 160k",        "" ],
+        [ "alac.m4a",     "-c:a alac",                 "" ],
+        [ "wavpack.wv",   "-c:a wavpack",              "wavpack -q %i -o %o" ],
+        [ "wma.wma",      "-c:a wmav2 -b:a 160k",      "" ],
+        [ "tta.tta",      "-c:a tta",                  "" ],
+        [ "a52.ac3",      "-c:a ac3 -b:a 192k",        "" ],
+        [ "musepack.mpc", "",                          "mpcenc --silent %i %o" ],
+    );
+
+    my $ffmpeg = have("ffmpeg");
+
+    for (@encoded) {
+        my ($name, $ff, $enc) = @$_;
+        my $out = "$dir/$name";
+
+        if (! -f $out) {
+            if ($ffmpeg && $ff ne "") {
+                run_quiet("ffmpeg -y -i $wav $ff $out");
+            }
+            if (! -s $out && $enc ne "" && have((split(/ /, $enc))[0])) {
+                (my $cmd = $enc) =~ s/%i/$wav/;
+                $cmd =~ s/%o/$out/;
+                run_quiet($cmd);
+            }
+        }
+
+        if (-s $out) {
+            push @files, $out;
+        } else {
+            unlink($out);
+            print STDERR "skipping $name: no encoder found\n";
+        }
+    }
+
+    return @files;
+}
+
+# Long files only run the seek profile, decoding them in full would take
+# longer than the rest of the corpus
+sub gen_seek_corpus {
+    my ($dir) = @_;
+    my $wav = "$dir/long_96k24.wav";
+    my @files;
+
+    if (! -f $wav && have("ffmpeg")) {
+        run_quiet("ffmpeg -y -f lavfi -i " .
+                  "sine=frequency=440:sample_rate=96000:duration=$seek_seconds" .
+                  " -ac 2 -c:a pcm_s24le $wav");
+    }
+    if (! -s $wav) {
+        print STDERR "skipping seek files: ffmpeg not found\n";
+        return ();
+    }
+
+    # file => flac seek table option
+    for ([ "long_noseek.flac", "--no-seektable" ],
+         [ "long_seek.flac",   "-S 10s" ],
+         [ "long_dense.flac",  "-S 20000x" ]) {
+        my ($name, $opt) = @$_;
+        my $out = "$dir/$name";
+
+        run_quiet("flac -s $opt -o $out $wav") if ! -f $out && have("flac");
+
+        if (-s $out) {
+            push @files, $out;
+        } else {
+            unlink($out);
+            print STDERR "skipping $name: flac not found\n";
+        }
+    }
+
+    return @files;
+}
+
+# ---- benchmark ----
+
+my @files = gen_corpus($work_dir);
+my %seek_only;
+
+if ($seek_seconds > 0 && grep { $_->[0] eq "seek" } @configs) {
+    my @long = gen_seek_corpus($work_dir);
+    $seek_only{$_} = 1 for @long;
+    push @files, @long;
+}
+
+if ($corpus_dir ne "") {
+    opendir(my $dh, $corpus_dir) or die "$corpus_dir: $!";
+    push @files, map { "$corpus_dir/$_" } sort grep { -f "$corpus_dir/$_" }
+                 readdir($dh);
+    closedir($dh);
+}
+
+my $json = JSON::PP->new->canonical;
+my $out;
+if ($output eq "-") {
+    $out = \*STDOUT;
+} else {
+    open($out, ">", $output) or die "$output: $!";
+}
+
+my %seen_codecs;
+
+for my $file (@files) {
+    for my $c (@configs) {
+        my ($name, $flags, $config) = @$c;
+        my $best;
+
+        next if $seek_only{$file} && $name ne "seek";
+
+        for (1 .. $runs) {
+            my $cmd = "$warble -b $flags" .
+                      ($config ne "" ? " -c $config" : "") .
+                      " '$file' 2>/dev/null";
+            my $line = `$cmd`;
+            my $r = eval { decode_json($line) };
+
+            if (!$r) {
+                print STDERR "$file ($name): warble failed\n";
+                last;
+            }
+
+            my $ms = $r->{seek_ms} // $r->{decode_ms} + $r->{dsp_ms};
+            my $best_ms = $best ? $best->{seek_ms} //
+                                  $best->{decode_ms} + $best->{dsp_ms} : 0;
+            $best = $r if !$best || $ms < $best_ms;
+        }
+
+        next if !$best;
+
+        $best->{profile} = $name;
+        $best->{tag} = $tag if $tag ne "";
+        print $out $json->encode($best), "\n";
+
+        $seen_codecs{$best->{codec}} = 1;
+        if (defined $best->{seek_ms}) {
+            printf STDERR "%-24s %-10s %-11s %9d %10.3f ms %10.1f KiB\n",
+                          basename($file), $best->{codec}, $name,
+                          $best->{seeks}, $best->{seek_ms},
+                          $best->{seek_read_kb};
+        } else {
+            printf STDERR "%-24s %-10s %-11s %8.1fx %10.3f ms %10.3f ms\n",
+                          basename($file), $best->{codec}, $name,
+                          $best->{realtime}, $best->{decode_ms},
+                          $best->{dsp_ms};
+        }
+    }
+}
+
+close($out) if $output ne "-";
+
+if ($codec_dir ne "") {
+    opendir(my $dh, $codec_dir) or die "$codec_dir: $!";
+    my @missing = grep { !$seen_codecs{$_} }
+                  map { /^(.*)\.codec$/ ? $1 : () } sort readdir($dh);
+    closedir($dh);
+    print STDERR "no test file for: @missing\n" if @missing;
+}
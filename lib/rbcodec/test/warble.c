@@ -29,14 +29,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 #include "buffering.h" /* TYPE_PACKET_AUDIO */
 #include "kernel.h"
 #include "core_alloc.h"
 #include "codecs.h"
 #include "dsp_core.h"
+#include "dsp_proc_entry.h"
+#include "compressor.h"
+#include "crossfeed.h"
+#include "eq.h"
+#include "resample.h"
 #include "metadata.h"
+#include "mp3data.h"
 #include "settings.h"
 #include "sound.h"
 #include "tdspeed.h"
@@ -97,7 +105,7 @@ off_t filesize(int fd)
 
 /***************** INTERNAL *****************/
 
-static enum { MODE_PLAY, MODE_WRITE } mode;
+static enum { MODE_PLAY, MODE_WRITE, MODE_BENCH } mode;
 static bool use_dsp = true;
 static bool enable_loop = false;
 static const char *config = "";
@@ -379,11 +387,173 @@ static void playback_pcm(int16_t *pcm, int count)
     }
 }
 
+/***** MODE_BENCH *****/
+
+/* MODE_BENCH decodes and runs the DSP without any output, timing the two
+ * separately, and prints one JSON line with the results to stdout so runs
+ * can be collected and compared across builds. Decode time is everything
+ * the codec spends outside of dsp_process(), including file reads. */
+
+struct bench_time {
+    uint64_t ns;     /* CPU time */
+    uint64_t cycles; /* Timestamp counter ticks, 0 if not available */
+};
+
+static struct bench_time bench_start_time, bench_dsp_time;
+static const char *bench_input_fn;
+static const char *bench_config;
+static const char *bench_codec = "";
+
+/* seeks=<n> makes the codec seek <n> times to positions spread over the
+ * file and stops decoding after the last one. Each seek is timed from the
+ * seek command until the codec outputs its first samples, and the input it
+ * reads and seeks meanwhile is counted. */
+static int bench_seeks;
+static int bench_seeks_done;
+static bool bench_seek_pending;
+static struct bench_time bench_seek_start, bench_seek_time;
+static uint64_t bench_seek_max_ns;
+static uint64_t bench_read_bytes, bench_seek_read_bytes;
+static unsigned long bench_seek_calls, bench_seek_seek_calls;
+
+static void bench_get_time(struct bench_time *t)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    t->ns = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#if defined(__x86_64__) || defined(__i386__)
+    t->cycles = __builtin_ia32_rdtsc();
+#else
+    t->cycles = 0;
+#endif
+}
+
+static void bench_add_time(struct bench_time *acc,
+                           const struct bench_time *from)
+{
+    struct bench_time now;
+    bench_get_time(&now);
+    acc->ns += now.ns - from->ns;
+    acc->cycles += now.cycles - from->cycles;
+}
+
+static void bench_init(const char *input_fn)
+{
+    mode = MODE_BENCH;
+    bench_input_fn = input_fn;
+    bench_config = config;
+}
+
+/* Issue the next benchmark seek once the previous one has landed */
+static void bench_next_seek(void)
+{
+    if (bench_seek_pending || bench_seeks_done >= bench_seeks ||
+        codec_action != CODEC_ACTION_NULL || !ci.id3->length)
+        return;
+
+    /* Golden ratio steps visit the whole file without a pattern that
+       favours short forward seeks */
+    uint64_t pos = (uint64_t)((bench_seeks_done + 1) * 0x9e3779b9u) *
+                   ci.id3->length >> 32;
+
+    codec_action = CODEC_ACTION_SEEK_TIME;
+    codec_action_param = pos;
+    bench_seek_pending = true;
+    bench_seek_read_bytes -= bench_read_bytes;
+    bench_seek_seek_calls -= bench_seek_calls;
+    bench_get_time(&bench_seek_start);
+}
+
+static void bench_seek_landed(void)
+{
+    uint64_t ns = bench_seek_time.ns;
+
+    bench_add_time(&bench_seek_time, &bench_seek_start);
+    bench_seek_max_ns = MAX(bench_seek_max_ns, bench_seek_time.ns - ns);
+    bench_seek_read_bytes += bench_read_bytes;
+    bench_seek_seek_calls += bench_seek_calls;
+    bench_seek_pending = false;
+
+    if (++bench_seeks_done >= bench_seeks)
+        codec_action = CODEC_ACTION_HALT;
+}
+
+static void bench_print_string(const char *key, const char *str)
+{
+    printf("\"%s\":\"", key);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\')
+            putchar('\\');
+        if ((unsigned char)*str >= 0x20)
+            putchar(*str);
+    }
+    printf("\",");
+}
+
+static void bench_quit(void)
+{
+    struct bench_time total = { 0, 0 };
+    bench_add_time(&total, &bench_start_time);
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+
+    uint64_t decode_ns = total.ns - bench_dsp_time.ns;
+    uint64_t decode_cycles = total.cycles - bench_dsp_time.cycles;
+    double samples = num_output_samples ?: 1;
+    double audio_s = format.freq ? (double)num_output_samples / format.freq
+                                 : 0;
+
+    printf("{");
+    bench_print_string("file", bench_input_fn);
+    bench_print_string("codec", bench_codec);
+    bench_print_string("config", bench_config);
+    printf("\"frequency\":%ld,\"channels\":%d,\"depth\":%ld,"
+           "\"dsp\":%s,\"samples\":%lu,\"audio_s\":%.3f,",
+           (long)format.freq, format.channels, (long)format.depth,
+           use_dsp ? "true" : "false", num_output_samples, audio_s);
+    printf("\"decode_ms\":%.3f,\"dsp_ms\":%.3f,\"realtime\":%.2f,",
+           decode_ns / 1e6, bench_dsp_time.ns / 1e6,
+           total.ns ? audio_s * 1e9 / total.ns : 0);
+    if (total.cycles)
+        printf("\"decode_cps\":%.1f,\"dsp_cps\":%.1f,",
+               decode_cycles / samples, bench_dsp_time.cycles / samples);
+    else
+        printf("\"decode_cps\":null,\"dsp_cps\":null,");
+    if (bench_seeks) {
+        double seeks = bench_seeks_done ?: 1;
+        printf("\"seeks\":%d,\"seek_ms\":%.3f,\"seek_max_ms\":%.3f,"
+               "\"seek_read_kb\":%.1f,\"seek_calls\":%.1f,",
+               bench_seeks_done, bench_seek_time.ns / 1e6 / seeks,
+               bench_seek_max_ns / 1e6,
+               bench_seek_read_bytes / 1024.0 / seeks,
+               bench_seek_seek_calls / seeks);
+    }
+    printf("\"maxrss_kb\":%ld}\n", ru.ru_maxrss);
+}
+
 /***** ALL MODES *****/
 
+/* Alternating +/-<gain> tenths of a dB on every band, which enables them
+ * all, or a flat EQ for 0 */
+static void set_eq(int gain)
+{
+    static const int cutoffs[EQ_NUM_BANDS] =
+        { 32, 64, 125, 250, 500, 1000, 2000, 4000, 8000, 16000 };
+
+    for (int i = 0; i < EQ_NUM_BANDS; i++) {
+        struct eq_band_setting band = {
+            .cutoff = cutoffs[i], .q = 10, .gain = (i & 1) ? -gain : gain,
+        };
+        dsp_set_eq_coefs(i, &band);
+    }
+
+    dsp_set_eq_precut(gain > 0 ? gain : -gain);
+    dsp_eq_enable(gain != 0);
+}
+
 static void perform_config(void)
 {
-    /* TODO: equalizer, etc. */
     while (config) {
         const char *name = config;
         const char *eq = strchr(config, '=');
@@ -395,8 +565,18 @@ static void perform_config(void)
         if (!strncmp(name, "wait=", 5)) {
             if (atoi(val) > num_output_samples)
                 return;
+        } else if (!strncmp(name, "compressor=", 11)) {
+            struct compressor_settings cs = {
+                .threshold = atoi(val), .makeup_gain = 1, .ratio = 1,
+                .knee = 1, .release_time = 500, .attack_time = 5,
+            };
+            dsp_set_compressor(&cs);
+        } else if (!strncmp(name, "crossfeed=", 10)) {
+            dsp_set_crossfeed_type(atoi(val));
         } else if (!strncmp(name, "dither=", 7)) {
             dsp_dither_enable(atoi(val) ? true : false);
+        } else if (!strncmp(name, "eq=", 3)) {
+            set_eq(atoi(val));
         } else if (!strncmp(name, "halt=", 5)) {
             if (atoi(val))
                 codec_action = CODEC_ACTION_HALT;
@@ -404,11 +584,16 @@ static void perform_config(void)
             enable_loop = atoi(val) != 0;
         } else if (!strncmp(name, "offset=", 7)) {
             ci.id3->offset = atoi(val);
+        } else if (!strncmp(name, "quality=", 8)) {
+            dsp_configure(dsp_get_config(CODEC_IDX_AUDIO),
+                          RESAMPLE_SET_QUALITY, atoi(val));
         } else if (!strncmp(name, "rate=", 5)) {
             dsp_set_pitch(atof(val) * PITCH_SPEED_100);
         } else if (!strncmp(name, "seek=", 5)) {
             codec_action = CODEC_ACTION_SEEK_TIME;
             codec_action_param = atoi(val);
+        } else if (!strncmp(name, "seeks=", 6)) {
+            bench_seeks = atoi(val);
         } else if (!strncmp(name, "tempo=", 6)) {
             dsp_set_timestretch(atof(val) * PITCH_SPEED_100);
         } else if (!strncmp(name, "vol=", 4)) {
@@ -440,6 +625,9 @@ static void ci_pcmbuf_insert(const void *ch1, const void *ch2, int count)
 {
     num_output_samples += count;
 
+    if (bench_seek_pending)
+        bench_seek_landed();
+
     if (use_dsp) {
         struct dsp_buffer src;
         src.remcount = count;
@@ -455,7 +643,14 @@ static void ci_pcmbuf_insert(const void *ch1, const void *ch2, int count)
             dst.p16out = buf;
             dst.bufcount = out_count;
 
-            dsp_process(ci.dsp, &src, &dst);
+            if (mode == MODE_BENCH) {
+                struct bench_time start;
+                bench_get_time(&start);
+                dsp_process(ci.dsp, &src, &dst);
+                bench_add_time(&bench_dsp_time, &start);
+            } else {
+                dsp_process(ci.dsp, &src, &dst);
+            }
 
             if (dst.remcount > 0) {
                 if (mode == MODE_WRITE)
@@ -466,7 +661,7 @@ static void ci_pcmbuf_insert(const void *ch1, const void *ch2, int count)
                 break;
             }
         }
-    } else {
+    } else if (mode != MODE_BENCH) {
         /* Convert to 32-bit interleaved. */
         count *= format.channels;
         int i;
@@ -524,6 +719,7 @@ static size_t ci_read_filebuf(void *ptr, size_t size)
     if (actual < 0)
         actual = 0;
     ci.curpos += actual;
+    bench_read_bytes += actual;
     return actual;
 }
 
@@ -545,6 +741,7 @@ static void *ci_request_buffer(size_t *realsize, size_t reqsize)
     if (*realsize < 0)
         *realsize = 0;
     lseek(input_fd, -*realsize, SEEK_CUR);
+    bench_read_bytes += *realsize;
     return input_buffer;
 }
 
@@ -577,6 +774,7 @@ static bool ci_seek_buffer(size_t newpos)
     off_t actual = lseek(input_fd, newpos, SEEK_SET);
     if (actual >= 0)
         ci.curpos = actual;
+    bench_seek_calls++;
     return actual != -1;
 }
 
@@ -591,23 +789,24 @@ static void ci_set_offset(size_t value)
 
 static void ci_configure(int setting, intptr_t value)
 {
-    if (use_dsp) {
-        dsp_configure(ci.dsp, setting, value);
-    } else {
-        if (setting == DSP_SET_FREQUENCY
-                || setting == DSP_SET_FREQUENCY)
-            format.freq = value;
-        else if (setting == DSP_SET_SAMPLE_DEPTH)
-            format.depth = value;
-        else if (setting == DSP_SET_STEREO_MODE) {
-            format.stereo_mode = value;
-            format.channels = (value == STEREO_MONO) ? 1 : 2;
-        }
+    if (setting == DSP_SET_FREQUENCY)
+        format.freq = value;
+    else if (setting == DSP_SET_SAMPLE_DEPTH)
+        format.depth = value;
+    else if (setting == DSP_SET_STEREO_MODE) {
+        format.stereo_mode = value;
+        format.channels = (value == STEREO_MONO) ? 1 : 2;
     }
+
+    if (use_dsp)
+        dsp_configure(ci.dsp, setting, value);
 }
 
 static long ci_get_command(intptr_t *param)
 {
+    if (mode == MODE_BENCH)
+        bench_next_seek();
+
     long ret = codec_action;
     *param = codec_action_param;
     codec_action = CODEC_ACTION_NULL;
@@ -619,6 +818,86 @@ static bool ci_should_loop(void)
     return enable_loop;
 }
 
+/* In-memory version of the player's seek index, built on first use */
+#define SEEK_INDEX_INTERVAL 16384
+
+static struct seek_point *seek_index;
+static int seek_index_count = -1;
+
+static bool add_seek_point(void *data, uint64_t sample,
+                           unsigned long offset)
+{
+    static int alloc;
+
+    if (seek_index_count > 0 &&
+        sample / SEEK_INDEX_INTERVAL ==
+        seek_index[seek_index_count-1].sample / SEEK_INDEX_INTERVAL)
+        return true;
+
+    if (seek_index_count >= alloc) {
+        alloc = alloc ? alloc * 2 : 1024;
+        seek_index = realloc(seek_index, alloc * sizeof(*seek_index));
+    }
+
+    seek_index[seek_index_count].sample = sample;
+    seek_index[seek_index_count].offset = offset;
+    seek_index_count++;
+    return true;
+}
+
+static bool ci_seek_index_find(uint64_t sample, struct seek_point *before,
+                               struct seek_point *after)
+{
+    if (seek_index_count < 0) {
+        unsigned char buf[4096];
+        int fd = open(ci.id3->path, O_RDONLY);
+        int frames = -1;
+
+        seek_index_count = 0;
+        if (fd >= 0) {
+            switch (ci.id3->codectype) {
+            case AFMT_MPA_L1:
+            case AFMT_MPA_L2:
+            case AFMT_MPA_L3:
+                frames = scan_mp3_frames(fd, ci.id3->first_frame_offset,
+                                         ci.id3->first_frame_offset +
+                                         ci.id3->filesize, add_seek_point,
+                                         NULL, buf, sizeof(buf));
+                break;
+            case AFMT_FLAC:
+                frames = scan_flac_frames(fd, ci.id3->first_frame_offset,
+                                          add_seek_point, NULL,
+                                          buf, sizeof(buf));
+                break;
+            }
+            close(fd);
+        }
+
+        if (frames <= 0)
+            seek_index_count = 0;
+    }
+
+    if (seek_index_count == 0)
+        return false;
+
+    int lo = 0, hi = seek_index_count;
+    while (hi - lo > 1) {
+        int mid = lo + (hi - lo) / 2;
+        if (seek_index[mid].sample <= sample)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    *before = seek_index[lo];
+    if (hi < seek_index_count) {
+        *after = seek_index[hi];
+    } else {
+        after->sample = after->offset = 0;
+    }
+    return true;
+}
+
 static unsigned ci_sleep(unsigned ticks)
 {
     return 0;
@@ -717,6 +996,8 @@ static struct codec_api ci = {
     ci_round_value_to_list32,
 
 #endif /* HAVE_RECORDING */
+
+    ci_seek_index_find,
 };
 
 static void print_mp3entry(const struct mp3entry *id3, FILE *f)
@@ -782,6 +1063,7 @@ static void decode_file(const char *input_fn)
         exit(1);
     }
     print_mp3entry(&id3, stderr);
+    bench_codec = audio_formats[id3.codectype].codec_root_fn;
     ci.filesize = filesize(input_fd);
     ci.id3 = &id3;
     if (use_dsp) {
@@ -817,6 +1099,8 @@ static void decode_file(const char *input_fn)
     }
 
     /* Run the codec */
+    if (mode == MODE_BENCH)
+        bench_get_time(&bench_start_time);
     *c_hdr->api = &ci;
     if (c_hdr->entry_point(CODEC_LOAD) != CODEC_OK) {
         fprintf(stderr, "error: codec returned error from codec_main\n");
@@ -838,22 +1122,32 @@ static void print_help(const char *progname)
     fprintf(stderr, "Usage:\n"
                     "        Play: %s [options] INPUTFILE\n"
                     "Write to WAV: %s [options] INPUTFILE OUTPUTFILE\n"
+                    "   Benchmark: %s -b [options] INPUTFILE\n"
                     "\n"
                     "general options:\n"
                     "  -c a=1:b=2    Configuration (see below)\n"
                     "  -h            Show this help\n"
                     "\n"
+                    "benchmark options:\n"
+                    "  -b            Decode without output and print timings as JSON\n"
+                    "  -f            Skip the DSP\n"
+                    "\n"
                     "write to WAV options:\n"
                     "  -f            Write raw codec output converted to 64-bit float\n"
                     "  -r            Write raw 32-bit codec output without WAV header\n"
                     "\n"
                     "configuration:\n"
+                    "  compressor=<n> Compress above <n> dB, 0 to disable [0]\n"
+                    "  crossfeed=<n> Crossfeed: 0 = off, 1 = Meier, 2 = custom [0]\n"
                     "  dither=<0|1>  Enable/disable dithering [0]\n"
+                    "  eq=<n>        Set all EQ bands to +/-<n> tenths of a dB [0]\n"
                     "  halt=<0|1>    Stop decoding if 1 [0]\n"
                     "  loop=<0|1>    Enable/disable looping [0]\n"
                     "  offset=<n>    Start at byte offset within the file [0]\n"
+                    "  quality=<n>   Resampler quality, 0 (Hermite) to 2 [target]\n"
                     "  rate=<n>      Multiply rate by <n> [1.0]\n"
                     "  seek=<n>      Seek <n> ms into the file\n"
+                    "  seeks=<n>     Benchmark <n> seeks, then stop [0]\n"
                     "  tempo=<n>     Timestretch by <n> [1.0]\n"
                     "  vol=<n>       Set volume attenuation to <n> dB [-0]\n"
                     "  wait=<n>      Don't apply remaining configuration until\n"
@@ -864,14 +1158,18 @@ static void print_help(const char *progname)
                     "  %s in.adx -c loop=1:wait=44100:halt=1\n"
                     "  # Lower pitch 1 octave and write to out.wav\n"
                     "  %s in.ogg -c rate=0.5:tempo=2 out.wav\n"
-                    , progname, progname, progname, progname);
+                    , progname, progname, progname, progname, progname);
 }
 
 int main(int argc, char **argv)
 {
     int opt;
-    while ((opt = getopt(argc, argv, "c:fhr")) != -1) {
+    bool bench = false;
+    while ((opt = getopt(argc, argv, "bc:fhr")) != -1) {
         switch (opt) {
+        case 'b':
+            bench = true;
+            break;
         case 'c':
             config = optarg;
             break;
@@ -889,7 +1187,14 @@ int main(int argc, char **argv)
         }
     }
 
-    if (argc == optind + 2) {
+    if (bench) {
+        if (argc != optind + 1) {
+            fprintf(stderr, "error: -b takes only an input file\n");
+            print_help(argv[0]);
+            exit(1);
+        }
+        bench_init(argv[optind]);
+    } else if (argc == optind + 2) {
         write_init(argv[optind + 1]);
     } else if (argc == optind + 1) {
         if (!use_dsp) {
@@ -912,6 +1217,8 @@ int main(int argc, char **argv)
         write_quit();
     else if (mode == MODE_PLAY)
         playback_quit();
+    else if (mode == MODE_BENCH)
+        bench_quit();
 
     return 0;
 }
@@ -22,6 +22,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "config.h"
 #include "checkwps.h"
 #include "resize.h"
@@ -251,11 +252,49 @@ struct font* font_get(int font)
 /* This is no longer defined in ROCKBOX builds so just use a huge value */
 #define SKIN_BUFFER_SIZE (200*1024)
 
+static void print_code_stats(struct wps_data *wps, struct skin_stats *stats,
+                             double load_ms)
+{
+    static const char * const names[] = {
+        [SKIN_OP_TEXT]        = "text",
+        [SKIN_OP_VALUE]       = "value",
+        [SKIN_OP_TAG]         = "tag",
+        [SKIN_OP_ALIGN]       = "align",
+        [SKIN_OP_FLAGS]       = "flags",
+        [SKIN_OP_CONDITIONAL] = "conditional",
+        [SKIN_OP_BRANCH]      = "branch",
+    };
+    int counts[ARRAYLEN(names)] = { 0 };
+    int families[SKIN_TOKEN_FAMILY_RADIO + 1] = { 0 };
+    struct skin_op *code = SKINOFFSETTOPTR(skin_buffer, wps->code);
+    size_t i;
+
+    for (i = 0; i < stats->code_ops; i++)
+    {
+        counts[code[i].type]++;
+        if (code[i].type == SKIN_OP_VALUE || code[i].type == SKIN_OP_TAG)
+            families[code[i].arg]++;
+    }
+
+    printf("%zd ops (%zd bytes), skin buffer %zd bytes\n",
+           stats->code_ops, stats->code_ops * sizeof(struct skin_op),
+           skin_buffer_usage());
+    for (i = 0; i < ARRAYLEN(names); i++)
+        printf("\t%-12s %d\n", names[i], counts[i]);
+    printf("token values: %d id3, %d radio, %d other\n",
+           families[SKIN_TOKEN_FAMILY_ID3], families[SKIN_TOKEN_FAMILY_RADIO],
+           families[SKIN_TOKEN_FAMILY_OTHER]);
+    /* checkwps has no renderer, the render time is on the skin engine
+       debug screen of a real build */
+    printf("parsed and compiled in %.3f ms\n", load_ms);
+}
+
 int main(int argc, char **argv)
 {
     int ret = 0;
     int res;
     int filearg = 1;
+    bool show_stats = false;
 
     struct wps_data wps={0};
     enum screen_type screen = SCREEN_MAIN;
@@ -272,6 +311,7 @@ int main(int argc, char **argv)
         printf("\t-v\t\tverbose\n");
         printf("\t-vv\t\tmore verbose\n");
         printf("\t-vvv\t\tvery verbose\n");
+        printf("\t-s\t\tshow the compiled skin's ops and its parse and compile time\n");
         printf("\t-h,\t--help\tshow this message\n");
         return 1;
     }
@@ -279,10 +319,14 @@ int main(int argc, char **argv)
     if (argv[1][0] == '-') {
         filearg++;
         int i = 1;
-        while (argv[1][i] && argv[1][i] == 'v') {
+        while (argv[1][i] == 'v' || argv[1][i] == 's') {
+            if (argv[1][i] == 's')
+                show_stats = true;
+            else {
+                wps_verbose_level++;
+                debug_wps = true;
+            }
             i++;
-            wps_verbose_level++;
-            debug_wps = true;
         }
     }
     skin_buffer = malloc(SKIN_BUFFER_SIZE);
@@ -329,7 +373,9 @@ int main(int argc, char **argv)
         }
         wps_screen = &screens[screen];
 
+        clock_t start = clock();
         res = skin_data_load(screen, &wps, name, true, &stats);
+        double load_ms = (clock() - start) * 1000.0 / CLOCKS_PER_SEC;
 
         if (!res) {
             printf("WPS parsing failure\n");
@@ -338,7 +384,10 @@ int main(int argc, char **argv)
             goto done;
         }
 
-        printf("WPS parsed OK\n\n");
+        printf("WPS parsed OK\n");
+        if (show_stats)
+            print_code_stats(&wps, &stats, load_ms);
+        printf("\n");
         if (wps_verbose_level>2)
             skin_debug_tree(SKINOFFSETTOPTR(skin_buffer, wps.tree));
     }
@@ -2,8 +2,11 @@
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <dirent.h>
+#include <time.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -11,16 +14,47 @@
 #include "tagcache.h"
 #include "dir.h"
 
+#ifdef TAGCACHE_SCAN_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
 /* This is meant to be run on the root of the dap. it'll put the db files into
  * a .rockbox subdir */
 
+static double elapsed_secs(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
 int main(int argc, char **argv)
 {
-    (void)argc;
-    (void)argv;
+    struct timespec start;
+    double secs;
+    int files;
 
     fprintf(stderr, "Rockbox database tool for '%s'\n\n", TARGET_NAME);
 
+#ifdef TAGCACHE_SCAN_THREADS
+    /* -j <threads> sets the number of metadata parsing threads */
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (argc == 3 && !strcmp(argv[1], "-j"))
+        threads = atoi(argv[2]);
+    else if (argc != 1)
+    {
+        fprintf(stderr, "Usage: %s [-j threads]\n", argv[0]);
+        return 1;
+    }
+
+    /* A single thread is no faster than parsing while scanning */
+    tagcache_set_scan_threads(threads > 1 ? threads : 0);
+#else
+    (void)argc;
+    (void)argv;
+#endif
+
     DIR* rbdir = opendir(ROCKBOX_DIR);
     if (!rbdir) {
         fprintf(stderr, "Unable to find the '%s' directory!\n", ROCKBOX_DIR);
@@ -36,10 +70,15 @@ int main(int argc, char **argv)
 
     fprintf(stderr, "Scanning files (make take some time)...");
 
+    clock_gettime(CLOCK_MONOTONIC, &start);
     do_tagcache_build(paths);
+    secs = elapsed_secs(&start);
+    files = tagcache_get_added_count();
     tagcache_reverse_scan();
 
     fprintf(stderr, "...done!\n");
+    fprintf(stderr, "Added %d files in %.2f s (%.0f files/s)\n",
+            files, secs, secs > 0 ? files / secs : 0.0);
 
     return 0;
 }
@@ -50,6 +89,41 @@ const char *sim_root_dir = ".";
 
 /* stubs to avoid including thread-sdl.c */
 #include "kernel.h"
+#ifdef TAGCACHE_SCAN_THREADS
+/* The metadata parsing threads share the few locks there are, so one
+ * recursive big lock will do. */
+static pthread_mutex_t big_lock;
+static pthread_once_t big_lock_once = PTHREAD_ONCE_INIT;
+
+static void big_lock_init(void)
+{
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&big_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void mutex_init(struct mutex *m)
+{
+    (void)m;
+    pthread_once(&big_lock_once, big_lock_init);
+}
+
+void mutex_lock(struct mutex *m)
+{
+    (void)m;
+    pthread_once(&big_lock_once, big_lock_init);
+    pthread_mutex_lock(&big_lock);
+}
+
+void mutex_unlock(struct mutex *m)
+{
+    (void)m;
+    pthread_mutex_unlock(&big_lock);
+}
+#else
 void mutex_init(struct mutex *m)
 {
     (void)m;
@@ -64,6 +138,7 @@ void mutex_unlock(struct mutex *m)
 {
     (void)m;
 }
+#endif /* TAGCACHE_SCAN_THREADS */
 
 void sim_thread_lock(void *me)
 {
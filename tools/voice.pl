@@ -73,6 +73,9 @@ Usage: voice.pl [options] [path to dir]
 
  -v
     Be verbose
+
+ Set the POOL environment variable to a directory to keep encoded clips
+ there and reuse them in later runs, for both voice files and .talk clips.
 USAGE
 ;
 }
@@ -404,6 +407,17 @@ sub synchronize {
     }
 }
 
+# Name of the clip for a string in the pool of snippets. The name is a hash
+# of everything that changes the encoded clip, so voice files and .talk
+# clips share the pool across runs, targets and directory layouts.
+sub poolfile {
+    my ($voice, $language, $encoder_opts, $tts_object, $tts_engine_opts) = @_;
+    $language = "" unless defined($language);
+    return sprintf("%s/%s-%s.enc", $ENV{'POOL'},
+                   md5_hex(Encode::encode_utf8("$voice ". $tts_object->{"name"}." $tts_engine_opts ".$tts_object->{"ttsoptions"}." $encoder_opts")),
+                   $language);
+}
+
 # Run genlang and create voice clips for each string
 sub generateclips {
     our $verbose;
@@ -489,9 +503,7 @@ sub generateclips {
 
                 # If we have a pool of snippets, see if the string exists there first
                 if (defined($ENV{'POOL'})) {
-                    $pool_file = sprintf("%s/%s-%s.enc", $ENV{'POOL'},
-                                         md5_hex(Encode::encode_utf8("$voice ". $tts_object->{"name"}." $tts_engine_opts ".$tts_object->{"ttsoptions"}." $encoder_opts")),
-                                         $language);
+                    $pool_file = poolfile($voice, $language, $encoder_opts, $tts_object, $tts_engine_opts);
                     if (-f $pool_file) {
                         printf("Re-using %s (%s) from pool\n", $id, $voice) if $verbose;
 #                        system("touch $pool_file"); # So we know it's still being used.
@@ -617,7 +629,7 @@ sub gentalkclips {
         if ( -d $path) { # Element is a dir
 	    $enc = sprintf("%s/_dirname.talk", $path);
             if (! -e "$path/talkclips.ignore") { # Skip directories containing "talkclips.ignore"
-                gentalkclips($path, $tts_object, $encoder, $encoder_opts, $tts_engine_opts, $i);
+                gentalkclips($path, $tts_object, $language, $encoder, $encoder_opts, $tts_engine_opts, $i);
             }
         } else { # Element is a file
             $enc = sprintf("%s.talk", $path);
@@ -631,6 +643,17 @@ sub gentalkclips {
 	# Don't generate encoded file if it already exists
 	next if (-f $enc && !$force);
 
+	# Reuse the clip from the pool of snippets if it's there
+	my $pool_file;
+	if (defined($ENV{'POOL'})) {
+	    $pool_file = poolfile($voice, $language, $encoder_opts, $tts_object, $tts_engine_opts);
+	    if (-f $pool_file) {
+		printf("Re-using %s (%s) from pool\n", $enc, $voice) if $verbose;
+		copy($pool_file, $enc);
+		next;
+	    }
+	}
+
 	voicestring($voice, $wav, $tts_engine_opts, $tts_object);
 	wavtrim($wav, $trim_thresh, $tts_object);
 
@@ -645,6 +668,9 @@ sub gentalkclips {
 	    copy($wav, $enc);
 	}
 	synchronize($tts_object);
+	if (defined($pool_file)) {
+	    copy($enc, $pool_file);
+	}
 	unlink($wav);
     }
 }
@@ -64,6 +64,8 @@ const static struct {
     { RbSettings::TalkStripExtensions,  "talk_strip_extensions","true" },
     { RbSettings::TalkIgnoreFiles,      "talk_ignore_files",    "false" },
     { RbSettings::TalkIgnoreWildcards,  "talk_ignore_wildcards","" },
+    { RbSettings::TalkWorkers,          "talk_workers",         "0" },
+    { RbSettings::TalkBenchmark,        "talk_benchmark",       "false" },
     { RbSettings::VoiceLanguage,        "voicelanguage",        "" },
     { RbSettings::TtsLanguage,          ":tts:/language",       "" },
     { RbSettings::TtsOptions,           ":tts:/options",        "" },
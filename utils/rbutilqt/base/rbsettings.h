@@ -57,6 +57,8 @@ class RbSettings : public QObject
             TalkStripExtensions,
             TalkIgnoreFiles,
             TalkIgnoreWildcards,
+            TalkWorkers,
+            TalkBenchmark,
             VoiceLanguage,
             TtsLanguage,
             TtsOptions,
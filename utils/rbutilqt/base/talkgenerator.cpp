@@ -22,6 +22,192 @@
 #include "wavtrim.h"
 #include "Logger.h"
 
+//! \brief Job queue shared between TalkGenerator and its worker threads.
+//!
+//! Jobs carry copies of the strings they need so workers never touch the
+//! entry list. Finished jobs are handed back through a result queue which
+//! only the thread running TalkGenerator::process() drains.
+class TalkPipeline
+{
+    public:
+        enum JobType { Voice, Encode };
+        struct Job
+        {
+            JobType type;
+            int index;
+            QString toSpeak;
+            QString wavfilename;
+            QString talkfilename;
+            TTSStatus status;
+            QString error;
+        };
+
+        TalkPipeline(TTSBase* tts, EncoderBase* enc, int wavtrimth, int workers);
+        ~TalkPipeline();
+
+        void push(const Job& job);
+        void runHere(Job job);
+        bool takeResult(Job* job, int timeout);
+        //! jobs queued, running or not yet collected
+        int pending(void)
+        { return m_pending; }
+
+        bool pop(Job* job);
+        void run(Job* job);
+        void finish(const Job& job);
+
+    private:
+        TTSBase* m_tts;
+        EncoderBase* m_enc;
+        int m_wavtrimth;
+        int m_pending;
+        bool m_stopped;
+
+        QMutex m_mutex;
+        QWaitCondition m_jobReady;
+        QWaitCondition m_resultReady;
+        QQueue<Job> m_jobs;
+        QQueue<Job> m_results;
+        QList<QThread*> m_workers;
+};
+
+// class for running pipeline jobs in a separate thread.
+class TalkWorker : public QThread
+{
+    public:
+        TalkWorker(TalkPipeline* pipeline) : m_pipeline(pipeline) {}
+        void run(void);
+    private:
+        TalkPipeline* m_pipeline;
+};
+
+void TalkWorker::run(void)
+{
+    TalkPipeline::Job job;
+    while(m_pipeline->pop(&job))
+    {
+        m_pipeline->run(&job);
+        m_pipeline->finish(job);
+    }
+}
+
+TalkPipeline::TalkPipeline(TTSBase* tts, EncoderBase* enc, int wavtrimth,
+                           int workers)
+    : m_tts(tts), m_enc(enc), m_wavtrimth(wavtrimth), m_pending(0),
+      m_stopped(false)
+{
+    for(int i = 0; i < workers; i++)
+    {
+        QThread* worker = new TalkWorker(this);
+        worker->start();
+        m_workers.append(worker);
+    }
+}
+
+//! \brief Discards queued jobs and waits for the running ones to finish.
+//!
+TalkPipeline::~TalkPipeline()
+{
+    m_mutex.lock();
+    m_stopped = true;
+    m_jobs.clear();
+    m_jobReady.wakeAll();
+    m_mutex.unlock();
+
+    for(int i = 0; i < m_workers.size(); i++)
+    {
+        m_workers.at(i)->wait();
+        delete m_workers.at(i);
+    }
+}
+
+//! \brief Queue a job for the workers. Encoding jobs go first so voiced
+//! wav files are turned into clips before more are created.
+void TalkPipeline::push(const Job& job)
+{
+    QMutexLocker locker(&m_mutex);
+    if(job.type == Encode)
+        m_jobs.prepend(job);
+    else
+        m_jobs.enqueue(job);
+    m_pending++;
+    m_jobReady.wakeOne();
+}
+
+//! \brief Run a job in the calling thread, for TTS engines which can't
+//! voice from several threads.
+void TalkPipeline::runHere(Job job)
+{
+    m_pending++;
+    run(&job);
+    finish(job);
+}
+
+//! \brief Wait for the next job, returns false once the pipeline stops.
+//!
+bool TalkPipeline::pop(Job* job)
+{
+    QMutexLocker locker(&m_mutex);
+    while(m_jobs.isEmpty() && !m_stopped)
+        m_jobReady.wait(&m_mutex);
+    if(m_stopped)
+        return false;
+    *job = m_jobs.dequeue();
+    return true;
+}
+
+void TalkPipeline::run(Job* job)
+{
+    if(job->type == Voice)
+    {
+        LOG_INFO() << "voicing: " << job->toSpeak << "to" << job->wavfilename;
+        job->status = m_tts->voice(job->toSpeak, job->wavfilename, &job->error);
+
+        // wavtrim if needed. Clips with warnings are trimmed as well, the
+        // engine may still have written a partial wav file.
+        if(job->status != FatalError && m_wavtrimth != -1)
+        {
+            char buffer[255];
+            if(wavtrim(job->wavfilename.toLocal8Bit().data(),
+                       m_wavtrimth, buffer, 255))
+            {
+                LOG_ERROR() << "wavtrim returned error on"
+                            << job->wavfilename;
+                job->status = FatalError;
+                job->error = QString::fromLocal8Bit(buffer);
+            }
+        }
+    }
+    else
+    {
+        LOG_INFO() << "encoding " << job->wavfilename
+                   << "to" << job->talkfilename;
+        job->status = m_enc->encode(job->wavfilename, job->talkfilename)
+                    ? NoError : FatalError;
+    }
+}
+
+void TalkPipeline::finish(const Job& job)
+{
+    QMutexLocker locker(&m_mutex);
+    m_results.enqueue(job);
+    m_resultReady.wakeOne();
+}
+
+//! \brief Get a finished job, waiting up to timeout ms if there is none.
+//!
+bool TalkPipeline::takeResult(Job* job, int timeout)
+{
+    QMutexLocker locker(&m_mutex);
+    if(m_results.isEmpty() && timeout > 0)
+        m_resultReady.wait(&m_mutex, timeout);
+    if(m_results.isEmpty())
+        return false;
+    *job = m_results.dequeue();
+    m_pending--;
+    return true;
+}
+
 TalkGenerator::TalkGenerator(QObject* parent): QObject(parent)
 {
 }
@@ -66,34 +252,20 @@ TalkGenerator::Status TalkGenerator::process(QList<TalkEntry>* list,int wavtrimt
     }
     QCoreApplication::processEvents();
 
+    initClipCache(wavtrimth);
     emit logProgress(0,0);
 
-    // Voice entries
-    emit logItem(tr("Voicing entries..."),LOGINFO);
-    Status voiceStatus= voiceList(list,wavtrimth);
-    if(voiceStatus == eERROR)
+    // Voice and encode entries
+    emit logItem(tr("Voicing and encoding entries..."),LOGINFO);
+    Status status = runPipeline(list, wavtrimth);
+    if(status == eERROR)
     {
         m_tts->stop();
         m_enc->stop();
         emit done(true);
         return eERROR;
     }
-    else if( voiceStatus == eWARNING)
-        warnings = true;
-
-    QCoreApplication::processEvents();
-
-    // Encoding Entries
-    emit logItem(tr("Encoding files..."),LOGINFO);
-    Status encoderStatus = encodeList(list);
-    if( encoderStatus == eERROR)
-    {
-        m_tts->stop();
-        m_enc->stop();
-        emit done(true);
-        return eERROR;
-    }
-    else if( voiceStatus == eWARNING)
+    else if(status == eWARNING)
         warnings = true;
 
     QCoreApplication::processEvents();
@@ -107,147 +279,310 @@ TalkGenerator::Status TalkGenerator::process(QList<TalkEntry>* list,int wavtrimt
     return eOK;
 }
 
-//! \brief Voices a List of string
+//! \brief Voices and encodes a list of entries.
 //!
-TalkGenerator::Status TalkGenerator::voiceList(QList<TalkEntry>* list,int wavtrimth)
+//! Voicing and wavtrim run on the worker threads if the TTS engine allows
+//! it, otherwise in this thread while the workers encode what has been
+//! voiced so far. At most twice as many jobs as workers are queued, which
+//! bounds the number of voiced but not yet encoded wav files.
+TalkGenerator::Status TalkGenerator::runPipeline(QList<TalkEntry>* list, int wavtrimth)
 {
-    int progressMax = list->size();
-    int m_progress = 0;
-    emit logProgress(m_progress,progressMax);
-
-    QStringList errors;
-    QStringList duplicates;
-
-    bool warnings = false;
-    for(int i=0; i < list->size(); i++)
+    int workers = RbSettings::value(RbSettings::TalkWorkers).toInt();
+    if(workers <= 0)
+        workers = QThread::idealThreadCount();
+    if(workers <= 0)
+        workers = 1;
+    bool parallel = m_tts->capabilities().testFlag(TTSBase::RunInParallel);
+    int backlog = 2 * workers;
+
+    m_ready.clear();
+    m_waiting.clear();
+    m_talkfiles.clear();
+    m_warnings = false;
+    m_progress = 0;
+    m_progressMax = 2 * list->size();
+    m_voiced = 0;
+    m_encoded = 0;
+    m_cachedWavs.clear();
+    m_cacheHits = 0;
+
+    // find the entries to voice. Entries sharing a wav file with an earlier
+    // one are encoded once that one has been voiced.
+    QHash<QString, int> wavfiles;
+    QSet<int> voicing;
+    QList<int> voice;
+    for(int i = 0; i < list->size(); i++)
     {
-        if(m_abort)
-        {
-            emit logItem(tr("Voicing aborted"), LOGERROR);
-            return eERROR;
-        }
-
-        // skip duplicated wav entrys
-        if(!duplicates.contains(list->at(i).wavfilename))
-            duplicates.append(list->at(i).wavfilename);
-        else
+        QString wavfilename = list->at(i).wavfilename;
+        if(wavfiles.contains(wavfilename))
         {
+            int first = wavfiles.value(wavfilename);
             LOG_INFO() << "duplicate skipped";
             (*list)[i].voiced = true;
-            emit logProgress(++m_progress,progressMax);
+            m_progress++;
+            if(voicing.contains(first))
+                m_waiting.insert(first, i);
+            else
+                m_ready.append(i);
             continue;
         }
+        wavfiles.insert(wavfilename, i);
 
-        // skip already voiced entrys
-        if(list->at(i).voiced == true)
+        // skip already voiced entries and entries with empty text
+        if(list->at(i).voiced || list->at(i).toSpeak.isEmpty())
         {
-            emit logProgress(++m_progress,progressMax);
+            m_progress++;
+            m_ready.append(i);
             continue;
         }
-        // skip entry whith empty text
-        if(list->at(i).toSpeak == "")
+        // reuse the clip of an earlier run if the cache has one
+        QString clip = cachedClip(list->at(i).toSpeak);
+        if(!clip.isEmpty() && QFileInfo::exists(clip))
         {
-            emit logProgress(++m_progress,progressMax);
+            (*list)[i].voiced = true;
+            m_cachedWavs.insert(wavfilename, clip);
+            m_cacheHits++;
+            m_progress++;
+            m_ready.append(i);
             continue;
         }
-
-        // voice entry
-        QString error;
-        LOG_INFO() << "voicing: " << list->at(i).toSpeak
-                 << "to" << list->at(i).wavfilename;
-        TTSStatus status = m_tts->voice(list->at(i).toSpeak,
-                                        list->at(i).wavfilename, &error);
-        if(status == Warning)
-        {
-            warnings = true;
-            emit logItem(tr("Voicing of %1 failed: %2")
-                         .arg(list->at(i).toSpeak, error), LOGWARNING);
-        }
-        else if (status == FatalError)
+        voicing.insert(i);
+        voice.append(i);
+    }
+    if(m_cacheHits > 0)
+        emit logItem(tr("Reusing %1 cached clips").arg(m_cacheHits), LOGINFO);
+    emit logProgress(m_progress, m_progressMax);
+
+    QElapsedTimer timer;
+    timer.start();
+    TalkPipeline pipeline(m_tts, m_enc, wavtrimth, workers);
+    int next = 0;
+    while(next < voice.size() || pipeline.pending() > 0 || !m_ready.isEmpty())
+    {
+        QCoreApplication::processEvents();
+        // returning stops the pipeline, running jobs are waited for.
+        if(m_abort)
         {
-            emit logItem(tr("Voicing of %1 failed: %2")
-                         .arg(list->at(i).toSpeak, error), LOGERROR);
+            if(next < voice.size())
+                emit logItem(tr("Voicing aborted"), LOGERROR);
+            else
+                emit logItem(tr("Encoding aborted"), LOGERROR);
             return eERROR;
         }
-        else
-           (*list)[i].voiced = true;
 
-        // wavtrim if needed
-        if(wavtrimth != -1)
+        // hand voiced entries to the encoder
+        while(!m_ready.isEmpty())
         {
-            char buffer[255];
-            if(wavtrim(list->at(i).wavfilename.toLocal8Bit().data(),
-                       wavtrimth, buffer, 255))
+            int i = m_ready.takeFirst();
+            TalkPipeline::Job job;
+            job.type = TalkPipeline::Encode;
+            job.index = i;
+            job.wavfilename = list->at(i).wavfilename;
+            job.talkfilename = list->at(i).talkfilename;
+
+            //skip non-voiced entrys
+            if(!list->at(i).voiced)
             {
-                LOG_ERROR() << "wavtrim returned error on"
-                            << list->at(i).wavfilename;
-                return eERROR;
+                LOG_WARNING() << "non voiced entry detected:"
+                              << list->at(i).toSpeak;
+                m_progress++;
+                continue;
+            }
+            //skip duplicates
+            if(m_talkfiles.contains(job.talkfilename))
+            {
+                LOG_INFO() << "duplicate skipped";
+                (*list)[i].encoded = true;
+                m_progress++;
+                continue;
+            }
+            m_talkfiles.insert(job.talkfilename);
+
+            // voiced entries found in the cache are copied, not encoded
+            if(m_cachedWavs.contains(job.wavfilename))
+            {
+                QFile::remove(job.talkfilename);
+                if(!QFile::copy(m_cachedWavs.value(job.wavfilename),
+                                job.talkfilename))
+                {
+                    emit logItem(tr("Copying cached clip for %1 failed")
+                                 .arg(list->at(i).toSpeak), LOGERROR);
+                    return eERROR;
+                }
+                (*list)[i].encoded = true;
+                m_progress++;
+                continue;
             }
+            pipeline.push(job);
         }
 
-        emit logProgress(++m_progress,progressMax);
-        QCoreApplication::processEvents();
+        // voice the next entry if the queue has room for it
+        bool producing = next < voice.size() && pipeline.pending() < backlog;
+        if(producing)
+        {
+            int i = voice.at(next++);
+            TalkPipeline::Job job;
+            job.type = TalkPipeline::Voice;
+            job.index = i;
+            job.toSpeak = list->at(i).toSpeak;
+            job.wavfilename = list->at(i).wavfilename;
+            if(parallel)
+                pipeline.push(job);
+            else
+                pipeline.runHere(job);
+        }
+
+        // only block when waiting for the workers is all that's left to do
+        if(collectResults(list, &pipeline, producing ? 0 : 50) == eERROR)
+            return eERROR;
+        emit logProgress(m_progress, m_progressMax);
     }
-    if(warnings)
+
+    qint64 elapsed = timer.elapsed();
+    double rate = elapsed > 0 ? m_encoded * 1000.0 / elapsed : 0;
+    LOG_INFO() << "voiced" << m_voiced << "and encoded" << m_encoded
+               << "clips in" << elapsed << "ms with" << workers << "workers";
+    if(RbSettings::value(RbSettings::TalkBenchmark).toBool())
+        emit logItem(tr("Voiced %1 and encoded %2 clips in %3 s "
+                        "(%4 clips/s, %5 workers)")
+                     .arg(m_voiced).arg(m_encoded)
+                     .arg(elapsed / 1000.0, 0, 'f', 1)
+                     .arg(rate, 0, 'f', 1).arg(workers), LOGINFO);
+
+    if(m_warnings)
         return eWARNING;
     else
         return eOK;
 }
 
 
-//! \brief Encodes a List of strings
+//! \brief Handles finished jobs, waiting up to timeout ms for the first.
 //!
-TalkGenerator::Status TalkGenerator::encodeList(QList<TalkEntry>* list)
+TalkGenerator::Status TalkGenerator::collectResults(QList<TalkEntry>* list,
+                                                    TalkPipeline* pipeline,
+                                                    int timeout)
 {
-    QStringList duplicates;
-
-    int progressMax = list->size();
-    int m_progress = 0;
-    emit logProgress(m_progress,progressMax);
-
-    for(int i=0; i < list->size(); i++)
+    TalkPipeline::Job job;
+    while(pipeline->takeResult(&job, timeout))
     {
-        if(m_abort)
+        timeout = 0;
+        m_progress++;
+        if(job.type == TalkPipeline::Voice)
         {
-            emit logItem(tr("Encoding aborted"), LOGERROR);
-            return eERROR;
-        }
+            if(job.status == Warning)
+            {
+                m_warnings = true;
+                emit logItem(tr("Voicing of %1 failed: %2")
+                             .arg(job.toSpeak, job.error), LOGWARNING);
+            }
+            else if(job.status == FatalError)
+            {
+                emit logItem(tr("Voicing of %1 failed: %2")
+                             .arg(job.toSpeak, job.error), LOGERROR);
+                return eERROR;
+            }
+            else
+            {
+                (*list)[job.index].voiced = true;
+                m_voiced++;
+            }
 
-         //skip non-voiced entrys
-        if(list->at(i).voiced == false)
-        {
-            LOG_WARNING() << "non voiced entry detected:"
-                          << list->at(i).toSpeak;
-            emit logProgress(++m_progress,progressMax);
-            continue;
+            // the entry and all sharing its wav file can be encoded now
+            m_ready.append(job.index);
+            m_ready.append(m_waiting.values(job.index));
+            m_waiting.remove(job.index);
         }
-        //skip duplicates
-         if(!duplicates.contains(list->at(i).talkfilename))
-            duplicates.append(list->at(i).talkfilename);
         else
         {
-            LOG_INFO() << "duplicate skipped";
-            (*list)[i].encoded = true;
-            emit logProgress(++m_progress,progressMax);
-            continue;
-        }
-
-        //encode entry
-        LOG_INFO() << "encoding " << list->at(i).wavfilename
-                   << "to" << list->at(i).talkfilename;
-        if(!m_enc->encode(list->at(i).wavfilename,list->at(i).talkfilename))
-        {
-            emit logItem(tr("Encoding of %1 failed").arg(
-                QFileInfo(list->at(i).wavfilename).baseName()), LOGERROR);
-            return eERROR;
+            if(job.status != NoError)
+            {
+                emit logItem(tr("Encoding of %1 failed").arg(
+                    QFileInfo(job.wavfilename).baseName()), LOGERROR);
+                return eERROR;
+            }
+            (*list)[job.index].encoded = true;
+            m_encoded++;
+            storeClip(list->at(job.index));
         }
-        (*list)[i].encoded = true;
-        emit logProgress(++m_progress,progressMax);
-        QCoreApplication::processEvents();
     }
     return eOK;
 }
 
+//! \brief Sets up the voice clip cache for the current TTS and encoder.
+//!
+//! Clips are stored in the download cache, named after a hash of the text
+//! and of every setting which changes the clip, so changing the voice or
+//! the encoder settings never reuses a stale clip.
+void TalkGenerator::initClipCache(int wavtrimth)
+{
+    m_cacheDir.clear();
+    m_cacheKey.clear();
+    if(RbSettings::value(RbSettings::CacheDisabled).toBool())
+        return;
+
+    QString tts = RbSettings::value(RbSettings::Tts).toString();
+    QString enc = PlayerBuildInfo::instance()->value(
+                    PlayerBuildInfo::Encoder).toString();
+    QStringList key;
+    key << tts
+        << RbSettings::subValue(tts, RbSettings::TtsVoice).toString()
+        << RbSettings::subValue(tts, RbSettings::TtsOptions).toString()
+        << RbSettings::subValue(tts, RbSettings::TtsLanguage).toString()
+        << RbSettings::subValue(tts, RbSettings::TtsSpeed).toString()
+        << RbSettings::subValue(tts, RbSettings::TtsPitch).toString()
+        << RbSettings::value(RbSettings::TtsUseSapi4).toString()
+        << enc
+        << RbSettings::subValue(enc, RbSettings::EncoderOptions).toString()
+        << RbSettings::subValue(enc, RbSettings::EncoderVolume).toString()
+        << RbSettings::subValue(enc, RbSettings::EncoderQuality).toString()
+        << RbSettings::subValue(enc, RbSettings::EncoderComplexity).toString()
+        << RbSettings::subValue(enc, RbSettings::EncoderNarrowBand).toString()
+        << QString::number(wavtrimth);
+    m_cacheKey = key.join("\n").toUtf8();
+
+    QDir dir(RbSettings::value(RbSettings::CachePath).toString()
+                + "/rbutil-cache/voiceclips");
+    if(!dir.exists() && !dir.mkpath("."))
+    {
+        LOG_WARNING() << "cannot create voice clip cache" << dir.path();
+        return;
+    }
+    m_cacheDir = dir.path();
+    LOG_INFO() << "voice clip cache:" << m_cacheDir;
+}
+
+//! \brief Path of the cached clip for text, empty if the cache is disabled.
+//!
+QString TalkGenerator::cachedClip(const QString& text)
+{
+    if(m_cacheDir.isEmpty())
+        return QString();
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(m_cacheKey);
+    hash.addData(QByteArray("\n"));
+    hash.addData(text.toUtf8());
+    return m_cacheDir + "/" + hash.result().toHex() + ".clip";
+}
+
+//! \brief Adds a freshly encoded clip to the cache.
+//!
+void TalkGenerator::storeClip(const TalkEntry& entry)
+{
+    QString clip = cachedClip(entry.toSpeak);
+    if(clip.isEmpty() || entry.toSpeak.isEmpty() || QFileInfo::exists(clip))
+        return;
+
+    // copy under a temporary name so an interrupted copy is never used
+    QString tmp = clip + ".part";
+    QFile::remove(tmp);
+    if(!QFile::copy(entry.talkfilename, tmp) || !QFile::rename(tmp, clip))
+    {
+        LOG_WARNING() << "could not cache clip for" << entry.toSpeak;
+        QFile::remove(tmp);
+    }
+}
+
 //! \brief slot, which is connected to the abort of the Logger.
 //Sets a flag, so Creating Talkfiles ends at the next possible position
 //!
@@ -28,6 +28,8 @@
 #include "encoderbase.h"
 #include "ttsbase.h"
 
+class TalkPipeline;
+
 //! \brief Talk generator, generates .wav and .talk files out of a list.
 class TalkGenerator :public QObject
 {
@@ -65,8 +67,12 @@ signals:
     void logProgress(int, int); //! set progress bar.
 
 private:
-    Status voiceList(QList<TalkEntry>* list,int wavetrimth);
-    Status encodeList(QList<TalkEntry>* list);
+    Status runPipeline(QList<TalkEntry>* list, int wavtrimth);
+    Status collectResults(QList<TalkEntry>* list, TalkPipeline* pipeline,
+                          int timeout);
+    void initClipCache(int wavtrimth);
+    QString cachedClip(const QString& text);
+    void storeClip(const TalkEntry& entry);
 
     TTSBase* m_tts;
     EncoderBase* m_enc;
@@ -83,6 +89,20 @@ private:
 
     bool m_abort;
 
+    // pipeline state, only touched by the thread calling process()
+    QList<int> m_ready;             //! voiced entries waiting to be encoded
+    QMultiHash<int, int> m_waiting; //! entries sharing the wav of another
+    QSet<QString> m_talkfiles;
+    bool m_warnings;
+    int m_progress;
+    int m_progressMax;
+    int m_voiced;
+    int m_encoded;
+
+    QString m_cacheDir;            //! empty if the clip cache is disabled
+    QByteArray m_cacheKey;         //! settings the clips depend on
+    QHash<QString, QString> m_cachedWavs; //! wav file -> cached clip
+    int m_cacheHits;
 
 };
 
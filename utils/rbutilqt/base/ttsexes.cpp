@@ -26,7 +26,9 @@ TTSExes::TTSExes(QObject* parent) : TTSBase(parent)
 {
     /* default to espeak */
     m_name = "espeak";
-    m_capabilities = TTSBase::CanSpeak;
+    /* each clip is voiced by its own process into its own file and voice()
+       only reads the settings, so clips can be voiced in parallel */
+    m_capabilities = TTSBase::CanSpeak | TTSBase::RunInParallel;
     m_TTSTemplate = "\"%exe\" %options -w \"%wavfile\" -- \"%text\"";
     m_TTSSpeakTemplate = "\"%exe\" %options -- \"%text\"";
 }
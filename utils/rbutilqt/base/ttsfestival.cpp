@@ -152,6 +152,9 @@ bool TTSFestival::start(QString* errStr)
                << RbSettings::subValue("festival", RbSettings::TtsVoice).toString();
 
     bool running = ensureServerRunning();
+    // voice() runs on several threads, don't look up settings from there
+    clientPath = RbSettings::subValue("festival-client",
+            RbSettings::TtsPath).toString();
     if (!RbSettings::subValue("festival",RbSettings::TtsVoice).toString().isEmpty())
     {
         /* There's no harm in using both methods to set the voice .. */
@@ -186,15 +189,13 @@ TTSStatus TTSFestival::voice(const QString& text, const QString& wavfile, QStrin
 {
     LOG_INFO() << "Voicing" << text << "->" << wavfile;
 
-    QString path = RbSettings::subValue("festival-client",
-            RbSettings::TtsPath).toString();
     QStringList cmd;
     cmd << "--server" << "localhost" << "--otype" << "riff" << "--ttw"
         << "--withlisp" << "--output" << wavfile << "--prolog" << prologPath << "-";
-    LOG_INFO() << "Client cmd:" << path << cmd;
+    LOG_INFO() << "Client cmd:" << clientPath << cmd;
 
     QProcess clientProcess;
-    clientProcess.start(path, cmd);
+    clientProcess.start(clientPath, cmd);
     clientProcess.write(QString("%1.\n").arg(text).toLatin1());
     clientProcess.waitForBytesWritten();
     clientProcess.closeWriteChannel();
@@ -56,6 +56,7 @@ class TTSFestival : public TTSBase
     private:
         QTemporaryFile prologFile;
         QString prologPath;
+        QString clientPath;
         QString currentPath;
         QStringList  getVoiceList();
         QString getVoiceInfo(QString voice);
@@ -35,7 +35,7 @@ class TTSFlite : public TTSExes
             /* default to espeak */
             m_TTSTemplate = "\"%exe\" %options -o \"%wavfile\" -t \"%text\"";
             m_TTSSpeakTemplate = "";
-            m_capabilities = TTSBase::None;
+            m_capabilities = TTSBase::RunInParallel;
 
         }
 };
@@ -33,6 +33,8 @@ class TTSSwift : public TTSExes
             m_name = "swift";
             m_TTSTemplate = "\"%exe\" %options -o \"%wavfile\" -- \"%text\"";
             m_TTSSpeakTemplate = "";
+            /* Cepstral voices are licensed per port, i.e. per concurrent
+               synthesis, and a single port license fails a second one */
             m_capabilities = TTSBase::None;
         }
 };
@@ -36,17 +36,31 @@ extern "C" int wavtrim(char* filename, int maxsilence, char* errstring, int errs
 
 static QMap<RbSettings::UserSettings, QVariant> stubUserSettings;
 
+// counters and results of the fake engines, checked by the pipeline tests.
+QAtomicInt stubVoiceCalls;
+QAtomicInt stubEncodeCalls;
+TTSStatus stubVoiceStatus = NoError;
+
 QVariant RbSettings::value(UserSettings setting)
 {
     switch (setting)
     {
         case RbSettings::Tts:
             return QString("espeak");
+        case RbSettings::TalkWorkers:
+            return 2;
+        case RbSettings::CacheDisabled:
+            return true;
         default:
             return QVariant();
     }
 }
 
+QVariant RbSettings::subValue(QString /*sub*/, UserSettings /*setting*/)
+{
+    return QVariant();
+}
+
 class TTSFakeEspeak : public TTSBase
 {
     Q_OBJECT
@@ -55,7 +69,13 @@ public:
     virtual bool start(QString *errStr) { (void)errStr; return true; }
     virtual bool stop() { return true; }
     virtual TTSStatus voice(const QString& text, const QString& wavfile, QString *errStr)
-    { (void)text; (void)wavfile; (void)errStr; return NoError; }
+    {
+        (void)text; (void)wavfile;
+        stubVoiceCalls.ref();
+        if(stubVoiceStatus != NoError)
+            *errStr = "fake error";
+        return stubVoiceStatus;
+    }
     virtual QString voiceVendor() { return QString("DummyVendor"); }
     virtual bool configOk() { return true; }
     virtual void generateSettings() {}
@@ -77,9 +97,27 @@ TTSBase* TTSBase::getTTS(QObject* parent, QString /*ttsName*/)
     return new TTSFakeEspeak(parent);
 }
 
-EncoderBase* EncoderBase::getEncoder(QObject*, QString)
+class EncoderFake : public EncoderBase
+{
+    Q_OBJECT
+public:
+    EncoderFake(QObject *parent): EncoderBase(parent) {}
+    virtual bool encode(QString input, QString output)
+    { (void)input; (void)output; stubEncodeCalls.ref(); return true; }
+    virtual bool start() { return true; }
+    virtual bool stop() { return true; }
+    virtual bool configOk() { return true; }
+    virtual void generateSettings() {}
+    virtual void saveSettings() {}
+};
+
+EncoderBase::EncoderBase(QObject *parent): EncTtsSettingInterface(parent)
+{
+}
+
+EncoderBase* EncoderBase::getEncoder(QObject* parent, QString)
 {
-    return nullptr;
+    return new EncoderFake(parent);
 }
 
 QVariant PlayerBuildInfo::value(PlayerBuildInfo::DeviceInfo /*item*/, QString /*target*/)
@@ -22,6 +22,10 @@
 #include <QObject>
 #include "talkgenerator.h"
 
+// set up by the fake engines in stubs-talkgenerator.cpp
+extern QAtomicInt stubVoiceCalls;
+extern QAtomicInt stubEncodeCalls;
+extern TTSStatus stubVoiceStatus;
 
 class TestTalkGenerator : public QObject
 {
@@ -29,9 +33,32 @@ class TestTalkGenerator : public QObject
         private slots:
         void testCorrectString();
         void testCorrectString_data();
+        void testPipelineDuplicates();
+        void testPipelineWarning();
+        void testPipelineAbort();
+    private:
+        QList<TalkGenerator::TalkEntry> entries(const QStringList& texts);
 };
 
 
+//! \brief Builds a list of entries, equal texts share their wav and talk file.
+//!
+QList<TalkGenerator::TalkEntry> TestTalkGenerator::entries(const QStringList& texts)
+{
+    QList<TalkGenerator::TalkEntry> list;
+    for(int i = 0; i < texts.size(); i++) {
+        TalkGenerator::TalkEntry entry;
+        entry.toSpeak = texts.at(i);
+        entry.wavfilename = "/nonexistent/" + texts.at(i) + ".wav";
+        entry.talkfilename = "/nonexistent/" + texts.at(i) + ".talk";
+        entry.voiced = false;
+        entry.encoded = false;
+        list.append(entry);
+    }
+    return list;
+}
+
+
 
 void TestTalkGenerator::testCorrectString_data()
 {
@@ -75,6 +102,84 @@ void TestTalkGenerator::testCorrectString()
 }
 
 
+void TestTalkGenerator::testPipelineDuplicates()
+{
+    QList<TalkGenerator::TalkEntry> list = entries(
+        { "one", "two", "one", "three", "two", "one" });
+    // same wav file, different talk file: voiced once, encoded twice.
+    list[4].talkfilename = "/nonexistent/two-again.talk";
+
+    stubVoiceCalls = 0;
+    stubEncodeCalls = 0;
+    stubVoiceStatus = NoError;
+    QList<QPair<int, int>> progress;
+    TalkGenerator t(this);
+    connect(&t, &TalkGenerator::logProgress, this,
+            [&](int value, int max) { progress.append(qMakePair(value, max)); });
+
+    QCOMPARE(t.process(&list), TalkGenerator::eOK);
+    QCOMPARE(stubVoiceCalls.loadAcquire(), 3);
+    QCOMPARE(stubEncodeCalls.loadAcquire(), 4);
+    for(int i = 0; i < list.size(); i++) {
+        QVERIFY(list.at(i).voiced);
+        QVERIFY(list.at(i).encoded);
+    }
+
+    // every entry is counted once for voicing and once for encoding, and
+    // the progress never goes backwards or past the total.
+    QVERIFY(progress.size() >= 3);
+    QCOMPARE(progress.last(), qMakePair(1, 1));
+    QCOMPARE(progress.at(progress.size() - 2),
+             qMakePair(2 * int(list.size()), 2 * int(list.size())));
+    for(int i = 2; i < progress.size() - 1; i++) {
+        QVERIFY(progress.at(i).first >= progress.at(i - 1).first);
+        QVERIFY(progress.at(i).first <= progress.at(i).second);
+    }
+}
+
+void TestTalkGenerator::testPipelineWarning()
+{
+    QList<TalkGenerator::TalkEntry> list = entries({ "one", "two" });
+
+    stubVoiceCalls = 0;
+    stubEncodeCalls = 0;
+    stubVoiceStatus = Warning;
+    TalkGenerator t(this);
+    TalkGenerator::Status status = t.process(&list, 250);
+    stubVoiceStatus = NoError;
+
+    // entries which failed voicing are skipped but don't stop the run.
+    QCOMPARE(status, TalkGenerator::eWARNING);
+    QCOMPARE(stubVoiceCalls.loadAcquire(), 2);
+    QCOMPARE(stubEncodeCalls.loadAcquire(), 0);
+    QVERIFY(!list.at(0).voiced);
+    QVERIFY(!list.at(1).encoded);
+}
+
+void TestTalkGenerator::testPipelineAbort()
+{
+    QStringList texts;
+    for(int i = 0; i < 100; i++)
+        texts.append(QString("entry%1").arg(i));
+    QList<TalkGenerator::TalkEntry> list = entries(texts);
+
+    stubVoiceCalls = 0;
+    stubEncodeCalls = 0;
+    stubVoiceStatus = NoError;
+    bool done = false;
+    TalkGenerator t(this);
+    connect(&t, &TalkGenerator::logProgress, this,
+            [&](int value, int) { if(value >= 10) t.abort(); });
+    connect(&t, &TalkGenerator::done, this, [&](bool error) { done = error; });
+
+    QCOMPARE(t.process(&list), TalkGenerator::eERROR);
+    QVERIFY(done);
+    QVERIFY(stubVoiceCalls.loadAcquire() < list.size());
+    QVERIFY(!list.last().voiced);
+    QVERIFY(!list.last().encoded);
+}
+
+
 QTEST_MAIN(TestTalkGenerator)
 
 // this include is needed because we don't use a separate header file for the
@@ -31,12 +31,14 @@
 #include <QImage>
 #include <QSettings>
 
+#include <cstring>
+
 #include <QDebug>
 
 quint16 RBFont::maxFontSizeFor16BitOffsets = 0xFFDB;
 
 RBFont::RBFont(QString file)
-    : valid(false), imageData(0), offsetData(0), widthData(0)
+    : valid(false)
 {
 
     bool badFile = false;
@@ -133,9 +135,8 @@ RBFont::RBFont(QString file)
    header.insert("nwidth", dword);
 
    /* Loading the image data */
-   imageData = new quint8[header.value("nbits").toInt()];
-   data.readRawData(reinterpret_cast<char*>(imageData),
-                    header.value("nbits").toInt());
+   imageData.resize(header.value("nbits").toInt());
+   data.readRawData(imageData.data(), imageData.size());
 
    /* Aligning on 16-bit boundary */
    if(header.value("nbits").toInt() % 2 == 1)
@@ -149,21 +150,20 @@ RBFont::RBFont(QString file)
            bytesToRead = 4 * header.value("noffset").toInt();
        else
            bytesToRead = 2 * header.value("noffset").toInt();
-       offsetData = new quint16[bytesToRead];
-       data.readRawData(reinterpret_cast<char*>(offsetData), bytesToRead);
+       offsetData.resize(bytesToRead);
+       data.readRawData(offsetData.data(), bytesToRead);
    }
 
    /* Loading the width table if necessary */
    if(header.value("nwidth").toInt() > 0)
    {
-       widthData = new quint8[header.value("nwidth").toInt()];
-       data.readRawData(reinterpret_cast<char*>(widthData),
-                        header.value("nwidth").toInt());
+       widthData.resize(header.value("nwidth").toInt());
+       data.readRawData(widthData.data(), widthData.size());
    }
 
    fin.close();
 
-   /* Caching the font data */
+   /* Caching the font data, the arrays are shared with the cache */
    cache = new RBFontCache::CacheInfo;
    cache->imageData = imageData;
    cache->offsetData = offsetData;
@@ -183,13 +183,48 @@ RBFont::~RBFont()
 RBText* RBFont::renderText(QString text, QColor color, int viewWidth,
                            QGraphicsItem *parent)
 {
+    QString file = header.value("filename").toString();
+    int height = header.value("height").toInt();
+
+    /* Looking up each glyph, rendering the ones that aren't cached yet */
+    QList<QImage> glyphs;
+    int totalWidth = 0;
+    for(int i = 0; i < text.length(); i++)
+    {
+        uint code = text[i].unicode();
+        QImage glyph;
+        if(!RBTextCache::lookup(file, code, &glyph))
+        {
+            glyph = renderGlyph(code);
+            RBTextCache::insert(file, code, glyph);
+        }
+        glyphs.append(glyph);
+        totalWidth += glyph.width();
+    }
 
-    /* Checking for a cache hit first */
-    QImage* image = RBTextCache::lookup(header.value("filename").toString()
-                                        + text);
-    if(image)
-        return new RBText(image, viewWidth, parent);
+    QImage image(totalWidth, height, QImage::Format_Indexed8);
+    image.setColor(0, qRgba(0,0,0,0));
+    image.setColor(1, color.rgb());
+    image.fill(0);
 
+    /* Copying the glyphs in, the colour is only applied through the table */
+    int startX = 0;
+    for(int i = 0; i < glyphs.count(); i++)
+    {
+        const QImage& glyph = glyphs[i];
+        if(glyph.isNull())
+            continue;
+        for(int y = 0; y < height && y < glyph.height(); y++)
+            memcpy(image.scanLine(y) + startX, glyph.constScanLine(y),
+                   glyph.width());
+        startX += glyph.width();
+    }
+
+    return new RBText(image, viewWidth, parent);
+}
+
+QImage RBFont::renderGlyph(uint code)
+{
     int firstChar = header.value("firstchar").toInt();
     int height = header.value("height").toInt();
     int maxWidth = header.value("maxwidth").toInt();
@@ -197,74 +232,63 @@ RBText* RBFont::renderText(QString text, QColor color, int viewWidth,
     bool extendedSet = header.value("nbits").
                        toUInt() > maxFontSizeFor16BitOffsets;
 
-    /* First we determine the width of the combined text */
-    QList<int> widths;
-    for(int i = 0; i < text.length(); i++)
+    const quint8* image8 =
+            reinterpret_cast<const quint8*>(imageData.constData());
+    const quint16* offset16 =
+            reinterpret_cast<const quint16*>(offsetData.constData());
+    const quint8* width8 =
+            reinterpret_cast<const quint8*>(widthData.constData());
+
+    int width;
+    if(!widthData.isEmpty())
+        width = width8[code - firstChar];
+    else
+        width = maxWidth;
+
+    QImage glyph(width, height, QImage::Format_Indexed8);
+    glyph.setColor(0, qRgba(0,0,0,0));
+    glyph.setColor(1, qRgb(0,0,0));
+
+    unsigned int offset;
+    if(!offsetData.isEmpty())
     {
-        if(widthData)
-            widths.append(widthData[text[i].unicode() - firstChar]);
+        if(extendedSet)
+            offset = reinterpret_cast<const quint32*>(offset16)[code - firstChar];
         else
-            widths.append(maxWidth);
+            offset = offset16[code - firstChar];
+    }
+    else
+    {
+        offset = (code - firstChar) * maxWidth;
     }
 
-    int totalWidth = 0;
-    for(int i = 0; i < widths.count(); i++)
-        totalWidth += widths[i];
-
-    image = new QImage(totalWidth, height, QImage::Format_Indexed8);
+    int bytesHigh = height / 8;
+    if(height % 8 > 0)
+        bytesHigh++;
 
-    image->setColor(0, qRgba(0,0,0,0));
-    image->setColor(1, color.rgb());
+    int bytes = bytesHigh * width;
 
-    /* Drawing the text */
-    int startX = 0;
-    for(int i = 0; i < text.length(); i++)
+    for(int byte = 0; byte < bytes; byte++)
     {
-        unsigned int offset;
-        if(offsetData)
+        int x = byte % width;
+        int y = byte / width * 8;
+        quint8 data = image8[offset];
+        quint8 mask = 0x1;
+        for(int bit = 0; bit < 8; bit++)
         {
-            if(extendedSet)
-                offset = reinterpret_cast<quint32*>(offsetData)[text[i].unicode() - firstChar];
+            if(mask & data)
+                glyph.setPixel(x, y, 1);
             else
-                offset = offsetData[text[i].unicode() - firstChar];
-        }
-        else
-        {
-            offset = (text[i].unicode() - firstChar) * maxWidth;
-        }
-
-        int bytesHigh = height / 8;
-        if(height % 8 > 0)
-            bytesHigh++;
+                glyph.setPixel(x, y, 0);
 
-        int bytes = bytesHigh * widths[i];
-
-        for(int byte = 0; byte < bytes; byte++)
-        {
-            int x = startX + byte % widths[i];
-            int y = byte / widths[i] * 8;
-            quint8 data = imageData[offset];
-            quint8 mask = 0x1;
-            for(int bit = 0; bit < 8; bit++)
-            {
-                if(mask & data)
-                    image->setPixel(x, y, 1);
-                else
-                    image->setPixel(x, y, 0);
-
-                y++;
-                mask <<= 1;
-                if(y >= height)
-                    break;
-            }
-
-            offset++;
+            y++;
+            mask <<= 1;
+            if(y >= height)
+                break;
         }
 
-        startX += widths[i];
+        offset++;
     }
 
-    RBTextCache::insert(header.value("filename").toString() + text, image);
-    return new RBText(image, viewWidth, parent);
-
+    return glyph;
 }
@@ -26,6 +26,8 @@
 #include <QFile>
 #include <QGraphicsPixmapItem>
 #include <QHash>
+#include <QImage>
+#include <QByteArray>
 
 #include "rbtext.h"
 
@@ -44,11 +46,13 @@ public:
     bool isValid(){ return valid; }
 
 private:
+    QImage renderGlyph(uint code);
+
     QHash<QString, QVariant> header;
     bool valid;
-    quint8* imageData;
-    quint16* offsetData;
-    quint8* widthData;
+    QByteArray imageData;
+    QByteArray offsetData;
+    QByteArray widthData;
 };
 
 #endif // RBFONT_H
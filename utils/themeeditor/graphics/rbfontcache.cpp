@@ -21,25 +21,40 @@
 
 #include "rbfontcache.h"
 
-QHash<QString, RBFontCache::CacheInfo*> RBFontCache::cache;
+#include <QObject>
 
-void RBFontCache::clearCache()
-{
-    QHash<QString, CacheInfo*>::iterator i;
-    for(i = cache.begin(); i != cache.end(); i++)
-    {
-        CacheInfo* c = *i;
-        if(c->imageData)
-            delete c->imageData;
+QCache<QString, RBFontCache::CacheInfo> RBFontCache::cache(maxCost);
+int RBFontCache::hits = 0;
+int RBFontCache::misses = 0;
 
-        if(c->offsetData)
-            delete c->offsetData;
+RBFontCache::CacheInfo* RBFontCache::lookup(QString key)
+{
+    CacheInfo* info = cache.object(key);
+    if(info)
+        hits++;
+    else
+        misses++;
 
-        if(c->widthData)
-            delete c->widthData;
+    return info;
+}
 
-        delete c;
-    }
+void RBFontCache::insert(QString key, CacheInfo* data)
+{
+    int cost = data->imageData.size() + data->offsetData.size()
+               + data->widthData.size();
+    cache.insert(key, data, cost);
+}
 
+void RBFontCache::clearCache()
+{
     cache.clear();
+    hits = 0;
+    misses = 0;
+}
+
+QString RBFontCache::statistics()
+{
+    return QObject::tr("Font cache: %1 hits, %2 misses, %3 fonts in %4/%5 kB")
+            .arg(hits).arg(misses).arg(cache.count())
+            .arg(cache.totalCost() / 1024).arg(cache.maxCost() / 1024);
 }
@@ -22,28 +22,37 @@
 #ifndef RBFONTCACHE_H
 #define RBFONTCACHE_H
 
+#include <QCache>
 #include <QHash>
+#include <QByteArray>
 #include <QVariant>
 
+/* Loaded font files, shared by every open document. The least recently
+ * used fonts are dropped once the cache grows past maxCost bytes. */
 class RBFontCache
 {
 
 public:
     struct CacheInfo
     {
-        quint8* imageData;
-        quint16* offsetData;
-        quint8* widthData;
+        QByteArray imageData;
+        QByteArray offsetData;
+        QByteArray widthData;
 
         QHash<QString, QVariant> header;
     };
 
-    static CacheInfo* lookup(QString key){ return cache.value(key, 0); }
-    static void insert(QString key, CacheInfo* data){ cache.insert(key, data); }
+    static const int maxCost = 16 * 1024 * 1024;
+
+    static CacheInfo* lookup(QString key);
+    static void insert(QString key, CacheInfo* data);
     static void clearCache();
+    static QString statistics();
 
 private:
-    static QHash<QString, CacheInfo*> cache;
+    static QCache<QString, CacheInfo> cache;
+    static int hits;
+    static int misses;
 
 };
 
@@ -21,9 +21,9 @@
 
 #include <QPainter>
 #include <QFile>
-#include <QBitmap>
 
 #include "rbimage.h"
+#include "rbimagecache.h"
 #include "parsetreenode.h"
 #include <rbscene.h>
 
@@ -37,19 +37,16 @@ RBImage::RBImage(QString file, int tiles, int x, int y, ParseTreeNode* node,
 
     if(QFile::exists(file))
     {
-        image = new QPixmap(file);
+        /* Decoded and masked by the image cache, usually off this thread */
+        QImage decoded = RBImageCache::lookup(file);
 
-        if(image->isNull())
+        if(decoded.isNull())
         {
-            delete image;
             image = 0;
             return;
         }
-        else
-        {
-            image->setMask(image->createMaskFromColor(QColor(255,0,255)));
 
-        }
+        image = new QPixmap(QPixmap::fromImage(decoded));
 
         size = QRectF(0, 0, image->width(), image->height() / tiles);
         setPos(x, y);
@@ -0,0 +1,167 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * Copyright (C) 2010 Robert Bieber
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+
+#include "rbimagecache.h"
+
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QObject>
+#include <QRunnable>
+#include <QThreadPool>
+
+QCache<QString, RBImageCache::Entry> RBImageCache::cache(maxCost);
+QMutex RBImageCache::mutex;
+QWaitCondition RBImageCache::decoded;
+int RBImageCache::hits = 0;
+int RBImageCache::misses = 0;
+
+class RBImageCache::Loader : public QRunnable
+{
+public:
+    Loader(QString file, QDateTime modified)
+        : file(file), modified(modified)
+    {
+    }
+
+    void run()
+    {
+        RBImageCache::finish(file, modified, RBImageCache::load(file));
+    }
+
+private:
+    QString file;
+    QDateTime modified;
+};
+
+void RBImageCache::prefetch(const QStringList& files)
+{
+    QMutexLocker lock(&mutex);
+
+    for(int i = 0; i < files.count(); i++)
+    {
+        QFileInfo info(files[i]);
+        if(!info.exists())
+            continue;
+
+        Entry* entry = cache.object(files[i]);
+        if(entry && entry->modified == info.lastModified())
+            continue;
+
+        /* A placeholder, so lookup() knows to wait for the loader */
+        entry = new Entry;
+        entry->modified = info.lastModified();
+        entry->ready = false;
+        cache.insert(files[i], entry, 1);
+
+        QThreadPool::globalInstance()->start(new Loader(files[i],
+                                                        entry->modified));
+    }
+}
+
+QImage RBImageCache::lookup(QString file)
+{
+    QDateTime modified = QFileInfo(file).lastModified();
+
+    QMutexLocker lock(&mutex);
+
+    Entry* entry = cache.object(file);
+    while(entry && !entry->ready && entry->modified == modified)
+    {
+        decoded.wait(&mutex);
+        entry = cache.object(file);
+    }
+
+    if(entry && entry->ready && entry->modified == modified)
+    {
+        hits++;
+        return entry->image;
+    }
+
+    misses++;
+
+    lock.unlock();
+    QImage image = load(file);
+    finish(file, modified, image);
+
+    return image;
+}
+
+void RBImageCache::clearCache()
+{
+    /* The loaders still running would put their images back */
+    QThreadPool::globalInstance()->waitForDone();
+
+    QMutexLocker lock(&mutex);
+
+    cache.clear();
+    hits = 0;
+    misses = 0;
+}
+
+QString RBImageCache::statistics()
+{
+    QMutexLocker lock(&mutex);
+
+    return QObject::tr("Image cache: %1 hits, %2 misses, %3 images in "
+                       "%4/%5 kB")
+            .arg(hits).arg(misses).arg(cache.count())
+            .arg(cache.totalCost() / 1024).arg(cache.maxCost() / 1024);
+}
+
+/* Runs on the loader threads, so it may only touch QImage */
+QImage RBImageCache::load(QString file)
+{
+    QImage image(file);
+    if(image.isNull())
+        return image;
+
+    image = image.convertToFormat(QImage::Format_ARGB32);
+    for(int y = 0; y < image.height(); y++)
+    {
+        QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(y));
+        for(int x = 0; x < image.width(); x++)
+            if(qRed(line[x]) == 255 && qGreen(line[x]) == 0
+               && qBlue(line[x]) == 255)
+                line[x] = 0;
+    }
+
+    return image;
+}
+
+void RBImageCache::finish(QString file, QDateTime modified,
+                          const QImage& image)
+{
+    QMutexLocker lock(&mutex);
+
+    /* The file may have changed again while this one was being decoded */
+    Entry* entry = cache.object(file);
+    if(entry && (entry->modified > modified
+                 || (entry->ready && entry->modified == modified)))
+        return;
+
+    entry = new Entry;
+    entry->modified = modified;
+    entry->image = image;
+    entry->ready = true;
+    cache.insert(file, entry, qMax(1, image.width() * image.height() * 4));
+
+    decoded.wakeAll();
+}
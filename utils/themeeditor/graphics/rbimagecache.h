@@ -0,0 +1,70 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * Copyright (C) 2010 Robert Bieber
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+
+#ifndef RBIMAGECACHE_H
+#define RBIMAGECACHE_H
+
+#include <QCache>
+#include <QDateTime>
+#include <QImage>
+#include <QMutex>
+#include <QStringList>
+#include <QWaitCondition>
+
+/* Skin images, decoded on the global thread pool and shared by every open
+ * document. The magenta pixels are made transparent while decoding, so the
+ * GUI thread only has to turn the result into a QPixmap. An image is loaded
+ * again once its file changes, and the least recently used ones are dropped
+ * once the cache grows past maxCost bytes. */
+class RBImageCache
+{
+public:
+    static const int maxCost = 32 * 1024 * 1024;
+
+    /* Starts decoding each file that isn't cached yet */
+    static void prefetch(const QStringList& files);
+    /* Returns the decoded image, waiting for it if it's still being decoded
+     * and decoding it here if it wasn't prefetched */
+    static QImage lookup(QString file);
+    static void clearCache();
+    static QString statistics();
+
+private:
+    struct Entry
+    {
+        QDateTime modified;
+        QImage image;
+        bool ready;
+    };
+
+    class Loader;
+
+    static QImage load(QString file);
+    static void finish(QString file, QDateTime modified, const QImage& image);
+
+    static QCache<QString, Entry> cache;
+    static QMutex mutex;
+    static QWaitCondition decoded;
+    static int hits;
+    static int misses;
+};
+
+#endif // RBIMAGECACHE_H
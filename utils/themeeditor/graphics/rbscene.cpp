@@ -56,3 +56,8 @@ void RBScene::addWarning(QString warning)
     console->addWarning(warning);
     console->show();
 }
+
+void RBScene::addInfo(QString info)
+{
+    console->addInfo(info);
+}
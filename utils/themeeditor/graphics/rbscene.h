@@ -52,6 +52,8 @@ public:
     }
 
     void addWarning(QString warning);
+    /* Logged to the console without showing it */
+    void addInfo(QString info);
 
 public slots:
     void clear();
@@ -28,17 +28,17 @@
 class RBText : public QGraphicsItem
 {
 public:
-    RBText(QImage* image, int maxWidth, QGraphicsItem* parent);
+    RBText(const QImage& image, int maxWidth, QGraphicsItem* parent);
 
     QRectF boundingRect() const;
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option,
                QWidget *widget);
 
-    int realWidth(){ return image->width(); }
+    int realWidth(){ return image.width(); }
     void setOffset(int offset){ this->offset = offset; }
 
 private:
-    QImage* image;
+    QImage image;
     int maxWidth;
     int offset;
 
@@ -21,15 +21,43 @@
 
 #include "rbtextcache.h"
 
-QHash<QString, QImage*> RBTextCache::cache;
+#include <QObject>
 
-void RBTextCache::clearCache()
+QCache<RBTextCache::GlyphKey, QImage> RBTextCache::cache(maxCost);
+int RBTextCache::hits = 0;
+int RBTextCache::misses = 0;
+
+bool RBTextCache::lookup(QString font, uint code, QImage* glyph)
 {
-    QHash<QString, QImage*>::iterator i;
-    for(i = cache.begin(); i != cache.end(); i++)
+    QImage* cached = cache.object(GlyphKey(font, code));
+    if(!cached)
     {
-        delete (*i);
+        misses++;
+        return false;
     }
 
+    hits++;
+    *glyph = *cached;
+    return true;
+}
+
+void RBTextCache::insert(QString font, uint code, const QImage& glyph)
+{
+    /* Counting a few bytes for empty glyphs, so they can't pile up */
+    int cost = qMax(static_cast<int>(glyph.sizeInBytes()), 16);
+    cache.insert(GlyphKey(font, code), new QImage(glyph), cost);
+}
+
+void RBTextCache::clearCache()
+{
     cache.clear();
+    hits = 0;
+    misses = 0;
+}
+
+QString RBTextCache::statistics()
+{
+    return QObject::tr("Glyph cache: %1 hits, %2 misses, %3 glyphs in %4/%5 kB")
+            .arg(hits).arg(misses).arg(cache.count())
+            .arg(cache.totalCost() / 1024).arg(cache.maxCost() / 1024);
 }
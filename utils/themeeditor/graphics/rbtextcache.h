@@ -22,18 +22,30 @@
 #ifndef RBTEXTCACHE_H
 #define RBTEXTCACHE_H
 
-#include <QHash>
+#include <QCache>
+#include <QPair>
 #include <QImage>
 
+/* Rendered glyphs, keyed by font file and character code and shared by
+ * every open document. Text is put together from these, so any string in
+ * a cached font only costs a copy. The least recently used glyphs are
+ * dropped once the cache grows past maxCost bytes. */
 class RBTextCache
 {
 public:
-    static QImage* lookup(QString key){ return cache.value(key, 0); }
-    static void insert(QString key, QImage* im){ cache.insert(key, im); }
+    static const int maxCost = 4 * 1024 * 1024;
+
+    static bool lookup(QString font, uint code, QImage* glyph);
+    static void insert(QString font, uint code, const QImage& glyph);
     static void clearCache();
+    static QString statistics();
 
 private:
-    static QHash<QString, QImage*> cache;
+    typedef QPair<QString, uint> GlyphKey;
+
+    static QCache<GlyphKey, QImage> cache;
+    static int hits;
+    static int misses;
 };
 
 #endif // RBTEXTCACHE_H
@@ -23,6 +23,7 @@
 #include "projectmodel.h"
 #include "ui_editorwindow.h"
 #include "rbfontcache.h"
+#include "rbimagecache.h"
 #include "rbtextcache.h"
 #include "newprojectdialog.h"
 #include "projectexporter.h"
@@ -62,6 +63,7 @@ EditorWindow::~EditorWindow()
     delete timerDock;
 
     RBFontCache::clearCache();
+    RBImageCache::clearCache();
     RBTextCache::clearCache();
 }
 
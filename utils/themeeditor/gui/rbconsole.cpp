@@ -39,3 +39,9 @@ void RBConsole::addWarning(QString warning)
     ui->output->appendHtml("<span style = \"color:orange\">" + warning
                            + "</span>");
 }
+
+void RBConsole::addInfo(QString info)
+{
+    ui->output->appendHtml("<span style = \"color:gray\">" + info
+                           + "</span>");
+}
@@ -35,6 +35,7 @@ public:
     ~RBConsole();
 
     void addWarning(QString warning);
+    void addInfo(QString info);
 
 private:
     Ui::RBConsole *ui;
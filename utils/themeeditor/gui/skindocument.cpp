@@ -185,10 +185,11 @@ void SkinDocument::setupUI()
 
     settingsChanged();
 
-    /* Setting up a timer to check for updates */
-    checkUpdate.setInterval(500);
+    /* Setting up a timer to render changes made while typing */
+    checkUpdate.setInterval(updateInterval);
+    checkUpdate.setSingleShot(true);
     QObject::connect(&checkUpdate, SIGNAL(timeout()),
-                     this, SLOT(codeChanged()));
+                     this, SLOT(renderPreview()));
 }
 
 void SkinDocument::settingsChanged()
@@ -307,20 +308,26 @@ void SkinDocument::codeChanged()
     else
         emit titleChanged(titleText);
 
-    if(lastUpdate.msecsTo(QTime::currentTime()) >= updateInterval)
-    {
-        model->render(project, device, this, &fileName);
-        checkUpdate.stop();
-        lastUpdate = QTime::currentTime();
-    }
-    else
+    /* The preview only needs rebuilding if a viewport changed, and while
+       typing that happens at most once every updateInterval */
+    if(model->treeChanged())
     {
-        checkUpdate.start();
+        if(lastUpdate.msecsTo(QTime::currentTime()) >= updateInterval)
+            renderPreview();
+        else if(!checkUpdate.isActive())
+            checkUpdate.start();
     }
     cursorChanged();
 
 }
 
+void SkinDocument::renderPreview()
+{
+    checkUpdate.stop();
+    model->renderChanges(project, device, this, &fileName);
+    lastUpdate = QTime::currentTime();
+}
+
 void SkinDocument::modelChanged()
 {
     treeInSync = false;
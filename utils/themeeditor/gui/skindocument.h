@@ -97,6 +97,7 @@ public slots:
 
 private slots:
     void codeChanged();
+    void renderPreview();
     void modelChanged();
     void deviceChanged(){ scene(); }
 
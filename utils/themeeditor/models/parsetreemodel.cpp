@@ -24,8 +24,13 @@
 #include "symbols.h"
 #include "rbscreen.h"
 #include "rbrenderinfo.h"
+#include "rbfontcache.h"
+#include "rbimagecache.h"
+#include "rbtextcache.h"
+#include "skin_scan.h"
 
 #include <cstdlib>
+#include <cstring>
 
 #include <QObject>
 #include <QPixmap>
@@ -35,14 +40,17 @@
 #include <iostream>
 
 ParseTreeModel::ParseTreeModel(const char* document, QObject* parent):
-        QAbstractItemModel(parent), sbsModel(0)
+        QAbstractItemModel(parent), root(0), sbsModel(0), changed(false),
+        renderedScreen(0), renderedProject(0), renderedDevice(0),
+        renderedDoc(0), renderedViewports(0), sceneStale(true)
 {
-    this->tree = skin_parse(document);
+    changeTree(document);
 
-    if(tree)
-        this->root = new ParseTreeNode(tree, this);
-    else
-        this->root = 0;
+    if(chunks.isEmpty())
+    {
+        delete root;
+        root = 0;
+    }
 
     scene = new RBScene();
 }
@@ -52,8 +60,8 @@ ParseTreeModel::~ParseTreeModel()
 {
     if(root)
         delete root;
-    if(tree)
-        skin_free_tree(tree);
+    for(int i = 0; i < chunks.count(); i++)
+        skin_free_tree(chunks[i].tree);
     if(sbsModel)
         sbsModel->deleteLater();
 }
@@ -68,35 +76,197 @@ QString ParseTreeModel::genCode()
 
 QString ParseTreeModel::changeTree(const char *document)
 {
-    struct skin_element* test = skin_parse(document);
-
-    if(!test)
+    QList<QByteArray> texts = splitViewports(document);
+
+    changed = false;
+    skin_clear_errors();
+
+    /* Viewports that haven't changed at either end of the document are kept,
+       along with their part of the model */
+    int prefix = 0;
+    while(prefix < texts.count() && prefix < chunks.count()
+          && texts[prefix] == chunks[prefix].text)
+        prefix++;
+
+    int suffix = 0;
+    while(suffix < texts.count() - prefix && suffix < chunks.count() - prefix
+          && texts[texts.count() - suffix - 1]
+          == chunks[chunks.count() - suffix - 1].text)
+        suffix++;
+
+    if(root && prefix + suffix == texts.count()
+       && prefix + suffix == chunks.count())
+        return tr("Document Parses Successfully");
+
+    /* Parsing the rest */
+    int line = 1;
+    if(prefix > 0)
+        line = chunks[prefix - 1].line + chunks[prefix - 1].lines;
+
+    QList<Chunk> parsed;
+    for(int i = prefix; i < texts.count() - suffix; i++)
     {
-        QString error = tr("Error on line ") +
-                        QString::number(skin_error_line())
-                        + tr(", column ") + QString::number(skin_error_col())
-                        + tr(": ") + QString(skin_error_message());
-        return error;
+        Chunk chunk;
+        chunk.text = texts[i];
+        chunk.tree = skin_parse(chunk.text.constData());
+        chunk.line = line;
+        chunk.lines = chunk.text.count('\n');
+        chunk.viewports = 0;
+
+        if(!chunk.tree)
+        {
+            for(int j = 0; j < parsed.count(); j++)
+                skin_free_tree(parsed[j].tree);
+            parsed.clear();
+
+            /* The whole document is parsed again, so the error is reported
+               with its position in the document */
+            chunk.tree = skin_parse(document);
+            if(!chunk.tree)
+            {
+                QString error = tr("Error on line ") +
+                                QString::number(skin_error_line())
+                                + tr(", column ") +
+                                QString::number(skin_error_col())
+                                + tr(": ") + QString(skin_error_message());
+                return error;
+            }
+
+            /* Splitting the document up didn't agree with the parser, so
+               it's replaced as a whole */
+            chunk.text = document;
+            chunk.line = 1;
+            chunk.lines = chunk.text.count('\n');
+            prefix = 0;
+            suffix = 0;
+            parsed.append(chunk);
+            break;
+        }
+
+        offsetLines(chunk.tree, line - 1);
+        parsed.append(chunk);
+        line += chunk.lines;
     }
 
-    ParseTreeNode* temp = new ParseTreeNode(test, this);
+    if(!root)
+        root = new ParseTreeNode(0, this);
 
-    if(root)
+    /* Replacing the changed viewports */
+    int row = 0;
+    for(int i = 0; i < prefix; i++)
+        row += chunks[i].viewports;
+
+    int count = 0;
+    for(int i = prefix; i < chunks.count() - suffix; i++)
+        count += chunks[i].viewports;
+
+    /* The items of the removed viewports are taken out of the scene on the
+       next render */
+    for(int i = row; i < row + count; i++)
     {
-        emit beginRemoveRows(QModelIndex(), 0, root->numChildren() - 1);
-        delete root;
-        emit endRemoveRows();
+        ParseTreeNode* viewport = root->child(i);
+        if(!viewport->getRendered())
+            continue;
+
+        staleViewports.append(viewport->getRendered());
+        if(!viewport->isLocalViewport())
+            sceneStale = true;
+    }
+
+    if(count > 0)
+    {
+        beginRemoveRows(QModelIndex(), row, row + count - 1);
+        root->removeChildren(row, count);
+        endRemoveRows();
     }
 
-    root = temp;
+    while(chunks.count() > prefix + suffix)
+        skin_free_tree(chunks.takeAt(prefix).tree);
+
+    count = 0;
+    for(int i = 0; i < parsed.count(); i++)
+        for(struct skin_element* vp = parsed[i].tree; vp; vp = vp->next)
+            count++;
 
-    emit beginInsertRows(QModelIndex(), 0, temp->numChildren() - 1);
-    emit endInsertRows();
+    if(count > 0)
+        beginInsertRows(QModelIndex(), row, row + count - 1);
+    for(int i = 0; i < parsed.count(); i++)
+    {
+        parsed[i].viewports = root->insertChildren(row, parsed[i].tree);
+        row += parsed[i].viewports;
+        chunks.insert(prefix + i, parsed[i]);
+    }
+    if(count > 0)
+        endInsertRows();
 
+    /* Moving whatever follows to its new position */
+    for(int i = prefix + parsed.count(); i < chunks.count(); i++)
+    {
+        if(chunks[i].line != line)
+        {
+            offsetLines(chunks[i].tree, line - chunks[i].line);
+            chunks[i].line = line;
+        }
+        line += chunks[i].lines;
+    }
+
+    changed = true;
     return tr("Document Parses Successfully");
 
 }
 
+/* Splits a document before every line that starts a viewport. A viewport
+ * declaration directly followed by another one stays with the next viewport,
+ * as the parser gives it no lines in that case. */
+QList<QByteArray> ParseTreeModel::splitViewports(const char* document)
+{
+    QList<QByteArray> texts;
+    const char* start = document;
+    const char* cursor = document;
+    const char* firstLine = 0;
+
+    while(*cursor != '\0')
+    {
+        const char* next = strchr(cursor, '\n');
+        next = next ? next + 1 : cursor + strlen(cursor);
+
+        /* check_viewport() looks at the length of the rest of the document,
+           so it's only called when the line could start a viewport */
+        bool viewport = cursor[0] == TAGSYM && cursor[1] == 'V'
+                        && check_viewport(cursor);
+
+        if(viewport && cursor != start && cursor != firstLine)
+        {
+            texts.append(QByteArray(start, cursor - start));
+            start = cursor;
+        }
+        if(cursor == start || cursor == firstLine)
+            firstLine = viewport ? next : 0;
+
+        cursor = next;
+    }
+
+    if(cursor != start)
+        texts.append(QByteArray(start, cursor - start));
+
+    return texts;
+}
+
+void ParseTreeModel::offsetLines(struct skin_element* element, int offset)
+{
+    for(; element; element = element->next)
+    {
+        element->line += offset;
+
+        for(int i = 0; i < element->params_count; i++)
+            if(element->params[i].type == skin_tag_parameter::CODE)
+                offsetLines(element->params[i].data.code, offset);
+
+        for(int i = 0; i < element->children_count; i++)
+            offsetLines(element->children[i], offset);
+    }
+}
+
 QModelIndex ParseTreeModel::index(int row, int column,
                                   const QModelIndex& parent) const
 {
@@ -277,37 +447,27 @@ RBScene* ParseTreeModel::render(ProjectModel* project,
                                        SkinDocument* doc, const QString* file)
 {
     scene->clear();
+    staleViewports.clear();
+    sceneStale = false;
 
     /* Setting the background */
     scene->setBackgroundBrush(QBrush(QPixmap(":/render/scenebg.png")));
 
-    /* Preparing settings */
-    QMap<QString, QString> settings;
-    if(project)
-        settings = project->getSettings();
+    QMap<QString, QString> settings = renderSettings(project, file);
 
-    /* Setting themebase if it can't be derived from the project */
-    if(settings.value("themebase", "") == "" && file && QFile::exists(*file))
-    {
-        QFileInfo wpsfile(*file);
-        QDir base(wpsfile.canonicalPath());
-        base.cdUp();
-        settings.insert("themebase", base.canonicalPath());
-    }
+    /* The images are decoded by the image cache's threads while the scene is
+       being put together */
+    QStringList images;
+    if(root)
+        root->findImages(settings, images);
+    RBImageCache::prefetch(images);
 
-    /* Finding imagebase and determining remote/wps status */
+    /* Determining remote/wps status */
     bool remote = false;
     bool wps = false;
     if(file)
     {
-        QString skinFile = *file;
-        QStringList decomp = skinFile.split("/");
-        skinFile = decomp[decomp.count() - 1];
-        skinFile.chop(skinFile.length() - skinFile.lastIndexOf("."));
-        settings.insert("imagepath", settings.value("themebase","") + "/wps/" +
-                        skinFile);
-
-        decomp = file->split(".");
+        QStringList decomp = file->split(".");
         QString extension = decomp.last();
         if(extension[0] == 'r')
             remote = true;
@@ -334,6 +494,10 @@ RBScene* ParseTreeModel::render(ProjectModel* project,
 
             if(sbsModel->root != 0)
             {
+                images.clear();
+                sbsModel->root->findImages(settings, images);
+                RBImageCache::prefetch(images);
+
                 RBRenderInfo sbsInfo(sbsModel, project, doc, &settings, device,
                                      screen);
 
@@ -368,9 +532,115 @@ RBScene* ParseTreeModel::render(ProjectModel* project,
     if(root)
         root->render(info);
 
+    scene->addInfo(RBFontCache::statistics());
+    scene->addInfo(RBImageCache::statistics());
+    scene->addInfo(RBTextCache::statistics());
+
+    renderedScreen = screen;
+    renderedSettings = settings;
+    renderedProject = project;
+    renderedDevice = device;
+    renderedDoc = doc;
+    renderedFile = file ? *file : QString();
+    renderedViewports = root ? root->numChildren() : 0;
+
     return scene;
 }
 
+RBScene* ParseTreeModel::renderChanges(ProjectModel* project,
+                                       DeviceState* device,
+                                       SkinDocument* doc, const QString* file)
+{
+    QMap<QString, QString> settings = renderSettings(project, file);
+
+    if(!root || !renderedScreen || sceneStale || project != renderedProject
+       || device != renderedDevice || doc != renderedDoc
+       || (file ? *file : QString()) != renderedFile
+       || settings != renderedSettings)
+        return render(project, device, doc, file);
+
+    /* The default viewport is only shown on its own when it's the only one */
+    if((root->numChildren() > 1) != (renderedViewports > 1))
+        return render(project, device, doc, file);
+
+    /* Viewports that haven't been rendered are the ones changeTree() put
+       in since the last render */
+    QList<int> changedViewports;
+    for(int i = 0; i < root->numChildren(); i++)
+    {
+        if(root->child(i)->getRendered())
+            continue;
+        if(!root->child(i)->isLocalViewport())
+            return render(project, device, doc, file);
+        changedViewports.append(i);
+    }
+
+    for(int i = 0; i < staleViewports.count(); i++)
+        delete staleViewports[i];
+    staleViewports.clear();
+
+    RBRenderInfo info(this, project, doc, &settings, device, renderedScreen);
+
+    static const enum skin_token_type mirror = SKIN_TOKEN_ALIGN_LANGDIRECTION;
+    for(int i = 0; i < changedViewports.count(); i++)
+    {
+        int row = changedViewports[i];
+
+        /* %ax applies to the viewport declared after it */
+        if(row > 0 && root->child(row - 1)->hasTag(&mirror, 1))
+            renderedScreen->RtlMirror();
+
+        root->child(row)->render(info);
+
+        /* Keeping the viewports stacked in document order */
+        for(int next = row + 1; next < root->numChildren(); next++)
+        {
+            if(root->child(next)->getRendered())
+            {
+                root->child(row)->getRendered()->stackBefore(
+                        root->child(next)->getRendered());
+                break;
+            }
+        }
+    }
+
+    renderedViewports = root->numChildren();
+
+    return scene;
+}
+
+/* The project's settings, with the theme and image directories filled in
+ * from the skin's location */
+QMap<QString, QString> ParseTreeModel::renderSettings(ProjectModel* project,
+                                                      const QString* file)
+{
+    QMap<QString, QString> settings;
+    if(project)
+        settings = project->getSettings();
+
+    /* Setting themebase if it can't be derived from the project */
+    if(settings.value("themebase", "") == "" && file && QFile::exists(*file))
+    {
+        QFileInfo wpsfile(*file);
+        QDir base(wpsfile.canonicalPath());
+        base.cdUp();
+        settings.insert("themebase", base.canonicalPath());
+    }
+
+    /* Finding imagebase */
+    if(file)
+    {
+        QString skinFile = *file;
+        QStringList decomp = skinFile.split("/");
+        skinFile = decomp[decomp.count() - 1];
+        skinFile.chop(skinFile.length() - skinFile.lastIndexOf("."));
+        settings.insert("imagepath", settings.value("themebase","") + "/wps/" +
+                        skinFile);
+    }
+
+    return settings;
+}
+
 void ParseTreeModel::paramChanged(ParseTreeNode *param)
 {
     QModelIndex left = indexFromPointer(param);
@@ -29,6 +29,7 @@
 
 #include <QAbstractItemModel>
 #include <QList>
+#include <QMap>
 
 #include "parsetreenode.h"
 #include "devicestate.h"
@@ -51,8 +52,11 @@ public:
     virtual ~ParseTreeModel();
 
     QString genCode();
-    /* Changes the parse tree to a new document */
+    /* Changes the parse tree to a new document, only the viewports whose
+     * text changed are parsed again */
     QString changeTree(const char* document);
+    /* Whether the last call to changeTree() modified the tree */
+    bool treeChanged() const{ return changed; }
 
     /* Model implementation stuff */
     QModelIndex index(int row, int column, const QModelIndex& parent) const;
@@ -66,6 +70,10 @@ public:
 
     RBScene* render(ProjectModel* project, DeviceState* device,
                     SkinDocument* doc, const QString* file = 0);
+    /* Like render(), but if every viewport changed since then can be drawn
+     * without the others, only those are drawn again */
+    RBScene* renderChanges(ProjectModel* project, DeviceState* device,
+                           SkinDocument* doc, const QString* file = 0);
 
     static QString safeSetting(ProjectModel* project, QString key,
                                QString fallback)
@@ -80,12 +88,42 @@ public:
     QModelIndex indexFromPointer(ParseTreeNode* p);
 
 private:
+    /* A run of lines starting with a viewport declaration, parsed on its
+     * own */
+    struct Chunk
+    {
+        QByteArray text;
+        struct skin_element* tree;
+        int line;
+        int lines;
+        int viewports;
+    };
+
+    static QList<QByteArray> splitViewports(const char* document);
+    static void offsetLines(struct skin_element* element, int offset);
+    static QMap<QString, QString> renderSettings(ProjectModel* project,
+                                                 const QString* file);
     void setChildrenUnselectable(QGraphicsItem* root);
 
     ParseTreeNode* root;
     ParseTreeModel* sbsModel;
-    struct skin_element* tree;
+    QList<Chunk> chunks;
+    bool changed;
     RBScene* scene;
+
+    /* What the scene was last rendered with */
+    RBScreen* renderedScreen;
+    QMap<QString, QString> renderedSettings;
+    ProjectModel* renderedProject;
+    DeviceState* renderedDevice;
+    SkinDocument* renderedDoc;
+    QString renderedFile;
+    int renderedViewports;
+
+    /* Items of the viewports removed from the tree since then, and whether
+     * any of those has to be rendered along with the others */
+    QList<QGraphicsItem*> staleViewports;
+    bool sceneStale;
 };
 
 
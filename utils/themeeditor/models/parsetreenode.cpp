@@ -26,6 +26,7 @@
 #include "parsetreemodel.h"
 
 #include "rbimage.h"
+#include "rbimagecache.h"
 #include "rbprogressbar.h"
 #include "rbtoucharea.h"
 
@@ -40,7 +41,8 @@ bool ParseTreeNode::breakFlag = false;
 
 /* Root element constructor */
 ParseTreeNode::ParseTreeNode(struct skin_element* data, ParseTreeModel* model)
-    : parent(0), element(0), param(0), children(), model(model)
+    : parent(0), element(0), param(0), children(), rendered(0),
+      model(model)
 {
     while(data)
     {
@@ -53,7 +55,7 @@ ParseTreeNode::ParseTreeNode(struct skin_element* data, ParseTreeModel* model)
 ParseTreeNode::ParseTreeNode(struct skin_element* data, ParseTreeNode* parent,
                              ParseTreeModel* model)
                                  : parent(parent), element(data), param(0),
-                                 children(), model(model)
+                                 children(), rendered(0), model(model)
 {
     switch(element->type)
     {
@@ -109,7 +111,7 @@ case VIEWPORT:
 ParseTreeNode::ParseTreeNode(skin_tag_parameter *data, ParseTreeNode *parent,
                              ParseTreeModel *model)
                                  : parent(parent), element(0), param(data),
-                                 children(), model(model)
+                                 children(), rendered(0), model(model)
 {
 
 }
@@ -509,6 +511,22 @@ ParseTreeNode* ParseTreeNode::getParent() const
     return parent;
 }
 
+void ParseTreeNode::removeChildren(int row, int count)
+{
+    for(int i = 0; i < count; i++)
+        delete children.takeAt(row);
+}
+
+/* Inserts a node for each element in the list at data, returns the number of
+ * nodes inserted */
+int ParseTreeNode::insertChildren(int row, struct skin_element* data)
+{
+    int count = 0;
+    for(; data; data = data->next)
+        children.insert(row + count++, new ParseTreeNode(data, this, model));
+    return count;
+}
+
 /* This version is called for the root node and for viewports */
 void ParseTreeNode::render(const RBRenderInfo& info)
 {
@@ -541,6 +559,76 @@ void ParseTreeNode::render(const RBRenderInfo& info)
 
 }
 
+/* Images, fonts, album art and named viewports are kept in the RBScreen by
+ * whichever viewport declares them, and a few tags change how the viewports
+ * after them are drawn, so a viewport using any of these can only be
+ * rendered along with all the others */
+bool ParseTreeNode::isLocalViewport() const
+{
+    static const enum skin_token_type screenTags[] =
+    {
+        SKIN_TOKEN_ALIGN_LANGDIRECTION, SKIN_TOKEN_DISABLE_THEME,
+        SKIN_TOKEN_IMAGE_PRELOAD, SKIN_TOKEN_IMAGE_DISPLAY,
+        SKIN_TOKEN_LOAD_FONT, SKIN_TOKEN_ALBUMART_LOAD,
+        SKIN_TOKEN_ALBUMART_DISPLAY, SKIN_TOKEN_VIEWPORT_ENABLE,
+        SKIN_TOKEN_UIVIEWPORT_ENABLE, SKIN_TOKEN_IMAGE_BACKDROP,
+    };
+
+    /* The default viewport and the named ones are looked up by others */
+    if(!element || element->type != VIEWPORT || !element->tag
+       || element->tag->type != SKIN_TOKEN_VIEWPORT_LOAD)
+        return false;
+
+    return !hasTag(screenTags, sizeof(screenTags) / sizeof(screenTags[0]));
+}
+
+bool ParseTreeNode::hasTag(const enum skin_token_type* types, int count) const
+{
+    if(element && element->type == TAG)
+        for(int i = 0; i < count; i++)
+            if(element->tag->type == types[i])
+                return true;
+
+    for(int i = 0; i < children.count(); i++)
+        if(children[i]->hasTag(types, count))
+            return true;
+
+    return false;
+}
+
+void ParseTreeNode::findImages(const QMap<QString, QString>& settings,
+                               QStringList& files) const
+{
+    QString filename;
+
+    if(element && element->type == TAG)
+    {
+        switch(element->tag->type)
+        {
+        case SKIN_TOKEN_IMAGE_PRELOAD:
+            if(element->params[1].data.text == QString("__list_icons__"))
+            {
+                filename = settings.value("iconset", "");
+                filename.replace(".rockbox", settings.value("themebase"));
+                files.append(filename);
+                break;
+            }
+            /* Deliberate fall-through here */
+
+        case SKIN_TOKEN_IMAGE_DISPLAY:
+            files.append(settings.value("imagepath", "") + "/" +
+                         element->params[1].data.text);
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    for(int i = 0; i < children.count(); i++)
+        children[i]->findImages(settings, files);
+}
+
 /* This version is called for logical lines, tags, conditionals and such */
 void ParseTreeNode::render(const RBRenderInfo &info, RBViewport* viewport,
                            bool noBreak)
@@ -640,7 +728,7 @@ bool ParseTreeNode::execTag(const RBRenderInfo& info, RBViewport* viewport)
     int x, y, tiles, tile, maxWidth, maxHeight, width, height;
     char c, hAlign, vAlign;
     RBImage* image;
-    QPixmap temp;
+    QImage temp;
     RBFont* fLoad;
 
     /* Two switch statements to narrow down the tag name */
@@ -830,7 +918,7 @@ bool ParseTreeNode::execTag(const RBRenderInfo& info, RBViewport* viewport)
                 filename = info.settings()->value("iconset", "");
                 filename.replace(".rockbox",
                                  info.settings()->value("themebase"));
-                temp.load(filename);
+                temp = RBImageCache::lookup(filename);
                 if(!temp.isNull())
                 {
                     tiles = temp.height() / temp.width();
@@ -23,6 +23,7 @@
 #define PARSETREENODE_H
 
 #include "skin_parser.h"
+#include "tag_table.h"
 #include "rbviewport.h"
 #include "rbscreen.h"
 #include "rbrenderinfo.h"
@@ -30,6 +31,8 @@
 #include <QString>
 #include <QVariant>
 #include <QList>
+#include <QMap>
+#include <QStringList>
 
 class ParseTreeNode
 {
@@ -61,9 +64,22 @@ public:
             return 0;
     }
 
+    /* Used on the root node to swap out viewports after a reparse */
+    void removeChildren(int row, int count);
+    int insertChildren(int row, struct skin_element* data);
+
     void render(const RBRenderInfo& info);
     void render(const RBRenderInfo &info, RBViewport* viewport,
                 bool noBreak = false);
+    /* The item last rendered for a viewport, or 0 if it hasn't been yet */
+    QGraphicsItem* getRendered() const{ return rendered; }
+
+    /* Whether a viewport can be rendered again without the ones around it */
+    bool isLocalViewport() const;
+    bool hasTag(const enum skin_token_type* types, int count) const;
+    /* Appends the files of the images loaded in the subtree */
+    void findImages(const QMap<QString, QString>& settings,
+                    QStringList& files) const;
 
     double findBranchTime(ParseTreeNode* branch, const RBRenderInfo& info);
     double findConditionalTime(ParseTreeNode* conditional,